@@ -18,17 +18,237 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ECOM_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ECOM_POSIX 1
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#define ECOM_SERVER 1
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 /* =============================================================================
  * CONFIGURATION CONSTANTS
  * ============================================================================= */
 
-#define MAX_ORDERS          100
-#define MAX_NAME_LENGTH     50
-#define MAX_PRODUCT_LENGTH  50
+#define ORDER_SLAB_SHIFT    12
+#define ORDER_SLAB_SIZE     (1 << ORDER_SLAB_SHIFT)
+#define ORDER_SLAB_MASK     (ORDER_SLAB_SIZE - 1)
+#define ORDER_SLAB_WORDS    (ORDER_SLAB_SIZE / 64)
+#define COMPACT_MIN_DEAD    64      /* Tombstones tolerated before compacting */
+#define COMPACT_DEAD_RATIO  4       /* Compact once 1/N of slots are dead     */
+#define TRIGRAM_LENGTH      3
+#define MAX_STATUS_IDS      65535
+#define STRING_CHUNK_SHIFT  20
+#define STRING_CHUNK_SIZE   (1u << STRING_CHUNK_SHIFT)
+#define STRING_MAX_CHUNKS   4096
+#define STRING_REF_NONE     UINT32_MAX
+#define STRING_TABLE_MIN_CAPACITY 1024
+#define INT_MAP_MIN_CAPACITY 64
+#define VALUE_NODE_KEYS     30      /* Keys per value index node (~500 bytes) */
+#define VALUE_BULK_KEYS     24      /* Keys per node when the index is rebuilt */
+#define VALUE_MAX_HEIGHT    16
+#define VALUE_DEFAULT_TOP   10      /* Orders listed by a top-N search        */
+#define VALUE_MAX_TOP       1000
+#define MAX_NAME_LENGTH     1024    /* Customer or product name, with NUL */
 #define MAX_STATUS_LENGTH   20
+#define MONEY_TEXT_LENGTH   48
+#define MAX_QUANTITY        1000000
+#define MAX_PRICE_CENTS     100000000000LL  /* $1,000,000,000.00          */
 #define DATA_FILE           "orders.txt"
+#define SNAPSHOT_FILE       "orders.snap"
+#define SNAPSHOT_MAGIC      "ECOMSNAP"
+#define SNAPSHOT_VERSION    4
+#define SNAPSHOT_ALIGNMENT  64
+#define SNAPSHOT_SEED       0xCBF29CE484222325ULL
+#define COLUMNAR_FILE       "orders.col"
+#define DAMAGED_SUFFIX      ".bad"      /* Kept copy of a damaged data file */
+#define COLUMNAR_MAGIC      "ECOMCOLS"
+#define COLUMNAR_VERSION    1
+#define COLUMNAR_BLOCK_ROWS 16384   /* Orders per independently decoded block */
+#define COLUMNAR_MAX_WIDTH  56      /* Widest packed value one 64-bit load reads */
+#define COLUMNAR_PACK_SLACK 8       /* Zero bytes after a packed column       */
+#define COLUMNAR_COLUMN_COUNT 5     /* Packed columns after the order IDs     */
+#define LOAD_FIELD_COUNT    6
+#ifndef WORKER_MAX_THREADS
+#define WORKER_MAX_THREADS  32      /* Override with -DWORKER_MAX_THREADS=n */
+#endif
+#define WORKER_THREADS_ENV  "ECOM_THREADS"
+#define WORKER_MIN_CHUNK_BYTES (1 << 20)  /* Smallest slice worth a thread  */
+#define LOAD_MAX_REPORTED_ERRORS 20
+#define RECORD_TEXT_LENGTH  (2 * MAX_NAME_LENGTH + 128)  /* One data record  */
+#define SAVE_CHUNK_SLABS    16      /* Slabs formatted per task when saving */
+#define SAVE_BYTES_PER_ORDER 48     /* Typical length of a formatted record */
+#define SCAN_BYTES_PER_ORDER 14     /* Price, quantity and status columns   */
+#define IMPORT_BLOCK_BYTES  (4 << 20)   /* Input handed from stage to stage */
+#define IMPORT_PIPELINE_DEPTH 4         /* Blocks in flight at once         */
+#define IMPORT_FILTER_BITS  10          /* Prefilter bits per expected ID   */
+#define IMPORT_FILTER_HASHES 3
+#define LIST_PAGE_SIZE      20      /* Table rows per page in the menu       */
+#define LIST_DETAIL_PAGE_SIZE 5     /* Order boxes per page in the menu      */
+#define LIST_WRITE_ROWS     4096    /* Rows per write when listing a file    */
+#define LIST_ROW_LENGTH     256     /* One order formatted as a table row    */
+#define LIST_ID_WIDTH       10
+#define LIST_NAME_WIDTH     24
+#define LIST_QUANTITY_WIDTH 8
+#define LIST_PRICE_WIDTH    14
+#define LIST_TOTAL_WIDTH    16
+#define GROUP_DEFAULT_TOP   10      /* Customers or products ranked          */
+#define GROUP_MAX_TOP       1000
+#define GROUP_MIN_BUCKETS   1024
+#define GROUP_BYTES_PER_ORDER 16    /* Name reference and columns per order  */
+#define GROUP_ROW_LENGTH    128     /* One group formatted as a table row    */
+#define GROUP_RANK_WIDTH    6
+#define GROUP_ORDERS_WIDTH  10
+#define GROUP_SHARE_WIDTH   8
+#define GENERATE_DEFAULT_ORDERS 100000
+#define GENERATE_MAX_ORDERS 10000000
+#define GENERATE_DEFAULT_SEED 42
+#define GENERATE_FIRST_ORDER_ID 1001
+#define GENERATE_BLOCK_BYTES (1 << 20)  /* Output buffered per write         */
+#define SERVER_SOCKET_FILE  "orders.sock"
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_BACKLOG      128
+#define SERVER_MAX_EVENTS   64      /* Readiness events taken per wait       */
+#define SERVER_SAVE_INTERVAL_MS 1000    /* Longest a change waits to be saved */
+#define LOADGEN_DEFAULT_CLIENTS 8
+#define LOADGEN_MAX_CLIENTS 64
+#define LOADGEN_DEFAULT_REQUESTS 10000  /* Per client                        */
+#define LOADGEN_MAX_REQUESTS 1000000
+#define LOADGEN_DEFAULT_WRITES 10       /* Percent of requests that write    */
+#define LOADGEN_FIRST_ORDER_ID 900000000    /* IDs load clients add and delete */
+#define BENCH_DEFAULT_REPEAT 3
+#define BENCH_LOOKUPS       1000000     /* Operations per lookup benchmark  */
+#define BENCH_MAX_RESULTS   20
+#define BENCH_ROW_NAME_LENGTH 50        /* Name fields of the old row layout */
+#define METRICS_SUB_BUCKET_BITS 5   /* 32 buckets per power of two: ~3% wide */
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_MAX_BITS    40      /* Latencies are capped at 2^40 ns (18 min) */
+#define METRICS_BUCKET_COUNT ((METRICS_MAX_BITS - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS)
+#define LIST_RADIX_BITS     11      /* Key bits sorted per radix pass        */
+#define LIST_RADIX_PASSES   6
+#define LIST_RADIX_MASK     ((1 << LIST_RADIX_BITS) - 1)
+#define LIST_RADIX_MIN_KEYS 1024    /* Fewer tied names are sorted by qsort  */
+#define CSV_SEQUENCE_HEADER "# Journal Sequence: "
+#define JOURNAL_FILE        "orders.journal"
+#define JOURNAL_LINE_LENGTH (RECORD_TEXT_LENGTH + 48)
+#define JOURNAL_CHECKPOINT_MIN_BYTES (1 << 20)  /* Journal size worth compacting */
+#define JOURNAL_CHECKPOINT_RATIO 4  /* Checkpoint once the journal is 1/N of the data */
+
+/* Journal record types */
+#define JOURNAL_ADD         'A'
+#define JOURNAL_UPDATE      'U'
+#define JOURNAL_DELETE      'D'
+#define JOURNAL_COMMIT      'C'
+
+/* Sections of a snapshot file, in file order */
+#define SNAPSHOT_SLABS          0
+#define SNAPSHOT_STRINGS        1
+#define SNAPSHOT_ORDER_INDEX    2
+#define SNAPSHOT_TRIGRAM_LISTS  3
+#define SNAPSHOT_TRIGRAM_COUNTS 4
+#define SNAPSHOT_TRIGRAM_SLOTS  5
+#define SNAPSHOT_VALUE_NODES    6
+#define SNAPSHOT_STATUS_LABELS  7
+#define SNAPSHOT_STRING_TABLE   8
+#define SNAPSHOT_SECTION_COUNT  9
+
+/* Sections of a columnar data file besides its blocks */
+#define COLUMNAR_NAMES          0
+#define COLUMNAR_STATUSES       1
+#define COLUMNAR_DIRECTORY      2
+#define COLUMNAR_SECTION_COUNT  3
+
+/* Packed columns of a columnar block, in block order */
+#define COLUMN_CUSTOMER     0
+#define COLUMN_PRODUCT      1
+#define COLUMN_STATUS       2
+#define COLUMN_QUANTITY     3
+#define COLUMN_PRICE        4
+
+/* Pipeline stages a block of import input passes through */
+#define IMPORT_EMPTY        0
+#define IMPORT_READ         1
+#define IMPORT_PARSED       2
+
+/* Operations timed by the metrics, indexing Metrics.latencies */
+#define METRIC_ADD          0
+#define METRIC_SEARCH       1
+#define METRIC_UPDATE       2
+#define METRIC_DELETE       3
+#define METRIC_SAVE         4
+#define METRIC_LOAD         5
+#define METRIC_ANALYTICS    6
+#define METRIC_OPERATION_COUNT 7
+
+/*
+ * Latency and I/O instrumentation. Build with -DECOM_NO_METRICS to compile
+ * every probe out.
+ */
+#ifndef ECOM_NO_METRICS
+#define METRICS_START(timer)            uint64_t timer = monotonicNanoseconds()
+#define METRICS_STOP(operation, timer)  metricsRecordLatency(operation, monotonicNanoseconds() - (timer))
+#define METRICS_COUNT(counter, amount)  metricsAdd(&metrics.counter, (uint64_t)(amount))
+#else
+#define METRICS_START(timer)            ((void)0)
+#define METRICS_STOP(operation, timer)  ((void)0)
+#define METRICS_COUNT(counter, amount)  ((void)0)
+#endif
+
+/* Keys a listing can be sorted by, indexing LIST_SORT_NAMES */
+#define LIST_SORT_ENTRY     0
+#define LIST_SORT_ID        1
+#define LIST_SORT_CUSTOMER  2
+#define LIST_SORT_PRODUCT   3
+#define LIST_SORT_QUANTITY  4
+#define LIST_SORT_PRICE     5
+#define LIST_SORT_VALUE     6
+#define LIST_SORT_STATUS    7
+#define LIST_SORT_COUNT     8
+
+/* Fields orders can be grouped by, indexing GROUP_FIELD_NAMES */
+#define GROUP_BY_CUSTOMER   0
+#define GROUP_BY_PRODUCT    1
+#define GROUP_FIELD_COUNT   2
+
+/* What groups are ranked by, indexing GROUP_RANK_NAMES */
+#define GROUP_RANK_REVENUE  0
+#define GROUP_RANK_ORDERS   1
+#define GROUP_RANK_COUNT    2
+
+/* Hint that memory will be read soon; a no-op where unsupported */
+#if defined(__GNUC__)
+#define PREFETCH(address)   __builtin_prefetch(address)
+#else
+#define PREFETCH(address)   ((void)0)
+#endif
+
+/* Locale-independent ASCII tests for the parsers' inner loops */
+#define IS_DIGIT(c)         ((unsigned)((c) - '0') < 10u)
+#define IS_SPACE(c)         ((c) == ' ' || (unsigned)((c) - '\t') < 5u)
 #define TEMP_BUFFER_LENGTH  128
+#define BATCH_LINE_LENGTH   (RECORD_TEXT_LENGTH + 64)
 
 static const char *STATUS_OPTIONS[] = {
     "Pending",
@@ -40,34 +260,837 @@ static const char *STATUS_OPTIONS[] = {
 
 static const size_t STATUS_OPTION_COUNT = sizeof(STATUS_OPTIONS) / sizeof(STATUS_OPTIONS[0]);
 
+/* Command-line names and menu labels of the LIST_SORT_* keys */
+static const char *LIST_SORT_NAMES[LIST_SORT_COUNT] = {
+    "entry", "id", "customer", "product", "quantity", "price", "value", "status"
+};
+static const char *LIST_SORT_LABELS[LIST_SORT_COUNT] = {
+    "Entry order", "Order ID", "Customer name", "Product name",
+    "Quantity", "Unit price", "Total amount", "Status"
+};
+
+/* Command-line names and table headings of the GROUP_BY_* fields */
+static const char *GROUP_FIELD_NAMES[GROUP_FIELD_COUNT] = { "customer", "product" };
+static const char *GROUP_FIELD_LABELS[GROUP_FIELD_COUNT] = { "Customer", "Product" };
+
+/* Command-line names of the GROUP_RANK_* orderings */
+static const char *GROUP_RANK_NAMES[GROUP_RANK_COUNT] = { "revenue", "orders" };
+
+#ifndef ECOM_NO_METRICS
+/* Names of the METRIC_* operations in reports */
+static const char *METRIC_NAMES[METRIC_OPERATION_COUNT] = {
+    "add", "search", "update", "delete", "save", "load", "analytics"
+};
+#endif
+
+/* One bucket per predefined status plus one for custom labels */
+#define STATUS_CATEGORY_COUNT (sizeof(STATUS_OPTIONS) / sizeof(STATUS_OPTIONS[0]) + 1)
+
 /* =============================================================================
  * DATA STRUCTURES
  * ============================================================================= */
 
 /**
- * Order structure representing a single order in the system.
+ * Money amount in whole cents. Prices and order values are exact; an
+ * order's value is at most MAX_PRICE_CENTS * MAX_QUANTITY, which leaves
+ * room to sum 64 of them in 64 bits.
+ */
+typedef int64_t Money;
+
+/**
+ * Sum of many Money amounts. 128 bits where the compiler provides them, so
+ * a book full of maximum-value orders still totals exactly.
+ */
+#if defined(__SIZEOF_INT128__)
+typedef __int128 MoneyTotal;
+#else
+typedef int64_t MoneyTotal;
+#endif
+
+/**
+ * Order structure representing a single order in the system. The names
+ * are borrowed: orderStoreGet() points them into the store's string heap,
+ * where they stay valid until the store next changes, and orders built
+ * from input point them at an OrderNames buffer.
  */
 typedef struct {
     int  orderID;
-    char customerName[MAX_NAME_LENGTH];
-    char productName[MAX_PRODUCT_LENGTH];
+    const char *customerName;
+    const char *productName;
     int  quantity;
-    float price;
-    char orderStatus[MAX_STATUS_LENGTH];
+    Money price;            /* Unit price in cents */
+    uint16_t statusId;      /* Index into the status dictionary */
 } Order;
 
+/**
+ * Room for the names of an order read from the operator or parsed from a
+ * record, each up to MAX_NAME_LENGTH - 1 characters.
+ */
+typedef struct {
+    char customer[MAX_NAME_LENGTH];
+    char product[MAX_NAME_LENGTH];
+} OrderNames;
+
+/**
+ * One bucket of an IntMap. A value of -1 marks an empty bucket.
+ */
+typedef struct {
+    int key;
+    int value;
+} IntMapEntry;
+
+/**
+ * Open-addressing hash map from int keys to non-negative int values. Used
+ * for the order ID -> slot index and for secondary lookup tables.
+ *
+ * Uses linear probing over a power-of-two table kept at most 70% full, so a
+ * lookup touches one or two cache lines regardless of the number of keys.
+ */
+typedef struct {
+    IntMapEntry *entries;
+    size_t       capacity;   /* Always zero or a power of two */
+    size_t       size;
+} IntMap;
+
+/**
+ * Interned order status labels. Ids below STATUS_OPTION_COUNT are the
+ * predefined STATUS_OPTIONS in order; custom labels entered by operators or
+ * found in the data file are appended as they are first seen. Each id also
+ * records which STATUS_OPTIONS entry it matches case-insensitively, or
+ * STATUS_OPTION_COUNT for custom labels, so analytics never compare text.
+ */
+typedef struct {
+    char   (*labels)[MAX_STATUS_LENGTH];
+    uint8_t *categories;
+    int      count;
+    int      capacity;
+    IntMap   lookup;        /* Label hash -> id */
+} StatusDictionary;
+
+/**
+ * Growable array of store slots, kept in ascending order when used as a
+ * posting list.
+ */
+typedef struct {
+    int *slots;
+    int  count;
+    int  capacity;
+} SlotList;
+
+/**
+ * Inverted index from case-folded customer-name trigrams to the slots whose
+ * name contains them.
+ *
+ * Posting lists are sorted by slot, so substring queries intersect the
+ * lists for the needle's trigrams and only verify the surviving candidates.
+ * Deleted slots are filtered by the store's live bitmap and purged when the
+ * store compacts; postings left behind by renames are counted in
+ * staleCount and trigger a rebuild once they make up a large share.
+ */
+typedef struct {
+    IntMap    lists;            /* Trigram code -> index into postings */
+    SlotList *postings;
+    int       listCount;
+    int       listCapacity;
+    long long postingCount;
+    long long staleCount;
+} TrigramIndex;
+
+/**
+ * An order's total value paired with its slot.
+ */
+typedef struct {
+    Money value;
+    int   slot;
+} ValueEntry;
+
+/**
+ * One node of the value index. A leaf holds up to VALUE_NODE_KEYS orders in
+ * index order and links to its neighbours; an internal node holds count
+ * separators and count + 1 children, separator i being no greater than any
+ * key under child i + 1. Values, slots and links sit in separate arrays so
+ * a search within a node reads only the values.
+ */
+typedef struct {
+    Money   values[VALUE_NODE_KEYS];
+    int32_t slots[VALUE_NODE_KEYS];
+    int32_t children[VALUE_NODE_KEYS + 1];
+    int32_t next;           /* Next leaf, or next free node; -1 at the end */
+    int32_t prev;           /* Previous leaf, or -1                        */
+    int16_t count;
+    int16_t leaf;
+} ValueNode;
+
+/**
+ * B+tree over (value, slot) ordered from the highest value down, ties going
+ * to the lower slot, which is the order listed first. The first key is the
+ * top order, a top-N query walks the leaf chain from the front and a value
+ * range query starts at one descent, so both cost O(log n + results).
+ * Nodes live in one pool addressed by index, so the tree is saved and
+ * mapped back from a snapshot as is. Leaves emptied by a delete are
+ * unlinked and freed; partly filled nodes are not merged, and the tree is
+ * rebuilt packed whenever the store compacts.
+ */
+typedef struct {
+    ValueNode *nodes;
+    int        nodeCount;       /* Nodes handed out, including freed ones */
+    int        nodeCapacity;
+    int        freeList;        /* First freed node, or -1                */
+    int        root;            /* -1 when empty                          */
+    int        height;          /* Levels, 0 when empty                   */
+    int        size;            /* Orders indexed                         */
+} ValueTree;
+
+/**
+ * Running totals behind the analytics dashboard, updated on every add,
+ * update and delete so the dashboard never rescans the book.
+ */
+typedef struct {
+    MoneyTotal revenue;
+    int        statusCounts[STATUS_CATEGORY_COUNT];
+    ValueTree  top;
+} OrderAggregates;
+
+/**
+ * The figures shown on the analytics dashboard.
+ */
+typedef struct {
+    int        orderCount;
+    MoneyTotal revenue;
+    MoneyTotal averageOrderValue;   /* Rounded to the nearest cent */
+    int        topSlot;             /* Highest-value order, or -1 */
+    Money      highestOrderValue;
+    const int *statusCounts;        /* STATUS_CATEGORY_COUNT buckets */
+} AnalyticsSummary;
+
+/**
+ * A file held in memory, either mapped (copy-on-write, so writes never
+ * reach the file) or, where mmap is not available, read into a heap buffer.
+ */
+typedef struct {
+    char   *data;
+    size_t  size;
+    bool    mapped;
+} MappedFile;
+
+/**
+ * One record parsed from the data file. Text fields point into the
+ * MappedFile and are not NUL-terminated.
+ */
+typedef struct {
+    long        line;           /* Line number within the chunk */
+    int         orderID;
+    int         quantity;
+    Money       price;
+    const char *customer;
+    const char *product;
+    const char *status;
+    uint16_t    customerLength;
+    uint16_t    productLength;
+    uint16_t    statusLength;
+} ParsedOrder;
+
+/**
+ * A malformed line found while loading.
+ */
+typedef struct {
+    long        line;           /* Line number within the chunk */
+    const char *reason;
+} LoadError;
+
+/**
+ * A newline-aligned slice of the data file and everything parsed from it.
+ * Each slice is parsed independently, possibly on its own thread, and the
+ * results are merged into the store in file order.
+ */
+typedef struct {
+    const char  *begin;
+    const char  *end;
+    long         lineCount;
+    ParsedOrder *rows;
+    int          rowCount;
+    int          rowCapacity;
+    LoadError   *errors;        /* The first errorLimit errors  */
+    int          errorCapacity;
+    int          errorLimit;
+    int          errorCount;    /* All errors, including unrecorded ones */
+    bool         outOfMemory;
+} LoadChunk;
+
+/**
+ * Blocked Bloom filter over Order IDs: each ID sets a few bits within a
+ * single 64-bit word, so a lookup costs at most one cache miss. A miss
+ * means the ID is certainly new, so only possible duplicates need a
+ * lookup in the store's ID index.
+ */
+typedef struct {
+    uint64_t *words;        /* NULL if the filter could not be allocated */
+    uint64_t  mask;         /* Number of words minus one                 */
+} IdFilter;
+
+/**
+ * A block of whole lines read from an import file, and the records and
+ * errors parsed from it.
+ */
+typedef struct {
+    char      *data;
+    size_t     size;
+    LoadChunk  chunk;
+    bool       last;        /* Nothing follows this block */
+    bool       overlong;    /* A line longer than a block starts here */
+    int        state;       /* IMPORT_EMPTY, IMPORT_READ or IMPORT_PARSED */
+} ImportBlock;
+
+/**
+ * State of a streaming import. A reader, a parser and the inserting thread
+ * pass a ring of blocks along, so memory stays bounded by the ring and
+ * the three stages overlap.
+ */
+typedef struct {
+    FILE       *file;
+    const char *path;
+    FILE       *report;         /* Every rejected row, or NULL        */
+    char       *carry;          /* Partial line left by the last read */
+    size_t      carrySize;
+    bool        discarding;     /* Skipping the rest of an overlong line */
+    bool        readFailed;
+    ImportBlock blocks[IMPORT_PIPELINE_DEPTH];
+    IdFilter    filter;
+    int         firstSlot;      /* Slots from here on were imported   */
+    long        lineBase;       /* Lines in the blocks already done   */
+    int         imported;
+    int         rejected;
+    bool        outOfMemory;
+    bool        saveFailed;
+    bool        checkpointAtEnd; /* Too big to journal row by row     */
+#ifdef ECOM_POSIX
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+#endif
+} ImportJob;
+
+#ifdef ECOM_SERVER
+/**
+ * A client of the order server. The connection is registered with epoll
+ * as EPOLLONESHOT, so only one worker handles it at a time; the worker
+ * re-arms it after answering every complete line it has read.
+ */
+typedef struct ServerConnection {
+    int    fd;
+    size_t used;                        /* Bytes of input held            */
+    long   line;                        /* Lines received so far          */
+    struct ServerConnection *nextReady; /* In the ready queue             */
+    struct ServerConnection *previous;  /* In the list of open connections */
+    struct ServerConnection *next;
+    char   input[BATCH_LINE_LENGTH];
+} ServerConnection;
+
+/**
+ * State shared by the event loop, the workers and the saver: connections
+ * waiting for a worker, and every open connection so they can be closed
+ * on shutdown.
+ */
+typedef struct {
+    pthread_mutex_t   lock;
+    pthread_cond_t    ready;        /* A connection was queued            */
+    pthread_cond_t    stopped;      /* The server is shutting down        */
+    ServerConnection *head;
+    ServerConnection *tail;
+    ServerConnection *connections;
+    int               epoll;
+    bool              stopping;
+} ServerQueue;
+
+/**
+ * One connection of the load generator and what it measured.
+ */
+typedef struct {
+    const char *path;
+    int       index;
+    int       requests;
+    int       writePercent;
+    int       idRange;          /* Lookups pick IDs this far past the first */
+    int       pendingID;        /* Order added and not yet deleted, or 0  */
+    uint64_t  state;            /* Generator state for the request mix    */
+    uint64_t *latencies;        /* Nanoseconds per completed request      */
+    int       completed;
+    int       failed;           /* Answers with "ok":false                */
+    bool      broken;           /* The connection failed                  */
+} LoadClient;
+#endif
+
+/**
+ * ASCII case-folding kernels behind equalsIgnoreCase(), toLowerCopy() and
+ * containsIgnoreCase(). One implementation is picked at startup by
+ * initCaseKernels() based on the instruction sets the CPU supports.
+ * Needles passed to find are already folded.
+ */
+typedef struct {
+    const char *name;
+    int  (*equals)(const char *a, const char *b, size_t length);
+    void (*copy)(const char *src, char *dest, size_t length);
+    const char *(*find)(const char *haystack, size_t haystackLength,
+                        const char *needle, size_t needleLength);
+} CaseKernels;
+
+/**
+ * Header in front of each string in a StringHeap.
+ */
+typedef struct {
+    uint32_t uses;          /* Orders referring to the string */
+    uint32_t length;        /* Excluding the NUL              */
+} StringHeader;
+
+/**
+ * One bucket of a StringHeap's lookup table. A ref of STRING_REF_NONE
+ * marks an empty bucket.
+ */
+typedef struct {
+    uint32_t hash;
+    uint32_t ref;
+} StringEntry;
+
+/**
+ * Interning arena holding the customer and product names of the store.
+ * Each distinct name is stored once, found through a hash table, and
+ * addressed by a 32-bit reference (chunk number in the high bits, offset
+ * in the low STRING_CHUNK_SHIFT bits), so the columns that point at names
+ * stay compact and two names are equal exactly when their references are.
+ * Chunks never move. A string no order uses any more stays in place, is
+ * counted as garbage, and is reclaimed when the store compacts.
+ */
+typedef struct {
+    char  **chunks;
+    int     chunkCount;
+    int     chunkCapacity;
+    uint32_t used;          /* Bytes used in the last chunk         */
+    size_t  totalBytes;     /* Distinct strings, headers included   */
+    size_t  garbageBytes;   /* The part of that no order uses       */
+    StringEntry *table;     /* Lookup table, at most half full      */
+    size_t  tableCapacity;  /* Zero or a power of two               */
+    size_t  tableSize;
+} StringHeap;
+
+/**
+ * A slab of ORDER_SLAB_SIZE orders stored column by column, plus a bitmap
+ * of which slots are live. Scans that only need numeric fields stream
+ * through the dense columns without touching the names.
+ */
+typedef struct {
+    int      orderIDs[ORDER_SLAB_SIZE];
+    Money    prices[ORDER_SLAB_SIZE];
+    int      quantities[ORDER_SLAB_SIZE];
+    uint16_t statusIds[ORDER_SLAB_SIZE];
+    uint32_t customerNames[ORDER_SLAB_SIZE];   /* StringHeap references */
+    uint32_t productNames[ORDER_SLAB_SIZE];    /* StringHeap references */
+    uint64_t liveMask[ORDER_SLAB_WORDS];
+} OrderSlab;
+
+/**
+ * Growable columnar order store.
+ *
+ * Records are carved out of fixed-size slabs of ORDER_SLAB_SIZE orders, so
+ * each column of a slab is a contiguous run that scans walk linearly and
+ * growth never moves an existing record. Names live in a side
+ * StringHeap. Only the slab directory is reallocated, and it doubles in
+ * size, so appends are amortised O(1) with no per-record malloc.
+ *
+ * Slots are handed out in insertion order. Deleting an order only clears its
+ * live bit, leaving a tombstone; orderStoreCompactIfNeeded() slides the
+ * survivors down once tombstones make up a large enough share of the slots.
+ * Iterate with orderStoreNextLive() to skip dead slots a word at a time.
+ */
+typedef struct {
+    OrderSlab **slabs;      /* Slab directory                         */
+    int     slabCount;      /* Slabs currently allocated              */
+    int     slabCapacity;   /* Capacity of the slab directory         */
+    int     count;          /* Slots in use, live or dead             */
+    int     liveCount;      /* Slots holding a live order             */
+    IntMap  index;          /* Order ID -> slot                       */
+    StringHeap strings;     /* Customer and product name text         */
+    TrigramIndex names;     /* Customer name trigrams -> slots        */
+    OrderAggregates stats;  /* Revenue, status counts, top order      */
+} OrderStore;
+
+/**
+ * A run of store slots formatted into data-file text by one thread. Saves
+ * format a round of chunks in parallel, write them out in slot order and
+ * reuse the buffers for the next round.
+ */
+typedef struct {
+    const OrderStore *store;
+    int     begin;          /* First slot                             */
+    int     end;            /* One past the last slot                 */
+    char   *data;
+    size_t  size;
+    size_t  capacity;
+    bool    outOfMemory;
+} SaveChunk;
+
+/**
+ * The live orders of the store in the order a listing shows them, and a
+ * buffer each page is rendered into so it reaches the stream in a single
+ * write. The buffer is kept from page to page.
+ */
+typedef struct {
+    int    *slots;
+    int     count;
+    char   *buffer;
+    size_t  capacity;
+} OrderListing;
+
+/**
+ * Sort key of one order while a listing is ordered. Text keys hold the
+ * first eight bytes of the text, big-endian, so most comparisons never
+ * touch the strings.
+ */
+typedef struct {
+    uint64_t    key;
+    const char *text;       /* Full text of a text key, else NULL */
+    int         slot;
+} ListingKey;
+
+/**
+ * Totals of one customer or product in a group-by.
+ */
+typedef struct {
+    MoneyTotal revenue;
+    uint32_t   name;        /* StringHeap reference of the name       */
+    int        orders;      /* Zero marks an empty bucket             */
+} OrderGroup;
+
+/**
+ * Open-addressing hash table of OrderGroups with linear probing, kept at
+ * most half full. Names are interned in the store, so groups are keyed by
+ * string reference and never compare text.
+ */
+typedef struct {
+    OrderGroup *buckets;
+    size_t  capacity;       /* Power of two                           */
+    size_t  size;
+    const StringHeap *strings;  /* Where the names live               */
+    int     field;          /* GROUP_BY_CUSTOMER or GROUP_BY_PRODUCT  */
+} GroupTable;
+
+/**
+ * HDR-style latency histogram: log-linear buckets that keep every latency
+ * to within about 3% across the whole range, at a fixed size and with O(1)
+ * recording.
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t total;         /* Nanoseconds */
+    uint64_t minimum;
+    uint64_t maximum;
+    uint64_t buckets[METRICS_BUCKET_COUNT];
+} LatencyHistogram;
+
+/**
+ * Instrumentation for the session: a latency histogram per METRIC_*
+ * operation and I/O counters. Server workers record their requests
+ * concurrently, so every field is updated with relaxed atomics and read
+ * through metricsLoad rather than under a shared lock.
+ */
+typedef struct {
+    LatencyHistogram latencies[METRIC_OPERATION_COUNT];
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t recordsParsed;
+    uint64_t recordsSkipped;
+} Metrics;
+
+/**
+ * Timings of one benchmark over all of its runs.
+ */
+typedef struct {
+    const char *name;
+    long        operations;     /* Per run */
+    int         runs;
+    double      bestSeconds;
+    double      totalSeconds;
+} BenchResult;
+
+/**
+ * One order in the array-of-structs layout used before the store kept
+ * orders column by column, names inline. Only the benchmarks use it, to
+ * compare a recount over rows with one over the columns.
+ */
+typedef struct {
+    int  orderID;
+    char customerName[BENCH_ROW_NAME_LENGTH];
+    char productName[BENCH_ROW_NAME_LENGTH];
+    int  quantity;
+    Money price;
+    uint16_t statusId;
+} BenchRowOrder;
+
+/**
+ * Where one section of a snapshot file lives, and its checksum.
+ */
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t checksum;
+} SnapshotSection;
+
+/**
+ * Header of a snapshot file: a byte-for-byte image of the order store
+ * (slabs, string heap, ID index, trigram index and aggregates) that can be
+ * mapped and used in place. The layout fields let a build with different
+ * structure sizes reject the file instead of misreading it, and the CSV
+ * stamp ties the snapshot to the data file it was saved with.
+ */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t byteOrder;         /* 0x01020304 as written */
+    uint32_t slabBytes;         /* sizeof(OrderSlab) */
+    uint32_t slabSize;          /* ORDER_SLAB_SIZE */
+    uint32_t stringChunkSize;   /* STRING_CHUNK_SIZE */
+    uint32_t valueNodeBytes;    /* sizeof(ValueNode) */
+    uint32_t statusLength;      /* MAX_STATUS_LENGTH */
+    uint64_t csvSize;
+    int64_t  csvModified;       /* Nanoseconds since the epoch */
+    uint64_t journalSequence;   /* Last journal record the image includes */
+    int32_t  count;
+    int32_t  liveCount;
+    int32_t  slabCount;
+    int32_t  stringChunkCount;
+    uint32_t stringUsed;
+    int32_t  trigramListCount;
+    uint64_t stringTotal;
+    uint64_t stringGarbage;
+    uint64_t stringTableCapacity;
+    uint64_t stringTableSize;
+    uint64_t indexCapacity;
+    uint64_t indexSize;
+    uint64_t trigramCapacity;
+    uint64_t trigramSize;
+    int64_t  postingCount;
+    int64_t  staleCount;
+    int32_t  valueNodeCount;
+    int32_t  valueFreeList;
+    int32_t  valueRoot;
+    int32_t  valueHeight;
+    int32_t  valueSize;
+    int32_t  statusCount;
+    int32_t  statusCounts[STATUS_CATEGORY_COUNT];
+    uint64_t revenueLow;        /* MoneyTotal split into two halves */
+    int64_t  revenueHigh;
+    SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+    uint64_t headerChecksum;    /* Of every byte above */
+} SnapshotHeader;
+
+/**
+ * Header of a columnar data file: a compact alternative to the CSV data
+ * file. Orders are stored in blocks of up to blockRows, each decodable on
+ * its own. Customer and product names are indexes into one dictionary of
+ * names and statuses into a dictionary of labels, both stored once per
+ * file as length-prefixed text. Like the snapshot, the file is written in
+ * the host's byte order and rejected elsewhere.
+ */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t byteOrder;         /* 0x01020304 as written */
+    uint32_t blockRows;         /* Most orders in one block */
+    uint64_t journalSequence;   /* Last journal record the file includes */
+    int32_t  orderCount;
+    int32_t  blockCount;
+    int32_t  nameCount;
+    int32_t  statusCount;
+    SnapshotSection sections[COLUMNAR_SECTION_COUNT];
+    uint64_t headerChecksum;    /* Of every byte above */
+} ColumnarHeader;
+
+/**
+ * Directory entry of one columnar block: where it lives and the range of
+ * every column in it, so a reader can rule the block out without decoding
+ * it. The block holds the order IDs as zigzag varint deltas (starting from
+ * minOrderID), then the COLUMN_* columns bit-packed.
+ */
+typedef struct {
+    SnapshotSection data;
+    int32_t  rows;
+    int32_t  minOrderID;
+    int32_t  maxOrderID;
+    int32_t  minQuantity;
+    int32_t  maxQuantity;
+    uint32_t categories;        /* Bit per status category present */
+    Money    minPrice;
+    Money    maxPrice;
+    Money    minValue;
+    Money    maxValue;
+} ColumnarBlock;
+
+/**
+ * A bit-packed column located within a block: every value is base plus
+ * width bits read from data, low bits first.
+ */
+typedef struct {
+    const uint8_t *data;
+    uint64_t       base;
+    uint64_t       mask;
+    int            width;
+} PackedColumn;
+
+/**
+ * Decoded columns of one or more blocks. Names and statuses are indexes
+ * into the file's dictionaries; the name columns may be left NULL when
+ * they are not wanted.
+ */
+typedef struct {
+    int      *orderIDs;
+    int      *quantities;
+    Money    *prices;
+    uint32_t *statuses;
+    uint32_t *customers;
+    uint32_t *products;
+    int       count;
+} ColumnarRows;
+
+/**
+ * A run of blocks decoded on one thread while loading a columnar file.
+ */
+typedef struct {
+    const MappedFile     *file;
+    const ColumnarHeader *header;
+    int                   first;        /* First block of the run  */
+    int                   end;          /* Block after the run     */
+    ColumnarRows          rows;
+    int                   damagedBlocks;
+    int                   damagedRows;
+    bool                  outOfMemory;
+} ColumnarChunk;
+
+/**
+ * Which orders a scan of a columnar file counts. Ranges are inclusive;
+ * status is a label, compared ignoring case, or NULL for any.
+ */
+typedef struct {
+    int   minOrderID;
+    int   maxOrderID;
+    Money minValue;
+    Money maxValue;
+    const char *status;
+} ColumnarFilter;
+
+/**
+ * Totals of the orders a scan matched, and how many blocks it had to
+ * decode.
+ */
+typedef struct {
+    int        orders;
+    MoneyTotal revenue;
+    int        topOrderID;      /* Highest-value match, or 0 */
+    Money      topValue;
+    int        blocksRead;
+    int        blocksSkipped;
+    int        damagedBlocks;
+} ColumnarScan;
+
+/**
+ * Names met while writing a columnar file, in dictionary order, and the
+ * dictionary index of each StringHeap reference.
+ */
+typedef struct {
+    IntMap    lookup;
+    uint32_t *refs;
+    int       count;
+    int       capacity;
+} ColumnarNames;
+
+/**
+ * A change read back from the journal, applied once the commit record of
+ * its batch has been read. The payload points into the mapped journal.
+ */
+typedef struct {
+    char        type;       /* JOURNAL_ADD, JOURNAL_UPDATE or JOURNAL_DELETE */
+    const char *payload;
+    size_t      length;
+} JournalEntry;
+
+/**
+ * Append-only log of the changes made since the last checkpoint (the data
+ * file and snapshot). Every record carries a sequence number; a checkpoint
+ * stores the last one it includes, so replay can skip records that were
+ * already folded in.
+ */
+typedef struct {
+    FILE         *file;             /* Open for appending, or NULL       */
+    uint64_t      nextSequence;     /* Number for the next record        */
+    uint64_t      checkpointSequence;
+    uint64_t      bytes;            /* Committed size of the journal     */
+    uint64_t      checkpointBytes;  /* Size of the data file             */
+    char         *pending;          /* Changes not yet written: a type,  */
+    size_t        pendingBytes;     /* then the payload and a NUL, each  */
+    size_t        pendingCapacity;
+    int           pendingCount;
+    bool          needsCheckpoint;  /* Next save must write a checkpoint */
+    bool          dataFileDamaged;  /* Orders were lost loading it       */
+} Journal;
+
+#ifdef ECOM_POSIX
+/**
+ * What a background save reports back to the process that started it:
+ * whether it succeeded, and the journal state it left on disk.
+ */
+typedef struct {
+    int32_t  ok;
+    int32_t  checkpointed;      /* Wrote a checkpoint, not a journal batch */
+    int32_t  needsCheckpoint;
+    int32_t  orders;
+    uint64_t nextSequence;
+    uint64_t checkpointSequence;
+    uint64_t bytes;
+    uint64_t checkpointBytes;
+    uint64_t nanoseconds;
+    uint64_t bytesWritten;
+} SaveResult;
+
+/**
+ * A save running in a forked child, which writes the copy-on-write image
+ * of the store it was forked with while edits carry on here.
+ */
+typedef struct {
+    pid_t    child;             /* 0 when no save is running          */
+    int      result;            /* Read end of the child's SaveResult */
+    uint64_t generation;        /* Last change the save covers        */
+    int      handedOver;        /* Journal entries the child writes   */
+    size_t   handedOverBytes;
+} BackgroundSave;
+#endif
+
 /* =============================================================================
  * GLOBAL VARIABLES
  * ============================================================================= */
 
-static Order orders[MAX_ORDERS];
-static int   orderCount = 0;
-static bool  hasUnsavedChanges = false;
+static OrderStore       orderStore;
+static StatusDictionary statusDictionary;
+static uint64_t         changeGeneration;   /* Changes made this session  */
+static uint64_t         savedGeneration;    /* Changes on disk so far     */
+static MappedFile       snapshotMemory;     /* Snapshot the store runs on */
+static const char      *dataFile = DATA_FILE;  /* Or COLUMNAR_FILE        */
+static Journal          journal = { .nextSequence = 1 };
+#ifdef ECOM_POSIX
+static BackgroundSave   backgroundSave;
+#endif
+#ifndef ECOM_NO_METRICS
+static Metrics          metrics;
+#if defined(ECOM_POSIX) && !defined(__GNUC__)
+static pthread_mutex_t  metricsLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+#endif
 
 /* =============================================================================
  * FUNCTION PROTOTYPES
  * ============================================================================= */
 
+/* Command Line */
+int  runCommand(int argc, char *argv[]);
+
 /* Core Operations */
 void addOrder(void);
 void displayOrders(void);
@@ -75,21 +1098,130 @@ void searchOrder(void);
 void updateOrder(void);
 void deleteOrder(void);
 void displayAnalytics(void);
+void displayMetrics(void);
+void displayRankings(void);
+void summarizeAnalytics(AnalyticsSummary *summary);
+const char *validateOrder(const Order *order);
+int  addOrderRecord(const Order *order);
+int  updateOrderRecord(const Order *order);
+int  deleteOrderRecord(int orderID);
 
 /* File Operations */
+bool hasUnsavedChanges(void);
 int  saveToFile(void);
+int  saveInBackground(void);
+int  finishBackgroundSave(bool wait);
 int  loadFromFile(void);
+int  saveOrdersToCsv(const char *path);
+int  loadOrdersFromCsv(const char *path);
+const char *parseOrderText(const char *text, size_t length, Order *order, OrderNames *names);
+
+/* Status Dictionary */
+int  statusDictionaryInit(void);
+void statusDictionaryFree(void);
+int  statusIntern(const char *label);
+const char *statusLabel(int statusId);
+int  statusCategory(int statusId);
+
+/* Snapshot */
+int  saveSnapshot(const char *path, const char *csvPath);
+int  loadSnapshot(const char *path, const char *csvPath);
+int  verifySnapshot(const char *path);
+bool isSnapshotFile(const char *path);
+
+/* Columnar Data File */
+int  saveOrdersToColumnar(const char *path);
+int  loadOrdersFromColumnar(const char *path);
+int  scanColumnarFile(const char *path, const ColumnarFilter *filter, ColumnarScan *scan);
+int  verifyColumnarFile(const char *path);
+bool isColumnarFile(const char *path);
+
+/* Journal */
+void journalRecord(char type, const Order *order);
+int  journalCommit(void);
+int  journalCheckpoint(void);
+bool journalNeedsCheckpoint(void);
+int  journalReplay(void);
+void journalClose(void);
+
+/* Server */
+#ifdef ECOM_SERVER
+int  serveOrders(const char *path, int workers);
+int  runLoadGenerator(const char *path, int clients, int requests, int writePercent, uint64_t seed);
+#endif
+
+/* Bulk Import */
+int  importOrders(const char *path, const char *reportPath);
+
+/* Order Listing */
+int  orderListingInit(OrderListing *listing, const OrderStore *store, int sortKey, bool descending);
+void orderListingFree(OrderListing *listing);
+int  orderListingWrite(OrderListing *listing, const OrderStore *store, FILE *out,
+                       int first, int count, bool header);
+int  listingSortKey(const char *name);
+
+/* Group-By */
+int  groupTableBuild(GroupTable *table, const OrderStore *store, int field);
+int  groupTableTop(const GroupTable *table, int rank, OrderGroup *top, int limit);
+void groupTableFree(GroupTable *table);
+int  printGroupRanking(FILE *out, const GroupTable *table, const OrderStore *store,
+                       const OrderGroup *top, int count);
+int  groupNameIndex(const char *const *names, int count, const char *name);
+
+/* Order Generator */
+int  generateOrders(const char *path, int count, uint64_t seed);
+#ifdef ECOM_BENCH
+int  runBenchmarks(int orders, uint64_t seed, int repeat, const char *output);
+#endif
+
+/* Self-Tests */
+#ifdef ECOM_TEST
+int  runSelfTests(bool timed);
+#endif
+
+/* Metrics */
+#ifndef ECOM_NO_METRICS
+void metricsRecordLatency(int operation, uint64_t nanoseconds);
+void metricsAdd(uint64_t *counter, uint64_t amount);
+void printMetrics(void);
+void writeMetricsJson(FILE *out);
+#endif
+
+/* Order Store */
+void   orderStoreInit(OrderStore *store);
+void   orderStoreFree(OrderStore *store);
+int    orderStoreCount(const OrderStore *store);
+int    orderStoreNextLive(const OrderStore *store, int slot);
+void   orderStoreGet(const OrderStore *store, int slot, Order *order);
+int    orderStoreOrderID(const OrderStore *store, int slot);
+const char *orderStoreCustomerName(const OrderStore *store, int slot);
+char  *orderStoreFormatRecord(const OrderStore *store, int slot, char *out);
+int    orderStoreAdd(OrderStore *store, const Order *order);
+int    orderStoreUpdate(OrderStore *store, int slot, const Order *order);
+int    orderStoreDelete(OrderStore *store, int slot);
+int    orderStoreFind(const OrderStore *store, int orderID);
+int    orderStoreAppendUnindexed(OrderStore *store, const Order *order);
+int    orderStoreAppendInterned(OrderStore *store, const Order *order, uint32_t customer, uint32_t product);
+int    orderStoreReindex(OrderStore *store);
+int    orderStoreCompactIfNeeded(OrderStore *store);
+int    orderStoreSearchName(const OrderStore *store, const char *needle, SlotList *results);
+const OrderAggregates *orderStoreStats(const OrderStore *store);
+int    orderStoreTopSlot(const OrderStore *store);
+int    orderStoreTopByValue(const OrderStore *store, int limit, SlotList *results);
+int    orderStoreValueRange(const OrderStore *store, Money minValue, Money maxValue, int limit, SlotList *results);
+Money  orderValue(const Order *order);
 
 /* User Interface */
 void displayMenu(void);
 void displayWelcomeBanner(void);
 void displayOrderDetails(const Order *order);
-void promptOrderStatus(char *buffer, int maxLength);
+void displayStoredOrder(int slot);
+int  promptOrderStatus(void);
 
 /* Utility Functions */
 void clearInputBuffer(void);
 int  readInteger(const char *prompt, int *value);
-int  readFloat(const char *prompt, float *value);
+int  readMoney(const char *prompt, Money *value);
 void readString(const char *prompt, char *buffer, int maxLength);
 int  findOrderByID(int orderID);
 int  isValidOrderID(int orderID);
@@ -98,14 +1230,35 @@ void pressEnterToContinue(void);
 int  equalsIgnoreCase(const char *a, const char *b);
 int  containsIgnoreCase(const char *haystack, const char *needle);
 void toLowerCopy(const char *src, char *dest, size_t destSize);
+int  parseInteger(const char *text, size_t length, int *value);
+int  parseMoney(const char *text, size_t length, Money *value);
+int  parseSequence(const char *text, size_t length, uint64_t *value);
+const char *formatMoney(MoneyTotal cents, char *buffer, size_t size);
 int  mapStatusToIndex(const char *status);
 int  promptYesNo(const char *message);
+void initCaseKernels(void);
+const char *caseKernelName(void);
+uint64_t monotonicNanoseconds(void);
 
 /* =============================================================================
  * MAIN FUNCTION
  * ============================================================================= */
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    initCaseKernels();
+    orderStoreInit(&orderStore);
+    if (!statusDictionaryInit()) {
+        printf("\n[ERROR] Out of memory during startup.\n");
+        return EXIT_FAILURE;
+    }
+    if (argc > 1) {
+        int status = runCommand(argc - 1, argv + 1);
+        journalClose();
+        orderStoreFree(&orderStore);
+        statusDictionaryFree();
+        return status;
+    }
+    
     displayWelcomeBanner();
     
     printf("\n[INFO] Loading existing orders from database...\n");
@@ -118,24 +1271,830 @@ int main(void) {
     }
     
     displayMenu();
+    journalClose();
+    orderStoreFree(&orderStore);
+    statusDictionaryFree();
     
     return EXIT_SUCCESS;
 }
 
 /* =============================================================================
- * USER INTERFACE FUNCTIONS
+ * COMMAND-LINE FUNCTIONS
  * ============================================================================= */
 
 /**
- * Displays the welcome banner at application startup.
+ * Prints the command-line usage summary.
  */
-void displayWelcomeBanner(void) {
-    printf("\n");
-    printf("+--------------------------------------------------+\n");
-    printf("|                                                  |\n");
-    printf("|     E-COMMERCE ORDER MANAGEMENT SYSTEM v2.0      |\n");
-    printf("|                                                  |\n");
-    printf("|          Professional Edition - 2026             |\n");
+static void printUsage(void) {
+    printf("Usage:\n");
+    printf("  ecommerce                          Start the interactive menu\n");
+    printf("  ecommerce convert <input> <output> Convert between CSV, columnar (.col) and\n");
+    printf("                                     snapshot (.snap) files\n");
+    printf("  ecommerce verify <file>            Check every snapshot or columnar checksum\n");
+    printf("  ecommerce import <csv> [report]    Add the orders in a CSV file, rejecting\n");
+    printf("                                     invalid rows and duplicate IDs\n");
+    printf("  ecommerce list [--sort <key>] [--desc] [--offset <n>] [--limit <n>]\n");
+    printf("                                     Print orders as a table; keys are entry,\n");
+    printf("                                     id, customer, product, quantity, price,\n");
+    printf("                                     value and status\n");
+    printf("  ecommerce top [--by customer|product] [--rank revenue|orders] [--limit <n>]\n");
+    printf("                                     Rank customers or products by revenue\n");
+    printf("                                     or number of orders\n");
+    printf("  ecommerce scan [file] [--min-id <n>] [--max-id <n>] [--min-total <amount>]\n");
+    printf("                 [--max-total <amount>] [--status <label>]\n");
+    printf("                                     Total matching orders of a columnar file\n");
+    printf("                                     without loading it\n");
+    printf("  ecommerce generate <output> [--orders <n>] [--seed <n>]\n");
+    printf("                                     Write a file of synthetic orders\n");
+#ifdef ECOM_BENCH
+    printf("  ecommerce bench [--orders <n>] [--seed <n>] [--repeat <n>] [--output <file>]\n");
+    printf("                                     Time the main operations on generated\n");
+    printf("                                     orders, writing JSON results\n");
+#endif
+#ifdef ECOM_TEST
+    printf("  ecommerce selftest [--bench]       Run the built-in tests, and with --bench\n");
+    printf("                                     their microbenchmarks\n");
+#endif
+    printf("  ecommerce batch [commands] [results]\n");
+    printf("                                     Run line-oriented commands from a file\n");
+    printf("                                     or stdin, writing JSON results\n");
+    printf("  ecommerce serve [--socket <path>] [--workers <n>]\n");
+    printf("                                     Answer batch commands from many clients\n");
+    printf("                                     over a Unix domain socket\n");
+    printf("  ecommerce loadgen [--socket <path>] [--clients <n>] [--requests <n>]\n");
+    printf("                    [--writes <percent>] [--seed <n>]\n");
+    printf("                                     Measure a running server's throughput\n");
+}
+
+/**
+ * Returns whether a path ends in the given extension.
+ */
+static bool hasExtension(const char *path, const char *extension) {
+    size_t length = strlen(path);
+    size_t suffix = strlen(extension);
+    return length > suffix && strcmp(path + length - suffix, extension) == 0;
+}
+
+/**
+ * Converts between the CSV data file, the columnar data file and the
+ * snapshot. The input format follows the file's contents. The output is a
+ * columnar file when its name ends in .col and a snapshot when it ends in
+ * .snap; otherwise a CSV input becomes a snapshot and anything else CSV.
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int convertCommand(const char *input, const char *output) {
+    const char *source = input;     /* Data file a snapshot output stands for */
+    bool fromCsv = false;
+    if (isSnapshotFile(input)) {
+        if (loadSnapshot(input, NULL) < 0) {
+            printf("[ERROR] Unable to load snapshot %s.\n", input);
+            return 0;
+        }
+        source = NULL;
+    } else if (isColumnarFile(input)) {
+        if (loadOrdersFromColumnar(input) < 0) {
+            return 0;
+        }
+    } else {
+        FILE *probe = fopen(input, "rb");
+        if (probe == NULL) {
+            printf("[ERROR] Unable to open %s.\n", input);
+            return 0;
+        }
+        fclose(probe);
+        loadOrdersFromCsv(input);
+        fromCsv = true;
+    }
+
+    if (hasExtension(output, ".col")) {
+        if (!saveOrdersToColumnar(output)) {
+            return 0;
+        }
+    } else if (hasExtension(output, ".snap") || fromCsv) {
+        if (!saveSnapshot(output, source)) {
+            printf("[ERROR] Unable to write snapshot %s.\n", output);
+            return 0;
+        }
+    } else if (!saveOrdersToCsv(output)) {
+        return 0;
+    }
+    printf("[INFO] Converted %d order(s) from %s to %s.\n", orderStoreCount(&orderStore), input, output);
+    return 1;
+}
+
+/**
+ * Imports an external CSV file into the saved orders.
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int importCommand(const char *input, const char *report) {
+    loadFromFile();
+    if (importOrders(input, report) < 0) {
+        return 0;
+    }
+    /* The rows are already journaled; fold a large journal into a checkpoint */
+    return !(hasUnsavedChanges() || journalNeedsCheckpoint()) || saveToFile();
+}
+
+/**
+ * Parses the numeric value of a command-line option.
+ *
+ * @param option The option, for the error message
+ * @param text   The value to parse
+ * @param min    Smallest value allowed
+ * @param max    Largest value allowed
+ * @param value  Receives the value
+ * @return 1 on success, 0 if the value is invalid
+ */
+static int parseCountOption(const char *option, const char *text, int min, int max, int *value) {
+    if (!parseInteger(text, strlen(text), value) || *value < min || *value > max) {
+        printf("[ERROR] Invalid value %s for %s; expected %d to %d.\n", text, option, min, max);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Prints the saved orders as a table on stdout, a block of rows per write.
+ *
+ * @param argc Number of options
+ * @param argv The options: --sort <key>, --desc, --offset <n>, --limit <n>
+ * @return 1 on success, 0 on failure
+ */
+static int listCommand(int argc, char *argv[]) {
+    int sortKey = LIST_SORT_ENTRY;
+    bool descending = false;
+    int offset = 0;
+    int limit = INT_MAX;
+    for (int i = 0; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--desc") == 0) {
+            descending = true;
+        } else if (strcmp(argv[i], "--sort") == 0 && hasValue) {
+            if ((sortKey = listingSortKey(argv[++i])) < 0) {
+                printf("[ERROR] Unknown sort key %s.\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--offset") == 0 && hasValue) {
+            if (!parseCountOption(argv[i], argv[i + 1], 0, INT_MAX, &offset)) {
+                return 0;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--limit") == 0 && hasValue) {
+            if (!parseCountOption(argv[i], argv[i + 1], 0, INT_MAX, &limit)) {
+                return 0;
+            }
+            i++;
+        } else {
+            printUsage();
+            return 0;
+        }
+    }
+
+    loadFromFile();
+    OrderListing listing;
+    if (!orderListingInit(&listing, &orderStore, sortKey, descending)) {
+        printf("[ERROR] Out of memory. Unable to list the orders.\n");
+        return 0;
+    }
+    int end = limit < listing.count - offset ? offset + limit : listing.count;
+    bool ok = orderListingWrite(&listing, &orderStore, stdout, offset, 0, true) >= 0;
+    for (int first = offset; ok && first < end; first += LIST_WRITE_ROWS) {
+        int rows = end - first < LIST_WRITE_ROWS ? end - first : LIST_WRITE_ROWS;
+        ok = orderListingWrite(&listing, &orderStore, stdout, first, rows, false) >= 0;
+    }
+    orderListingFree(&listing);
+    if (!ok || fflush(stdout) != 0) {
+        fprintf(stderr, "[ERROR] Unable to write the order list.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Prints the customers or products with the most revenue or orders.
+ *
+ * @param argc Number of options
+ * @param argv The options: --by <field>, --rank <order>, --limit <n>
+ * @return 1 on success, 0 on failure
+ */
+static int topCommand(int argc, char *argv[]) {
+    int field = GROUP_BY_CUSTOMER;
+    int rank = GROUP_RANK_REVENUE;
+    int limit = GROUP_DEFAULT_TOP;
+    for (int i = 0; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--by") == 0 && hasValue) {
+            if ((field = groupNameIndex(GROUP_FIELD_NAMES, GROUP_FIELD_COUNT, argv[++i])) < 0) {
+                printf("[ERROR] Unknown field %s; expected customer or product.\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--rank") == 0 && hasValue) {
+            if ((rank = groupNameIndex(GROUP_RANK_NAMES, GROUP_RANK_COUNT, argv[++i])) < 0) {
+                printf("[ERROR] Unknown ranking %s; expected revenue or orders.\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--limit") == 0 && hasValue) {
+            if (!parseCountOption(argv[i], argv[i + 1], 1, GROUP_MAX_TOP, &limit)) {
+                return 0;
+            }
+            i++;
+        } else {
+            printUsage();
+            return 0;
+        }
+    }
+
+    loadFromFile();
+    GroupTable table;
+    OrderGroup *top = malloc((size_t)limit * sizeof(*top));
+    if (top == NULL || !groupTableBuild(&table, &orderStore, field)) {
+        free(top);
+        printf("[ERROR] Out of memory. Unable to group the orders.\n");
+        return 0;
+    }
+    int count = groupTableTop(&table, rank, top, limit);
+    bool ok = printGroupRanking(stdout, &table, &orderStore, top, count) && fflush(stdout) == 0;
+    groupTableFree(&table);
+    free(top);
+    if (!ok) {
+        fprintf(stderr, "[ERROR] Unable to write the ranking.\n");
+    }
+    return ok;
+}
+
+/**
+ * Totals the orders of a columnar data file that match a filter, reading
+ * the file directly rather than loading it.
+ *
+ * @param argc Number of arguments
+ * @param argv An optional file, then the options --min-id <n>,
+ *             --max-id <n>, --min-total <amount>, --max-total <amount>
+ *             and --status <label>
+ * @return 1 on success, 0 on failure
+ */
+static int scanCommand(int argc, char *argv[]) {
+    const char *path = COLUMNAR_FILE;
+    ColumnarFilter filter = { INT_MIN, INT_MAX, -INT64_MAX, INT64_MAX, NULL };
+    int i = 0;
+    if (argc > 0 && argv[0][0] != '-') {
+        path = argv[i++];
+    }
+    for (; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        int ok = 1;
+        if (strcmp(argv[i], "--min-id") == 0 && hasValue) {
+            ok = parseCountOption(argv[i], argv[i + 1], 1, INT_MAX, &filter.minOrderID);
+        } else if (strcmp(argv[i], "--max-id") == 0 && hasValue) {
+            ok = parseCountOption(argv[i], argv[i + 1], 1, INT_MAX, &filter.maxOrderID);
+        } else if ((strcmp(argv[i], "--min-total") == 0 || strcmp(argv[i], "--max-total") == 0) && hasValue) {
+            Money *bound = strcmp(argv[i], "--min-total") == 0 ? &filter.minValue : &filter.maxValue;
+            if (!parseMoney(argv[i + 1], strlen(argv[i + 1]), bound)) {
+                printf("[ERROR] Invalid amount %s for %s.\n", argv[i + 1], argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--status") == 0 && hasValue) {
+            filter.status = argv[i + 1];
+        } else {
+            printUsage();
+            return 0;
+        }
+        if (!ok) {
+            return 0;
+        }
+        i++;
+    }
+
+    ColumnarScan scan;
+    if (!scanColumnarFile(path, &filter, &scan)) {
+        return 0;
+    }
+    char revenue[32];
+    char average[32];
+    char top[32];
+    MoneyTotal half = scan.revenue < 0 ? -(scan.orders / 2) : scan.orders / 2;
+    printf("Orders matched : %d\n", scan.orders);
+    printf("Revenue        : $%s\n", formatMoney(scan.revenue, revenue, sizeof(revenue)));
+    printf("Average order  : $%s\n",
+           formatMoney(scan.orders > 0 ? (scan.revenue + half) / scan.orders : 0, average, sizeof(average)));
+    if (scan.orders > 0) {
+        printf("Largest order  : #%d ($%s)\n", scan.topOrderID, formatMoney(scan.topValue, top, sizeof(top)));
+    }
+    printf("Blocks decoded : %d of %d (%d ruled out by their stats)\n", scan.blocksRead,
+           scan.blocksRead + scan.blocksSkipped + scan.damagedBlocks, scan.blocksSkipped);
+    if (scan.damagedBlocks > 0) {
+        printf("[WARN] %s: skipped %d damaged block(s).\n", path, scan.damagedBlocks);
+    }
+    return scan.damagedBlocks == 0;
+}
+
+/**
+ * Generates a data file of synthetic orders, or runs the benchmarks on
+ * one when built with -DECOM_BENCH.
+ *
+ * @param benchmark Whether to run the benchmarks
+ * @param argc      Number of arguments
+ * @param argv      For generate, the output file and then the options
+ *                  --orders <n> and --seed <n>; the benchmarks also take
+ *                  --repeat <n> and --output <file>
+ * @return 1 on success, 0 on failure
+ */
+static int generateCommand(bool benchmark, int argc, char *argv[]) {
+    const char *path = NULL;
+    const char *output = NULL;
+    int orders = GENERATE_DEFAULT_ORDERS;
+    int repeat = BENCH_DEFAULT_REPEAT;
+    uint64_t seed = GENERATE_DEFAULT_SEED;
+    int i = 0;
+    if (!benchmark && argc > 0 && argv[0][0] != '-') {
+        path = argv[i++];
+    }
+    for (; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--orders") == 0 && hasValue) {
+            if (!parseCountOption(argv[i], argv[i + 1], 1, GENERATE_MAX_ORDERS, &orders)) {
+                return 0;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            if (!parseSequence(argv[i + 1], strlen(argv[i + 1]), &seed)) {
+                printf("[ERROR] Invalid seed %s.\n", argv[i + 1]);
+                return 0;
+            }
+            i++;
+        } else if (benchmark && strcmp(argv[i], "--repeat") == 0 && hasValue) {
+            if (!parseCountOption(argv[i], argv[i + 1], 1, 1000, &repeat)) {
+                return 0;
+            }
+            i++;
+        } else if (benchmark && strcmp(argv[i], "--output") == 0 && hasValue) {
+            output = argv[++i];
+        } else {
+            printUsage();
+            return 0;
+        }
+    }
+
+    if (benchmark) {
+#ifdef ECOM_BENCH
+        return runBenchmarks(orders, seed, repeat, output);
+#else
+        (void)output;
+        (void)repeat;
+        printf("[ERROR] Benchmarks are not built in. Rebuild with -DECOM_BENCH.\n");
+        return 0;
+#endif
+    }
+    if (path == NULL) {
+        printUsage();
+        return 0;
+    }
+    if (!generateOrders(path, orders, seed)) {
+        return 0;
+    }
+    printf("[INFO] Generated %d order(s) in %s.\n", orders, path);
+    return 1;
+}
+
+/**
+ * Writes a string as a quoted JSON string.
+ */
+static void printJsonString(FILE *out, const char *text) {
+    fputc('"', out);
+    for (; *text != '\0'; text++) {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Writes the fields of an order as members of a JSON object.
+ */
+static void printOrderJson(FILE *out, const Order *order) {
+    char money[MONEY_TEXT_LENGTH];
+    fprintf(out, "{\"orderID\":%d,\"customerName\":", order->orderID);
+    printJsonString(out, order->customerName);
+    fprintf(out, ",\"productName\":");
+    printJsonString(out, order->productName);
+    fprintf(out, ",\"quantity\":%d,\"price\":%s,\"status\":", order->quantity,
+            formatMoney(order->price, money, sizeof(money)));
+    printJsonString(out, statusLabel(order->statusId));
+    fputc('}', out);
+}
+
+/**
+ * Returns whether a batch command changes the orders.
+ */
+static bool batchCommandWrites(const char *command) {
+    return strcmp(command, "add") == 0 || strcmp(command, "update") == 0 || strcmp(command, "delete") == 0;
+}
+
+/**
+ * Runs one batch command and writes its result.
+ *
+ * @param out       Where to write the result
+ * @param line      Line number of the command
+ * @param command   The command name
+ * @param arguments Everything after the command name
+ * @return 1 if the command succeeded, 0 otherwise
+ */
+static int batchExecute(FILE *out, long line, const char *command, const char *arguments) {
+    const char *error = NULL;
+    Order order;
+    OrderNames names;
+    int orderID;
+    /* A save logs to stdout, so it must finish before the result line starts */
+    bool saving = strcmp(command, "save") == 0;
+    bool saved = saving && (!hasUnsavedChanges() || saveToFile());
+    fprintf(out, "{\"line\":%ld,\"command\":", line);
+    printJsonString(out, command);
+
+    if (strcmp(command, "add") == 0 || strcmp(command, "update") == 0) {
+        bool adding = command[0] == 'a';
+        if ((error = parseOrderText(arguments, strlen(arguments), &order, &names)) == NULL &&
+            (error = validateOrder(&order)) == NULL) {
+            int result = adding ? addOrderRecord(&order) : updateOrderRecord(&order);
+            if (result == 0) {
+                error = adding ? "Order ID already exists" : "order not found";
+            } else if (result < 0) {
+                error = "out of memory";
+            } else {
+                fprintf(out, ",\"ok\":true,\"orderID\":%d", order.orderID);
+            }
+        }
+    } else if (strcmp(command, "delete") == 0 || strcmp(command, "find") == 0) {
+        if (!parseInteger(arguments, strlen(arguments), &orderID)) {
+            error = "invalid Order ID";
+        } else if (command[0] == 'd') {
+            if (!deleteOrderRecord(orderID)) {
+                error = "order not found";
+            } else {
+                fprintf(out, ",\"ok\":true,\"orderID\":%d", orderID);
+            }
+        } else {
+            METRICS_START(started);
+            int index = findOrderByID(orderID);
+            METRICS_STOP(METRIC_SEARCH, started);
+            if (index == -1) {
+                error = "order not found";
+            } else {
+                orderStoreGet(&orderStore, index, &order);
+                fprintf(out, ",\"ok\":true,\"order\":");
+                printOrderJson(out, &order);
+            }
+        }
+    } else if (strcmp(command, "largest") == 0 || strcmp(command, "range") == 0) {
+        int limit = VALUE_DEFAULT_TOP;
+        Money minValue = INT64_MIN;
+        Money maxValue = INT64_MAX;
+        char low[MONEY_TEXT_LENGTH];
+        char high[MONEY_TEXT_LENGTH];
+        SlotList matches = { NULL, 0, 0 };
+        if (command[0] == 'l') {
+            if (arguments[0] != '\0' &&
+                (!parseInteger(arguments, strlen(arguments), &limit) || limit <= 0 || limit > VALUE_MAX_TOP)) {
+                error = "invalid count";
+            }
+        } else if (sscanf(arguments, "%47s %47s", low, high) != 2 || !parseMoney(low, strlen(low), &minValue) ||
+                   !parseMoney(high, strlen(high), &maxValue) || minValue > maxValue) {
+            error = "invalid range";
+        } else {
+            limit = INT_MAX;
+        }
+        if (error == NULL) {
+            METRICS_START(started);
+            int found = orderStoreValueRange(&orderStore, minValue, maxValue, limit, &matches);
+            METRICS_STOP(METRIC_SEARCH, started);
+            if (!found) {
+                error = "out of memory";
+            } else {
+                fprintf(out, ",\"ok\":true,\"orders\":[");
+                for (int i = 0; i < matches.count; i++) {
+                    orderStoreGet(&orderStore, matches.slots[i], &order);
+                    if (i > 0) {
+                        fputc(',', out);
+                    }
+                    printOrderJson(out, &order);
+                }
+                fprintf(out, "]");
+            }
+        }
+        free(matches.slots);
+    } else if (strcmp(command, "search") == 0) {
+        SlotList matches = { NULL, 0, 0 };
+        METRICS_START(started);
+        size_t length = strlen(arguments);
+        int found = length > 0 && length < MAX_NAME_LENGTH && orderStoreSearchName(&orderStore, arguments, &matches);
+        METRICS_STOP(METRIC_SEARCH, started);
+        if (length == 0) {
+            error = "customer name cannot be empty";
+        } else if (length >= MAX_NAME_LENGTH) {
+            error = "customer name is too long";
+        } else if (!found) {
+            error = "out of memory";
+        } else {
+            fprintf(out, ",\"ok\":true,\"orders\":[");
+            for (int i = 0; i < matches.count; i++) {
+                orderStoreGet(&orderStore, matches.slots[i], &order);
+                if (i > 0) {
+                    fputc(',', out);
+                }
+                printOrderJson(out, &order);
+            }
+            fprintf(out, "]");
+        }
+        free(matches.slots);
+    } else if (strcmp(command, "analytics") == 0) {
+        AnalyticsSummary summary;
+        char revenue[MONEY_TEXT_LENGTH];
+        char average[MONEY_TEXT_LENGTH];
+        summarizeAnalytics(&summary);
+        fprintf(out, ",\"ok\":true,\"orders\":%d,\"revenue\":%s,\"averageOrderValue\":%s,\"topOrder\":",
+                summary.orderCount, formatMoney(summary.revenue, revenue, sizeof(revenue)),
+                formatMoney(summary.averageOrderValue, average, sizeof(average)));
+        if (summary.topSlot == -1) {
+            fprintf(out, "null");
+        } else {
+            orderStoreGet(&orderStore, summary.topSlot, &order);
+            printOrderJson(out, &order);
+        }
+    } else if (strcmp(command, "stats") == 0) {
+        const OrderAggregates *stats = orderStoreStats(&orderStore);
+        char money[MONEY_TEXT_LENGTH];
+        fprintf(out, ",\"ok\":true,\"orders\":%d,\"revenue\":%s,\"statuses\":{",
+                orderStoreCount(&orderStore), formatMoney(stats->revenue, money, sizeof(money)));
+        for (size_t i = 0; i < STATUS_OPTION_COUNT; i++) {
+            fprintf(out, "\"%s\":%d,", STATUS_OPTIONS[i], stats->statusCounts[i]);
+        }
+        fprintf(out, "\"Other\":%d}", stats->statusCounts[STATUS_OPTION_COUNT]);
+    } else if (strcmp(command, "metrics") == 0) {
+#ifndef ECOM_NO_METRICS
+        fprintf(out, ",\"ok\":true,\"metrics\":");
+        writeMetricsJson(out);
+#else
+        error = "metrics not built in";
+#endif
+    } else if (saving) {
+        if (!saved) {
+            error = "save failed";
+        } else {
+            fprintf(out, ",\"ok\":true");
+        }
+    } else {
+        error = "unknown command";
+    }
+
+    if (error != NULL) {
+        fprintf(out, ",\"ok\":false,\"error\":");
+        printJsonString(out, error);
+    }
+    fprintf(out, "}\n");
+    return error == NULL;
+}
+
+/**
+ * Splits a command line in place into its command word and arguments,
+ * dropping the line ending and the spaces around the arguments.
+ *
+ * @param line      The line to split
+ * @param arguments Receives the text after the command word
+ * @return The command word, or NULL for a blank or comment line
+ */
+static char *batchSplitLine(char *line, char **arguments) {
+    trimNewline(line);
+    size_t length = strlen(line);
+    if (length > 0 && line[length - 1] == '\r') {
+        line[--length] = '\0';
+    }
+
+    char *command = line;
+    while (IS_SPACE(*command)) {
+        command++;
+    }
+    if (*command == '\0' || *command == '#') {
+        return NULL;
+    }
+    char *rest = command;
+    while (*rest != '\0' && !IS_SPACE(*rest)) {
+        rest++;
+    }
+    if (*rest != '\0') {
+        *rest++ = '\0';
+        while (IS_SPACE(*rest)) {
+            rest++;
+        }
+    }
+    *arguments = rest;
+    return command;
+}
+
+/**
+ * Runs a stream of line-oriented commands against the saved orders:
+ *
+ *     add <id>,<customer>,<product>,<quantity>,<price>,<status>
+ *     update <id>,<customer>,<product>,<quantity>,<price>,<status>
+ *     delete <id>
+ *     find <id>
+ *     search <customer name>
+ *     largest [count]
+ *     range <min total> <max total>
+ *     stats
+ *     analytics
+ *     metrics
+ *     save
+ *
+ * Blank lines and lines starting with '#' are skipped. Each command's
+ * result is written as one JSON object per line, followed by a summary.
+ * Changes are saved once at the end (or at an explicit save), so a whole
+ * batch costs a single journal write.
+ *
+ * @param input  Commands file, or NULL or "-" for stdin
+ * @param output Results file, or NULL or "-" for stdout
+ * @return 1 if every command succeeded and the changes were saved
+ */
+static int batchCommand(const char *input, const char *output) {
+    bool fromStdin = input == NULL || strcmp(input, "-") == 0;
+    bool toStdout = output == NULL || strcmp(output, "-") == 0;
+    FILE *in = fromStdin ? stdin : fopen(input, "r");
+    if (in == NULL) {
+        printf("[ERROR] Unable to open %s.\n", input);
+        return 0;
+    }
+    FILE *out = toStdout ? stdout : fopen(output, "w");
+    if (out == NULL) {
+        printf("[ERROR] Unable to open %s for writing.\n", output);
+        if (!fromStdin) {
+            fclose(in);
+        }
+        return 0;
+    }
+
+    loadFromFile();
+    char buffer[BATCH_LINE_LENGTH];
+    long line = 0;
+    int succeeded = 0;
+    int failed = 0;
+    while (fgets(buffer, sizeof(buffer), in) != NULL) {
+        line++;
+        size_t length = strlen(buffer);
+        bool complete = length > 0 && buffer[length - 1] == '\n';
+        if (!complete && !feof(in)) {
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n') {
+                /* Discard the rest of an overlong line */
+            }
+            fprintf(out, "{\"line\":%ld,\"ok\":false,\"error\":\"line too long\"}\n", line);
+            failed++;
+            continue;
+        }
+        char *arguments;
+        char *command = batchSplitLine(buffer, &arguments);
+        if (command == NULL) {
+            continue;
+        }
+        if (batchExecute(out, line, command, arguments)) {
+            succeeded++;
+        } else {
+            failed++;
+        }
+        if (batchCommandWrites(command)) {
+            /* Reclaim tombstones left by deletes, as the menu does when idle */
+            orderStoreCompactIfNeeded(&orderStore);
+        }
+    }
+
+    bool saved = !hasUnsavedChanges() || saveToFile();
+    fprintf(out, "{\"summary\":true,\"succeeded\":%d,\"failed\":%d,\"orders\":%d,\"saved\":%s}\n",
+            succeeded, failed, orderStoreCount(&orderStore), saved ? "true" : "false");
+    if (!fromStdin) {
+        fclose(in);
+    }
+    if (!toStdout && fclose(out) != 0) {
+        printf("[ERROR] Unable to write %s.\n", output);
+        return 0;
+    }
+    return failed == 0 && saved;
+}
+
+/**
+ * Starts the order server or the load generator.
+ *
+ * @param loadgen Whether to run the load generator instead of the server
+ * @param argc    Number of options
+ * @param argv    The options: --socket <path>, and --workers <n> for the
+ *                server or --clients <n>, --requests <n>, --writes <percent>
+ *                and --seed <n> for the load generator
+ * @return 1 on success, 0 on failure
+ */
+static int serveCommand(bool loadgen, int argc, char *argv[]) {
+    const char *path = SERVER_SOCKET_FILE;
+    int workers = SERVER_DEFAULT_WORKERS;
+    int clients = LOADGEN_DEFAULT_CLIENTS;
+    int requests = LOADGEN_DEFAULT_REQUESTS;
+    int writes = LOADGEN_DEFAULT_WRITES;
+    uint64_t seed = GENERATE_DEFAULT_SEED;
+    for (int i = 0; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        int ok = 1;
+        if (strcmp(argv[i], "--socket") == 0 && hasValue) {
+            path = argv[i + 1];
+        } else if (!loadgen && strcmp(argv[i], "--workers") == 0 && hasValue) {
+            ok = parseCountOption(argv[i], argv[i + 1], 1, WORKER_MAX_THREADS, &workers);
+        } else if (loadgen && strcmp(argv[i], "--clients") == 0 && hasValue) {
+            ok = parseCountOption(argv[i], argv[i + 1], 1, LOADGEN_MAX_CLIENTS, &clients);
+        } else if (loadgen && strcmp(argv[i], "--requests") == 0 && hasValue) {
+            ok = parseCountOption(argv[i], argv[i + 1], 1, LOADGEN_MAX_REQUESTS, &requests);
+        } else if (loadgen && strcmp(argv[i], "--writes") == 0 && hasValue) {
+            ok = parseCountOption(argv[i], argv[i + 1], 0, 100, &writes);
+        } else if (loadgen && strcmp(argv[i], "--seed") == 0 && hasValue) {
+            if (!parseSequence(argv[i + 1], strlen(argv[i + 1]), &seed)) {
+                printf("[ERROR] Invalid seed %s.\n", argv[i + 1]);
+                return 0;
+            }
+        } else {
+            printUsage();
+            return 0;
+        }
+        if (!ok) {
+            return 0;
+        }
+        i++;
+    }
+
+#ifdef ECOM_SERVER
+    return loadgen ? runLoadGenerator(path, clients, requests, writes, seed) : serveOrders(path, workers);
+#else
+    (void)path;
+    (void)workers;
+    (void)clients;
+    (void)requests;
+    (void)writes;
+    printf("[ERROR] Server mode needs Linux (epoll and Unix domain sockets).\n");
+    return 0;
+#endif
+}
+
+/**
+ * Runs a non-interactive command given on the command line.
+ *
+ * @param argc Number of arguments after the program name
+ * @param argv Arguments after the program name
+ * @return Process exit status
+ */
+int runCommand(int argc, char *argv[]) {
+    int ok = 0;
+    if (strcmp(argv[0], "convert") == 0 && argc == 3) {
+        ok = convertCommand(argv[1], argv[2]);
+    } else if (strcmp(argv[0], "verify") == 0 && argc == 2) {
+        ok = isColumnarFile(argv[1]) ? verifyColumnarFile(argv[1]) : verifySnapshot(argv[1]);
+    } else if (strcmp(argv[0], "import") == 0 && (argc == 2 || argc == 3)) {
+        ok = importCommand(argv[1], argc == 3 ? argv[2] : NULL);
+    } else if (strcmp(argv[0], "generate") == 0 || strcmp(argv[0], "bench") == 0) {
+        ok = generateCommand(argv[0][0] == 'b', argc - 1, argv + 1);
+    } else if (strcmp(argv[0], "list") == 0) {
+        ok = listCommand(argc - 1, argv + 1);
+    } else if (strcmp(argv[0], "top") == 0) {
+        ok = topCommand(argc - 1, argv + 1);
+    } else if (strcmp(argv[0], "scan") == 0) {
+        ok = scanCommand(argc - 1, argv + 1);
+    } else if (strcmp(argv[0], "serve") == 0 || strcmp(argv[0], "loadgen") == 0) {
+        ok = serveCommand(argv[0][0] == 'l', argc - 1, argv + 1);
+    } else if (strcmp(argv[0], "selftest") == 0 && (argc == 1 || (argc == 2 && strcmp(argv[1], "--bench") == 0))) {
+#ifdef ECOM_TEST
+        ok = runSelfTests(argc == 2);
+#else
+        printf("[ERROR] Self-tests are not built in. Rebuild with -DECOM_TEST.\n");
+#endif
+    } else if (strcmp(argv[0], "batch") == 0 && argc <= 3) {
+        ok = batchCommand(argc > 1 ? argv[1] : NULL, argc > 2 ? argv[2] : NULL);
+    } else {
+        printUsage();
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* =============================================================================
+ * USER INTERFACE FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Displays the welcome banner at application startup.
+ */
+void displayWelcomeBanner(void) {
+    printf("\n");
+    printf("+--------------------------------------------------+\n");
+    printf("|                                                  |\n");
+    printf("|     E-COMMERCE ORDER MANAGEMENT SYSTEM v2.0      |\n");
+    printf("|                                                  |\n");
+    printf("|          Professional Edition - 2026             |\n");
     printf("|                                                  |\n");
     printf("+--------------------------------------------------+\n");
 }
@@ -148,6 +2107,11 @@ void displayMenu(void) {
     int running = 1;
     
     while (running) {
+        /* Report a background save that has finished since the last menu */
+        bool saving = !finishBackgroundSave(false);
+        /* Reclaim tombstones left by deletes while the operator is idle */
+        orderStoreCompactIfNeeded(&orderStore);
+        
         printf("\n");
         printf("+--------------------------------------------------+\n");
         printf("|              MAIN MENU                           |\n");
@@ -159,14 +2123,24 @@ void displayMenu(void) {
         printf("|  [5]  Delete Order                               |\n");
         printf("|  [6]  Save Orders to File                        |\n");
         printf("|  [7]  View Analytics Dashboard                   |\n");
-        printf("|  [8]  Exit Application                           |\n");
+        printf("|  [8]  Customer & Product Rankings                |\n");
+        printf("|  [9]  Performance Statistics                     |\n");
+        printf("|  [10] Exit Application                           |\n");
         printf("+--------------------------------------------------+\n");
-        printf("   Total Orders in System: %d / %d\n", orderCount, MAX_ORDERS);
-        printf("   Pending Changes      : %s\n", hasUnsavedChanges ? "YES" : "NO");
+        printf("   Total Orders in System: %d\n", orderStoreCount(&orderStore));
+        uint64_t pending = changeGeneration - savedGeneration;
+        if (pending == 0) {
+            printf("   Pending Changes      : NO\n");
+        } else {
+            printf("   Pending Changes      : YES (%llu)\n", (unsigned long long)pending);
+        }
+        if (saving) {
+            printf("   Background Save      : IN PROGRESS\n");
+        }
         printf("+--------------------------------------------------+\n");
         
-        if (!readInteger("Enter your choice (1-8): ", &choice)) {
-            printf("\n[ERROR] Invalid input. Please enter a number between 1 and 8.\n");
+        if (!readInteger("Enter your choice (1-10): ", &choice)) {
+            printf("\n[ERROR] Invalid input. Please enter a number between 1 and 10.\n");
             continue;
         }
         
@@ -187,15 +2161,21 @@ void displayMenu(void) {
                 deleteOrder();
                 break;
             case 6:
-                if (saveToFile()) {
-                    printf("\n[SUCCESS] Orders saved successfully!\n");
-                }
+                saveInBackground();
                 break;
             case 7:
                 displayAnalytics();
                 break;
             case 8:
-                if (hasUnsavedChanges) {
+                displayRankings();
+                break;
+            case 9:
+                displayMetrics();
+                break;
+            case 10:
+                /* Let an in-flight save land before deciding what is unsaved */
+                finishBackgroundSave(true);
+                if (hasUnsavedChanges()) {
                     if (promptYesNo("\n[WARN] Unsaved changes detected. Save before exit? (yes/no): ")) {
                         saveToFile();
                     }
@@ -206,7 +2186,7 @@ void displayMenu(void) {
                 running = 0;
                 break;
             default:
-                printf("\n[ERROR] Invalid choice. Please select an option between 1 and 8.\n");
+                printf("\n[ERROR] Invalid choice. Please select an option between 1 and 10.\n");
         }
     }
 }
@@ -224,19 +2204,32 @@ void displayOrderDetails(const Order *order) {
     printf("| Customer      : %-32s |\n", order->customerName);
     printf("| Product       : %-32s |\n", order->productName);
     printf("| Quantity      : %-32d |\n", order->quantity);
-    printf("| Unit Price    : $%-31.2f |\n", order->price);
-    printf("| Total Amount  : $%-31.2f |\n", order->price * order->quantity);
-    printf("| Status        : %-32s |\n", order->orderStatus);
+    char money[MONEY_TEXT_LENGTH];
+    printf("| Unit Price    : $%-31s |\n", formatMoney(order->price, money, sizeof(money)));
+    printf("| Total Amount  : $%-31s |\n", formatMoney(orderValue(order), money, sizeof(money)));
+    printf("| Status        : %-32s |\n", statusLabel(order->statusId));
     printf("+--------------------------------------------------+\n");
 }
 
+/**
+ * Displays the order held in a store slot.
+ *
+ * @param slot Slot of the order to display
+ */
+void displayStoredOrder(int slot) {
+    Order order;
+    orderStoreGet(&orderStore, slot, &order);
+    displayOrderDetails(&order);
+}
+
 /**
  * Prompts the user to select a valid order status.
+ *
+ * @return Dictionary id of the chosen status
  */
-void promptOrderStatus(char *buffer, int maxLength) {
-    if (buffer == NULL || maxLength <= 0) {
-        return;
-    }
+int promptOrderStatus(void) {
+    char buffer[MAX_STATUS_LENGTH] = "";
+    int maxLength = MAX_STATUS_LENGTH;
 
     printf("\nAvailable Order Status Options:\n");
     for (size_t i = 0; i < STATUS_OPTION_COUNT; i++) {
@@ -249,9 +2242,7 @@ void promptOrderStatus(char *buffer, int maxLength) {
         if (selection == 0) {
             readString("Enter Order Status: ", buffer, maxLength);
         } else if (selection >= 1 && (size_t)selection <= STATUS_OPTION_COUNT) {
-            strncpy(buffer, STATUS_OPTIONS[selection - 1], maxLength - 1);
-            buffer[maxLength - 1] = '\0';
-            return;
+            return selection - 1;
         } else {
             printf("[WARN] Invalid selection. Please enter a custom status.\n");
             readString("Enter Order Status: ", buffer, maxLength);
@@ -262,8 +2253,15 @@ void promptOrderStatus(char *buffer, int maxLength) {
     }
 
     if (strlen(buffer) == 0) {
-        strcpy(buffer, STATUS_OPTIONS[0]);
+        return 0;
+    }
+
+    int statusId = statusIntern(buffer);
+    if (statusId == -1) {
+        printf("[WARN] Unable to record custom status. Using %s.\n", STATUS_OPTIONS[0]);
+        return 0;
     }
+    return statusId;
 }
 
 /* =============================================================================
@@ -278,14 +2276,8 @@ void addOrder(void) {
     printf("|              ADD NEW ORDER                       |\n");
     printf("+--------------------------------------------------+\n");
     
-    /* Check capacity */
-    if (orderCount >= MAX_ORDERS) {
-        printf("\n[ERROR] Order limit reached (%d). Cannot add more orders.\n", MAX_ORDERS);
-        printf("[TIP] Delete some orders or increase MAX_ORDERS limit.\n");
-        return;
-    }
-    
     Order newOrder;
+    OrderNames names;
     int orderID;
     
     /* Get and validate Order ID */
@@ -308,70 +2300,141 @@ void addOrder(void) {
     newOrder.orderID = orderID;
     
     /* Get customer details */
-    readString("Enter Customer Name: ", newOrder.customerName, MAX_NAME_LENGTH);
+    readString("Enter Customer Name: ", names.customer, MAX_NAME_LENGTH);
+    newOrder.customerName = names.customer;
     if (strlen(newOrder.customerName) == 0) {
         printf("\n[ERROR] Customer name cannot be empty.\n");
         return;
     }
     
-    readString("Enter Product Name: ", newOrder.productName, MAX_PRODUCT_LENGTH);
+    readString("Enter Product Name: ", names.product, MAX_NAME_LENGTH);
+    newOrder.productName = names.product;
     if (strlen(newOrder.productName) == 0) {
         printf("\n[ERROR] Product name cannot be empty.\n");
         return;
     }
     
     /* Get quantity */
-    if (!readInteger("Enter Quantity: ", &newOrder.quantity) || newOrder.quantity <= 0) {
-        printf("\n[ERROR] Invalid quantity. Please enter a positive number.\n");
+    if (!readInteger("Enter Quantity: ", &newOrder.quantity) ||
+        newOrder.quantity <= 0 || newOrder.quantity > MAX_QUANTITY) {
+        printf("\n[ERROR] Invalid quantity. Please enter a number from 1 to %d.\n", MAX_QUANTITY);
         return;
     }
     
     /* Get price */
-    if (!readFloat("Enter Unit Price: $", &newOrder.price) || newOrder.price < 0) {
-        printf("\n[ERROR] Invalid price. Please enter a non-negative number.\n");
+    if (!readMoney("Enter Unit Price: $", &newOrder.price) ||
+        newOrder.price < 0 || newOrder.price > MAX_PRICE_CENTS) {
+        printf("\n[ERROR] Invalid price. Please enter a non-negative amount with at most 2 decimals.\n");
         return;
     }
     
-    promptOrderStatus(newOrder.orderStatus, MAX_STATUS_LENGTH);
+    newOrder.statusId = (uint16_t)promptOrderStatus();
     
-    /* Add order to array */
-    orders[orderCount] = newOrder;
-    orderCount++;
-    hasUnsavedChanges = true;
+    /* Add order to the store */
+    if (addOrderRecord(&newOrder) != 1) {
+        printf("\n[ERROR] Out of memory. Order #%d was not added.\n", newOrder.orderID);
+        return;
+    }
     
     printf("\n[SUCCESS] Order #%d added successfully!\n", newOrder.orderID);
-    printf("[INFO] Total Amount: $%.2f\n", newOrder.price * newOrder.quantity);
+    char money[MONEY_TEXT_LENGTH];
+    printf("[INFO] Total Amount: $%s\n", formatMoney(orderValue(&newOrder), money, sizeof(money)));
 }
 
 /**
- * Displays all orders in the system.
+ * Displays the orders in the system a page at a time, as a table or as
+ * detailed boxes, in the order the user chooses.
  */
 void displayOrders(void) {
     printf("\n+--------------------------------------------------+\n");
     printf("|              ORDER LIST                          |\n");
     printf("+--------------------------------------------------+\n");
     
+    int orderCount = orderStoreCount(&orderStore);
     if (orderCount == 0) {
         printf("\n[INFO] No orders available in the system.\n");
         printf("[TIP] Use option [1] to add new orders.\n");
         return;
     }
     
-    printf("\n[INFO] Displaying %d order(s):\n", orderCount);
+    printf("\nDisplay Format:\n");
+    printf("  [1] Table, one line per order\n");
+    printf("  [2] Detailed\n");
+    int format;
+    if (!readInteger("Select format (1-2): ", &format) || (format != 1 && format != 2)) {
+        printf("[WARN] Invalid selection. Using the table format.\n");
+        format = 1;
+    }
+    bool detailed = format == 2;
     
-    float totalRevenue = 0.0f;
+    printf("\nSort By:\n");
+    for (int i = 0; i < LIST_SORT_COUNT; i++) {
+        printf("  [%d] %s\n", i, LIST_SORT_LABELS[i]);
+    }
+    int sortKey;
+    if (!readInteger("Select sort key (0-7): ", &sortKey) || sortKey < 0 || sortKey >= LIST_SORT_COUNT) {
+        printf("[WARN] Invalid selection. Listing in entry order.\n");
+        sortKey = LIST_SORT_ENTRY;
+    }
+    bool descending = promptYesNo("Descending order? (yes/no): ");
     
-    for (int i = 0; i < orderCount; i++) {
-        printf("\n--- Order %d of %d ---\n", i + 1, orderCount);
-        displayOrderDetails(&orders[i]);
-        totalRevenue += orders[i].price * orders[i].quantity;
+    int pageSize = detailed ? LIST_DETAIL_PAGE_SIZE : LIST_PAGE_SIZE;
+    char prompt[TEMP_BUFFER_LENGTH];
+    char buffer[TEMP_BUFFER_LENGTH];
+    snprintf(prompt, sizeof(prompt), "Orders per page (Enter for %d): ", pageSize);
+    readString(prompt, buffer, (int)sizeof(buffer));
+    if (buffer[0] != '\0' && (!parseInteger(buffer, strlen(buffer), &pageSize) || pageSize <= 0)) {
+        pageSize = detailed ? LIST_DETAIL_PAGE_SIZE : LIST_PAGE_SIZE;
+        printf("[WARN] Invalid page size. Showing %d per page.\n", pageSize);
     }
     
+    OrderListing listing;
+    if (!orderListingInit(&listing, &orderStore, sortKey, descending)) {
+        printf("\n[ERROR] Out of memory. Unable to list the orders.\n");
+        return;
+    }
+    
+    int pageCount = (orderCount - 1) / pageSize + 1;
+    int page = 0;
+    while (page < pageCount) {
+        int first = page * pageSize;
+        int last = first + pageSize < orderCount ? first + pageSize : orderCount;
+        printf("\n--- Page %d of %d: orders %d to %d of %d ---\n", page + 1, pageCount, first + 1, last, orderCount);
+        if (detailed) {
+            for (int i = first; i < last; i++) {
+                displayStoredOrder(listing.slots[i]);
+            }
+        } else if (orderListingWrite(&listing, &orderStore, stdout, first, pageSize, true) < 0) {
+            printf("\n[ERROR] Out of memory. Unable to list the orders.\n");
+            break;
+        }
+        if (pageCount == 1) {
+            break;
+        }
+        
+        readString("[Enter] Next, [P]revious, page number or [Q]uit: ", buffer, (int)sizeof(buffer));
+        int target;
+        if (buffer[0] == '\0' || buffer[0] == 'n' || buffer[0] == 'N') {
+            page++;
+        } else if (buffer[0] == 'p' || buffer[0] == 'P') {
+            page = page > 0 ? page - 1 : 0;
+        } else if (buffer[0] == 'q' || buffer[0] == 'Q') {
+            break;
+        } else if (parseInteger(buffer, strlen(buffer), &target) && target >= 1 && target <= pageCount) {
+            page = target - 1;
+        } else {
+            printf("[WARN] Enter a page number from 1 to %d.\n", pageCount);
+        }
+    }
+    orderListingFree(&listing);
+    
     printf("\n+--------------------------------------------------+\n");
     printf("|  SUMMARY                                         |\n");
     printf("+--------------------------------------------------+\n");
     printf("| Total Orders  : %-32d |\n", orderCount);
-    printf("| Total Revenue : $%-31.2f |\n", totalRevenue);
+    char money[MONEY_TEXT_LENGTH];
+    printf("| Total Revenue : $%-31s |\n",
+           formatMoney(orderStoreStats(&orderStore)->revenue, money, sizeof(money)));
     printf("+--------------------------------------------------+\n");
 }
 
@@ -383,63 +2446,159 @@ void displayAnalytics(void) {
     printf("|              ANALYTICS DASHBOARD                |\n");
     printf("+--------------------------------------------------+\n");
 
+    int orderCount = orderStoreCount(&orderStore);
     if (orderCount == 0) {
         printf("\n[INFO] No orders available. Submit orders to unlock analytics.\n");
         return;
     }
 
-    float totalRevenue = 0.0f;
-    float highestOrderValue = -1.0f;
-    int highestIndex = -1;
-    int statusCounts[STATUS_OPTION_COUNT + 1];
-    memset(statusCounts, 0, sizeof(statusCounts));
+    AnalyticsSummary summary;
+    summarizeAnalytics(&summary);
+    char money[MONEY_TEXT_LENGTH];
 
-    for (int i = 0; i < orderCount; i++) {
-        float currentValue = orders[i].price * orders[i].quantity;
-        totalRevenue += currentValue;
+    printf("\nKey Metrics:\n");
+    printf("  Total Orders        : %d\n", summary.orderCount);
+    printf("  Total Revenue       : $%s\n", formatMoney(summary.revenue, money, sizeof(money)));
+    printf("  Average Order Value : $%s\n", formatMoney(summary.averageOrderValue, money, sizeof(money)));
+    printf("  Highest Order Value : $%s\n", formatMoney(summary.highestOrderValue, money, sizeof(money)));
 
-        if (currentValue > highestOrderValue) {
-            highestOrderValue = currentValue;
-            highestIndex = i;
-        }
+    printf("\nStatus Breakdown:\n");
+    for (size_t i = 0; i < STATUS_OPTION_COUNT; i++) {
+        printf("  %-12s : %d\n", STATUS_OPTIONS[i], summary.statusCounts[i]);
+    }
+    if (summary.statusCounts[STATUS_OPTION_COUNT] > 0) {
+        printf("  Custom/Other : %d\n", summary.statusCounts[STATUS_OPTION_COUNT]);
+    }
 
-        int statusIndex = mapStatusToIndex(orders[i].orderStatus);
-        if (statusIndex < 0 || statusIndex > (int)STATUS_OPTION_COUNT) {
-            statusIndex = (int)STATUS_OPTION_COUNT;
-        }
-        statusCounts[statusIndex]++;
+    if (summary.topSlot != -1) {
+        printf("\nTop Performing Order:\n");
+        displayStoredOrder(summary.topSlot);
     }
+}
 
-    float averageOrderValue = totalRevenue / orderCount;
+/**
+ * Ranks customers or products by revenue or number of orders.
+ */
+void displayRankings(void) {
+    printf("\n+--------------------------------------------------+\n");
+    printf("|          CUSTOMER & PRODUCT RANKINGS             |\n");
+    printf("+--------------------------------------------------+\n");
 
-    printf("\nKey Metrics:\n");
-    printf("  Total Orders        : %d\n", orderCount);
-    printf("  Total Revenue       : $%.2f\n", totalRevenue);
-    printf("  Average Order Value : $%.2f\n", averageOrderValue);
-    printf("  Highest Order Value : $%.2f\n", highestOrderValue);
+    if (orderStoreCount(&orderStore) == 0) {
+        printf("\n[INFO] No orders available. Submit orders to unlock rankings.\n");
+        return;
+    }
 
-    printf("\nStatus Breakdown:\n");
-    for (size_t i = 0; i < STATUS_OPTION_COUNT; i++) {
-        printf("  %-12s : %d\n", STATUS_OPTIONS[i], statusCounts[i]);
+    printf("\nGroup By:\n");
+    printf("  [1] Customer\n");
+    printf("  [2] Product\n");
+    int field;
+    if (!readInteger("Select field (1-2): ", &field) || (field != 1 && field != 2)) {
+        printf("[WARN] Invalid selection. Grouping by customer.\n");
+        field = 1;
+    }
+    printf("\nRank By:\n");
+    printf("  [1] Revenue\n");
+    printf("  [2] Number of orders\n");
+    int rank;
+    if (!readInteger("Select ranking (1-2): ", &rank) || (rank != 1 && rank != 2)) {
+        printf("[WARN] Invalid selection. Ranking by revenue.\n");
+        rank = 1;
     }
-    if (statusCounts[STATUS_OPTION_COUNT] > 0) {
-        printf("  Custom/Other : %d\n", statusCounts[STATUS_OPTION_COUNT]);
+    int limit = GROUP_DEFAULT_TOP;
+    char prompt[TEMP_BUFFER_LENGTH];
+    char buffer[TEMP_BUFFER_LENGTH];
+    snprintf(prompt, sizeof(prompt), "How many to show (Enter for %d): ", limit);
+    readString(prompt, buffer, (int)sizeof(buffer));
+    if (buffer[0] != '\0' && (!parseInteger(buffer, strlen(buffer), &limit) || limit <= 0 || limit > GROUP_MAX_TOP)) {
+        limit = GROUP_DEFAULT_TOP;
+        printf("[WARN] Enter a number from 1 to %d. Showing %d.\n", GROUP_MAX_TOP, limit);
     }
 
-    if (highestIndex != -1) {
-        printf("\nTop Performing Order:\n");
-        displayOrderDetails(&orders[highestIndex]);
+    GroupTable table;
+    OrderGroup *top = malloc((size_t)limit * sizeof(*top));
+    if (top == NULL || !groupTableBuild(&table, &orderStore, field == 1 ? GROUP_BY_CUSTOMER : GROUP_BY_PRODUCT)) {
+        free(top);
+        printf("\n[ERROR] Out of memory. Unable to group the orders.\n");
+        return;
     }
+    int count = groupTableTop(&table, rank == 1 ? GROUP_RANK_REVENUE : GROUP_RANK_ORDERS, top, limit);
+    printf("\n");
+    printGroupRanking(stdout, &table, &orderStore, top, count);
+    groupTableFree(&table);
+    free(top);
+}
+
+/**
+ * Shows how long each kind of operation has taken this session and how much
+ * data has been read and written, then offers to save the figures as JSON.
+ */
+void displayMetrics(void) {
+    printf("\n+--------------------------------------------------+\n");
+    printf("|              PERFORMANCE STATISTICS              |\n");
+    printf("+--------------------------------------------------+\n");
+#ifndef ECOM_NO_METRICS
+    printMetrics();
+    if (!promptYesNo("\nSave these statistics as JSON? (yes/no): ")) {
+        return;
+    }
+    char path[TEMP_BUFFER_LENGTH];
+    readString("Enter output file: ", path, (int)sizeof(path));
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        printf("\n[ERROR] Unable to open %s for writing.\n", path);
+        return;
+    }
+    writeMetricsJson(file);
+    fputc('\n', file);
+    if (fclose(file) != 0) {
+        printf("\n[ERROR] Unable to write %s.\n", path);
+        return;
+    }
+    printf("\n[SUCCESS] Statistics written to %s.\n", path);
+#else
+    printf("\n[INFO] This build was compiled without performance statistics.\n");
+#endif
+}
+
+/**
+ * Computes the analytics dashboard figures. Every figure is maintained
+ * incrementally by the order store, so this never scans the book.
+ *
+ * @param summary Receives the figures
+ */
+void summarizeAnalytics(AnalyticsSummary *summary) {
+    METRICS_START(started);
+    const OrderAggregates *stats = orderStoreStats(&orderStore);
+    int orderCount = orderStoreCount(&orderStore);
+    summary->orderCount = orderCount;
+    summary->revenue = stats->revenue;
+    summary->statusCounts = stats->statusCounts;
+    summary->averageOrderValue = 0;
+    summary->highestOrderValue = 0;
+    summary->topSlot = orderStoreTopSlot(&orderStore);
+    if (orderCount > 0) {
+        /* Round half away from zero to the nearest cent */
+        MoneyTotal half = stats->revenue < 0 ? -(orderCount / 2) : orderCount / 2;
+        summary->averageOrderValue = (stats->revenue + half) / orderCount;
+    }
+    if (summary->topSlot != -1) {
+        Order topOrder;
+        orderStoreGet(&orderStore, summary->topSlot, &topOrder);
+        summary->highestOrderValue = orderValue(&topOrder);
+    }
+    METRICS_STOP(METRIC_ANALYTICS, started);
 }
 
 /**
- * Searches for orders by ID or customer name.
+ * Searches for orders by ID, customer name or total value.
  */
 void searchOrder(void) {
     printf("\n+--------------------------------------------------+\n");
     printf("|              SEARCH ORDER                        |\n");
     printf("+--------------------------------------------------+\n");
     
+    int orderCount = orderStoreCount(&orderStore);
     if (orderCount == 0) {
         printf("\n[INFO] No orders available to search.\n");
         return;
@@ -448,6 +2607,8 @@ void searchOrder(void) {
     printf("\nSearch Options:\n");
     printf("  [1] Search by Order ID\n");
     printf("  [2] Search by Customer Name\n");
+    printf("  [3] Top Orders by Value\n");
+    printf("  [4] Orders in a Value Range\n");
     
     int choice;
     if (!readInteger("Enter your choice: ", &choice)) {
@@ -463,10 +2624,12 @@ void searchOrder(void) {
             return;
         }
         
+        METRICS_START(started);
         int index = findOrderByID(searchID);
+        METRICS_STOP(METRIC_SEARCH, started);
         if (index != -1) {
             printf("\n[SUCCESS] Order found!\n");
-            displayOrderDetails(&orders[index]);
+            displayStoredOrder(index);
         } else {
             printf("\n[INFO] No order found with ID: %d\n", searchID);
         }
@@ -481,15 +2644,22 @@ void searchOrder(void) {
             return;
         }
         
-        int foundCount = 0;
+        SlotList matches = { NULL, 0, 0 };
+        METRICS_START(started);
+        if (!orderStoreSearchName(&orderStore, searchName, &matches)) {
+            printf("\n[ERROR] Out of memory while searching.\n");
+            free(matches.slots);
+            return;
+        }
+        METRICS_STOP(METRIC_SEARCH, started);
+        
+        int foundCount = matches.count;
         printf("\n[INFO] Search results for \"%s\":\n", searchName);
         
-        for (int i = 0; i < orderCount; i++) {
-            if (containsIgnoreCase(orders[i].customerName, searchName)) {
-                displayOrderDetails(&orders[i]);
-                foundCount++;
-            }
+        for (int i = 0; i < matches.count; i++) {
+            displayStoredOrder(matches.slots[i]);
         }
+        free(matches.slots);
         
         if (foundCount == 0) {
             printf("\n[INFO] No orders found for customer: %s\n", searchName);
@@ -497,8 +2667,60 @@ void searchOrder(void) {
             printf("\n[INFO] Found %d matching order(s).\n", foundCount);
         }
         
+    } else if (choice == 3 || choice == 4) {
+        /* Search the value index */
+        int limit = INT_MAX;
+        Money minValue = INT64_MIN;
+        Money maxValue = INT64_MAX;
+        char money[MONEY_TEXT_LENGTH];
+        char other[MONEY_TEXT_LENGTH];
+        if (choice == 3) {
+            char prompt[TEMP_BUFFER_LENGTH];
+            char buffer[TEMP_BUFFER_LENGTH];
+            limit = VALUE_DEFAULT_TOP;
+            snprintf(prompt, sizeof(prompt), "How many to show (Enter for %d): ", limit);
+            readString(prompt, buffer, (int)sizeof(buffer));
+            if (buffer[0] != '\0' &&
+                (!parseInteger(buffer, strlen(buffer), &limit) || limit <= 0 || limit > VALUE_MAX_TOP)) {
+                limit = VALUE_DEFAULT_TOP;
+                printf("[WARN] Enter a number from 1 to %d. Showing %d.\n", VALUE_MAX_TOP, limit);
+            }
+        } else if (!readMoney("Minimum order total: $", &minValue) ||
+                   !readMoney("Maximum order total: $", &maxValue)) {
+            printf("\n[ERROR] Invalid amount.\n");
+            return;
+        } else if (minValue > maxValue) {
+            printf("\n[ERROR] The minimum must not exceed the maximum.\n");
+            return;
+        }
+
+        SlotList matches = { NULL, 0, 0 };
+        METRICS_START(started);
+        if (!orderStoreValueRange(&orderStore, minValue, maxValue, limit, &matches)) {
+            printf("\n[ERROR] Out of memory while searching.\n");
+            free(matches.slots);
+            return;
+        }
+        METRICS_STOP(METRIC_SEARCH, started);
+
+        if (choice == 3) {
+            printf("\n[INFO] Top %d order(s) by total value:\n", matches.count);
+        } else {
+            printf("\n[INFO] Orders totalling $%s to $%s, highest first:\n",
+                   formatMoney(minValue, money, sizeof(money)), formatMoney(maxValue, other, sizeof(other)));
+        }
+        for (int i = 0; i < matches.count; i++) {
+            displayStoredOrder(matches.slots[i]);
+        }
+        if (matches.count == 0) {
+            printf("\n[INFO] No orders found in that range.\n");
+        } else {
+            printf("\n[INFO] Found %d matching order(s).\n", matches.count);
+        }
+        free(matches.slots);
+
     } else {
-        printf("\n[ERROR] Invalid choice. Please select 1 or 2.\n");
+        printf("\n[ERROR] Invalid choice. Please select 1 to 4.\n");
     }
 }
 
@@ -510,7 +2732,7 @@ void updateOrder(void) {
     printf("|              UPDATE ORDER                        |\n");
     printf("+--------------------------------------------------+\n");
     
-    if (orderCount == 0) {
+    if (orderStoreCount(&orderStore) == 0) {
         printf("\n[INFO] No orders available to update.\n");
         return;
     }
@@ -527,50 +2749,59 @@ void updateOrder(void) {
         return;
     }
     
+    /* Edit a copy so the store sees the change as a single update */
+    Order updated;
+    orderStoreGet(&orderStore, index, &updated);
+    
     printf("\n[INFO] Current order details:\n");
-    displayOrderDetails(&orders[index]);
+    displayOrderDetails(&updated);
     
     printf("\n[INFO] Enter new details (press Enter to keep current value):\n");
     
     /* Update Customer Name */
-    char tempStr[MAX_NAME_LENGTH];
-    printf("Current Customer Name: %s\n", orders[index].customerName);
-    readString("New Customer Name: ", tempStr, MAX_NAME_LENGTH);
-    if (strlen(tempStr) > 0) {
-        strcpy(orders[index].customerName, tempStr);
+    OrderNames names;
+    printf("Current Customer Name: %s\n", updated.customerName);
+    readString("New Customer Name: ", names.customer, MAX_NAME_LENGTH);
+    if (strlen(names.customer) > 0) {
+        updated.customerName = names.customer;
     }
     
     /* Update Product Name */
-    printf("Current Product Name: %s\n", orders[index].productName);
-    readString("New Product Name: ", tempStr, MAX_PRODUCT_LENGTH);
-    if (strlen(tempStr) > 0) {
-        strcpy(orders[index].productName, tempStr);
+    printf("Current Product Name: %s\n", updated.productName);
+    readString("New Product Name: ", names.product, MAX_NAME_LENGTH);
+    if (strlen(names.product) > 0) {
+        updated.productName = names.product;
     }
     
     /* Update Quantity */
     int tempInt;
-    printf("Current Quantity: %d\n", orders[index].quantity);
-    if (readInteger("New Quantity (0 to skip): ", &tempInt) && tempInt > 0) {
-        orders[index].quantity = tempInt;
+    printf("Current Quantity: %d\n", updated.quantity);
+    if (readInteger("New Quantity (0 to skip): ", &tempInt) && tempInt > 0 && tempInt <= MAX_QUANTITY) {
+        updated.quantity = tempInt;
     }
     
     /* Update Price */
-    float tempFloat;
-    printf("Current Price: $%.2f\n", orders[index].price);
-    if (readFloat("New Price (-1 to skip): $", &tempFloat) && tempFloat >= 0) {
-        orders[index].price = tempFloat;
+    Money tempMoney;
+    char money[MONEY_TEXT_LENGTH];
+    printf("Current Price: $%s\n", formatMoney(updated.price, money, sizeof(money)));
+    if (readMoney("New Price (-1 to skip): $", &tempMoney) && tempMoney >= 0 && tempMoney <= MAX_PRICE_CENTS) {
+        updated.price = tempMoney;
     }
     
     /* Update Status */
-    printf("Current Status: %s\n", orders[index].orderStatus);
+    printf("Current Status: %s\n", statusLabel(updated.statusId));
     if (promptYesNo("Update status? (yes/no): ")) {
-        promptOrderStatus(orders[index].orderStatus, MAX_STATUS_LENGTH);
+        updated.statusId = (uint16_t)promptOrderStatus();
+    }
+    
+    if (updateOrderRecord(&updated) != 1) {
+        printf("\n[ERROR] Out of memory. Order #%d was not updated.\n", updateID);
+        return;
     }
     
     printf("\n[SUCCESS] Order #%d updated successfully!\n", updateID);
     printf("\n[INFO] Updated order details:\n");
-    displayOrderDetails(&orders[index]);
-    hasUnsavedChanges = true;
+    displayStoredOrder(index);
 }
 
 /**
@@ -581,7 +2812,7 @@ void deleteOrder(void) {
     printf("|              DELETE ORDER                        |\n");
     printf("+--------------------------------------------------+\n");
     
-    if (orderCount == 0) {
+    if (orderStoreCount(&orderStore) == 0) {
         printf("\n[INFO] No orders available to delete.\n");
         return;
     }
@@ -599,15 +2830,10 @@ void deleteOrder(void) {
     }
     
     printf("\n[WARNING] You are about to delete the following order:\n");
-    displayOrderDetails(&orders[index]);
+    displayStoredOrder(index);
     
     if (promptYesNo("Are you sure you want to delete this order? (yes/no): ")) {
-        /* Shift remaining orders */
-        for (int i = index; i < orderCount - 1; i++) {
-            orders[i] = orders[i + 1];
-        }
-        orderCount--;
-        hasUnsavedChanges = true;
+        deleteOrderRecord(deleteID);
         
         printf("\n[SUCCESS] Order #%d deleted successfully.\n", deleteID);
     } else {
@@ -615,137 +2841,8441 @@ void deleteOrder(void) {
     }
 }
 
+/**
+ * Checks an order against the rules the interactive prompts enforce.
+ *
+ * @param order The order to check
+ * @return NULL if the order is valid, otherwise the reason it is not
+ */
+const char *validateOrder(const Order *order) {
+    if (order->orderID <= 0) {
+        return "Order ID must be a positive number";
+    }
+    if (order->customerName[0] == '\0') {
+        return "customer name cannot be empty";
+    }
+    if (strlen(order->customerName) >= MAX_NAME_LENGTH) {
+        return "customer name is too long";
+    }
+    if (order->productName[0] == '\0') {
+        return "product name cannot be empty";
+    }
+    if (strlen(order->productName) >= MAX_NAME_LENGTH) {
+        return "product name is too long";
+    }
+    if (order->quantity <= 0 || order->quantity > MAX_QUANTITY) {
+        return "quantity must be from 1 to 1000000";
+    }
+    if (order->price < 0 || order->price > MAX_PRICE_CENTS) {
+        return "price must be from 0.00 to 1000000000.00";
+    }
+    return NULL;
+}
+
+/**
+ * Adds an order to the store and queues it for the journal. Both the
+ * interactive menu and batch mode make their changes through here.
+ *
+ * @param order The order to add
+ * @return 1 on success, 0 if the Order ID already exists, -1 if memory
+ *         could not be allocated
+ */
+int addOrderRecord(const Order *order) {
+    METRICS_START(started);
+    if (findOrderByID(order->orderID) != -1) {
+        return 0;
+    }
+    if (orderStoreAdd(&orderStore, order) == -1) {
+        return -1;
+    }
+    journalRecord(JOURNAL_ADD, order);
+    changeGeneration++;
+    METRICS_STOP(METRIC_ADD, started);
+    return 1;
+}
+
+/**
+ * Replaces the order with the same Order ID and queues the change for the
+ * journal.
+ *
+ * @param order The new contents of the order
+ * @return 1 on success, 0 if the order does not exist, -1 if memory could
+ *         not be allocated
+ */
+int updateOrderRecord(const Order *order) {
+    METRICS_START(started);
+    int index = findOrderByID(order->orderID);
+    if (index == -1) {
+        return 0;
+    }
+    if (!orderStoreUpdate(&orderStore, index, order)) {
+        return -1;
+    }
+    journalRecord(JOURNAL_UPDATE, order);
+    changeGeneration++;
+    METRICS_STOP(METRIC_UPDATE, started);
+    return 1;
+}
+
+/**
+ * Deletes an order and queues the change for the journal.
+ *
+ * @param orderID ID of the order to delete
+ * @return 1 on success, 0 if the order does not exist
+ */
+int deleteOrderRecord(int orderID) {
+    METRICS_START(started);
+    int index = findOrderByID(orderID);
+    if (index == -1) {
+        return 0;
+    }
+    Order removed;
+    orderStoreGet(&orderStore, index, &removed);
+    orderStoreDelete(&orderStore, index);
+    journalRecord(JOURNAL_DELETE, &removed);
+    changeGeneration++;
+    METRICS_STOP(METRIC_DELETE, started);
+    return 1;
+}
+
 /* =============================================================================
  * FILE OPERATION FUNCTIONS
  * ============================================================================= */
 
 /**
- * Saves all orders to file.
+ * Reports whether any change made this session is not yet on disk. The
+ * change and save generations count changes, so a save that was started
+ * earlier covers exactly the changes made before it started.
+ */
+bool hasUnsavedChanges(void) {
+    return changeGeneration != savedGeneration;
+}
+
+/**
+ * Writes the queued changes to the journal, or everything to a new
+ * checkpoint when one is due.
+ *
+ * @param checkpointed Set to whether a checkpoint was written
+ * @return 1 on success, 0 on failure
+ */
+static int writePendingChanges(bool *checkpointed) {
+    *checkpointed = false;
+    if (journalCommit() && !journalNeedsCheckpoint()) {
+        return 1;
+    }
+    *checkpointed = true;
+    return journalCheckpoint();
+}
+
+/**
+ * Saves pending changes. Normally only the changes made since the last
+ * save are appended to the journal, so a save costs time in proportion to
+ * what was edited. Once the journal has grown large relative to the data
+ * file, or could not be appended to, everything is written to a new
+ * checkpoint instead and the journal starts over. A background save still
+ * running is waited for first.
  * 
  * @return 1 on success, 0 on failure
  */
 int saveToFile(void) {
-    FILE *file = fopen(DATA_FILE, "w");
-    
-    if (file == NULL) {
-        printf("\n[ERROR] Unable to open file for writing: %s\n", DATA_FILE);
-        printf("[TIP] Check file permissions and disk space.\n");
+    finishBackgroundSave(true);
+    METRICS_START(started);
+    int changes = journal.pendingCount;
+    uint64_t generation = changeGeneration;
+    bool checkpointed;
+    if (!writePendingChanges(&checkpointed)) {
         return 0;
     }
-    
-    /* Write header comment */
-    fprintf(file, "# E-Commerce Orders Database\n");
-    fprintf(file, "# Format: OrderID,CustomerName,ProductName,Quantity,Price,Status\n");
-    fprintf(file, "# Total Orders: %d\n", orderCount);
-    
-    for (int i = 0; i < orderCount; i++) {
-        fprintf(file, "%d,%s,%s,%d,%.2f,%s\n",
-                orders[i].orderID,
-                orders[i].customerName,
-                orders[i].productName,
-                orders[i].quantity,
-                orders[i].price,
-                orders[i].orderStatus);
+    savedGeneration = generation;
+    METRICS_STOP(METRIC_SAVE, started);
+    if (checkpointed) {
+        printf("[INFO] %d order(s) saved to %s\n", orderStoreCount(&orderStore), dataFile);
+    } else {
+        printf("[INFO] %d change(s) saved to %s\n", changes, JOURNAL_FILE);
     }
-    
-    fclose(file);
-    hasUnsavedChanges = false;
-    printf("[INFO] %d order(s) saved to %s\n", orderCount, DATA_FILE);
     return 1;
 }
 
+#ifdef ECOM_POSIX
 /**
- * Loads orders from file.
- * 
- * @return Number of orders loaded
+ * Body of a background save's child process: writes the pending changes
+ * as they stood at the fork and sends the outcome up the pipe. Its own
+ * messages go to /dev/null; the parent reports the outcome instead.
+ *
+ * @param fd Write end of the pipe to the parent
+ * @return Exit status for the child
  */
-int loadFromFile(void) {
-    FILE *file = fopen(DATA_FILE, "r");
-    
-    if (file == NULL) {
-        return 0;
+static int runBackgroundSave(int fd) {
+    int null = open("/dev/null", O_WRONLY);
+    if (null != -1) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
     }
-    
-    char line[256];
-    int loadedCount = 0;
-    
-    while (fgets(line, sizeof(line), file) != NULL && orderCount < MAX_ORDERS) {
-        /* Skip comments and empty lines */
-        if (line[0] == '#' || line[0] == '\n') {
-            continue;
+    SaveResult result;
+    memset(&result, 0, sizeof(result));
+    uint64_t started = monotonicNanoseconds();
+#ifndef ECOM_NO_METRICS
+    uint64_t written = metrics.bytesWritten;
+#endif
+    bool checkpointed;
+    result.ok = writePendingChanges(&checkpointed);
+    result.checkpointed = checkpointed;
+    result.needsCheckpoint = journal.needsCheckpoint;
+    result.orders = orderStoreCount(&orderStore);
+    result.nextSequence = journal.nextSequence;
+    result.checkpointSequence = journal.checkpointSequence;
+    result.bytes = journal.bytes;
+    result.checkpointBytes = journal.checkpointBytes;
+    result.nanoseconds = monotonicNanoseconds() - started;
+#ifndef ECOM_NO_METRICS
+    result.bytesWritten = metrics.bytesWritten - written;
+#endif
+    bool sent = write(fd, &result, sizeof(result)) == (ssize_t)sizeof(result);
+    return sent && result.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+/**
+ * Starts saving the pending changes and returns without waiting. fork()
+ * hands a child process a copy-on-write image of the whole store, and the
+ * child writes the book exactly as it stood at this moment while editing
+ * carries on here; only pages changed in the meantime get copied. The
+ * journal entries handed to the child stay queued until
+ * finishBackgroundSave() learns that they reached the disk. Where fork()
+ * is unavailable or fails, the save runs in the foreground instead.
+ *
+ * @return 1 if the save was started or completed, 0 on failure
+ */
+int saveInBackground(void) {
+    finishBackgroundSave(true);
+    if (!hasUnsavedChanges() && !journalNeedsCheckpoint()) {
+        printf("[INFO] There are no unsaved changes.\n");
+        return 1;
+    }
+#ifdef ECOM_POSIX
+    int fds[2];
+    if (pipe(fds) == 0) {
+        fflush(NULL);
+        pid_t child = fork();
+        if (child == 0) {
+            close(fds[0]);
+            _exit(runBackgroundSave(fds[1]));
         }
-        
-        Order tempOrder;
-        int parsed = sscanf(line, "%d,%49[^,],%49[^,],%d,%f,%19[^\n]",
-                           &tempOrder.orderID,
-                           tempOrder.customerName,
-                           tempOrder.productName,
-                           &tempOrder.quantity,
-                           &tempOrder.price,
-                           tempOrder.orderStatus);
-        
-        if (parsed == 6) {
-            orders[orderCount] = tempOrder;
-            orderCount++;
-            loadedCount++;
+        close(fds[1]);
+        if (child > 0) {
+            backgroundSave.child = child;
+            backgroundSave.result = fds[0];
+            backgroundSave.generation = changeGeneration;
+            backgroundSave.handedOver = journal.pendingCount;
+            backgroundSave.handedOverBytes = journal.pendingBytes;
+            /* Set again if a change made during the save is lost to the journal */
+            journal.needsCheckpoint = false;
+            printf("[INFO] Saving in the background; you can keep working.\n");
+            return 1;
         }
+        close(fds[0]);
     }
-    
-    fclose(file);
-    hasUnsavedChanges = false;
-    return loadedCount;
+    printf("[WARN] Unable to start a background save; saving now instead.\n");
+#endif
+    return saveToFile();
 }
 
-/* =============================================================================
- * UTILITY FUNCTIONS
- * ============================================================================= */
+/**
+ * Collects a background save that has finished, optionally waiting for it.
+ * On success the changes it covered count as saved and their journal
+ * entries leave the queue. On failure they stay queued, and the next save
+ * writes a checkpoint since the child may have left a partial batch in the
+ * journal.
+ *
+ * @param wait Whether to wait for a save that is still running
+ * @return 1 if no save is running any more, 0 if one still is
+ */
+int finishBackgroundSave(bool wait) {
+#ifdef ECOM_POSIX
+    if (backgroundSave.child == 0) {
+        return 1;
+    }
+    int status;
+    pid_t done = waitpid(backgroundSave.child, &status, WNOHANG);
+    if (done == 0 && !wait) {
+        return 0;
+    }
+    if (done == 0) {
+        printf("[INFO] Waiting for the background save to finish...\n");
+        while ((done = waitpid(backgroundSave.child, &status, 0)) == -1 && errno == EINTR) {
+        }
+    }
+    SaveResult result;
+    bool received = done != -1 && read(backgroundSave.result, &result, sizeof(result)) == (ssize_t)sizeof(result);
+    close(backgroundSave.result);
+    backgroundSave.child = 0;
+    if (!received || !result.ok) {
+        journal.needsCheckpoint = true;
+        printf("\n[ERROR] The background save failed; its changes are still pending.\n");
+        printf("[TIP] Check file permissions and disk space, then save again.\n");
+        return 1;
+    }
+
+    int handedOver = backgroundSave.handedOver;
+    size_t handedOverBytes = backgroundSave.handedOverBytes;
+    journal.pendingCount -= handedOver;
+    journal.pendingBytes -= handedOverBytes;
+    memmove(journal.pending, journal.pending + handedOverBytes, journal.pendingBytes);
+    journal.nextSequence = result.nextSequence;
+    journal.checkpointSequence = result.checkpointSequence;
+    journal.bytes = result.bytes;
+    journal.checkpointBytes = result.checkpointBytes;
+    journal.needsCheckpoint = journal.needsCheckpoint || result.needsCheckpoint;
+    /* The child kept any damaged data file before replacing it */
+    journal.dataFileDamaged = journal.dataFileDamaged && !result.checkpointed;
+    if (result.checkpointed && journal.file != NULL) {
+        /* The child emptied the journal; reopen it at the next save */
+        fclose(journal.file);
+        journal.file = NULL;
+    }
+    savedGeneration = backgroundSave.generation;
+#ifndef ECOM_NO_METRICS
+    metricsRecordLatency(METRIC_SAVE, result.nanoseconds);
+    METRICS_COUNT(bytesWritten, result.bytesWritten);
+#endif
+    if (result.checkpointed) {
+        printf("\n[INFO] Background save finished: %d order(s) saved to %s\n", result.orders, dataFile);
+    } else {
+        printf("\n[INFO] Background save finished: %d change(s) saved to %s\n", handedOver, JOURNAL_FILE);
+    }
+#else
+    (void)wait;
+#endif
+    return 1;
+}
 
 /**
- * Clears the input buffer to prevent input issues.
+ * Returns how many threads to process the given amount of data with: one
+ * per WORKER_MIN_CHUNK_BYTES, up to the number of processors. Setting the
+ * ECOM_THREADS environment variable replaces the processor count. Either
+ * way the count is capped at WORKER_MAX_THREADS.
  */
-void clearInputBuffer(void) {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
+static int workerThreadCount(size_t size) {
+    int threads = 1;
+#ifdef ECOM_POSIX
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *setting = getenv(WORKER_THREADS_ENV);
+    if (setting != NULL && *setting != '\0') {
+        char *end;
+        long requested = strtol(setting, &end, 10);
+        if (*end == '\0' && requested > 0) {
+            cpus = requested;
+        }
+    }
+    threads = cpus > 0 ? (int)(cpus < WORKER_MAX_THREADS ? cpus : WORKER_MAX_THREADS) : 1;
+#endif
+    size_t bySize = size / WORKER_MIN_CHUNK_BYTES;
+    if (bySize < (size_t)threads) {
+        threads = bySize > 0 ? (int)bySize : 1;
+    }
+    return threads;
 }
 
 /**
- * Reads an integer from user input with validation.
- * 
- * @param prompt The prompt to display
- * @param value  Pointer to store the result
+ * Flushes a stream and, where the platform allows, forces its contents
+ * onto the disk. On Linux fdatasync() skips flushing metadata such as the
+ * modification time that a reader does not need.
+ *
  * @return 1 on success, 0 on failure
  */
-int readInteger(const char *prompt, int *value) {
-    printf("%s", prompt);
-    
-    if (scanf("%d", value) != 1) {
-        clearInputBuffer();
+static int syncFile(FILE *file) {
+    if (fflush(file) != 0) {
         return 0;
     }
-    
-    clearInputBuffer();
+#if defined(__linux__)
+    if (fdatasync(fileno(file)) != 0) {
+        return 0;
+    }
+#elif defined(ECOM_POSIX)
+    if (fsync(fileno(file)) != 0) {
+        return 0;
+    }
+#endif
     return 1;
 }
 
 /**
- * Reads a float from user input with validation.
- * 
- * @param prompt The prompt to display
- * @param value  Pointer to store the result
+ * Writes blocks of memory to a file in order: with a single writev() call
+ * where available, one fwrite() per block otherwise. Nothing else may be
+ * buffered in the stream.
+ *
+ * @param file   The file to write
+ * @param blocks The blocks to write
+ * @param sizes  Size of each block
+ * @param count  Number of blocks, at most WORKER_MAX_THREADS + 1
  * @return 1 on success, 0 on failure
  */
-int readFloat(const char *prompt, float *value) {
-    printf("%s", prompt);
-    
-    if (scanf("%f", value) != 1) {
-        clearInputBuffer();
+static int writeBlocks(FILE *file, char *const *blocks, const size_t *sizes, int count) {
+    for (int i = 0; i < count; i++) {
+        METRICS_COUNT(bytesWritten, sizes[i]);
+    }
+#ifdef ECOM_POSIX
+    struct iovec vectors[WORKER_MAX_THREADS + 1];
+    struct iovec *next = vectors;
+    for (int i = 0; i < count; i++) {
+        vectors[i].iov_base = blocks[i];
+        vectors[i].iov_len = sizes[i];
+    }
+    int fd = fileno(file);
+    while (count > 0) {
+        ssize_t written = writev(fd, next, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        while (count > 0 && (size_t)written >= next->iov_len) {
+            written -= (ssize_t)next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = (char *)next->iov_base + written;
+            next->iov_len -= (size_t)written;
+        }
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        if (sizes[i] > 0 && fwrite(blocks[i], 1, sizes[i], file) != sizes[i]) {
+            return 0;
+        }
+    }
+#endif
+    return 1;
+}
+
+/**
+ * Renames a fully written temporary file over its destination. On POSIX
+ * the containing directory is synced too, so the rename survives a crash.
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int replaceFile(const char *temporary, const char *path) {
+#ifndef ECOM_POSIX
+    remove(path);
+#endif
+    if (rename(temporary, path) != 0) {
         return 0;
     }
-    
-    clearInputBuffer();
+#ifdef ECOM_POSIX
+    char directory[FILENAME_MAX] = ".";
+    const char *slash = strrchr(path, '/');
+    if (slash != NULL) {
+        size_t length = slash == path ? 1 : (size_t)(slash - path);
+        if (length >= sizeof(directory)) {
+            return 1;
+        }
+        memcpy(directory, path, length);
+        directory[length] = '\0';
+    }
+    int fd = open(directory, O_RDONLY);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
     return 1;
 }
 
+/* "00" to "99", for converting numbers two digits at a time */
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+/**
+ * Writes an unsigned number in decimal.
+ *
+ * @return Pointer just past the last digit written
+ */
+static char *appendUnsigned(char *out, uint64_t value) {
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (value >= 100) {
+        p -= 2;
+        memcpy(p, &DIGIT_PAIRS[(value % 100) * 2], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, &DIGIT_PAIRS[value * 2], 2);
+    } else {
+        *--p = (char)('0' + value);
+    }
+    size_t length = (size_t)(digits + sizeof(digits) - p);
+    memcpy(out, p, length);
+    return out + length;
+}
+
+/**
+ * Writes a signed integer in decimal.
+ *
+ * @return Pointer just past the last digit written
+ */
+static char *appendInteger(char *out, int64_t value) {
+    if (value < 0) {
+        *out++ = '-';
+        return appendUnsigned(out, 0 - (uint64_t)value);
+    }
+    return appendUnsigned(out, (uint64_t)value);
+}
+
+/**
+ * Writes an amount in cents the way formatMoney() does, e.g. "1234.50" or
+ * "-0.05", without its 128-bit arithmetic.
+ *
+ * @return Pointer just past the last digit written
+ */
+static char *appendMoney(char *out, Money cents) {
+    uint64_t magnitude = (uint64_t)cents;
+    if (cents < 0) {
+        *out++ = '-';
+        magnitude = 0 - magnitude;
+    }
+    out = appendUnsigned(out, magnitude / 100);
+    *out++ = '.';
+    memcpy(out, &DIGIT_PAIRS[(magnitude % 100) * 2], 2);
+    return out + 2;
+}
+
+/**
+ * Copies a NUL-terminated string, without the terminator.
+ *
+ * @return Pointer just past the last character written
+ */
+static char *appendText(char *out, const char *text) {
+    size_t length = strlen(text);
+    memcpy(out, text, length);
+    return out + length;
+}
+
+/**
+ * Writes the fields of one data-file record, without a line terminator.
+ * The names and status must fit their Order fields, which bounds the
+ * record to RECORD_TEXT_LENGTH - 1 characters.
+ *
+ * @return Pointer just past the last character written
+ */
+static char *appendOrderRecord(char *out, int orderID, const char *customerName, const char *productName,
+                               int quantity, Money price, int statusId) {
+    out = appendInteger(out, orderID);
+    *out++ = ',';
+    out = appendText(out, customerName);
+    *out++ = ',';
+    out = appendText(out, productName);
+    *out++ = ',';
+    out = appendInteger(out, quantity);
+    *out++ = ',';
+    out = appendMoney(out, price);
+    *out++ = ',';
+    return appendText(out, statusLabel(statusId));
+}
+
+/**
+ * Formats an order as one data-file record, without a line terminator.
+ *
+ * @param order  The order to format
+ * @param buffer Receives the record
+ * @param size   Size of buffer
+ * @return Length of the record, or -1 if the buffer may be too small
+ */
+static int formatOrderRecord(const Order *order, char *buffer, size_t size) {
+    if (size < RECORD_TEXT_LENGTH) {
+        return -1;
+    }
+    char *end = appendOrderRecord(buffer, order->orderID, order->customerName, order->productName,
+                                  order->quantity, order->price, order->statusId);
+    *end = '\0';
+    return (int)(end - buffer);
+}
+
+/**
+ * Formats the live orders in a chunk's slot range into its buffer, one
+ * record per line, growing the buffer as needed.
+ *
+ * @param chunk The chunk to format; its data and size are filled in
+ */
+static void formatOrderChunk(SaveChunk *chunk) {
+    const OrderStore *store = chunk->store;
+    chunk->size = 0;
+    for (int slot = orderStoreNextLive(store, chunk->begin); slot != -1 && slot < chunk->end;
+         slot = orderStoreNextLive(store, slot + 1)) {
+        if (chunk->capacity - chunk->size < RECORD_TEXT_LENGTH) {
+            size_t capacity = chunk->capacity == 0 ? (size_t)(chunk->end - chunk->begin) * SAVE_BYTES_PER_ORDER
+                                                   : chunk->capacity * 2;
+            if (capacity < chunk->size + RECORD_TEXT_LENGTH) {
+                capacity = chunk->size + RECORD_TEXT_LENGTH;
+            }
+            char *data = realloc(chunk->data, capacity);
+            if (data == NULL) {
+                chunk->outOfMemory = true;
+                return;
+            }
+            chunk->data = data;
+            chunk->capacity = capacity;
+        }
+        char *end = orderStoreFormatRecord(store, slot, chunk->data + chunk->size);
+        chunk->size = (size_t)(end - chunk->data);
+    }
+}
+
+#ifdef ECOM_POSIX
+/**
+ * Thread entry point for formatOrderChunk().
+ */
+static void *formatOrderChunkThread(void *arg) {
+    formatOrderChunk(arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Formats a round of chunks, one thread per chunk where threads are
+ * available.
+ *
+ * @param chunks     The chunks to format
+ * @param chunkCount Number of chunks, at most WORKER_MAX_THREADS
+ */
+static void formatOrderChunks(SaveChunk *chunks, int chunkCount) {
+#ifdef ECOM_POSIX
+    pthread_t threads[WORKER_MAX_THREADS];
+    bool started[WORKER_MAX_THREADS] = { false };
+    for (int i = 1; i < chunkCount; i++) {
+        started[i] = pthread_create(&threads[i], NULL, formatOrderChunkThread, &chunks[i]) == 0;
+    }
+    formatOrderChunk(&chunks[0]);
+    for (int i = 1; i < chunkCount; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            formatOrderChunk(&chunks[i]);
+        }
+    }
+#else
+    for (int i = 0; i < chunkCount; i++) {
+        formatOrderChunk(&chunks[i]);
+    }
+#endif
+}
+
+/**
+ * Writes all orders to a CSV data file. The file is written under a
+ * temporary name, synced and renamed into place, so a crash never leaves
+ * a half-written data file behind.
+ *
+ * Records are formatted in rounds of SAVE_CHUNK_SLABS-slab chunks, one
+ * chunk per thread, and each round is written with a single writev()
+ * call, so memory use stays bounded however large the book is.
+ * 
+ * @param path The file to write
+ * @return 1 on success, 0 on failure
+ */
+int saveOrdersToCsv(const char *path) {
+    const OrderStore *store = &orderStore;
+    char temporary[FILENAME_MAX];
+    FILE *file = NULL;
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) < (int)sizeof(temporary)) {
+        file = fopen(temporary, "w");
+    }
+    
+    if (file == NULL) {
+        printf("\n[ERROR] Unable to open file for writing: %s\n", path);
+        printf("[TIP] Check file permissions and disk space.\n");
+        return 0;
+    }
+    
+    /* Write header comment */
+    char header[TEMP_BUFFER_LENGTH * 2];
+    char *blocks[WORKER_MAX_THREADS];
+    size_t sizes[WORKER_MAX_THREADS];
+    blocks[0] = header;
+    sizes[0] = (size_t)snprintf(header, sizeof(header),
+                                "# E-Commerce Orders Database\n"
+                                "# Format: OrderID,CustomerName,ProductName,Quantity,Price,Status\n"
+                                "# Total Orders: %d\n"
+                                CSV_SEQUENCE_HEADER "%llu\n",
+                                orderStoreCount(store), (unsigned long long)journal.checkpointSequence);
+    bool failed = !writeBlocks(file, blocks, sizes, 1);
+    
+    SaveChunk chunks[WORKER_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    int threads = workerThreadCount((size_t)store->liveCount * SAVE_BYTES_PER_ORDER);
+    int chunkSlots = SAVE_CHUNK_SLABS * ORDER_SLAB_SIZE;
+    for (int slot = 0; slot < store->count && !failed; ) {
+        int used = 0;
+        for (; used < threads && slot < store->count; used++, slot += chunkSlots) {
+            chunks[used].store = store;
+            chunks[used].begin = slot;
+            chunks[used].end = store->count - slot > chunkSlots ? slot + chunkSlots : store->count;
+        }
+        formatOrderChunks(chunks, used);
+        for (int i = 0; i < used; i++) {
+            failed = failed || chunks[i].outOfMemory;
+            blocks[i] = chunks[i].data;
+            sizes[i] = chunks[i].size;
+        }
+        failed = failed || !writeBlocks(file, blocks, sizes, used);
+    }
+    for (int i = 0; i < WORKER_MAX_THREADS; i++) {
+        free(chunks[i].data);
+    }
+    
+    failed = failed || ferror(file) || !syncFile(file);
+    if (fclose(file) != 0 || failed || !replaceFile(temporary, path)) {
+        remove(temporary);
+        printf("\n[ERROR] Unable to write %s.\n", path);
+        printf("[TIP] Check file permissions and disk space.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Opens a file as one contiguous block of memory, mapping it where mmap is
+ * available and reading it into a heap buffer otherwise.
+ *
+ * @param path     The file to open
+ * @param file     Receives the file contents
+ * @param writable Whether the memory may be modified. Changes are private
+ *                 to the process and never written back to the file.
+ * @return 1 on success, 0 if the file does not exist or cannot be read
+ */
+static int mappedFileOpen(const char *path, MappedFile *file, bool writable) {
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = false;
+#ifdef ECOM_POSIX
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        close(fd);
+        return 0;
+    }
+    if (info.st_size > 0) {
+        int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *data = mmap(NULL, (size_t)info.st_size, protection, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            if (!writable) {
+                madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+            }
+            file->data = data;
+            file->size = (size_t)info.st_size;
+            file->mapped = true;
+            close(fd);
+            METRICS_COUNT(bytesRead, file->size);
+            return 1;
+        }
+    }
+    close(fd);
+    if (info.st_size == 0) {
+        return 1;
+    }
+#endif
+    (void)writable;     /* A heap buffer is always writable */
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL) {
+        return 0;
+    }
+    size_t capacity = 1 << 16;
+    char *data = malloc(capacity);
+    size_t size = 0;
+    while (data != NULL) {
+        size += fread(data + size, 1, capacity - size, stream);
+        if (size < capacity) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = realloc(data, capacity);
+        if (grown == NULL) {
+            free(data);
+        }
+        data = grown;
+    }
+    bool failed = data == NULL || ferror(stream);
+    fclose(stream);
+    if (failed) {
+        free(data);
+        return 0;
+    }
+    file->data = data;
+    file->size = size;
+    METRICS_COUNT(bytesRead, size);
+    return 1;
+}
+
+/**
+ * Releases a file opened with mappedFileOpen().
+ */
+static void mappedFileClose(MappedFile *file) {
+#ifdef ECOM_POSIX
+    if (file->mapped) {
+        munmap(file->data, file->size);
+        file->data = NULL;
+        return;
+    }
+#endif
+    free(file->data);
+    file->data = NULL;
+}
+
+/**
+ * Finds the end of the line starting at p and the positions of its first
+ * LOAD_FIELD_COUNT - 1 commas in one pass. On x86 the line is scanned
+ * 16 bytes at a time, comparing against ',' and '\n' in parallel and
+ * walking the resulting bitmasks.
+ *
+ * @param p          Start of the line
+ * @param end        End of the file data
+ * @param commas     Receives the comma positions
+ * @param commaCount Receives the number of commas recorded
+ * @return Pointer to the terminating '\n', or end for an unterminated line
+ */
+static const char *scanLine(const char *p, const char *end, const char **commas, int *commaCount) {
+    int found = 0;
+#ifdef ECOM_X86_SIMD
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        unsigned newlines = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        unsigned commaBits = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, comma));
+        if (newlines != 0) {
+            commaBits &= (newlines & -newlines) - 1;
+        }
+        for (; commaBits != 0 && found < LOAD_FIELD_COUNT - 1; commaBits &= commaBits - 1) {
+            commas[found++] = p + __builtin_ctz(commaBits);
+        }
+        if (newlines != 0) {
+            *commaCount = found;
+            return p + __builtin_ctz(newlines);
+        }
+    }
+#endif
+    for (; p < end && *p != '\n'; p++) {
+        if (*p == ',' && found < LOAD_FIELD_COUNT - 1) {
+            commas[found++] = p;
+        }
+    }
+    *commaCount = found;
+    return p;
+}
+
+/**
+ * Records a malformed line in a chunk. Only the first errorLimit are kept,
+ * but all of them are counted.
+ */
+static void loadChunkError(LoadChunk *chunk, long line, const char *reason) {
+    if (chunk->errorCount < chunk->errorLimit && chunk->errorCount == chunk->errorCapacity) {
+        int capacity = chunk->errorCapacity == 0 ? 16 : chunk->errorCapacity * 2;
+        LoadError *errors = realloc(chunk->errors, (size_t)capacity * sizeof(*errors));
+        if (errors == NULL) {
+            chunk->errorLimit = chunk->errorCount;
+        } else {
+            chunk->errors = errors;
+            chunk->errorCapacity = capacity;
+        }
+    }
+    if (chunk->errorCount < chunk->errorLimit) {
+        chunk->errors[chunk->errorCount].line = line;
+        chunk->errors[chunk->errorCount].reason = reason;
+    }
+    chunk->errorCount++;
+}
+
+/**
+ * Returns how many of a chunk's errors were recorded.
+ */
+static int loadChunkRecordedErrors(const LoadChunk *chunk) {
+    return chunk->errorCount < chunk->errorLimit ? chunk->errorCount : chunk->errorLimit;
+}
+
+/**
+ * Checks that a text field of a record is non-empty and fits its buffer.
+ *
+ * @return NULL if the field is valid, otherwise emptyReason or longReason
+ */
+static const char *checkTextField(const char *begin, const char *end, int maxLength,
+                                  const char *emptyReason, const char *longReason) {
+    if (begin == end) {
+        return emptyReason;
+    }
+    if (end - begin > maxLength - 1) {
+        return longReason;
+    }
+    return NULL;
+}
+
+/**
+ * Parses the fields of one order record. The record's commas must already
+ * have been located with scanLine().
+ *
+ * @param p          Start of the record
+ * @param textEnd    End of the record, excluding any line terminator
+ * @param commas     The record's first LOAD_FIELD_COUNT - 1 commas
+ * @param commaCount Number of commas found
+ * @param row        Receives the parsed fields
+ * @return NULL on success, otherwise the reason the record is invalid
+ */
+static const char *parseOrderRecord(const char *p, const char *textEnd, const char **commas,
+                                    int commaCount, ParsedOrder *row) {
+    const char *reason = NULL;
+    if (commaCount < LOAD_FIELD_COUNT - 1) {
+        return "expected 6 comma-separated fields";
+    }
+    row->customer = commas[0] + 1;
+    row->product = commas[1] + 1;
+    row->status = commas[4] + 1;
+    if (!parseInteger(p, (size_t)(commas[0] - p), &row->orderID)) {
+        return "invalid Order ID";
+    }
+    if ((reason = checkTextField(row->customer, commas[1], MAX_NAME_LENGTH,
+                                 "customer name is empty", "customer name is too long")) != NULL ||
+        (reason = checkTextField(row->product, commas[2], MAX_NAME_LENGTH,
+                                 "product name is empty", "product name is too long")) != NULL ||
+        (reason = checkTextField(row->status, textEnd, MAX_STATUS_LENGTH,
+                                 "status is empty", "status is too long")) != NULL) {
+        return reason;
+    }
+    if (!parseInteger(commas[2] + 1, (size_t)(commas[3] - commas[2] - 1), &row->quantity) ||
+        row->quantity < -MAX_QUANTITY || row->quantity > MAX_QUANTITY) {
+        return "invalid quantity";
+    }
+    if (!parseMoney(commas[3] + 1, (size_t)(commas[4] - commas[3] - 1), &row->price) ||
+        row->price < -MAX_PRICE_CENTS || row->price > MAX_PRICE_CENTS) {
+        return "invalid price";
+    }
+    row->customerLength = (uint16_t)(commas[1] - row->customer);
+    row->productLength = (uint16_t)(commas[2] - row->product);
+    row->statusLength = (uint16_t)(textEnd - row->status);
+    return NULL;
+}
+
+/**
+ * Copies a parsed record into an Order whose names live in the given
+ * buffer, interning its status.
+ *
+ * @return 1 on success, 0 if the status dictionary is full
+ */
+static int parsedOrderToOrder(const ParsedOrder *row, Order *order, OrderNames *names) {
+    char status[MAX_STATUS_LENGTH];
+    order->orderID = row->orderID;
+    order->quantity = row->quantity;
+    order->price = row->price;
+    memcpy(names->customer, row->customer, row->customerLength);
+    names->customer[row->customerLength] = '\0';
+    memcpy(names->product, row->product, row->productLength);
+    names->product[row->productLength] = '\0';
+    order->customerName = names->customer;
+    order->productName = names->product;
+    memcpy(status, row->status, row->statusLength);
+    status[row->statusLength] = '\0';
+
+    int statusId = statusIntern(status);
+    if (statusId == -1) {
+        return 0;
+    }
+    order->statusId = (uint16_t)statusId;
+    return 1;
+}
+
+/**
+ * Parses one order record in the data-file format, such as a record given
+ * to a batch command or written to the journal.
+ *
+ * @param text   The record, without a line terminator
+ * @param length Number of characters in text
+ * @param order  Receives the order
+ * @param names  Receives the order's names
+ * @return NULL on success, otherwise the reason the record is invalid
+ */
+const char *parseOrderText(const char *text, size_t length, Order *order, OrderNames *names) {
+    const char *end = text + length;
+    const char *commas[LOAD_FIELD_COUNT - 1];
+    int commaCount;
+    ParsedOrder row;
+    scanLine(text, end, commas, &commaCount);
+    const char *reason = parseOrderRecord(text, end, commas, commaCount, &row);
+    if (reason != NULL) {
+        return reason;
+    }
+    if (!parsedOrderToOrder(&row, order, names)) {
+        return "too many distinct statuses";
+    }
+    return NULL;
+}
+
+/**
+ * Parses every record in a chunk of the data file. Comment lines (starting
+ * with '#') and blank lines are skipped; anything else that is not a valid
+ * record is reported as an error with its line number.
+ *
+ * @param chunk The chunk to parse; its rows and errors are filled in
+ */
+static void parseOrderChunk(LoadChunk *chunk) {
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+    long line = 0;
+
+    while (p < end) {
+        const char *commas[LOAD_FIELD_COUNT - 1];
+        int commaCount;
+        const char *lineEnd = scanLine(p, end, commas, &commaCount);
+        const char *next = lineEnd < end ? lineEnd + 1 : end;
+        const char *textEnd = lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        line++;
+
+        const char *first = p;
+        while (first < textEnd && IS_SPACE(*first)) {
+            first++;
+        }
+        if (first == textEnd || *p == '#') {
+            p = next;
+            continue;
+        }
+
+        ParsedOrder row;
+        row.line = line;
+        const char *reason = parseOrderRecord(p, textEnd, commas, commaCount, &row);
+        if (reason != NULL) {
+            loadChunkError(chunk, line, reason);
+            p = next;
+            continue;
+        }
+
+        if (chunk->rowCount == chunk->rowCapacity) {
+            int capacity = chunk->rowCapacity == 0 ? 1024 : chunk->rowCapacity * 2;
+            ParsedOrder *rows = realloc(chunk->rows, (size_t)capacity * sizeof(*rows));
+            if (rows == NULL) {
+                chunk->outOfMemory = true;
+                break;
+            }
+            chunk->rows = rows;
+            chunk->rowCapacity = capacity;
+        }
+        chunk->rows[chunk->rowCount++] = row;
+        p = next;
+    }
+    chunk->lineCount = line;
+}
+
+#ifdef ECOM_POSIX
+/**
+ * Thread entry point for parseOrderChunk().
+ */
+static void *parseOrderChunkThread(void *arg) {
+    parseOrderChunk(arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Splits file data into newline-aligned chunks and parses them, one thread
+ * per chunk where threads are available.
+ *
+ * @param data       The file contents
+ * @param size       Number of bytes in data
+ * @param chunks     Array of at least chunkCount chunks to fill
+ * @param chunkCount Number of chunks to split the data into
+ */
+static void parseOrderChunks(const char *data, size_t size, LoadChunk *chunks, int chunkCount) {
+    const char *begin = data;
+    const char *end = data + size;
+    for (int i = 0; i < chunkCount; i++) {
+        memset(&chunks[i], 0, sizeof(chunks[i]));
+        const char *split = i == chunkCount - 1 ? end : data + size / (size_t)chunkCount * (size_t)(i + 1);
+        if (split < begin) {
+            split = begin;
+        }
+        if (split < end) {
+            const char *newline = memchr(split, '\n', (size_t)(end - split));
+            split = newline != NULL ? newline + 1 : end;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        chunks[i].errorLimit = LOAD_MAX_REPORTED_ERRORS;
+        begin = split;
+    }
+
+#ifdef ECOM_POSIX
+    pthread_t threads[WORKER_MAX_THREADS];
+    bool started[WORKER_MAX_THREADS] = { false };
+    for (int i = 1; i < chunkCount; i++) {
+        started[i] = pthread_create(&threads[i], NULL, parseOrderChunkThread, &chunks[i]) == 0;
+    }
+    parseOrderChunk(&chunks[0]);
+    for (int i = 1; i < chunkCount; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            parseOrderChunk(&chunks[i]);
+        }
+    }
+#else
+    for (int i = 0; i < chunkCount; i++) {
+        parseOrderChunk(&chunks[i]);
+    }
+#endif
+}
+
+/**
+ * Loads orders from file, mapping the snapshot written by the last
+ * checkpoint when it is still current and reading the data file
+ * otherwise, then replays the changes journaled since. The data file is
+ * the columnar file once one exists and the CSV file until then.
+ * 
+ * @return Number of orders loaded
+ */
+int loadFromFile(void) {
+    METRICS_START(started);
+    dataFile = isColumnarFile(COLUMNAR_FILE) ? COLUMNAR_FILE : DATA_FILE;
+    if (loadSnapshot(SNAPSHOT_FILE, dataFile) < 0) {
+        if (strcmp(dataFile, DATA_FILE) == 0) {
+            loadOrdersFromCsv(dataFile);
+        } else {
+            loadOrdersFromColumnar(dataFile);
+        }
+#ifndef ECOM_NO_SNAPSHOT
+        /* Write the missing snapshot at the first save */
+        journal.needsCheckpoint = true;
+#endif
+    }
+    journalReplay();
+    savedGeneration = changeGeneration;
+    METRICS_STOP(METRIC_LOAD, started);
+    return orderStoreCount(&orderStore);
+}
+
+/**
+ * Reads the journal sequence number recorded in a data file's header
+ * comments.
+ *
+ * @return The sequence number, or 0 if the file does not record one
+ */
+static uint64_t csvJournalSequence(const char *data, size_t size) {
+    const char *p = data;
+    const char *end = data + size;
+    size_t prefix = strlen(CSV_SEQUENCE_HEADER);
+    while (p < end && *p == '#') {
+        const char *lineEnd = memchr(p, '\n', (size_t)(end - p));
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        const char *textEnd = lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        uint64_t sequence;
+        if ((size_t)(textEnd - p) > prefix && memcmp(p, CSV_SEQUENCE_HEADER, prefix) == 0 &&
+            parseSequence(p + prefix, (size_t)(textEnd - p) - prefix, &sequence)) {
+            return sequence;
+        }
+        p = lineEnd + 1;
+    }
+    return 0;
+}
+
+/**
+ * Records that loading a data file dropped some of its orders, so the next
+ * checkpoint keeps the file rather than overwrite them (see
+ * journalCheckpoint()).
+ */
+static void markDataFileDamaged(const char *path) {
+    printf("[TIP] The next save keeps it as %s%s.\n", path, DAMAGED_SUFFIX);
+    journal.dataFileDamaged = true;
+}
+
+/**
+ * Loads orders from a CSV data file.
+ *
+ * The file is mapped into memory, split at line boundaries and parsed in
+ * parallel; the parsed records are then appended to the store in file
+ * order. Malformed lines are reported with their line numbers, and the
+ * next checkpoint keeps the file rather than drop them.
+ * 
+ * @param path The file to read
+ * @return Number of orders loaded
+ */
+int loadOrdersFromCsv(const char *path) {
+    MappedFile file;
+    if (!mappedFileOpen(path, &file, false)) {
+        return 0;
+    }
+    journal.checkpointSequence = csvJournalSequence(file.data, file.size);
+    journal.checkpointBytes = file.size;
+
+    LoadChunk chunks[WORKER_MAX_THREADS];
+    int chunkCount = workerThreadCount(file.size);
+    parseOrderChunks(file.data, file.size, chunks, chunkCount);
+
+    int loadedCount = 0;
+    int errorCount = 0;
+    int reported = 0;
+    long lineBase = 0;
+    bool outOfMemory = false;
+    for (int c = 0; c < chunkCount; c++) {
+        LoadChunk *chunk = &chunks[c];
+        int recorded = loadChunkRecordedErrors(chunk);
+        for (int e = 0; e < recorded && reported < LOAD_MAX_REPORTED_ERRORS; e++, reported++) {
+            printf("[WARN] %s:%ld: %s\n", path, lineBase + chunk->errors[e].line, chunk->errors[e].reason);
+        }
+        errorCount += chunk->errorCount;
+        outOfMemory = outOfMemory || chunk->outOfMemory;
+
+        for (int r = 0; r < chunk->rowCount && !outOfMemory; r++) {
+            const ParsedOrder *row = &chunk->rows[r];
+            Order order;
+            OrderNames names;
+            if (!parsedOrderToOrder(row, &order, &names)) {
+                if (reported++ < LOAD_MAX_REPORTED_ERRORS) {
+                    printf("[WARN] %s:%ld: too many distinct statuses\n", path, lineBase + row->line);
+                }
+                errorCount++;
+                continue;
+            }
+
+            if (orderStoreAppendUnindexed(&orderStore, &order) == -1) {
+                outOfMemory = true;
+                break;
+            }
+            loadedCount++;
+        }
+        lineBase += chunk->lineCount;
+        free(chunk->rows);
+        free(chunk->errors);
+    }
+    mappedFileClose(&file);
+
+    if (errorCount > reported) {
+        printf("[WARN] ... and %d more malformed line(s).\n", errorCount - reported);
+    }
+    if (errorCount > 0) {
+        printf("[WARN] Skipped %d malformed line(s) in %s.\n", errorCount, path);
+    }
+    if (outOfMemory) {
+        printf("[ERROR] Out of memory after loading %d order(s).\n", loadedCount);
+    }
+    
+    /* Index everything in one pass; duplicate IDs would be unreachable */
+    int duplicates = orderStoreReindex(&orderStore);
+    if (duplicates < 0) {
+        printf("[ERROR] Out of memory while indexing orders.\n");
+        orderStoreFree(&orderStore);
+        return 0;
+    }
+    if (duplicates > 0) {
+        printf("[WARN] Skipped %d order(s) with a duplicate Order ID.\n", duplicates);
+        loadedCount -= duplicates;
+    }
+    if (errorCount > 0 || duplicates > 0) {
+        markDataFileDamaged(path);
+    }
+    METRICS_COUNT(recordsParsed, loadedCount);
+    METRICS_COUNT(recordsSkipped, errorCount + duplicates);
+    return loadedCount;
+}
+
+/* =============================================================================
+ * ORDER STORE FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Returns whether a block of store memory lives inside the mapped snapshot
+ * rather than on the heap.
+ */
+static bool isSnapshotMemory(const void *block) {
+    const char *p = block;
+    return snapshotMemory.data != NULL && p >= snapshotMemory.data &&
+           p < snapshotMemory.data + snapshotMemory.size;
+}
+
+/**
+ * Frees a block of store memory unless it belongs to the mapped snapshot.
+ */
+static void releaseStoreMemory(void *block) {
+    if (!isSnapshotMemory(block)) {
+        free(block);
+    }
+}
+
+/**
+ * Reallocates a block of store memory. Blocks inside the mapped snapshot
+ * are copied to the heap on their first resize, so the store can grow out
+ * of a snapshot without ever freeing or moving mapped pages.
+ *
+ * @param block   The block to resize, or NULL
+ * @param oldSize Current size of the block in bytes
+ * @param newSize Requested size in bytes
+ * @return The resized block, or NULL if memory could not be allocated
+ */
+static void *resizeStoreMemory(void *block, size_t oldSize, size_t newSize) {
+    if (!isSnapshotMemory(block)) {
+        return realloc(block, newSize);
+    }
+    void *copy = malloc(newSize);
+    if (copy != NULL) {
+        memcpy(copy, block, oldSize < newSize ? oldSize : newSize);
+    }
+    return copy;
+}
+
+/**
+ * Returns the index of the lowest set bit of a non-zero word.
+ */
+static int lowestSetBit(uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int n = 0;
+    while ((bits & 1) == 0) {
+        bits >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Returns the index of the highest set bit of a non-zero word.
+ */
+static int highestSetBit(uint64_t bits) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(bits);
+#else
+    int n = 0;
+    while (bits >>= 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Returns the number of set bits in a word.
+ */
+static int countSetBits(uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(bits);
+#else
+    int n = 0;
+    for (; bits != 0; bits &= bits - 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Hashes a key to its home bucket: the key is multiplied by the 64-bit
+ * golden-ratio constant and the upper half of the product is masked to the
+ * capacity, which spreads sequential keys evenly across the table.
+ */
+static size_t intMapHome(const IntMap *map, int key) {
+    unsigned long long h = (unsigned long long)(unsigned int)key * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32) & (map->capacity - 1);
+}
+
+/**
+ * Returns the bucket holding a key, or the empty bucket where it would be
+ * inserted.
+ */
+static IntMapEntry *intMapProbe(const IntMap *map, int key) {
+    size_t mask = map->capacity - 1;
+    size_t i = intMapHome(map, key);
+    while (map->entries[i].value != -1 && map->entries[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    return &map->entries[i];
+}
+
+/**
+ * Resizes the map to a new power-of-two capacity and re-inserts every
+ * entry.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int intMapResize(IntMap *map, size_t capacity) {
+    IntMapEntry *entries = malloc(capacity * sizeof(*entries));
+    if (entries == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        entries[i].value = -1;
+    }
+
+    IntMap resized = { entries, capacity, map->size };
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->entries[i].value != -1) {
+            *intMapProbe(&resized, map->entries[i].key) = map->entries[i];
+        }
+    }
+
+    releaseStoreMemory(map->entries);
+    *map = resized;
+    return 1;
+}
+
+/**
+ * Ensures the map can hold the given number of entries without exceeding
+ * its 70% load factor.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int intMapReserve(IntMap *map, size_t entries) {
+    if (entries * 10 < map->capacity * 7) {
+        return 1;
+    }
+    size_t capacity = map->capacity == 0 ? INT_MAP_MIN_CAPACITY : map->capacity;
+    while (entries * 10 >= capacity * 7) {
+        capacity *= 2;
+    }
+    return intMapResize(map, capacity);
+}
+
+/**
+ * Looks up the value stored for a key.
+ *
+ * @return The value, or -1 if the key is not present
+ */
+static int intMapGet(const IntMap *map, int key) {
+    if (map->size == 0) {
+        return -1;
+    }
+    return intMapProbe(map, key)->value;
+}
+
+/**
+ * Maps a key to a value, replacing any existing mapping. The caller must
+ * have reserved room for the entry.
+ */
+static void intMapPut(IntMap *map, int key, int value) {
+    IntMapEntry *entry = intMapProbe(map, key);
+    if (entry->value == -1) {
+        entry->key = key;
+        map->size++;
+    }
+    entry->value = value;
+}
+
+/**
+ * Removes a key from the map. Later entries of the probe run are shifted
+ * back so lookups never need tombstones.
+ */
+static void intMapRemove(IntMap *map, int key) {
+    if (map->size == 0) {
+        return;
+    }
+    size_t mask = map->capacity - 1;
+    IntMapEntry *entry = intMapProbe(map, key);
+    if (entry->value == -1) {
+        return;
+    }
+
+    size_t hole = (size_t)(entry - map->entries);
+    size_t i = hole;
+    for (;;) {
+        i = (i + 1) & mask;
+        if (map->entries[i].value == -1) {
+            break;
+        }
+        /* Move the entry back only if its home bucket is not inside (hole, i] */
+        size_t home = intMapHome(map, map->entries[i].key);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            map->entries[hole] = map->entries[i];
+            hole = i;
+        }
+    }
+    map->entries[hole].value = -1;
+    map->size--;
+}
+
+/**
+ * Appends a slot to a list, growing it geometrically.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int slotListAppend(SlotList *list, int slot) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity == 0 ? 4 : list->capacity * 2;
+        int *slots = resizeStoreMemory(list->slots, (size_t)list->capacity * sizeof(*slots),
+                                       (size_t)capacity * sizeof(*slots));
+        if (slots == NULL) {
+            return 0;
+        }
+        list->slots = slots;
+        list->capacity = capacity;
+    }
+    list->slots[list->count++] = slot;
+    return 1;
+}
+
+/**
+ * Returns the position of the first element of a sorted list that is not
+ * less than slot, starting the search at a given position.
+ */
+static int slotListLowerBound(const SlotList *list, int from, int slot) {
+    int lo = from;
+    int hi = list->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (list->slots[mid] < slot) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Inserts a slot into a sorted list unless it is already present.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int slotListInsertSorted(SlotList *list, int slot) {
+    if (list->count == 0 || list->slots[list->count - 1] < slot) {
+        return slotListAppend(list, slot);
+    }
+    int pos = slotListLowerBound(list, 0, slot);
+    if (list->slots[pos] == slot) {
+        return 1;
+    }
+    if (!slotListAppend(list, slot)) {
+        return 0;
+    }
+    memmove(&list->slots[pos + 1], &list->slots[pos],
+            (size_t)(list->count - 1 - pos) * sizeof(int));
+    list->slots[pos] = slot;
+    return 1;
+}
+
+/**
+ * Extracts the distinct case-folded trigrams of a string.
+ *
+ * @param text  The string to split; only its first MAX_NAME_LENGTH - 1
+ *              characters are read
+ * @param codes Output array with room for MAX_NAME_LENGTH entries
+ * @return Number of distinct trigram codes written
+ */
+static int trigramCollect(const char *text, int *codes) {
+    int count = 0;
+    size_t length = 0;
+    while (length < MAX_NAME_LENGTH - 1 && text[length] != '\0') {
+        length++;
+    }
+    for (size_t i = 0; i + TRIGRAM_LENGTH <= length; i++) {
+        int code = (tolower((unsigned char)text[i]) << 16) |
+                   (tolower((unsigned char)text[i + 1]) << 8) |
+                   tolower((unsigned char)text[i + 2]);
+        int seen = 0;
+        for (int j = 0; j < count && !seen; j++) {
+            seen = codes[j] == code;
+        }
+        if (!seen) {
+            codes[count++] = code;
+        }
+    }
+    return count;
+}
+
+/**
+ * Adds a slot to the posting list of every trigram in a name.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int trigramIndexAdd(TrigramIndex *trigrams, int slot, const char *name) {
+    int codes[MAX_NAME_LENGTH];
+    int count = trigramCollect(name, codes);
+
+    for (int i = 0; i < count; i++) {
+        int list = intMapGet(&trigrams->lists, codes[i]);
+        if (list == -1) {
+            if (trigrams->listCount == trigrams->listCapacity) {
+                int capacity = trigrams->listCapacity == 0 ? 256 : trigrams->listCapacity * 2;
+                SlotList *postings = resizeStoreMemory(trigrams->postings,
+                                                       (size_t)trigrams->listCapacity * sizeof(*postings),
+                                                       (size_t)capacity * sizeof(*postings));
+                if (postings == NULL) {
+                    return 0;
+                }
+                trigrams->postings = postings;
+                trigrams->listCapacity = capacity;
+            }
+            if (!intMapReserve(&trigrams->lists, trigrams->lists.size + 1)) {
+                return 0;
+            }
+            list = trigrams->listCount++;
+            memset(&trigrams->postings[list], 0, sizeof(SlotList));
+            intMapPut(&trigrams->lists, codes[i], list);
+        }
+
+        int before = trigrams->postings[list].count;
+        if (!slotListInsertSorted(&trigrams->postings[list], slot)) {
+            return 0;
+        }
+        trigrams->postingCount += trigrams->postings[list].count - before;
+    }
+    return 1;
+}
+
+/**
+ * Releases every posting list, leaving an empty index whose lookup table
+ * and list directory can be reused.
+ */
+static void trigramIndexClear(TrigramIndex *trigrams) {
+    for (int i = 0; i < trigrams->listCount; i++) {
+        releaseStoreMemory(trigrams->postings[i].slots);
+    }
+    for (size_t i = 0; i < trigrams->lists.capacity; i++) {
+        trigrams->lists.entries[i].value = -1;
+    }
+    trigrams->lists.size = 0;
+    trigrams->listCount = 0;
+    trigrams->postingCount = 0;
+    trigrams->staleCount = 0;
+}
+
+/**
+ * Hashes a name eight bytes at a time. Byte-at-a-time hashes such as
+ * FNV-1a spend a dependent multiply on every character, which dominates
+ * interning millions of names during a load.
+ */
+static uint64_t stringHash(const char *text, size_t length) {
+    uint64_t hash = 0xCBF29CE484222325ULL ^ length;
+    for (; length >= 8; text += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, text, 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 32;
+    }
+    if (length > 0) {
+        uint64_t word = 0;
+        memcpy(&word, text, length);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    }
+    /* Final avalanche so the low bits used for buckets depend on every byte */
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * Returns the text behind a string heap reference.
+ */
+static inline const char *stringHeapGet(const StringHeap *heap, uint32_t ref) {
+    return heap->chunks[ref >> STRING_CHUNK_SHIFT] + (ref & (STRING_CHUNK_SIZE - 1));
+}
+
+/**
+ * Returns the header in front of a string heap reference.
+ */
+static inline StringHeader *stringHeapHeader(const StringHeap *heap, uint32_t ref) {
+    return (StringHeader *)(heap->chunks[ref >> STRING_CHUNK_SHIFT] + (ref & (STRING_CHUNK_SIZE - 1))) - 1;
+}
+
+/**
+ * Returns the bytes a string of the given length takes up in the heap:
+ * its header, the text and its NUL, rounded up so headers stay aligned.
+ */
+static size_t stringHeapFootprint(size_t length) {
+    return (sizeof(StringHeader) + length + 1 + 3) & ~(size_t)3;
+}
+
+/**
+ * Doubles the lookup table, moving every entry by its stored hash.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int stringHeapGrowTable(StringHeap *heap) {
+    size_t capacity = heap->tableCapacity == 0 ? STRING_TABLE_MIN_CAPACITY : heap->tableCapacity * 2;
+    StringEntry *table = malloc(capacity * sizeof(*table));
+    if (table == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        table[i].ref = STRING_REF_NONE;
+    }
+    for (size_t i = 0; i < heap->tableCapacity; i++) {
+        if (heap->table[i].ref != STRING_REF_NONE) {
+            size_t b = heap->table[i].hash & (capacity - 1);
+            while (table[b].ref != STRING_REF_NONE) {
+                b = (b + 1) & (capacity - 1);
+            }
+            table[b] = heap->table[i];
+        }
+    }
+    releaseStoreMemory(heap->table);
+    heap->table = table;
+    heap->tableCapacity = capacity;
+    return 1;
+}
+
+/**
+ * Copies a string of known length into the arena with a header counting
+ * no uses yet.
+ *
+ * @return Reference to the copy, or STRING_REF_NONE if memory could not be
+ *         allocated
+ */
+static uint32_t stringHeapAppend(StringHeap *heap, const char *text, size_t length) {
+    size_t size = stringHeapFootprint(length);
+    if (heap->chunkCount == 0 || heap->used + size > STRING_CHUNK_SIZE) {
+        if (heap->chunkCount == STRING_MAX_CHUNKS) {
+            return STRING_REF_NONE;
+        }
+        if (heap->chunkCount == heap->chunkCapacity) {
+            int capacity = heap->chunkCapacity == 0 ? 4 : heap->chunkCapacity * 2;
+            char **chunks = resizeStoreMemory(heap->chunks, (size_t)heap->chunkCapacity * sizeof(*chunks),
+                                              (size_t)capacity * sizeof(*chunks));
+            if (chunks == NULL) {
+                return STRING_REF_NONE;
+            }
+            heap->chunks = chunks;
+            heap->chunkCapacity = capacity;
+        }
+        char *chunk = malloc(STRING_CHUNK_SIZE);
+        if (chunk == NULL) {
+            return STRING_REF_NONE;
+        }
+        heap->chunks[heap->chunkCount++] = chunk;
+        heap->used = 0;
+    }
+
+    char *at = heap->chunks[heap->chunkCount - 1] + heap->used;
+    StringHeader header = { 0, (uint32_t)length };
+    memcpy(at, &header, sizeof(header));
+    memcpy(at + sizeof(header), text, length);
+    at[sizeof(header) + length] = '\0';
+    uint32_t ref = ((uint32_t)(heap->chunkCount - 1) << STRING_CHUNK_SHIFT) | (heap->used + (uint32_t)sizeof(header));
+    heap->used += (uint32_t)size;
+    heap->totalBytes += size;
+    return ref;
+}
+
+/**
+ * Adds a use of a string, storing it first if the heap does not hold it
+ * yet. Growth happens before the probe, so the table is never more than
+ * half full.
+ *
+ * @param heap   The heap to intern into
+ * @param text   The string, which need not be NUL-terminated
+ * @param length Number of characters in text
+ * @return Reference to the interned string, or STRING_REF_NONE if memory
+ *         could not be allocated
+ */
+static uint32_t stringHeapIntern(StringHeap *heap, const char *text, size_t length) {
+    if ((heap->tableSize + 1) * 2 > heap->tableCapacity && !stringHeapGrowTable(heap)) {
+        return STRING_REF_NONE;
+    }
+    uint64_t wide = stringHash(text, length);
+    uint32_t hash = (uint32_t)(wide ^ (wide >> 32));
+    size_t mask = heap->tableCapacity - 1;
+    size_t b = hash & mask;
+    for (; heap->table[b].ref != STRING_REF_NONE; b = (b + 1) & mask) {
+        uint32_t ref = heap->table[b].ref;
+        if (heap->table[b].hash != hash) {
+            continue;
+        }
+        StringHeader *header = stringHeapHeader(heap, ref);
+        if (header->length == length && memcmp(stringHeapGet(heap, ref), text, length) == 0) {
+            if (header->uses++ == 0) {
+                heap->garbageBytes -= stringHeapFootprint(length);
+            }
+            return ref;
+        }
+    }
+
+    uint32_t ref = stringHeapAppend(heap, text, length);
+    if (ref == STRING_REF_NONE) {
+        return STRING_REF_NONE;
+    }
+    stringHeapHeader(heap, ref)->uses = 1;
+    heap->table[b].hash = hash;
+    heap->table[b].ref = ref;
+    heap->tableSize++;
+    return ref;
+}
+
+/**
+ * Adds a use of a string that is already interned.
+ */
+static void stringHeapRetain(StringHeap *heap, uint32_t ref) {
+    StringHeader *header = stringHeapHeader(heap, ref);
+    if (header->uses++ == 0) {
+        heap->garbageBytes -= stringHeapFootprint(header->length);
+    }
+}
+
+/**
+ * Drops a use of a string. A string no order uses any more becomes
+ * garbage, but stays interned until the heap is compacted, so a later use
+ * of the same name revives it.
+ */
+static void stringHeapRelease(StringHeap *heap, uint32_t ref) {
+    StringHeader *header = stringHeapHeader(heap, ref);
+    if (--header->uses == 0) {
+        heap->garbageBytes += stringHeapFootprint(header->length);
+    }
+}
+
+/**
+ * Releases every chunk of the heap and its lookup table.
+ */
+static void stringHeapFree(StringHeap *heap) {
+    for (int i = 0; i < heap->chunkCount; i++) {
+        releaseStoreMemory(heap->chunks[i]);
+    }
+    releaseStoreMemory(heap->chunks);
+    releaseStoreMemory(heap->table);
+    memset(heap, 0, sizeof(*heap));
+}
+
+/**
+ * Returns the slab holding a slot.
+ */
+static inline OrderSlab *orderStoreSlab(const OrderStore *store, int slot) {
+    return store->slabs[slot >> ORDER_SLAB_SHIFT];
+}
+
+/**
+ * Returns the total value of an order.
+ */
+Money orderValue(const Order *order) {
+    return order->price * order->quantity;
+}
+
+/**
+ * Returns whether key (value, slot) comes before key (otherValue, otherSlot)
+ * in the value index: higher values first, ties to the lower slot.
+ */
+static inline bool valueKeyBefore(Money value, int slot, Money otherValue, int otherSlot) {
+    return value > otherValue || (value == otherValue && slot < otherSlot);
+}
+
+/**
+ * Binary searches the keys of a value index node.
+ *
+ * @param node  The node to search
+ * @param value Value of the key to place
+ * @param slot  Slot of the key to place
+ * @param upper Whether keys equal to (value, slot) count as before it
+ * @return Number of keys before (value, slot); for an internal node with
+ *         upper set, the child the key belongs under
+ */
+static int valueNodeSearch(const ValueNode *node, Money value, int slot, bool upper) {
+    int low = 0;
+    int high = node->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        bool before = upper ? !valueKeyBefore(value, slot, node->values[mid], node->slots[mid])
+                            : valueKeyBefore(node->values[mid], node->slots[mid], value, slot);
+        if (before) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Inserts a key into a node with room for it. For an internal node, child
+ * is placed just after the key.
+ */
+static void valueNodeInsert(ValueNode *node, int position, Money value, int slot, int child) {
+    int moved = node->count - position;
+    memmove(&node->values[position + 1], &node->values[position], (size_t)moved * sizeof(node->values[0]));
+    memmove(&node->slots[position + 1], &node->slots[position], (size_t)moved * sizeof(node->slots[0]));
+    node->values[position] = value;
+    node->slots[position] = slot;
+    if (!node->leaf) {
+        memmove(&node->children[position + 2], &node->children[position + 1],
+                (size_t)moved * sizeof(node->children[0]));
+        node->children[position + 1] = child;
+    }
+    node->count++;
+}
+
+/**
+ * Removes a key from a leaf, or a child and the separator beside it from an
+ * internal node with more than one child.
+ */
+static void valueNodeRemove(ValueNode *node, int position) {
+    int key = position;
+    if (!node->leaf) {
+        /* The first child takes the range of the second */
+        key = position == 0 ? 0 : position - 1;
+        memmove(&node->children[position], &node->children[position + 1],
+                (size_t)(node->count - position) * sizeof(node->children[0]));
+    }
+    int moved = node->count - key - 1;
+    memmove(&node->values[key], &node->values[key + 1], (size_t)moved * sizeof(node->values[0]));
+    memmove(&node->slots[key], &node->slots[key + 1], (size_t)moved * sizeof(node->slots[0]));
+    node->count--;
+}
+
+/**
+ * Empties a tree, keeping its node pool for reuse.
+ */
+static void valueTreeReset(ValueTree *tree) {
+    tree->nodeCount = 0;
+    tree->freeList = -1;
+    tree->root = -1;
+    tree->height = 0;
+    tree->size = 0;
+}
+
+/**
+ * Grows the node pool so that a further count nodes can be handed out
+ * without moving it.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int valueTreeReserve(ValueTree *tree, int count) {
+    if (tree->nodeCount + count <= tree->nodeCapacity) {
+        return 1;
+    }
+    int capacity = tree->nodeCapacity == 0 ? 64 : tree->nodeCapacity;
+    while (capacity < tree->nodeCount + count) {
+        capacity *= 2;
+    }
+    ValueNode *nodes = resizeStoreMemory(tree->nodes, (size_t)tree->nodeCount * sizeof(*nodes),
+                                         (size_t)capacity * sizeof(*nodes));
+    if (nodes == NULL) {
+        return 0;
+    }
+    tree->nodes = nodes;
+    tree->nodeCapacity = capacity;
+    return 1;
+}
+
+/**
+ * Hands out a cleared node, reusing a freed one when there is one. Room
+ * must have been reserved.
+ */
+static int valueTreeAllocate(ValueTree *tree, bool leaf) {
+    int node = tree->freeList;
+    if (node != -1) {
+        tree->freeList = tree->nodes[node].next;
+    } else {
+        node = tree->nodeCount++;
+    }
+    /* Cleared so snapshots never contain stale bytes */
+    memset(&tree->nodes[node], 0, sizeof(tree->nodes[node]));
+    tree->nodes[node].leaf = leaf;
+    tree->nodes[node].next = -1;
+    tree->nodes[node].prev = -1;
+    return node;
+}
+
+/**
+ * Returns a node to the free list.
+ */
+static void valueTreeRelease(ValueTree *tree, int node) {
+    tree->nodes[node].next = tree->freeList;
+    tree->freeList = node;
+}
+
+/**
+ * Adds a key to the tree, splitting full nodes on the way back up. Room for
+ * height + 1 nodes must have been reserved.
+ */
+static void valueTreeInsert(ValueTree *tree, Money value, int slot) {
+    if (tree->root == -1) {
+        tree->root = valueTreeAllocate(tree, true);
+        tree->height = 1;
+    }
+    int path[VALUE_MAX_HEIGHT];
+    int branch[VALUE_MAX_HEIGHT];
+    int node = tree->root;
+    for (int level = 0; level < tree->height - 1; level++) {
+        path[level] = node;
+        branch[level] = valueNodeSearch(&tree->nodes[node], value, slot, true);
+        node = tree->nodes[node].children[branch[level]];
+    }
+    tree->size++;
+
+    ValueNode *leaf = &tree->nodes[node];
+    int position = valueNodeSearch(leaf, value, slot, false);
+    if (leaf->count < VALUE_NODE_KEYS) {
+        valueNodeInsert(leaf, position, value, slot, -1);
+        return;
+    }
+    int right = valueTreeAllocate(tree, true);
+    ValueNode *sibling = &tree->nodes[right];
+    int half = VALUE_NODE_KEYS / 2;
+    sibling->count = VALUE_NODE_KEYS - half;
+    memcpy(sibling->values, &leaf->values[half], (size_t)sibling->count * sizeof(leaf->values[0]));
+    memcpy(sibling->slots, &leaf->slots[half], (size_t)sibling->count * sizeof(leaf->slots[0]));
+    leaf->count = half;
+    sibling->prev = node;
+    sibling->next = leaf->next;
+    if (leaf->next != -1) {
+        tree->nodes[leaf->next].prev = right;
+    }
+    leaf->next = right;
+    if (position > half) {
+        valueNodeInsert(sibling, position - half, value, slot, -1);
+    } else {
+        valueNodeInsert(leaf, position, value, slot, -1);
+    }
+
+    /* Push the first key of each new right half into the level above */
+    Money separatorValue = sibling->values[0];
+    int separatorSlot = sibling->slots[0];
+    for (int level = tree->height - 2; level >= 0; level--) {
+        ValueNode *parent = &tree->nodes[path[level]];
+        position = branch[level];
+        if (parent->count < VALUE_NODE_KEYS) {
+            valueNodeInsert(parent, position, separatorValue, separatorSlot, right);
+            return;
+        }
+        int split = valueTreeAllocate(tree, false);
+        sibling = &tree->nodes[split];
+        int middle = VALUE_NODE_KEYS / 2;
+        Money promotedValue = parent->values[middle];
+        int promotedSlot = parent->slots[middle];
+        sibling->count = VALUE_NODE_KEYS - middle - 1;
+        memcpy(sibling->values, &parent->values[middle + 1], (size_t)sibling->count * sizeof(parent->values[0]));
+        memcpy(sibling->slots, &parent->slots[middle + 1], (size_t)sibling->count * sizeof(parent->slots[0]));
+        memcpy(sibling->children, &parent->children[middle + 1],
+               (size_t)(sibling->count + 1) * sizeof(parent->children[0]));
+        parent->count = middle;
+        if (position <= middle) {
+            valueNodeInsert(parent, position, separatorValue, separatorSlot, right);
+        } else {
+            valueNodeInsert(sibling, position - middle - 1, separatorValue, separatorSlot, right);
+        }
+        separatorValue = promotedValue;
+        separatorSlot = promotedSlot;
+        right = split;
+    }
+
+    int root = valueTreeAllocate(tree, false);
+    ValueNode *top = &tree->nodes[root];
+    top->count = 1;
+    top->values[0] = separatorValue;
+    top->slots[0] = separatorSlot;
+    top->children[0] = tree->root;
+    top->children[1] = right;
+    tree->root = root;
+    tree->height++;
+}
+
+/**
+ * Removes a key from the tree if present. A leaf left empty is unlinked and
+ * freed, as is any parent left without children.
+ */
+static void valueTreeRemove(ValueTree *tree, Money value, int slot) {
+    if (tree->root == -1) {
+        return;
+    }
+    int path[VALUE_MAX_HEIGHT];
+    int branch[VALUE_MAX_HEIGHT];
+    int node = tree->root;
+    for (int level = 0; level < tree->height - 1; level++) {
+        path[level] = node;
+        branch[level] = valueNodeSearch(&tree->nodes[node], value, slot, true);
+        node = tree->nodes[node].children[branch[level]];
+    }
+    ValueNode *leaf = &tree->nodes[node];
+    int position = valueNodeSearch(leaf, value, slot, false);
+    if (position == leaf->count || leaf->values[position] != value || leaf->slots[position] != slot) {
+        return;
+    }
+    valueNodeRemove(leaf, position);
+    tree->size--;
+    if (leaf->count > 0) {
+        return;
+    }
+
+    if (leaf->prev != -1) {
+        tree->nodes[leaf->prev].next = leaf->next;
+    }
+    if (leaf->next != -1) {
+        tree->nodes[leaf->next].prev = leaf->prev;
+    }
+    valueTreeRelease(tree, node);
+    int level = tree->height - 2;
+    while (level >= 0 && tree->nodes[path[level]].count == 0) {
+        /* An internal node losing its only child goes too */
+        valueTreeRelease(tree, path[level]);
+        level--;
+    }
+    if (level < 0) {
+        valueTreeReset(tree);
+        return;
+    }
+    valueNodeRemove(&tree->nodes[path[level]], branch[level]);
+    while (tree->height > 1 && tree->nodes[tree->root].count == 0) {
+        int root = tree->root;
+        tree->root = tree->nodes[root].children[0];
+        valueTreeRelease(tree, root);
+        tree->height--;
+    }
+}
+
+/**
+ * Finds the first key of the tree whose value is at most maxValue.
+ *
+ * @param tree     The tree to search
+ * @param maxValue Highest value wanted
+ * @param leaf     Receives the leaf holding the key
+ * @return Position of the key in *leaf, or -1 if every value is higher
+ */
+static int valueTreeSeek(const ValueTree *tree, Money maxValue, int *leaf) {
+    if (tree->root == -1) {
+        return -1;
+    }
+    int node = tree->root;
+    for (int level = 0; level < tree->height - 1; level++) {
+        node = tree->nodes[node].children[valueNodeSearch(&tree->nodes[node], maxValue, INT_MIN, true)];
+    }
+    int position = valueNodeSearch(&tree->nodes[node], maxValue, INT_MIN, false);
+    if (position == tree->nodes[node].count) {
+        /* Separators can outlive their keys; the next leaf starts in range */
+        node = tree->nodes[node].next;
+        position = 0;
+    }
+    *leaf = node;
+    return node == -1 ? -1 : position;
+}
+
+/**
+ * Sorts value entries from the highest value down with a stable LSD radix
+ * sort, so entries passed in slot order come out in index order.
+ *
+ * @param entries The entries to sort
+ * @param scratch Room for count entries
+ * @param count   Number of entries
+ * @return Whichever of entries and scratch holds the sorted entries
+ */
+static ValueEntry *sortValueEntries(ValueEntry *entries, ValueEntry *scratch, size_t count) {
+    uint32_t histogram[LIST_RADIX_PASSES][1 << LIST_RADIX_BITS];
+    memset(histogram, 0, sizeof(histogram));
+    for (size_t i = 0; i < count; i++) {
+        /* Inverted so that higher values sort first */
+        uint64_t key = ~((uint64_t)entries[i].value ^ (1ULL << 63));
+        for (int pass = 0; pass < LIST_RADIX_PASSES; pass++) {
+            histogram[pass][(key >> (pass * LIST_RADIX_BITS)) & LIST_RADIX_MASK]++;
+        }
+    }
+
+    for (int pass = 0; pass < LIST_RADIX_PASSES; pass++) {
+        int shift = pass * LIST_RADIX_BITS;
+        uint32_t *offsets = histogram[pass];
+        uint64_t first = ~((uint64_t)entries[0].value ^ (1ULL << 63));
+        if (offsets[(first >> shift) & LIST_RADIX_MASK] == count) {
+            continue;
+        }
+        uint32_t total = 0;
+        for (int digit = 0; digit <= LIST_RADIX_MASK; digit++) {
+            uint32_t bucket = offsets[digit];
+            offsets[digit] = total;
+            total += bucket;
+        }
+        for (size_t i = 0; i < count; i++) {
+            uint64_t key = ~((uint64_t)entries[i].value ^ (1ULL << 63));
+            scratch[offsets[(key >> shift) & LIST_RADIX_MASK]++] = entries[i];
+        }
+        ValueEntry *swap = entries;
+        entries = scratch;
+        scratch = swap;
+    }
+    return entries;
+}
+
+/**
+ * Returns the leftmost leaf under a node.
+ */
+static int valueTreeFirstLeaf(const ValueTree *tree, int node) {
+    while (!tree->nodes[node].leaf) {
+        node = tree->nodes[node].children[0];
+    }
+    return node;
+}
+
+/**
+ * Replaces the contents of a tree with entries already in index order,
+ * bottom up in O(n). Nodes are filled to VALUE_BULK_KEYS so that the
+ * inserts that follow a rebuild do not split straight away.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int valueTreeBuild(ValueTree *tree, const ValueEntry *entries, int count) {
+    valueTreeReset(tree);
+    if (count == 0) {
+        return 1;
+    }
+    int leaves = (count + VALUE_BULK_KEYS - 1) / VALUE_BULK_KEYS;
+    int total = leaves;
+    for (int width = leaves; width > 1; total += width) {
+        width = (width + VALUE_BULK_KEYS) / (VALUE_BULK_KEYS + 1);
+    }
+    if (!valueTreeReserve(tree, total)) {
+        return 0;
+    }
+
+    for (int i = 0; i < leaves; i++) {
+        int node = valueTreeAllocate(tree, true);
+        ValueNode *leaf = &tree->nodes[node];
+        int first = i * VALUE_BULK_KEYS;
+        leaf->count = count - first < VALUE_BULK_KEYS ? count - first : VALUE_BULK_KEYS;
+        for (int k = 0; k < leaf->count; k++) {
+            leaf->values[k] = entries[first + k].value;
+            leaf->slots[k] = entries[first + k].slot;
+        }
+        leaf->prev = i - 1;
+        leaf->next = i + 1 < leaves ? i + 1 : -1;
+    }
+
+    /* Each level is a run of consecutive nodes over the run below it */
+    int begin = 0;
+    int end = leaves;
+    tree->height = 1;
+    while (end - begin > 1) {
+        int levelBegin = tree->nodeCount;
+        for (int child = begin; child < end; child += VALUE_BULK_KEYS + 1) {
+            int node = valueTreeAllocate(tree, false);
+            ValueNode *parent = &tree->nodes[node];
+            int children = end - child < VALUE_BULK_KEYS + 1 ? end - child : VALUE_BULK_KEYS + 1;
+            parent->count = children - 1;
+            parent->children[0] = child;
+            for (int k = 1; k < children; k++) {
+                const ValueNode *first = &tree->nodes[valueTreeFirstLeaf(tree, child + k)];
+                parent->values[k - 1] = first->values[0];
+                parent->slots[k - 1] = first->slots[0];
+                parent->children[k] = child + k;
+            }
+        }
+        begin = levelBegin;
+        end = tree->nodeCount;
+        tree->height++;
+    }
+    tree->root = begin;
+    tree->size = count;
+    return 1;
+}
+
+/**
+ * Adds the order at a slot to the running aggregates.
+ */
+static void aggregatesAdd(OrderStore *store, int slot) {
+    const OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    Money value = slab->prices[i] * slab->quantities[i];
+    store->stats.revenue += value;
+    store->stats.statusCounts[statusCategory(slab->statusIds[i])]++;
+    valueTreeInsert(&store->stats.top, value, slot);
+}
+
+/**
+ * Removes the order at a slot from the running aggregates.
+ */
+static void aggregatesRemove(OrderStore *store, int slot) {
+    const OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    Money value = slab->prices[i] * slab->quantities[i];
+    store->stats.revenue -= value;
+    store->stats.statusCounts[statusCategory(slab->statusIds[i])]--;
+    valueTreeRemove(&store->stats.top, value, slot);
+}
+
+/**
+ * Column totals gathered by a streaming pass over the store.
+ */
+typedef struct {
+    MoneyTotal revenue;
+    int        statusCounts[STATUS_CATEGORY_COUNT];
+    Money      topValue;
+    int        topSlot;
+} ColumnScan;
+
+/**
+ * A run of slabs scanned by one thread. Each thread keeps its own totals,
+ * which are merged in slab order afterwards.
+ */
+typedef struct {
+    const OrderStore *store;
+    int     firstSlab;
+    int     endSlab;        /* One past the last slab                 */
+    ValueEntry *values; /* Where this run's values go, or NULL    */
+    ColumnScan scan;
+    int     emitted;        /* Values written                         */
+} ColumnScanChunk;
+
+/**
+ * Streams the price, quantity and status columns of a run of slabs,
+ * reading live slots a 64-slot bitmap word at a time. Order values are
+ * computed and summed in 64-bit integer lanes with no per-slot branching;
+ * each word's subtotal cannot overflow (see Money) and is folded into the
+ * wide revenue total once. When chunk->values is not NULL, each live
+ * order's value is also written there in slot order.
+ */
+static void scanColumnChunk(ColumnScanChunk *chunk) {
+    const OrderStore *store = chunk->store;
+    const uint8_t *categories = statusDictionary.categories;
+    ColumnScan *scan = &chunk->scan;
+    ValueEntry *values = chunk->values;
+    memset(scan, 0, sizeof(*scan));
+    scan->topValue = INT64_MIN;
+    scan->topSlot = -1;
+    int emitted = 0;
+
+    for (int s = chunk->firstSlab; s < chunk->endSlab; s++) {
+        const OrderSlab *slab = store->slabs[s];
+        int base = s << ORDER_SLAB_SHIFT;
+        int limit = store->count - base < ORDER_SLAB_SIZE ? store->count - base : ORDER_SLAB_SIZE;
+
+        for (int w = 0; w * 64 < limit; w++) {
+            uint64_t bits = slab->liveMask[w];
+            if (bits == 0) {
+                continue;
+            }
+            int start = w * 64;
+            int end = start + 64 < limit ? start + 64 : limit;
+            Money block[64];
+            Money partial[4] = { 0, 0, 0, 0 };
+
+            for (int i = start; i < end; i++) {
+                block[i - start] = slab->prices[i] * slab->quantities[i];
+            }
+            if (bits != ~0ULL) {
+                for (int i = start; i < end; i++) {
+                    /* All ones for a live slot, zero for a dead one */
+                    block[i - start] &= -(Money)((bits >> (i - start)) & 1);
+                }
+            }
+            for (int i = 0; i < end - start; i++) {
+                partial[i & 3] += block[i];
+            }
+            scan->revenue += (partial[0] + partial[1]) + (partial[2] + partial[3]);
+
+            for (uint64_t live = bits; live != 0; live &= live - 1) {
+                int i = start + lowestSetBit(live);
+                if (i >= end) {
+                    break;
+                }
+                Money value = block[i - start];
+                scan->statusCounts[categories[slab->statusIds[i]]]++;
+                if (value > scan->topValue) {
+                    scan->topValue = value;
+                    scan->topSlot = base + i;
+                }
+                if (values != NULL) {
+                    ValueEntry entry = { value, base + i };
+                    values[emitted++] = entry;
+                }
+            }
+        }
+    }
+    chunk->emitted = emitted;
+}
+
+#ifdef ECOM_POSIX
+/**
+ * Thread entry point for scanColumnChunk().
+ */
+static void *scanColumnChunkThread(void *arg) {
+    scanColumnChunk(arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Counts the live orders in a run of slabs.
+ */
+static int orderStoreLiveInSlabs(const OrderStore *store, int firstSlab, int endSlab) {
+    int live = 0;
+    for (int s = firstSlab; s < endSlab; s++) {
+        const OrderSlab *slab = store->slabs[s];
+        int limit = store->count - (s << ORDER_SLAB_SHIFT);
+        for (int w = 0; w * 64 < limit && w < ORDER_SLAB_WORDS; w++) {
+            uint64_t bits = slab->liveMask[w];
+            if (limit - w * 64 < 64) {
+                bits &= (1ULL << (limit - w * 64)) - 1;
+            }
+            live += countSetBits(bits);
+        }
+    }
+    return live;
+}
+
+/**
+ * Computes revenue, status counts and the top order over every live order
+ * of a store. Large stores are split into runs of slabs scanned by
+ * separate threads (see workerThreadCount()); small ones are scanned on
+ * the calling thread. The per-thread totals are merged in slab order, and
+ * ties for the top order go to the lowest slot, so the result is the same
+ * whatever the thread count. When values is not NULL, each live order's
+ * value is also written to values[] in slot order so callers can reuse it
+ * without a second pass.
+ */
+static void orderStoreScanColumns(const OrderStore *store, ColumnScan *scan, ValueEntry *values, int *valueCount) {
+    ColumnScanChunk chunks[WORKER_MAX_THREADS];
+    int threads = workerThreadCount((size_t)store->count * SCAN_BYTES_PER_ORDER);
+    int slabsPerChunk = (store->slabCount + threads - 1) / threads;
+    int chunkCount = 0;
+    int emitted = 0;
+    for (int s = 0; s < store->slabCount; s += slabsPerChunk) {
+        ColumnScanChunk *chunk = &chunks[chunkCount++];
+        chunk->store = store;
+        chunk->firstSlab = s;
+        chunk->endSlab = store->slabCount - s > slabsPerChunk ? s + slabsPerChunk : store->slabCount;
+        chunk->values = NULL;
+        if (values != NULL) {
+            /* Each run writes where the live orders before it end */
+            chunk->values = values + emitted;
+            if (chunk->endSlab < store->slabCount) {
+                emitted += orderStoreLiveInSlabs(store, chunk->firstSlab, chunk->endSlab);
+            }
+        }
+    }
+
+#ifdef ECOM_POSIX
+    pthread_t workers[WORKER_MAX_THREADS];
+    bool started[WORKER_MAX_THREADS] = { false };
+    for (int i = 1; i < chunkCount; i++) {
+        started[i] = pthread_create(&workers[i], NULL, scanColumnChunkThread, &chunks[i]) == 0;
+    }
+#endif
+    if (chunkCount > 0) {
+        scanColumnChunk(&chunks[0]);
+    }
+    for (int i = 1; i < chunkCount; i++) {
+#ifdef ECOM_POSIX
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+            continue;
+        }
+#endif
+        scanColumnChunk(&chunks[i]);
+    }
+
+    memset(scan, 0, sizeof(*scan));
+    scan->topValue = INT64_MIN;
+    scan->topSlot = -1;
+    emitted = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        const ColumnScan *partial = &chunks[i].scan;
+        scan->revenue += partial->revenue;
+        for (size_t c = 0; c < STATUS_CATEGORY_COUNT; c++) {
+            scan->statusCounts[c] += partial->statusCounts[c];
+        }
+        if (partial->topValue > scan->topValue) {
+            scan->topValue = partial->topValue;
+            scan->topSlot = partial->topSlot;
+        }
+        emitted += chunks[i].emitted;
+    }
+    if (valueCount != NULL) {
+        *valueCount = emitted;
+    }
+}
+
+/**
+ * Recomputes the aggregates from the live orders of a store, rebuilding the
+ * value index from one sorted pass in O(n).
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int aggregatesRebuild(OrderStore *store) {
+    OrderAggregates *stats = &store->stats;
+    ValueEntry *entries = malloc(2 * (size_t)(store->liveCount > 0 ? store->liveCount : 1) * sizeof(*entries));
+    if (entries == NULL) {
+        return 0;
+    }
+
+    ColumnScan scan;
+    int count = 0;
+    orderStoreScanColumns(store, &scan, entries, &count);
+    stats->revenue = scan.revenue;
+    memcpy(stats->statusCounts, scan.statusCounts, sizeof(stats->statusCounts));
+    const ValueEntry *sorted = count > 0 ? sortValueEntries(entries, entries + count, (size_t)count) : entries;
+    int built = valueTreeBuild(&stats->top, sorted, count);
+    free(entries);
+    return built;
+}
+
+#ifdef ECOM_VERIFY_AGGREGATES
+/**
+ * Debug check: recomputes the aggregates with a full rescan and reports any
+ * drift from the incrementally maintained values. Enabled by compiling with
+ * -DECOM_VERIFY_AGGREGATES.
+ */
+static void aggregatesVerify(const OrderStore *store) {
+    ColumnScan scan;
+    orderStoreScanColumns(store, &scan, NULL, NULL);
+    MoneyTotal revenue = scan.revenue;
+    const int *statusCounts = scan.statusCounts;
+    int topSlot = scan.topSlot;
+
+    const OrderAggregates *stats = &store->stats;
+    if (revenue != stats->revenue) {
+        char running[MONEY_TEXT_LENGTH];
+        char rescan[MONEY_TEXT_LENGTH];
+        printf("[DEBUG] Revenue drift: running %s, rescan %s\n",
+               formatMoney(stats->revenue, running, sizeof(running)),
+               formatMoney(revenue, rescan, sizeof(rescan)));
+    }
+    if (memcmp(statusCounts, stats->statusCounts, sizeof(stats->statusCounts)) != 0) {
+        printf("[DEBUG] Status counts differ from rescan.\n");
+    }
+    if (orderStoreTopSlot(store) != topSlot) {
+        printf("[DEBUG] Top order slot %d differs from rescan slot %d.\n",
+               orderStoreTopSlot(store), topSlot);
+    }
+    if (stats->top.size != store->liveCount) {
+        printf("[DEBUG] Value index holds %d order(s), store has %d.\n", stats->top.size, store->liveCount);
+    }
+}
+#define AGGREGATES_VERIFY(store) aggregatesVerify(store)
+#else
+#define AGGREGATES_VERIFY(store) ((void)0)
+#endif
+
+/**
+ * Initialises an empty order store. No memory is allocated until the first
+ * order is added.
+ *
+ * @param store The store to initialise
+ */
+void orderStoreInit(OrderStore *store) {
+    store->slabs = NULL;
+    store->slabCount = 0;
+    store->slabCapacity = 0;
+    store->count = 0;
+    store->liveCount = 0;
+    store->index.entries = NULL;
+    store->index.capacity = 0;
+    store->index.size = 0;
+    memset(&store->strings, 0, sizeof(store->strings));
+    memset(&store->names, 0, sizeof(store->names));
+    memset(&store->stats, 0, sizeof(store->stats));
+    valueTreeReset(&store->stats.top);
+}
+
+/**
+ * Releases every slab owned by the store and resets it to empty.
+ *
+ * @param store The store to release
+ */
+void orderStoreFree(OrderStore *store) {
+    for (int i = 0; i < store->slabCount; i++) {
+        releaseStoreMemory(store->slabs[i]);
+    }
+    releaseStoreMemory(store->slabs);
+    releaseStoreMemory(store->index.entries);
+    stringHeapFree(&store->strings);
+    trigramIndexClear(&store->names);
+    releaseStoreMemory(store->names.lists.entries);
+    releaseStoreMemory(store->names.postings);
+    releaseStoreMemory(store->stats.top.nodes);
+    orderStoreInit(store);
+    if (snapshotMemory.data != NULL) {
+        /* Nothing points into the snapshot any more */
+        mappedFileClose(&snapshotMemory);
+    }
+}
+
+/**
+ * Returns the number of live orders held by the store.
+ */
+int orderStoreCount(const OrderStore *store) {
+    return store->liveCount;
+}
+
+/**
+ * Reads the order stored at a slot out of the columns. Its names point
+ * into the string heap and stay valid until the store next changes.
+ *
+ * @param store The store to read from
+ * @param slot  Slot index in the range [0, count)
+ * @param order Receives the order
+ */
+void orderStoreGet(const OrderStore *store, int slot, Order *order) {
+    const OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    order->orderID = slab->orderIDs[i];
+    order->customerName = stringHeapGet(&store->strings, slab->customerNames[i]);
+    order->productName = stringHeapGet(&store->strings, slab->productNames[i]);
+    order->quantity = slab->quantities[i];
+    order->price = slab->prices[i];
+    order->statusId = slab->statusIds[i];
+}
+
+/**
+ * Returns the order ID stored at a slot.
+ */
+int orderStoreOrderID(const OrderStore *store, int slot) {
+    return orderStoreSlab(store, slot)->orderIDs[slot & ORDER_SLAB_MASK];
+}
+
+/**
+ * Returns the customer name stored at a slot, valid until the store is
+ * compacted.
+ */
+const char *orderStoreCustomerName(const OrderStore *store, int slot) {
+    return stringHeapGet(&store->strings, orderStoreSlab(store, slot)->customerNames[slot & ORDER_SLAB_MASK]);
+}
+
+/**
+ * Formats the order at a slot as one data-file record, followed by a
+ * newline, straight from the slab columns.
+ *
+ * @param store The store to read
+ * @param slot  Slot of a live order
+ * @param out   Buffer with room for RECORD_TEXT_LENGTH bytes
+ * @return Pointer just past the newline
+ */
+char *orderStoreFormatRecord(const OrderStore *store, int slot, char *out) {
+    const OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    out = appendOrderRecord(out, slab->orderIDs[i],
+                            stringHeapGet(&store->strings, slab->customerNames[i]),
+                            stringHeapGet(&store->strings, slab->productNames[i]),
+                            slab->quantities[i], slab->prices[i], slab->statusIds[i]);
+    *out++ = '\n';
+    return out;
+}
+
+/**
+ * Finds the first live slot at or after a given slot. Dead slots are skipped
+ * 64 at a time using the slab live bitmaps.
+ *
+ * @param store The store to scan
+ * @param slot  Slot to start from
+ * @return The next live slot, or -1 if there is none
+ */
+int orderStoreNextLive(const OrderStore *store, int slot) {
+    while (slot < store->count) {
+        const OrderSlab *slab = store->slabs[slot >> ORDER_SLAB_SHIFT];
+        int base = slot & ~ORDER_SLAB_MASK;
+        int word = (slot & ORDER_SLAB_MASK) >> 6;
+        uint64_t bits = slab->liveMask[word] & (~0ULL << (slot & 63));
+
+        for (;;) {
+            if (bits != 0) {
+                int found = base + word * 64 + lowestSetBit(bits);
+                return found < store->count ? found : -1;
+            }
+            if (++word == ORDER_SLAB_WORDS) {
+                break;
+            }
+            bits = slab->liveMask[word];
+        }
+        slot = base + ORDER_SLAB_SIZE;
+    }
+    return -1;
+}
+
+/**
+ * Marks a slot live or dead in its slab bitmap.
+ */
+static void orderStoreSetLive(OrderStore *store, int slot, bool live) {
+    OrderSlab *slab = store->slabs[slot >> ORDER_SLAB_SHIFT];
+    uint64_t bit = 1ULL << (slot & 63);
+    if (live) {
+        slab->liveMask[(slot & ORDER_SLAB_MASK) >> 6] |= bit;
+    } else {
+        slab->liveMask[(slot & ORDER_SLAB_MASK) >> 6] &= ~bit;
+    }
+}
+
+/**
+ * Returns whether a slot currently holds a live order.
+ */
+static bool orderStoreIsLive(const OrderStore *store, int slot) {
+    const OrderSlab *slab = store->slabs[slot >> ORDER_SLAB_SHIFT];
+    return (slab->liveMask[(slot & ORDER_SLAB_MASK) >> 6] >> (slot & 63)) & 1;
+}
+
+/**
+ * Rebuilds the trigram index from the live orders of a store.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int trigramIndexRebuild(OrderStore *store) {
+    trigramIndexClear(&store->names);
+    for (int i = orderStoreNextLive(store, 0); i != -1; i = orderStoreNextLive(store, i + 1)) {
+        if (!trigramIndexAdd(&store->names, i, orderStoreCustomerName(store, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Finds every live order whose customer name contains a needle, ignoring
+ * case. Needles of at least TRIGRAM_LENGTH characters are answered from the
+ * trigram index, so the cost follows the shortest posting list rather than
+ * the size of the book; shorter needles fall back to a scan. Needles of
+ * MAX_NAME_LENGTH or more characters cannot match any name and find nothing.
+ *
+ * @param store   The store to search
+ * @param needle  Substring to look for
+ * @param results Receives the matching slots in display order
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+int orderStoreSearchName(const OrderStore *store, const char *needle, SlotList *results) {
+    results->count = 0;
+    size_t length = strlen(needle);
+    if (length >= MAX_NAME_LENGTH) {
+        /* Longer than any name, and than the trigram arrays below */
+        return 1;
+    }
+    if (length < TRIGRAM_LENGTH) {
+        for (int i = orderStoreNextLive(store, 0); i != -1; i = orderStoreNextLive(store, i + 1)) {
+            if (containsIgnoreCase(orderStoreCustomerName(store, i), needle) &&
+                !slotListAppend(results, i)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    int codes[MAX_NAME_LENGTH];
+    const SlotList *lists[MAX_NAME_LENGTH];
+    int listCount = trigramCollect(needle, codes);
+    for (int i = 0; i < listCount; i++) {
+        int list = intMapGet(&store->names.lists, codes[i]);
+        if (list == -1) {
+            return 1;
+        }
+        /* Insertion sort by length so the shortest list drives the merge */
+        const SlotList *postings = &store->names.postings[list];
+        int j = i;
+        while (j > 0 && lists[j - 1]->count > postings->count) {
+            lists[j] = lists[j - 1];
+            j--;
+        }
+        lists[j] = postings;
+    }
+
+    int cursors[MAX_NAME_LENGTH] = { 0 };
+    for (int c = 0; c < lists[0]->count; c++) {
+        int slot = lists[0]->slots[c];
+        int present = 1;
+        for (int l = 1; l < listCount && present; l++) {
+            cursors[l] = slotListLowerBound(lists[l], cursors[l], slot);
+            present = cursors[l] < lists[l]->count && lists[l]->slots[cursors[l]] == slot;
+        }
+        if (!present || slot >= store->count || !orderStoreIsLive(store, slot)) {
+            continue;
+        }
+        if (containsIgnoreCase(orderStoreCustomerName(store, slot), needle) &&
+            !slotListAppend(results, slot)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Makes room for one more slot, allocating a new slab (and doubling the slab
+ * directory) when the current slabs are full.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int orderStoreReserve(OrderStore *store) {
+    if (store->count < store->slabCount * ORDER_SLAB_SIZE) {
+        return 1;
+    }
+    if (store->slabCount == store->slabCapacity) {
+        int newCapacity = store->slabCapacity == 0 ? 4 : store->slabCapacity * 2;
+        OrderSlab **slabs = resizeStoreMemory(store->slabs, (size_t)store->slabCapacity * sizeof(*slabs),
+                                              (size_t)newCapacity * sizeof(*slabs));
+        if (slabs == NULL) {
+            return 0;
+        }
+        store->slabs = slabs;
+        store->slabCapacity = newCapacity;
+    }
+    OrderSlab *slab = malloc(sizeof(*slab));
+    if (slab == NULL) {
+        return 0;
+    }
+    memset(slab->liveMask, 0, sizeof(slab->liveMask));
+    store->slabs[store->slabCount++] = slab;
+    return 1;
+}
+
+/**
+ * Appends an order to the end of the store.
+ *
+ * @param store The store to append to
+ * @param order The order to copy into the store
+ * @return Slot of the new order, or -1 if memory could not be allocated
+ */
+int orderStoreAdd(OrderStore *store, const Order *order) {
+    if (!intMapReserve(&store->index, store->index.size + 1) ||
+        !valueTreeReserve(&store->stats.top, store->stats.top.height + 1)) {
+        return -1;
+    }
+    int slot = orderStoreAppendUnindexed(store, order);
+    if (slot == -1) {
+        return -1;
+    }
+    if (!trigramIndexAdd(&store->names, slot, order->customerName)) {
+        OrderSlab *slab = orderStoreSlab(store, slot);
+        stringHeapRelease(&store->strings, slab->customerNames[slot & ORDER_SLAB_MASK]);
+        stringHeapRelease(&store->strings, slab->productNames[slot & ORDER_SLAB_MASK]);
+        orderStoreSetLive(store, slot, false);
+        store->count--;
+        store->liveCount--;
+        return -1;
+    }
+    intMapPut(&store->index, order->orderID, slot);
+    aggregatesAdd(store, slot);
+    AGGREGATES_VERIFY(store);
+    return slot;
+}
+
+/**
+ * Fills the slot after the last one with an order and its interned names.
+ * Room must already be reserved.
+ *
+ * @return The slot
+ */
+static int orderStorePlace(OrderStore *store, const Order *order, uint32_t customer, uint32_t product) {
+    int slot = store->count;
+    OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    slab->orderIDs[i] = order->orderID;
+    slab->quantities[i] = order->quantity;
+    slab->prices[i] = order->price;
+    slab->statusIds[i] = order->statusId;
+    slab->customerNames[i] = customer;
+    slab->productNames[i] = product;
+    orderStoreSetLive(store, slot, true);
+    store->count++;
+    store->liveCount++;
+    return slot;
+}
+
+/**
+ * Appends an order without touching the ID index. Bulk loaders use this and
+ * call orderStoreReindex() once at the end instead of paying for an index
+ * update per record.
+ *
+ * @param store The store to append to
+ * @param order The order to copy into the store
+ * @return Slot of the new order, or -1 if memory could not be allocated
+ */
+int orderStoreAppendUnindexed(OrderStore *store, const Order *order) {
+    if (!orderStoreReserve(store)) {
+        return -1;
+    }
+    uint32_t customer = stringHeapIntern(&store->strings, order->customerName, strlen(order->customerName));
+    if (customer == STRING_REF_NONE) {
+        return -1;
+    }
+    uint32_t product = stringHeapIntern(&store->strings, order->productName, strlen(order->productName));
+    if (product == STRING_REF_NONE) {
+        stringHeapRelease(&store->strings, customer);
+        return -1;
+    }
+    return orderStorePlace(store, order, customer, product);
+}
+
+/**
+ * Appends an order whose names are already interned in the store's string
+ * heap, adding a use of each; the order's own name pointers are ignored.
+ * Otherwise the same as orderStoreAppendUnindexed().
+ *
+ * @return Slot of the new order, or -1 if memory could not be allocated
+ */
+int orderStoreAppendInterned(OrderStore *store, const Order *order, uint32_t customer, uint32_t product) {
+    if (!orderStoreReserve(store)) {
+        return -1;
+    }
+    stringHeapRetain(&store->strings, customer);
+    stringHeapRetain(&store->strings, product);
+    return orderStorePlace(store, order, customer, product);
+}
+
+/**
+ * Interns the names of all live orders into a fresh string heap once
+ * names no order uses any more make up a quarter of the heap.
+ *
+ * @return 1 on success (including when no compaction was needed), 0 if
+ *         memory could not be allocated
+ */
+static int orderStoreCompactStrings(OrderStore *store) {
+    StringHeap *old = &store->strings;
+    if (old->garbageBytes * COMPACT_DEAD_RATIO < old->totalBytes) {
+        return 1;
+    }
+
+    StringHeap fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    for (int s = 0; s < store->slabCount; s++) {
+        OrderSlab *slab = store->slabs[s];
+        int limit = store->count - (s << ORDER_SLAB_SHIFT);
+        for (int i = 0; i < limit && i < ORDER_SLAB_SIZE; i++) {
+            uint32_t customer = stringHeapIntern(&fresh, stringHeapGet(old, slab->customerNames[i]),
+                                                 stringHeapHeader(old, slab->customerNames[i])->length);
+            uint32_t product = stringHeapIntern(&fresh, stringHeapGet(old, slab->productNames[i]),
+                                                stringHeapHeader(old, slab->productNames[i])->length);
+            if (customer == STRING_REF_NONE || product == STRING_REF_NONE) {
+                stringHeapFree(&fresh);
+                return 0;
+            }
+            /* Store compaction has already packed the live slots densely */
+            slab->customerNames[i] = customer;
+            slab->productNames[i] = product;
+        }
+    }
+    stringHeapFree(old);
+    *old = fresh;
+    return 1;
+}
+
+/**
+ * Rebuilds the ID index in a single pass over the store, compacting away
+ * tombstones as it goes. When an order ID occurs more than once, the first
+ * occurrence is kept and later ones are dropped. Surviving orders keep their
+ * relative sequence and slabs left empty at the end are released.
+ *
+ * @param store The store to reindex
+ * @return Number of duplicate orders dropped, or -1 if memory could not be
+ *         allocated
+ */
+int orderStoreReindex(OrderStore *store) {
+    store->index.size = 0;
+    for (size_t i = 0; i < store->index.capacity; i++) {
+        store->index.entries[i].value = -1;
+    }
+    if (!intMapReserve(&store->index, (size_t)store->liveCount)) {
+        return -1;
+    }
+
+    int kept = 0;
+    for (int i = orderStoreNextLive(store, 0); i != -1; i = orderStoreNextLive(store, i + 1)) {
+        OrderSlab *from = orderStoreSlab(store, i);
+        int f = i & ORDER_SLAB_MASK;
+        IntMapEntry *entry = intMapProbe(&store->index, from->orderIDs[f]);
+        if (entry->value != -1) {
+            stringHeapRelease(&store->strings, from->customerNames[f]);
+            stringHeapRelease(&store->strings, from->productNames[f]);
+            continue;
+        }
+        if (kept != i) {
+            OrderSlab *to = orderStoreSlab(store, kept);
+            int t = kept & ORDER_SLAB_MASK;
+            to->orderIDs[t] = from->orderIDs[f];
+            to->quantities[t] = from->quantities[f];
+            to->prices[t] = from->prices[f];
+            to->statusIds[t] = from->statusIds[f];
+            to->customerNames[t] = from->customerNames[f];
+            to->productNames[t] = from->productNames[f];
+        }
+        entry->key = from->orderIDs[f];
+        entry->value = kept++;
+        store->index.size++;
+    }
+
+    int dropped = store->liveCount - kept;
+    int usedSlabs = (kept + ORDER_SLAB_SIZE - 1) >> ORDER_SLAB_SHIFT;
+    for (int i = usedSlabs; i < store->slabCount; i++) {
+        releaseStoreMemory(store->slabs[i]);
+    }
+    store->slabCount = usedSlabs;
+    for (int i = 0; i < usedSlabs; i++) {
+        OrderSlab *slab = store->slabs[i];
+        int live = kept - i * ORDER_SLAB_SIZE;
+        for (int w = 0; w < ORDER_SLAB_WORDS; w++, live -= 64) {
+            slab->liveMask[w] = live >= 64 ? ~0ULL : live <= 0 ? 0 : (1ULL << live) - 1;
+        }
+    }
+
+    store->count = kept;
+    store->liveCount = kept;
+    if (!orderStoreCompactStrings(store) || !trigramIndexRebuild(store) || !aggregatesRebuild(store)) {
+        return -1;
+    }
+    AGGREGATES_VERIFY(store);
+    return dropped;
+}
+
+/**
+ * Compacts the store once tombstones exceed COMPACT_DEAD_RATIO of the slots
+ * in use. Each compaction costs O(count) but only runs after a proportional
+ * number of deletes, so deletes stay O(1) amortised. Callers run this between
+ * operations rather than inside them.
+ *
+ * @param store The store to compact
+ * @return 1 if a compaction ran, 0 otherwise
+ */
+int orderStoreCompactIfNeeded(OrderStore *store) {
+    int dead = store->count - store->liveCount;
+    if (dead < COMPACT_MIN_DEAD || dead * COMPACT_DEAD_RATIO < store->count) {
+        long long stale = store->names.staleCount;
+        if (stale >= COMPACT_MIN_DEAD && stale * COMPACT_DEAD_RATIO >= store->names.postingCount) {
+            trigramIndexRebuild(store);
+        }
+        return 0;
+    }
+    return orderStoreReindex(store) >= 0;
+}
+
+/**
+ * Replaces the order stored at a slot.
+ *
+ * @param store The store to modify
+ * @param slot  Slot of the order to replace
+ * @param order The new contents of the slot
+ * @return 1 on success, 0 if the slot is out of range or memory could not
+ *         be allocated
+ */
+int orderStoreUpdate(OrderStore *store, int slot, const Order *order) {
+    if (slot < 0 || slot >= store->count || !orderStoreIsLive(store, slot) ||
+        !valueTreeReserve(&store->stats.top, store->stats.top.height + 1)) {
+        return 0;
+    }
+    OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    const char *customer = stringHeapGet(&store->strings, slab->customerNames[i]);
+    const char *product = stringHeapGet(&store->strings, slab->productNames[i]);
+    uint32_t customerRef = slab->customerNames[i];
+    uint32_t productRef = slab->productNames[i];
+
+    if (strcmp(product, order->productName) != 0) {
+        productRef = stringHeapIntern(&store->strings, order->productName, strlen(order->productName));
+        if (productRef == STRING_REF_NONE) {
+            return 0;
+        }
+    }
+    if (strcmp(customer, order->customerName) != 0) {
+        customerRef = stringHeapIntern(&store->strings, order->customerName, strlen(order->customerName));
+        if (customerRef == STRING_REF_NONE) {
+            if (productRef != slab->productNames[i]) {
+                stringHeapRelease(&store->strings, productRef);
+            }
+            return 0;
+        }
+        if (!equalsIgnoreCase(customer, order->customerName)) {
+            /* Old postings stay behind and are filtered by re-verification */
+            int codes[MAX_NAME_LENGTH];
+            store->names.staleCount += trigramCollect(customer, codes);
+            if (!trigramIndexAdd(&store->names, slot, order->customerName)) {
+                stringHeapRelease(&store->strings, customerRef);
+                if (productRef != slab->productNames[i]) {
+                    stringHeapRelease(&store->strings, productRef);
+                }
+                return 0;
+            }
+        }
+        stringHeapRelease(&store->strings, slab->customerNames[i]);
+    }
+    if (productRef != slab->productNames[i]) {
+        stringHeapRelease(&store->strings, slab->productNames[i]);
+    }
+    if (slab->orderIDs[i] != order->orderID) {
+        intMapRemove(&store->index, slab->orderIDs[i]);
+        intMapPut(&store->index, order->orderID, slot);
+    }
+
+    aggregatesRemove(store, slot);
+    slab->orderIDs[i] = order->orderID;
+    slab->quantities[i] = order->quantity;
+    slab->prices[i] = order->price;
+    slab->statusIds[i] = order->statusId;
+    slab->customerNames[i] = customerRef;
+    slab->productNames[i] = productRef;
+    aggregatesAdd(store, slot);
+    AGGREGATES_VERIFY(store);
+    return 1;
+}
+
+/**
+ * Removes the order at a slot in O(1) by leaving a tombstone. The remaining
+ * orders keep their slots and sequence until the next compaction.
+ *
+ * @param store The store to modify
+ * @param slot  Slot of the order to remove
+ * @return 1 on success, 0 if the slot is out of range or already dead
+ */
+int orderStoreDelete(OrderStore *store, int slot) {
+    if (slot < 0 || slot >= store->count || !orderStoreIsLive(store, slot)) {
+        return 0;
+    }
+    OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    intMapRemove(&store->index, slab->orderIDs[i]);
+    aggregatesRemove(store, slot);
+    stringHeapRelease(&store->strings, slab->customerNames[i]);
+    stringHeapRelease(&store->strings, slab->productNames[i]);
+    orderStoreSetLive(store, slot, false);
+    store->liveCount--;
+    AGGREGATES_VERIFY(store);
+    return 1;
+}
+
+/**
+ * Finds the slot holding an order ID.
+ *
+ * @param store   The store to search
+ * @param orderID The order ID to search for
+ * @return Slot of the order, or -1 if not found
+ */
+int orderStoreFind(const OrderStore *store, int orderID) {
+    return intMapGet(&store->index, orderID);
+}
+
+/**
+ * Returns the running aggregates over the live orders of a store.
+ */
+const OrderAggregates *orderStoreStats(const OrderStore *store) {
+    return &store->stats;
+}
+
+/**
+ * Returns the slot of the highest-value live order, the first listed one
+ * on ties.
+ *
+ * @return Slot of the top order, or -1 if the store is empty
+ */
+int orderStoreTopSlot(const OrderStore *store) {
+    const ValueTree *tree = &store->stats.top;
+    return tree->root == -1 ? -1 : tree->nodes[valueTreeFirstLeaf(tree, tree->root)].slots[0];
+}
+
+/**
+ * Lists the live orders whose total value lies in a range, from the highest
+ * value down, ties in listing order. Costs one descent of the value index
+ * plus the orders returned.
+ *
+ * @param store    The store to search
+ * @param minValue Lowest total value wanted
+ * @param maxValue Highest total value wanted
+ * @param limit    Most orders to return
+ * @param results  Receives the matching slots after any already there
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+int orderStoreValueRange(const OrderStore *store, Money minValue, Money maxValue, int limit, SlotList *results) {
+    const ValueTree *tree = &store->stats.top;
+    int leaf;
+    int position = valueTreeSeek(tree, maxValue, &leaf);
+    if (position == -1) {
+        return 1;
+    }
+    for (int found = 0; leaf != -1 && found < limit; found++) {
+        const ValueNode *node = &tree->nodes[leaf];
+        if (node->values[position] < minValue) {
+            break;
+        }
+        if (!slotListAppend(results, node->slots[position])) {
+            return 0;
+        }
+        if (++position == node->count) {
+            leaf = node->next;
+            position = 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Lists the highest-value live orders, as orderStoreTopSlot() would rank
+ * them.
+ *
+ * @param store   The store to search
+ * @param limit   Most orders to return
+ * @param results Receives the slots after any already there
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+int orderStoreTopByValue(const OrderStore *store, int limit, SlotList *results) {
+    return orderStoreValueRange(store, INT64_MIN, INT64_MAX, limit, results);
+}
+
+/* =============================================================================
+ * SNAPSHOT FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Streaming writer that lays out the sections of a snapshot file.
+ */
+typedef struct {
+    FILE    *file;
+    uint64_t offset;
+    bool     failed;
+} SnapshotWriter;
+
+/**
+ * Folds a block of 64-bit words into a running checksum. Blocks are always
+ * a multiple of 8 bytes, so a section hashes the same whether it is
+ * written in one piece or many.
+ */
+static uint64_t snapshotChecksum(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001B3ULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+/**
+ * Rounds a byte count up to a whole number of 64-bit words.
+ */
+static size_t snapshotPadded(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * Writes raw bytes to a snapshot file.
+ */
+static void snapshotWriteRaw(SnapshotWriter *writer, const void *data, size_t size) {
+    if (!writer->failed && size > 0 && fwrite(data, 1, size, writer->file) != size) {
+        writer->failed = true;
+    }
+    METRICS_COUNT(bytesWritten, size);
+    writer->offset += size;
+}
+
+/**
+ * Starts a new section at the next SNAPSHOT_ALIGNMENT boundary.
+ */
+static void snapshotBeginSection(SnapshotWriter *writer, SnapshotSection *section) {
+    static const char zeros[SNAPSHOT_ALIGNMENT] = { 0 };
+    size_t padding = (size_t)(-writer->offset & (SNAPSHOT_ALIGNMENT - 1));
+    snapshotWriteRaw(writer, zeros, padding);
+    section->offset = writer->offset;
+    section->length = 0;
+    section->checksum = SNAPSHOT_SEED;
+}
+
+/**
+ * Appends a block to the current section, zero-padded to a whole number of
+ * 64-bit words.
+ */
+static void snapshotWriteBlock(SnapshotWriter *writer, SnapshotSection *section, const void *data, size_t size) {
+    static const char zeros[8] = { 0 };
+    snapshotWriteRaw(writer, data, size);
+    snapshotWriteRaw(writer, zeros, snapshotPadded(size) - size);
+    section->checksum = snapshotChecksum(section->checksum, data, size & ~(size_t)7);
+    if (size & 7) {
+        char tail[8] = { 0 };
+        memcpy(tail, (const char *)data + (size & ~(size_t)7), size & 7);
+        section->checksum = snapshotChecksum(section->checksum, tail, sizeof(tail));
+    }
+    section->length += snapshotPadded(size);
+}
+
+/**
+ * Records the size and modification time of the data file a snapshot
+ * belongs to.
+ *
+ * @return 1 if the file exists, 0 otherwise
+ */
+static int snapshotStampFile(const char *path, uint64_t *size, int64_t *modified) {
+#ifdef ECOM_POSIX
+    struct stat info;
+    if (stat(path, &info) == -1) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    long nanoseconds = info.st_mtimespec.tv_nsec;
+#else
+    long nanoseconds = info.st_mtim.tv_nsec;
+#endif
+    *size = (uint64_t)info.st_size;
+    *modified = (int64_t)info.st_mtime * 1000000000LL + nanoseconds;
+    return 1;
+#else
+    /* Without stat() the size is the only stamp available */
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = (uint64_t)ftell(file);
+    *modified = 0;
+    fclose(file);
+    return 1;
+#endif
+}
+
+/**
+ * Writes the order store to a snapshot file. The file is written under a
+ * temporary name and renamed into place, so a snapshot the store is
+ * currently running on is never modified underneath it.
+ *
+ * @param path    The snapshot file to write
+ * @param csvPath The data file saved alongside it, or NULL
+ * @return 1 on success, 0 on failure
+ */
+int saveSnapshot(const char *path, const char *csvPath) {
+    const OrderStore *store = &orderStore;
+    char temporary[FILENAME_MAX];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+        return 0;
+    }
+    SnapshotWriter writer = { fopen(temporary, "wb"), 0, false };
+    if (writer.file == NULL) {
+        return 0;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(header);
+    header.byteOrder = 0x01020304;
+    header.slabBytes = sizeof(OrderSlab);
+    header.slabSize = ORDER_SLAB_SIZE;
+    header.stringChunkSize = STRING_CHUNK_SIZE;
+    header.valueNodeBytes = sizeof(ValueNode);
+    header.statusLength = MAX_STATUS_LENGTH;
+    if (csvPath != NULL) {
+        snapshotStampFile(csvPath, &header.csvSize, &header.csvModified);
+    }
+    header.journalSequence = journal.checkpointSequence;
+    header.count = store->count;
+    header.liveCount = store->liveCount;
+    header.slabCount = store->slabCount;
+    header.stringChunkCount = store->strings.chunkCount;
+    header.stringUsed = store->strings.used;
+    header.stringTotal = store->strings.totalBytes;
+    header.stringGarbage = store->strings.garbageBytes;
+    header.stringTableCapacity = store->strings.tableCapacity;
+    header.stringTableSize = store->strings.tableSize;
+    header.indexCapacity = store->index.capacity;
+    header.indexSize = store->index.size;
+    header.trigramCapacity = store->names.lists.capacity;
+    header.trigramSize = store->names.lists.size;
+    header.trigramListCount = store->names.listCount;
+    header.postingCount = store->names.postingCount;
+    header.staleCount = store->names.staleCount;
+    header.valueNodeCount = store->stats.top.nodeCount;
+    header.valueFreeList = store->stats.top.freeList;
+    header.valueRoot = store->stats.top.root;
+    header.valueHeight = store->stats.top.height;
+    header.valueSize = store->stats.top.size;
+    header.statusCount = statusDictionary.count;
+    for (size_t i = 0; i < STATUS_CATEGORY_COUNT; i++) {
+        header.statusCounts[i] = store->stats.statusCounts[i];
+    }
+    header.revenueLow = (uint64_t)store->stats.revenue;
+#if defined(__SIZEOF_INT128__)
+    header.revenueHigh = (int64_t)(store->stats.revenue >> 64);
+#else
+    header.revenueHigh = store->stats.revenue < 0 ? -1 : 0;
+#endif
+    snapshotWriteRaw(&writer, &header, sizeof(header));
+
+    SnapshotSection *sections = header.sections;
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_SLABS]);
+    for (int i = 0; i < store->slabCount; i++) {
+        snapshotWriteBlock(&writer, &sections[SNAPSHOT_SLABS], store->slabs[i], sizeof(OrderSlab));
+    }
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_STRINGS]);
+    for (int i = 0; i < store->strings.chunkCount; i++) {
+        snapshotWriteBlock(&writer, &sections[SNAPSHOT_STRINGS], store->strings.chunks[i], STRING_CHUNK_SIZE);
+    }
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_ORDER_INDEX]);
+    snapshotWriteBlock(&writer, &sections[SNAPSHOT_ORDER_INDEX], store->index.entries,
+                       store->index.capacity * sizeof(IntMapEntry));
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_TRIGRAM_LISTS]);
+    snapshotWriteBlock(&writer, &sections[SNAPSHOT_TRIGRAM_LISTS], store->names.lists.entries,
+                       store->names.lists.capacity * sizeof(IntMapEntry));
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_TRIGRAM_COUNTS]);
+    int32_t *counts = malloc((size_t)store->names.listCount * sizeof(*counts) + 1);
+    if (counts == NULL) {
+        writer.failed = true;
+    } else {
+        for (int i = 0; i < store->names.listCount; i++) {
+            counts[i] = store->names.postings[i].count;
+        }
+        snapshotWriteBlock(&writer, &sections[SNAPSHOT_TRIGRAM_COUNTS], counts,
+                           (size_t)store->names.listCount * sizeof(*counts));
+        free(counts);
+    }
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_TRIGRAM_SLOTS]);
+    for (int i = 0; i < store->names.listCount; i++) {
+        const SlotList *list = &store->names.postings[i];
+        snapshotWriteBlock(&writer, &sections[SNAPSHOT_TRIGRAM_SLOTS], list->slots, (size_t)list->count * sizeof(int));
+    }
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_VALUE_NODES]);
+    snapshotWriteBlock(&writer, &sections[SNAPSHOT_VALUE_NODES], store->stats.top.nodes,
+                       (size_t)store->stats.top.nodeCount * sizeof(ValueNode));
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_STATUS_LABELS]);
+    snapshotWriteBlock(&writer, &sections[SNAPSHOT_STATUS_LABELS], statusDictionary.labels,
+                       (size_t)statusDictionary.count * MAX_STATUS_LENGTH);
+    snapshotBeginSection(&writer, &sections[SNAPSHOT_STRING_TABLE]);
+    snapshotWriteBlock(&writer, &sections[SNAPSHOT_STRING_TABLE], store->strings.table,
+                       store->strings.tableCapacity * sizeof(StringEntry));
+
+    header.headerChecksum = snapshotChecksum(SNAPSHOT_SEED, &header, offsetof(SnapshotHeader, headerChecksum));
+    if (!writer.failed && (fseek(writer.file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer.file) != 1)) {
+        writer.failed = true;
+    }
+    if (!syncFile(writer.file)) {
+        writer.failed = true;
+    }
+    if (fclose(writer.file) != 0) {
+        writer.failed = true;
+    }
+    if (writer.failed || !replaceFile(temporary, path)) {
+        remove(temporary);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Validates the header and section table of a mapped snapshot file.
+ *
+ * @param file The mapped file
+ * @return The header, or NULL if the file is not a snapshot this build can
+ *         use
+ */
+static const SnapshotHeader *snapshotHeader(const MappedFile *file) {
+    if (file->size < sizeof(SnapshotHeader)) {
+        return NULL;
+    }
+    const SnapshotHeader *header = (const SnapshotHeader *)file->data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION ||
+        header->headerSize != sizeof(SnapshotHeader) ||
+        header->byteOrder != 0x01020304 ||
+        header->slabBytes != sizeof(OrderSlab) ||
+        header->slabSize != ORDER_SLAB_SIZE ||
+        header->stringChunkSize != STRING_CHUNK_SIZE ||
+        header->valueNodeBytes != sizeof(ValueNode) ||
+        header->statusLength != MAX_STATUS_LENGTH ||
+        header->headerChecksum != snapshotChecksum(SNAPSHOT_SEED, header, offsetof(SnapshotHeader, headerChecksum))) {
+        return NULL;
+    }
+
+    uint64_t expected[SNAPSHOT_SECTION_COUNT];
+    expected[SNAPSHOT_SLABS] = (uint64_t)header->slabCount * sizeof(OrderSlab);
+    expected[SNAPSHOT_STRINGS] = (uint64_t)header->stringChunkCount * STRING_CHUNK_SIZE;
+    expected[SNAPSHOT_ORDER_INDEX] = header->indexCapacity * sizeof(IntMapEntry);
+    expected[SNAPSHOT_TRIGRAM_LISTS] = header->trigramCapacity * sizeof(IntMapEntry);
+    expected[SNAPSHOT_TRIGRAM_COUNTS] = snapshotPadded((size_t)header->trigramListCount * sizeof(int32_t));
+    expected[SNAPSHOT_TRIGRAM_SLOTS] = header->sections[SNAPSHOT_TRIGRAM_SLOTS].length;
+    expected[SNAPSHOT_VALUE_NODES] = (uint64_t)header->valueNodeCount * sizeof(ValueNode);
+    expected[SNAPSHOT_STATUS_LABELS] = snapshotPadded((size_t)header->statusCount * MAX_STATUS_LENGTH);
+    expected[SNAPSHOT_STRING_TABLE] = header->stringTableCapacity * sizeof(StringEntry);
+    for (int i = 0; i < SNAPSHOT_SECTION_COUNT; i++) {
+        const SnapshotSection *section = &header->sections[i];
+        if (section->length != expected[i] || section->offset % SNAPSHOT_ALIGNMENT != 0 ||
+            section->offset > file->size || section->length > file->size - section->offset) {
+            return NULL;
+        }
+    }
+    if (header->count < 0 || header->liveCount < 0 || header->liveCount > header->count ||
+        header->count > header->slabCount * ORDER_SLAB_SIZE || header->valueSize != header->liveCount ||
+        header->valueNodeCount < 0 || header->valueRoot < -1 || header->valueRoot >= header->valueNodeCount ||
+        header->valueFreeList < -1 || header->valueFreeList >= header->valueNodeCount ||
+        header->valueHeight < 0 || header->valueHeight > VALUE_MAX_HEIGHT ||
+        (header->valueRoot == -1) != (header->valueHeight == 0) || header->statusCount < (int)STATUS_OPTION_COUNT ||
+        header->statusCount > MAX_STATUS_IDS || header->stringChunkCount > STRING_MAX_CHUNKS ||
+        header->stringUsed > STRING_CHUNK_SIZE ||
+        (header->stringTableCapacity & (header->stringTableCapacity - 1)) != 0 ||
+        (header->stringTableCapacity > 0 && header->stringTableSize >= header->stringTableCapacity)) {
+        return NULL;
+    }
+    return header;
+}
+
+/**
+ * Returns whether a section's contents match its checksum.
+ */
+static bool snapshotSectionValid(const MappedFile *file, const SnapshotSection *section) {
+    return snapshotChecksum(SNAPSHOT_SEED, file->data + section->offset, section->length) == section->checksum;
+}
+
+/**
+ * Returns whether a file starts with the given eight-byte magic.
+ */
+static bool fileHasMagic(const char *path, const char *expected) {
+    char magic[8];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    bool match = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                 memcmp(magic, expected, sizeof(magic)) == 0;
+    fclose(file);
+    return match;
+}
+
+/**
+ * Returns whether a file starts with the snapshot magic.
+ */
+bool isSnapshotFile(const char *path) {
+    return fileHasMagic(path, SNAPSHOT_MAGIC);
+}
+
+/**
+ * Returns whether a file starts with the columnar data file magic.
+ */
+bool isColumnarFile(const char *path) {
+    return fileHasMagic(path, COLUMNAR_MAGIC);
+}
+
+/**
+ * Returns whether a name reference read from a snapshot points at a whole
+ * string inside the heap: a header, its text and the NUL after it.
+ */
+static bool snapshotStringValid(const StringHeap *heap, uint32_t ref) {
+    int chunk = (int)(ref >> STRING_CHUNK_SHIFT);
+    uint32_t offset = ref & (STRING_CHUNK_SIZE - 1);
+    if (chunk >= heap->chunkCount) {
+        return false;
+    }
+    uint32_t limit = chunk + 1 == heap->chunkCount ? heap->used : STRING_CHUNK_SIZE;
+    if (offset < sizeof(StringHeader) || offset % sizeof(uint32_t) != 0 || offset >= limit) {
+        return false;
+    }
+    uint32_t length = stringHeapHeader(heap, ref)->length;
+    return length < limit - offset && stringHeapGet(heap, ref)[length] == '\0';
+}
+
+/**
+ * Returns whether every bucket of an IntMap read from a snapshot maps to a
+ * value below limit, and the map has as many entries as it claims and at
+ * least one empty bucket to end a probe.
+ */
+static bool snapshotIntMapValid(const IntMap *map, int limit) {
+    size_t used = 0;
+    for (size_t i = 0; i < map->capacity; i++) {
+        int value = map->entries[i].value;
+        if (value < -1 || value >= limit) {
+            return false;
+        }
+        used += value != -1;
+    }
+    return used == map->size && (map->capacity == 0 || used < map->capacity);
+}
+
+/**
+ * Checks the subtree of the value index under a node read from a snapshot:
+ * every node is reached once, at the depth its leaf flag implies, and the
+ * leaves are chained in order and hold slots below slotCount.
+ *
+ * @param seen     One flag per node, set as nodes are reached
+ * @param prevLeaf The leaf reached last, updated
+ * @param keys     Keys found in leaves, updated
+ * @return true if the subtree is sound
+ */
+static bool snapshotValueNodeValid(const ValueTree *tree, int node, int depth, uint8_t *seen,
+                                   int *prevLeaf, int *keys, int slotCount) {
+    if (node < 0 || node >= tree->nodeCount || seen[node]) {
+        return false;
+    }
+    seen[node] = 1;
+    const ValueNode *current = &tree->nodes[node];
+    bool leaf = depth == tree->height - 1;
+    if (current->count < 0 || current->count > VALUE_NODE_KEYS || current->leaf != leaf) {
+        return false;
+    }
+    if (!leaf) {
+        for (int i = 0; i <= current->count; i++) {
+            if (!snapshotValueNodeValid(tree, current->children[i], depth + 1, seen, prevLeaf, keys, slotCount)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (current->prev != *prevLeaf || (*prevLeaf != -1 && tree->nodes[*prevLeaf].next != node)) {
+        return false;
+    }
+    for (int k = 0; k < current->count; k++) {
+        if (current->slots[k] < 0 || current->slots[k] >= slotCount) {
+            return false;
+        }
+    }
+    *keys += current->count;
+    *prevLeaf = node;
+    return true;
+}
+
+/**
+ * A run of slabs and posting lists bounds-checked by one thread.
+ */
+typedef struct {
+    const OrderStore *store;
+    int     statusCount;
+    int     firstSlab;
+    int     endSlab;        /* One past the last slab                 */
+    int     firstList;
+    int     endList;        /* One past the last posting list         */
+    int     live;           /* Live orders found                      */
+    const char *problem;    /* What is wrong, or NULL                 */
+} SnapshotCheckChunk;
+
+/**
+ * Checks the live orders of a run of slabs and the slots of a run of
+ * posting lists (see snapshotCheckBounds()).
+ */
+static void snapshotCheckChunk(SnapshotCheckChunk *chunk) {
+    const OrderStore *store = chunk->store;
+    chunk->live = 0;
+    chunk->problem = NULL;
+    for (int s = chunk->firstSlab; s < chunk->endSlab; s++) {
+        const OrderSlab *slab = store->slabs[s];
+        int limit = store->count - (s << ORDER_SLAB_SHIFT);
+        for (int w = 0; w * 64 < limit && w < ORDER_SLAB_WORDS; w++) {
+            uint64_t bits = slab->liveMask[w];
+            if (limit - w * 64 < 64) {
+                bits &= (1ULL << (limit - w * 64)) - 1;
+            }
+            chunk->live += countSetBits(bits);
+            for (; bits != 0; bits &= bits - 1) {
+                int i = w * 64 + lowestSetBit(bits);
+                if (slab->statusIds[i] >= chunk->statusCount ||
+                    !snapshotStringValid(&store->strings, slab->customerNames[i]) ||
+                    !snapshotStringValid(&store->strings, slab->productNames[i])) {
+                    chunk->problem = "an order refers outside it";
+                    return;
+                }
+            }
+        }
+    }
+    for (int i = chunk->firstList; i < chunk->endList; i++) {
+        const SlotList *list = &store->names.postings[i];
+        for (int k = 0; k < list->count; k++) {
+            if (list->slots[k] < 0 || list->slots[k] >= store->count) {
+                chunk->problem = "its trigram index is damaged";
+                return;
+            }
+        }
+    }
+}
+
+#ifdef ECOM_POSIX
+/**
+ * Thread entry point for snapshotCheckChunk().
+ */
+static void *snapshotCheckChunkThread(void *arg) {
+    snapshotCheckChunk(arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Checks that the indexes and references of a store just mapped from a
+ * snapshot stay inside it: status ids below the label count, name
+ * references at whole strings in the heap, slots below the slot count,
+ * and value index links below the node count, forming one tree whose
+ * leaves are chained in order. Each column and index is read once and
+ * nothing is hashed, so a truncated or damaged snapshot is turned away
+ * instead of being read out of bounds. The orders and posting lists, the
+ * bulk of the work, are split across threads (see workerThreadCount()).
+ *
+ * @return NULL if the store is usable, or what is wrong with it
+ */
+static const char *snapshotCheckBounds(const OrderStore *store, int statusCount) {
+    SnapshotCheckChunk chunks[WORKER_MAX_THREADS];
+    int chunkCount = workerThreadCount((size_t)store->slabCount * sizeof(OrderSlab));
+    for (int c = 0; c < chunkCount; c++) {
+        SnapshotCheckChunk *chunk = &chunks[c];
+        chunk->store = store;
+        chunk->statusCount = statusCount;
+        chunk->firstSlab = (int)((int64_t)store->slabCount * c / chunkCount);
+        chunk->endSlab = (int)((int64_t)store->slabCount * (c + 1) / chunkCount);
+        chunk->firstList = (int)((int64_t)store->names.listCount * c / chunkCount);
+        chunk->endList = (int)((int64_t)store->names.listCount * (c + 1) / chunkCount);
+    }
+#ifdef ECOM_POSIX
+    pthread_t threads[WORKER_MAX_THREADS];
+    bool started[WORKER_MAX_THREADS] = { false };
+    for (int i = 1; i < chunkCount; i++) {
+        started[i] = pthread_create(&threads[i], NULL, snapshotCheckChunkThread, &chunks[i]) == 0;
+    }
+    snapshotCheckChunk(&chunks[0]);
+    for (int i = 1; i < chunkCount; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            snapshotCheckChunk(&chunks[i]);
+        }
+    }
+#else
+    for (int i = 0; i < chunkCount; i++) {
+        snapshotCheckChunk(&chunks[i]);
+    }
+#endif
+    int live = 0;
+    for (int c = 0; c < chunkCount; c++) {
+        if (chunks[c].problem != NULL) {
+            return chunks[c].problem;
+        }
+        live += chunks[c].live;
+    }
+    if (live != store->liveCount) {
+        return "its live order count is wrong";
+    }
+    for (size_t i = 0; i < store->strings.tableCapacity; i++) {
+        uint32_t ref = store->strings.table[i].ref;
+        if (ref != STRING_REF_NONE && !snapshotStringValid(&store->strings, ref)) {
+            return "its string table is damaged";
+        }
+    }
+    if (!snapshotIntMapValid(&store->index, store->count)) {
+        return "its Order ID index is damaged";
+    }
+    if (!snapshotIntMapValid(&store->names.lists, store->names.listCount)) {
+        return "its trigram index is damaged";
+    }
+
+    const ValueTree *tree = &store->stats.top;
+    uint8_t *seen = calloc((size_t)tree->nodeCount + 1, 1);
+    if (seen == NULL) {
+        return "out of memory";
+    }
+    int prevLeaf = -1;
+    int keys = 0;
+    bool valid = tree->root == -1 ||
+                 (snapshotValueNodeValid(tree, tree->root, 0, seen, &prevLeaf, &keys, store->count) &&
+                  tree->nodes[prevLeaf].next == -1);
+    valid = valid && keys == tree->size;
+    for (int node = tree->freeList; valid && node != -1; node = tree->nodes[node].next) {
+        valid = node >= 0 && node < tree->nodeCount && !seen[node];
+        if (valid) {
+            seen[node] = 1;
+        }
+    }
+    free(seen);
+    return valid ? NULL : "its value index is damaged";
+}
+
+/**
+ * Loads the order store from a snapshot file without parsing or copying
+ * the orders. The file is mapped copy-on-write and the store's slabs,
+ * string chunks, indexes and aggregates point straight into it; pages are
+ * read on first touch and copied only when modified. Structures that later
+ * need to grow are moved to the heap at that point (see
+ * resizeStoreMemory()).
+ *
+ * Only the header and the small sections are checksummed here;
+ * verifySnapshot() checks the rest. Every index and reference in the file
+ * is still bounds-checked (see snapshotCheckBounds()), which costs one
+ * read of the columns and indexes but no hashing.
+ *
+ * @param path    The snapshot file to load
+ * @param csvPath The data file the snapshot must match, or NULL to accept
+ *                it regardless
+ * @return Number of orders loaded, or -1 if there is no usable snapshot and
+ *         the data file should be parsed instead
+ */
+int loadSnapshot(const char *path, const char *csvPath) {
+    OrderStore *store = &orderStore;
+    if (store->count != 0 || snapshotMemory.data != NULL) {
+        return -1;
+    }
+    MappedFile file;
+    if (!mappedFileOpen(path, &file, true)) {
+        return -1;
+    }
+    const SnapshotHeader *header = snapshotHeader(&file);
+    if (header == NULL ||
+        !snapshotSectionValid(&file, &header->sections[SNAPSHOT_TRIGRAM_COUNTS]) ||
+        !snapshotSectionValid(&file, &header->sections[SNAPSHOT_STATUS_LABELS])) {
+        printf("[WARN] Ignoring %s: not a valid snapshot for this version.\n", path);
+        mappedFileClose(&file);
+        return -1;
+    }
+
+    uint64_t csvSize;
+    int64_t csvModified;
+    if (csvPath != NULL && snapshotStampFile(csvPath, &csvSize, &csvModified) &&
+        (csvSize != header->csvSize || csvModified != header->csvModified)) {
+        printf("[INFO] %s has changed since %s was saved; reading it instead.\n", csvPath, path);
+        mappedFileClose(&file);
+        return -1;
+    }
+
+#if defined(__SIZEOF_INT128__)
+    MoneyTotal revenue = (MoneyTotal)(((unsigned __int128)(uint64_t)header->revenueHigh << 64) | header->revenueLow);
+#else
+    MoneyTotal revenue = (MoneyTotal)header->revenueLow;
+    if (header->revenueHigh != (revenue < 0 ? -1 : 0)) {
+        printf("[WARN] Ignoring %s: revenue total exceeds 64 bits.\n", path);
+        mappedFileClose(&file);
+        return -1;
+    }
+#endif
+
+    /* Status ids in the slabs must mean the same labels after interning */
+    const char *labels = file.data + header->sections[SNAPSHOT_STATUS_LABELS].offset;
+    for (int i = 0; i < header->statusCount; i++) {
+        char label[MAX_STATUS_LENGTH];
+        memcpy(label, labels + (size_t)i * MAX_STATUS_LENGTH, sizeof(label));
+        label[sizeof(label) - 1] = '\0';
+        if (statusIntern(label) != i) {
+            printf("[WARN] Ignoring %s: its status labels do not match.\n", path);
+            mappedFileClose(&file);
+            return -1;
+        }
+    }
+
+    int slabCapacity = 4;
+    while (slabCapacity < header->slabCount) {
+        slabCapacity *= 2;
+    }
+    int chunkCapacity = header->stringChunkCount > 0 ? header->stringChunkCount : 1;
+    int listCapacity = header->trigramListCount > 0 ? header->trigramListCount : 1;
+    OrderSlab **slabs = malloc((size_t)slabCapacity * sizeof(*slabs));
+    char **chunks = malloc((size_t)chunkCapacity * sizeof(*chunks));
+    SlotList *postings = malloc((size_t)listCapacity * sizeof(*postings));
+    if (slabs == NULL || chunks == NULL || postings == NULL) {
+        free(slabs);
+        free(chunks);
+        free(postings);
+        mappedFileClose(&file);
+        printf("[ERROR] Out of memory while loading %s.\n", path);
+        return -1;
+    }
+
+    char *base = file.data;
+    const SnapshotSection *sections = header->sections;
+    for (int i = 0; i < header->slabCount; i++) {
+        slabs[i] = (OrderSlab *)(base + sections[SNAPSHOT_SLABS].offset) + i;
+    }
+    for (int i = 0; i < header->stringChunkCount; i++) {
+        chunks[i] = base + sections[SNAPSHOT_STRINGS].offset + (size_t)i * STRING_CHUNK_SIZE;
+    }
+    const int32_t *counts = (const int32_t *)(base + sections[SNAPSHOT_TRIGRAM_COUNTS].offset);
+    char *slots = base + sections[SNAPSHOT_TRIGRAM_SLOTS].offset;
+    char *slotsEnd = slots + sections[SNAPSHOT_TRIGRAM_SLOTS].length;
+    for (int i = 0; i < header->trigramListCount; i++) {
+        size_t bytes = snapshotPadded((size_t)counts[i] * sizeof(int));
+        if (counts[i] < 0 || bytes > (size_t)(slotsEnd - slots)) {
+            free(slabs);
+            free(chunks);
+            free(postings);
+            mappedFileClose(&file);
+            printf("[WARN] Ignoring %s: its trigram index is damaged.\n", path);
+            return -1;
+        }
+        postings[i].slots = (int *)slots;
+        postings[i].count = counts[i];
+        postings[i].capacity = counts[i];
+        slots += bytes;
+    }
+
+    store->slabs = slabs;
+    store->slabCount = header->slabCount;
+    store->slabCapacity = slabCapacity;
+    store->count = header->count;
+    store->liveCount = header->liveCount;
+    store->index.entries = (IntMapEntry *)(base + sections[SNAPSHOT_ORDER_INDEX].offset);
+    store->index.capacity = header->indexCapacity;
+    store->index.size = header->indexSize;
+    store->strings.chunks = chunks;
+    store->strings.chunkCount = header->stringChunkCount;
+    store->strings.chunkCapacity = chunkCapacity;
+    store->strings.used = header->stringUsed;
+    store->strings.totalBytes = header->stringTotal;
+    store->strings.garbageBytes = header->stringGarbage;
+    store->strings.table = (StringEntry *)(base + sections[SNAPSHOT_STRING_TABLE].offset);
+    store->strings.tableCapacity = header->stringTableCapacity;
+    store->strings.tableSize = header->stringTableSize;
+    store->names.lists.entries = (IntMapEntry *)(base + sections[SNAPSHOT_TRIGRAM_LISTS].offset);
+    store->names.lists.capacity = header->trigramCapacity;
+    store->names.lists.size = header->trigramSize;
+    store->names.postings = postings;
+    store->names.listCount = header->trigramListCount;
+    store->names.listCapacity = listCapacity;
+    store->names.postingCount = header->postingCount;
+    store->names.staleCount = header->staleCount;
+    store->stats.revenue = revenue;
+    for (size_t i = 0; i < STATUS_CATEGORY_COUNT; i++) {
+        store->stats.statusCounts[i] = header->statusCounts[i];
+    }
+    store->stats.top.nodes = (ValueNode *)(base + sections[SNAPSHOT_VALUE_NODES].offset);
+    store->stats.top.nodeCount = header->valueNodeCount;
+    store->stats.top.nodeCapacity = header->valueNodeCount;
+    store->stats.top.freeList = header->valueFreeList;
+    store->stats.top.root = header->valueRoot;
+    store->stats.top.height = header->valueHeight;
+    store->stats.top.size = header->valueSize;
+    const char *problem = snapshotCheckBounds(store, header->statusCount);
+    if (problem != NULL) {
+        free(slabs);
+        free(chunks);
+        free(postings);
+        orderStoreInit(store);
+        mappedFileClose(&file);
+        printf("[WARN] Ignoring %s: %s.\n", path, problem);
+        return -1;
+    }
+    snapshotMemory = file;
+    journal.checkpointSequence = header->journalSequence;
+    journal.checkpointBytes = header->csvSize;
+    AGGREGATES_VERIFY(store);
+    return store->liveCount;
+}
+
+/**
+ * Checks every section of a snapshot file against its checksum.
+ *
+ * @param path The snapshot file to check
+ * @return 1 if the snapshot is intact, 0 otherwise
+ */
+int verifySnapshot(const char *path) {
+    MappedFile file;
+    if (!mappedFileOpen(path, &file, false)) {
+        printf("[ERROR] Unable to open %s.\n", path);
+        return 0;
+    }
+    static const char *const names[SNAPSHOT_SECTION_COUNT] = {
+        "slabs", "strings", "order index", "trigram lists", "trigram counts",
+        "trigram postings", "value index", "status labels", "string table"
+    };
+    const SnapshotHeader *header = snapshotHeader(&file);
+    int valid = header != NULL;
+    if (!valid) {
+        printf("[ERROR] %s: bad header or layout.\n", path);
+    }
+    for (int i = 0; valid && i < SNAPSHOT_SECTION_COUNT; i++) {
+        if (!snapshotSectionValid(&file, &header->sections[i])) {
+            printf("[ERROR] %s: %s section fails its checksum.\n", path, names[i]);
+            valid = 0;
+        }
+    }
+    if (valid) {
+        printf("[INFO] %s: %d order(s), all %d sections intact.\n", path, header->liveCount, SNAPSHOT_SECTION_COUNT);
+    }
+    mappedFileClose(&file);
+    return valid;
+}
+
+/* =============================================================================
+ * COLUMNAR FILE FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Appends an unsigned varint: seven bits per byte, low bits first, with the
+ * top bit set on every byte but the last.
+ */
+static uint8_t *appendVarint(uint8_t *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+/**
+ * Reads an unsigned varint.
+ *
+ * @return The byte after the varint, or NULL if it runs past end or does
+ *         not fit in 64 bits
+ */
+static const uint8_t *readVarint(const uint8_t *p, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Maps a signed difference to an unsigned one so that small differences of
+ * either sign make short varints: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+ */
+static inline uint64_t zigzagEncode(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+/**
+ * Reverses zigzagEncode().
+ */
+static inline int64_t zigzagDecode(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * Reads eight bytes as a little-endian word. Compilers turn this into a
+ * single load on little-endian machines.
+ */
+static inline uint64_t loadLittleEndian(const uint8_t *p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+/**
+ * Appends a bit-packed column: the number of bits the widest value above
+ * the smallest needs, the smallest as a varint, then every value less the
+ * smallest in that many bits, low bits first. COLUMNAR_PACK_SLACK zero
+ * bytes follow so a reader can always load a whole word. A column of equal
+ * values takes no bits at all.
+ *
+ * @param out    Where to write the column
+ * @param values The values; their spread must fit in COLUMNAR_MAX_WIDTH bits
+ * @param count  Number of values, at least 1
+ * @return The byte after the column
+ */
+static uint8_t *appendPackedColumn(uint8_t *out, const uint64_t *values, int count) {
+    uint64_t low = values[0];
+    uint64_t high = values[0];
+    for (int i = 1; i < count; i++) {
+        low = values[i] < low ? values[i] : low;
+        high = values[i] > high ? values[i] : high;
+    }
+    int width = high > low ? highestSetBit(high - low) + 1 : 0;
+    *out++ = (uint8_t)width;
+    out = appendVarint(out, low);
+    if (width == 0) {
+        return out;
+    }
+
+    uint64_t word = 0;
+    int bits = 0;
+    for (int i = 0; i < count; i++) {
+        word |= (values[i] - low) << bits;
+        bits += width;
+        while (bits >= 8) {
+            *out++ = (uint8_t)word;
+            word >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0) {
+        *out++ = (uint8_t)word;
+    }
+    memset(out, 0, COLUMNAR_PACK_SLACK);
+    return out + COLUMNAR_PACK_SLACK;
+}
+
+/**
+ * Locates a column written by appendPackedColumn() and moves past it.
+ *
+ * @param p      Start of the column; receives the byte after it
+ * @param end    End of the block
+ * @param count  Number of values in the column
+ * @param column Receives the column
+ * @return 1 on success, 0 if the column is malformed
+ */
+static int readPackedColumn(const uint8_t **p, const uint8_t *end, int count, PackedColumn *column) {
+    static const uint8_t zeros[8] = { 0 };
+    const uint8_t *at = *p;
+    if (at >= end || *at > COLUMNAR_MAX_WIDTH) {
+        return 0;
+    }
+    column->width = *at++;
+    if ((at = readVarint(at, end, &column->base)) == NULL) {
+        return 0;
+    }
+    column->mask = ((uint64_t)1 << column->width) - 1;
+    column->data = zeros;
+    if (column->width > 0) {
+        size_t bytes = ((size_t)count * (size_t)column->width + 7) / 8 + COLUMNAR_PACK_SLACK;
+        if (bytes > (size_t)(end - at)) {
+            return 0;
+        }
+        column->data = at;
+        at += bytes;
+    }
+    *p = at;
+    return 1;
+}
+
+/**
+ * Returns value i of a packed column.
+ */
+static inline uint64_t packedValue(const PackedColumn *column, int i) {
+    size_t bit = (size_t)i * (size_t)column->width;
+    return column->base + ((loadLittleEndian(column->data + (bit >> 3)) >> (bit & 7)) & column->mask);
+}
+
+/**
+ * Returns the dictionary index of a name being written to a columnar file,
+ * adding the name the first time it is seen.
+ *
+ * @return The index, or -1 if memory could not be allocated
+ */
+static int columnarNameIndex(ColumnarNames *names, uint32_t ref) {
+    int index = intMapGet(&names->lookup, (int)ref);
+    if (index != -1) {
+        return index;
+    }
+    if (names->count == names->capacity) {
+        int capacity = names->capacity == 0 ? 1024 : names->capacity * 2;
+        uint32_t *refs = realloc(names->refs, (size_t)capacity * sizeof(*refs));
+        if (refs == NULL) {
+            return -1;
+        }
+        names->refs = refs;
+        names->capacity = capacity;
+    }
+    if (!intMapReserve(&names->lookup, names->lookup.size + 1)) {
+        return -1;
+    }
+    intMapPut(&names->lookup, (int)ref, names->count);
+    names->refs[names->count] = ref;
+    return names->count++;
+}
+
+/**
+ * Appends a length-prefixed string to a dictionary section.
+ */
+static uint8_t *appendDictionaryText(uint8_t *out, const char *text, size_t length) {
+    out = appendVarint(out, length);
+    memcpy(out, text, length);
+    return out + length;
+}
+
+/**
+ * Reads one string from a dictionary section.
+ *
+ * @param p      Start of the entry
+ * @param end    End of the section
+ * @param limit  Lengths must be below this
+ * @param text   Receives the text, which is not NUL-terminated
+ * @param length Receives its length
+ * @return The byte after the entry, or NULL if it is malformed
+ */
+static const uint8_t *readDictionaryText(const uint8_t *p, const uint8_t *end, size_t limit,
+                                         const char **text, size_t *length) {
+    uint64_t value;
+    if ((p = readVarint(p, end, &value)) == NULL || value == 0 || value >= limit ||
+        value > (uint64_t)(end - p) || memchr(p, '\0', (size_t)value) != NULL) {
+        return NULL;
+    }
+    *text = (const char *)p;
+    *length = (size_t)value;
+    return p + value;
+}
+
+/**
+ * Encodes one block: the order IDs as zigzag varint differences, each from
+ * the one before and the first from the block's smallest ID, then the
+ * packed columns.
+ *
+ * @param ids     Order IDs of the block's orders
+ * @param columns COLUMNAR_COLUMN_COUNT runs of COLUMNAR_BLOCK_ROWS values
+ * @param block   The block's directory entry, with its rows and stats set
+ * @param out     Room for the encoded block
+ * @return The byte after the block
+ */
+static uint8_t *encodeColumnarBlock(const int *ids, const uint64_t *columns, const ColumnarBlock *block, uint8_t *out) {
+    int64_t previous = block->minOrderID;
+    for (int i = 0; i < block->rows; i++) {
+        out = appendVarint(out, zigzagEncode((int64_t)ids[i] - previous));
+        previous = ids[i];
+    }
+    for (int c = 0; c < COLUMNAR_COLUMN_COUNT; c++) {
+        out = appendPackedColumn(out, columns + (size_t)c * COLUMNAR_BLOCK_ROWS, block->rows);
+    }
+    return out;
+}
+
+/**
+ * Writes all orders to a columnar data file (see ColumnarHeader). Like the
+ * CSV, the file is written under a temporary name, synced and renamed into
+ * place. Blocks are encoded one at a time, so memory use beyond the name
+ * dictionary stays bounded however large the book is.
+ *
+ * @param path The file to write
+ * @return 1 on success, 0 on failure
+ */
+int saveOrdersToColumnar(const char *path) {
+    const OrderStore *store = &orderStore;
+    char temporary[FILENAME_MAX];
+    SnapshotWriter writer = { NULL, 0, false };
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) < (int)sizeof(temporary)) {
+        writer.file = fopen(temporary, "wb");
+    }
+    if (writer.file == NULL) {
+        printf("\n[ERROR] Unable to open file for writing: %s\n", path);
+        printf("[TIP] Check file permissions and disk space.\n");
+        return 0;
+    }
+
+    /* Worst case: ten-byte varints and eight-byte values throughout */
+    size_t blockBytes = (size_t)COLUMNAR_BLOCK_ROWS * (10 + 8 * COLUMNAR_COLUMN_COUNT) +
+                        COLUMNAR_COLUMN_COUNT * (1 + 10 + COLUMNAR_PACK_SLACK);
+    int blockCount = (store->liveCount + COLUMNAR_BLOCK_ROWS - 1) / COLUMNAR_BLOCK_ROWS;
+    ColumnarBlock *directory = calloc((size_t)blockCount + 1, sizeof(*directory));
+    int *ids = malloc(COLUMNAR_BLOCK_ROWS * sizeof(*ids));
+    uint64_t *columns = malloc((size_t)COLUMNAR_COLUMN_COUNT * COLUMNAR_BLOCK_ROWS * sizeof(*columns));
+    uint8_t *encoded = malloc(blockBytes);
+    ColumnarNames names;
+    memset(&names, 0, sizeof(names));
+    bool failed = directory == NULL || ids == NULL || columns == NULL || encoded == NULL;
+
+    ColumnarHeader header;
+    memset(&header, 0, sizeof(header));
+    snapshotWriteRaw(&writer, &header, sizeof(header));
+
+    int slot = orderStoreNextLive(store, 0);
+    for (int b = 0; b < blockCount && !failed; b++) {
+        ColumnarBlock *block = &directory[b];
+        int rows = 0;
+        for (; rows < COLUMNAR_BLOCK_ROWS && slot != -1; rows++, slot = orderStoreNextLive(store, slot + 1)) {
+            const OrderSlab *slab = orderStoreSlab(store, slot);
+            int i = slot & ORDER_SLAB_MASK;
+            int customer = columnarNameIndex(&names, slab->customerNames[i]);
+            int product = columnarNameIndex(&names, slab->productNames[i]);
+            if (customer == -1 || product == -1) {
+                failed = true;
+                break;
+            }
+            int orderID = slab->orderIDs[i];
+            int quantity = slab->quantities[i];
+            Money price = slab->prices[i];
+            Money value = price * quantity;
+            ids[rows] = orderID;
+            columns[COLUMN_CUSTOMER * COLUMNAR_BLOCK_ROWS + rows] = (uint64_t)customer;
+            columns[COLUMN_PRODUCT * COLUMNAR_BLOCK_ROWS + rows] = (uint64_t)product;
+            columns[COLUMN_STATUS * COLUMNAR_BLOCK_ROWS + rows] = slab->statusIds[i];
+            /* Offset so the negative amounts a CSV file may hold stay unsigned */
+            columns[COLUMN_QUANTITY * COLUMNAR_BLOCK_ROWS + rows] = (uint64_t)(quantity + MAX_QUANTITY);
+            columns[COLUMN_PRICE * COLUMNAR_BLOCK_ROWS + rows] = (uint64_t)(price + MAX_PRICE_CENTS);
+
+            if (rows == 0) {
+                block->minOrderID = block->maxOrderID = orderID;
+                block->minQuantity = block->maxQuantity = quantity;
+                block->minPrice = block->maxPrice = price;
+                block->minValue = block->maxValue = value;
+            }
+            block->minOrderID = orderID < block->minOrderID ? orderID : block->minOrderID;
+            block->maxOrderID = orderID > block->maxOrderID ? orderID : block->maxOrderID;
+            block->minQuantity = quantity < block->minQuantity ? quantity : block->minQuantity;
+            block->maxQuantity = quantity > block->maxQuantity ? quantity : block->maxQuantity;
+            block->minPrice = price < block->minPrice ? price : block->minPrice;
+            block->maxPrice = price > block->maxPrice ? price : block->maxPrice;
+            block->minValue = value < block->minValue ? value : block->minValue;
+            block->maxValue = value > block->maxValue ? value : block->maxValue;
+            block->categories |= 1u << statusCategory(slab->statusIds[i]);
+        }
+        if (failed) {
+            break;
+        }
+        block->rows = rows;
+        uint8_t *end = encodeColumnarBlock(ids, columns, block, encoded);
+        snapshotBeginSection(&writer, &block->data);
+        snapshotWriteBlock(&writer, &block->data, encoded, (size_t)(end - encoded));
+    }
+
+    /* The dictionaries: every name the blocks refer to, and every status */
+    size_t nameBytes = 0;
+    for (int i = 0; i < names.count; i++) {
+        nameBytes += stringHeapHeader(&store->strings, names.refs[i])->length + 10;
+    }
+    size_t statusBytes = (size_t)statusDictionary.count * (MAX_STATUS_LENGTH + 10);
+    uint8_t *text = failed ? NULL : malloc((nameBytes > statusBytes ? nameBytes : statusBytes) + 1);
+    failed = failed || text == NULL;
+    if (!failed) {
+        uint8_t *end = text;
+        for (int i = 0; i < names.count; i++) {
+            end = appendDictionaryText(end, stringHeapGet(&store->strings, names.refs[i]),
+                                       stringHeapHeader(&store->strings, names.refs[i])->length);
+        }
+        snapshotBeginSection(&writer, &header.sections[COLUMNAR_NAMES]);
+        snapshotWriteBlock(&writer, &header.sections[COLUMNAR_NAMES], text, (size_t)(end - text));
+
+        end = text;
+        for (int i = 0; i < statusDictionary.count; i++) {
+            const char *label = statusLabel(i);
+            end = appendDictionaryText(end, label, strlen(label));
+        }
+        snapshotBeginSection(&writer, &header.sections[COLUMNAR_STATUSES]);
+        snapshotWriteBlock(&writer, &header.sections[COLUMNAR_STATUSES], text, (size_t)(end - text));
+
+        snapshotBeginSection(&writer, &header.sections[COLUMNAR_DIRECTORY]);
+        snapshotWriteBlock(&writer, &header.sections[COLUMNAR_DIRECTORY], directory,
+                           (size_t)blockCount * sizeof(*directory));
+    }
+    free(text);
+    free(encoded);
+    free(columns);
+    free(ids);
+    free(directory);
+    free(names.refs);
+    free(names.lookup.entries);
+
+    memcpy(header.magic, COLUMNAR_MAGIC, sizeof(header.magic));
+    header.version = COLUMNAR_VERSION;
+    header.headerSize = sizeof(header);
+    header.byteOrder = 0x01020304;
+    header.blockRows = COLUMNAR_BLOCK_ROWS;
+    header.journalSequence = journal.checkpointSequence;
+    header.orderCount = store->liveCount;
+    header.blockCount = blockCount;
+    header.nameCount = names.count;
+    header.statusCount = statusDictionary.count;
+    header.headerChecksum = snapshotChecksum(SNAPSHOT_SEED, &header, offsetof(ColumnarHeader, headerChecksum));
+    if (!writer.failed && (fseek(writer.file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer.file) != 1)) {
+        writer.failed = true;
+    }
+    failed = failed || writer.failed || !syncFile(writer.file);
+    if (fclose(writer.file) != 0 || failed || !replaceFile(temporary, path)) {
+        remove(temporary);
+        printf("\n[ERROR] Unable to write %s.\n", path);
+        printf("[TIP] Check file permissions and disk space.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Checks that a section lies within a file and matches its checksum.
+ */
+static bool columnarSectionValid(const MappedFile *file, const SnapshotSection *section) {
+    return section->offset % 8 == 0 && section->offset <= file->size &&
+           section->length <= file->size - section->offset && snapshotSectionValid(file, section);
+}
+
+/**
+ * Returns the block directory of a validated columnar file.
+ */
+static const ColumnarBlock *columnarDirectory(const MappedFile *file, const ColumnarHeader *header) {
+    return (const ColumnarBlock *)(file->data + header->sections[COLUMNAR_DIRECTORY].offset);
+}
+
+/**
+ * Validates the header, dictionaries and block directory of a mapped
+ * columnar file. The blocks themselves are checked as they are decoded.
+ *
+ * @param file The mapped file
+ * @return The header, or NULL if the file is not a columnar file this
+ *         build can use
+ */
+static const ColumnarHeader *columnarHeader(const MappedFile *file) {
+    if (file->size < sizeof(ColumnarHeader)) {
+        return NULL;
+    }
+    const ColumnarHeader *header = (const ColumnarHeader *)file->data;
+    if (memcmp(header->magic, COLUMNAR_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != COLUMNAR_VERSION ||
+        header->headerSize != sizeof(ColumnarHeader) ||
+        header->byteOrder != 0x01020304 ||
+        header->blockRows == 0 || header->blockRows > COLUMNAR_BLOCK_ROWS ||
+        header->headerChecksum != snapshotChecksum(SNAPSHOT_SEED, header, offsetof(ColumnarHeader, headerChecksum)) ||
+        header->orderCount < 0 || header->blockCount < 0 || header->nameCount < 0 ||
+        header->statusCount < 0 || header->statusCount > MAX_STATUS_IDS) {
+        return NULL;
+    }
+    for (int i = 0; i < COLUMNAR_SECTION_COUNT; i++) {
+        if (!columnarSectionValid(file, &header->sections[i])) {
+            return NULL;
+        }
+    }
+    if (header->sections[COLUMNAR_DIRECTORY].length != (uint64_t)header->blockCount * sizeof(ColumnarBlock)) {
+        return NULL;
+    }
+
+    const ColumnarBlock *directory = columnarDirectory(file, header);
+    int64_t orders = 0;
+    for (int b = 0; b < header->blockCount; b++) {
+        const SnapshotSection *data = &directory[b].data;
+        if (directory[b].rows <= 0 || (uint32_t)directory[b].rows > header->blockRows ||
+            data->offset % 8 != 0 || data->offset > file->size || data->length > file->size - data->offset) {
+            return NULL;
+        }
+        orders += directory[b].rows;
+    }
+    return orders == header->orderCount ? header : NULL;
+}
+
+/**
+ * Allocates room for decoded rows.
+ *
+ * @param rows     The rows to set up
+ * @param capacity Number of rows to make room for
+ * @param names    Whether to allocate the name columns too
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int columnarRowsAllocate(ColumnarRows *rows, size_t capacity, bool names) {
+    memset(rows, 0, sizeof(*rows));
+    capacity++;
+    rows->orderIDs = malloc(capacity * sizeof(*rows->orderIDs));
+    rows->quantities = malloc(capacity * sizeof(*rows->quantities));
+    rows->prices = malloc(capacity * sizeof(*rows->prices));
+    rows->statuses = malloc(capacity * sizeof(*rows->statuses));
+    if (names) {
+        rows->customers = malloc(capacity * sizeof(*rows->customers));
+        rows->products = malloc(capacity * sizeof(*rows->products));
+    }
+    return rows->orderIDs != NULL && rows->quantities != NULL && rows->prices != NULL &&
+           rows->statuses != NULL && (!names || (rows->customers != NULL && rows->products != NULL));
+}
+
+/**
+ * Releases decoded rows.
+ */
+static void columnarRowsFree(ColumnarRows *rows) {
+    free(rows->orderIDs);
+    free(rows->quantities);
+    free(rows->prices);
+    free(rows->statuses);
+    free(rows->customers);
+    free(rows->products);
+    memset(rows, 0, sizeof(*rows));
+}
+
+/**
+ * Decodes one block after the rows already held, checking its checksum
+ * and that every value is one an order can have. Nothing is kept from a
+ * damaged block.
+ *
+ * @param file   The mapped file
+ * @param header Its header
+ * @param block  The block's directory entry
+ * @param rows   Receives the rows; must have room for block->rows more
+ * @param names  Whether to decode the name columns or only skip them
+ * @return 1 on success, 0 if the block is damaged
+ */
+static int decodeColumnarBlock(const MappedFile *file, const ColumnarHeader *header,
+                               const ColumnarBlock *block, ColumnarRows *rows, bool names) {
+    if (!snapshotSectionValid(file, &block->data)) {
+        return 0;
+    }
+    const uint8_t *p = (const uint8_t *)file->data + block->data.offset;
+    const uint8_t *end = p + block->data.length;
+    int count = block->rows;
+    int first = rows->count;
+
+    int64_t previous = block->minOrderID;
+    for (int i = 0; i < count; i++) {
+        uint64_t delta;
+        if ((p = readVarint(p, end, &delta)) == NULL || delta > 2 * (uint64_t)UINT32_MAX) {
+            return 0;
+        }
+        previous += zigzagDecode(delta);
+        if (previous < INT_MIN || previous > INT_MAX) {
+            return 0;
+        }
+        rows->orderIDs[first + i] = (int)previous;
+    }
+
+    /* A base out of range would also let the sums below wrap around */
+    const uint64_t limits[COLUMNAR_COLUMN_COUNT] = {
+        (uint64_t)header->nameCount, (uint64_t)header->nameCount, (uint64_t)header->statusCount,
+        2 * MAX_QUANTITY + 1, 2 * MAX_PRICE_CENTS + 1
+    };
+    PackedColumn columns[COLUMNAR_COLUMN_COUNT];
+    for (int c = 0; c < COLUMNAR_COLUMN_COUNT; c++) {
+        if (!readPackedColumn(&p, end, count, &columns[c]) || columns[c].base >= limits[c]) {
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        uint64_t status = packedValue(&columns[COLUMN_STATUS], i);
+        uint64_t quantity = packedValue(&columns[COLUMN_QUANTITY], i);
+        uint64_t price = packedValue(&columns[COLUMN_PRICE], i);
+        if (status >= limits[COLUMN_STATUS] || quantity >= limits[COLUMN_QUANTITY] || price >= limits[COLUMN_PRICE]) {
+            return 0;
+        }
+        rows->statuses[first + i] = (uint32_t)status;
+        rows->quantities[first + i] = (int)quantity - MAX_QUANTITY;
+        rows->prices[first + i] = (Money)price - MAX_PRICE_CENTS;
+    }
+    if (names) {
+        for (int i = 0; i < count; i++) {
+            uint64_t customer = packedValue(&columns[COLUMN_CUSTOMER], i);
+            uint64_t product = packedValue(&columns[COLUMN_PRODUCT], i);
+            if (customer >= limits[COLUMN_CUSTOMER] || product >= limits[COLUMN_PRODUCT]) {
+                return 0;
+            }
+            rows->customers[first + i] = (uint32_t)customer;
+            rows->products[first + i] = (uint32_t)product;
+        }
+    }
+    rows->count += count;
+    return 1;
+}
+
+/**
+ * Decodes a loader's run of blocks.
+ */
+static void decodeColumnarChunk(ColumnarChunk *chunk) {
+    const ColumnarBlock *directory = columnarDirectory(chunk->file, chunk->header);
+    size_t capacity = 0;
+    for (int b = chunk->first; b < chunk->end; b++) {
+        capacity += (size_t)directory[b].rows;
+    }
+    if (!columnarRowsAllocate(&chunk->rows, capacity, true)) {
+        chunk->outOfMemory = true;
+        return;
+    }
+    for (int b = chunk->first; b < chunk->end; b++) {
+        if (!decodeColumnarBlock(chunk->file, chunk->header, &directory[b], &chunk->rows, true)) {
+            chunk->damagedBlocks++;
+            chunk->damagedRows += directory[b].rows;
+        }
+    }
+}
+
+#ifdef ECOM_POSIX
+/**
+ * Thread entry point for decodeColumnarChunk().
+ */
+static void *decodeColumnarChunkThread(void *arg) {
+    decodeColumnarChunk(arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Decodes runs of blocks, one thread per run where threads are available.
+ *
+ * @param chunks     The runs to decode
+ * @param chunkCount Number of runs, at most WORKER_MAX_THREADS
+ */
+static void decodeColumnarChunks(ColumnarChunk *chunks, int chunkCount) {
+#ifdef ECOM_POSIX
+    pthread_t threads[WORKER_MAX_THREADS];
+    bool started[WORKER_MAX_THREADS] = { false };
+    for (int i = 1; i < chunkCount; i++) {
+        started[i] = pthread_create(&threads[i], NULL, decodeColumnarChunkThread, &chunks[i]) == 0;
+    }
+    decodeColumnarChunk(&chunks[0]);
+    for (int i = 1; i < chunkCount; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            decodeColumnarChunk(&chunks[i]);
+        }
+    }
+#else
+    for (int i = 0; i < chunkCount; i++) {
+        decodeColumnarChunk(&chunks[i]);
+    }
+#endif
+}
+
+/**
+ * Loads orders from a columnar data file.
+ *
+ * The dictionaries are interned first, so each distinct name is hashed
+ * once rather than once per order. The blocks are then decoded in
+ * parallel and their rows appended to the store in file order. A damaged
+ * block is reported and skipped; the rest still load, and the next
+ * checkpoint moves the file aside rather than overwrite it.
+ *
+ * @param path The file to read
+ * @return Number of orders loaded, or -1 if the file cannot be used
+ */
+int loadOrdersFromColumnar(const char *path) {
+    MappedFile file;
+    if (!mappedFileOpen(path, &file, false)) {
+        printf("[ERROR] Unable to read %s.\n", path);
+        return -1;
+    }
+    const ColumnarHeader *header = columnarHeader(&file);
+    if (header == NULL) {
+        printf("[ERROR] %s is damaged or was written by an incompatible version.\n", path);
+        markDataFileDamaged(path);
+        mappedFileClose(&file);
+        return -1;
+    }
+    journal.checkpointSequence = header->journalSequence;
+    journal.checkpointBytes = file.size;
+
+    /* File dictionary index -> status id, and -> interned name */
+    int *statusIds = malloc(((size_t)header->statusCount + 1) * sizeof(*statusIds));
+    uint32_t *nameRefs = malloc(((size_t)header->nameCount + 1) * sizeof(*nameRefs));
+    const char *problem = statusIds == NULL || nameRefs == NULL ? "out of memory" : NULL;
+    const SnapshotSection *section = &header->sections[COLUMNAR_STATUSES];
+    const uint8_t *p = (const uint8_t *)file.data + section->offset;
+    const uint8_t *end = p + section->length;
+    for (int i = 0; problem == NULL && i < header->statusCount; i++) {
+        const char *text;
+        size_t length;
+        char label[MAX_STATUS_LENGTH];
+        if ((p = readDictionaryText(p, end, MAX_STATUS_LENGTH, &text, &length)) == NULL) {
+            problem = "its status dictionary is damaged";
+            break;
+        }
+        memcpy(label, text, length);
+        label[length] = '\0';
+        if ((statusIds[i] = statusIntern(label)) < 0) {
+            problem = "too many distinct statuses";
+        }
+    }
+    int interned = 0;
+    section = &header->sections[COLUMNAR_NAMES];
+    p = (const uint8_t *)file.data + section->offset;
+    end = p + section->length;
+    for (; problem == NULL && interned < header->nameCount; interned++) {
+        const char *text;
+        size_t length;
+        if ((p = readDictionaryText(p, end, MAX_NAME_LENGTH, &text, &length)) == NULL) {
+            problem = "its name dictionary is damaged";
+            break;
+        }
+        if ((nameRefs[interned] = stringHeapIntern(&orderStore.strings, text, length)) == STRING_REF_NONE) {
+            problem = "out of memory";
+            break;
+        }
+    }
+    if (problem != NULL) {
+        for (int i = 0; i < interned; i++) {
+            stringHeapRelease(&orderStore.strings, nameRefs[i]);
+        }
+        free(statusIds);
+        free(nameRefs);
+        mappedFileClose(&file);
+        printf("[ERROR] Unable to load %s: %s.\n", path, problem);
+        return -1;
+    }
+
+    ColumnarChunk chunks[WORKER_MAX_THREADS];
+    int chunkCount = workerThreadCount(file.size);
+    if (chunkCount > header->blockCount) {
+        chunkCount = header->blockCount > 0 ? header->blockCount : 1;
+    }
+    for (int c = 0; c < chunkCount; c++) {
+        memset(&chunks[c], 0, sizeof(chunks[c]));
+        chunks[c].file = &file;
+        chunks[c].header = header;
+        chunks[c].first = (int)((int64_t)header->blockCount * c / chunkCount);
+        chunks[c].end = (int)((int64_t)header->blockCount * (c + 1) / chunkCount);
+    }
+    decodeColumnarChunks(chunks, chunkCount);
+
+    int loadedCount = 0;
+    int damagedBlocks = 0;
+    int damagedRows = 0;
+    bool outOfMemory = false;
+    for (int c = 0; c < chunkCount; c++) {
+        const ColumnarRows *rows = &chunks[c].rows;
+        damagedBlocks += chunks[c].damagedBlocks;
+        damagedRows += chunks[c].damagedRows;
+        outOfMemory = outOfMemory || chunks[c].outOfMemory;
+        for (int r = 0; r < rows->count && !outOfMemory; r++) {
+            Order order = {
+                .orderID = rows->orderIDs[r],
+                .quantity = rows->quantities[r],
+                .price = rows->prices[r],
+                .statusId = (uint16_t)statusIds[rows->statuses[r]]
+            };
+            if (orderStoreAppendInterned(&orderStore, &order, nameRefs[rows->customers[r]],
+                                         nameRefs[rows->products[r]]) == -1) {
+                outOfMemory = true;
+                break;
+            }
+            loadedCount++;
+        }
+        columnarRowsFree(&chunks[c].rows);
+    }
+    /* Drop the dictionary's own uses, leaving one per order */
+    for (int i = 0; i < interned; i++) {
+        stringHeapRelease(&orderStore.strings, nameRefs[i]);
+    }
+    free(statusIds);
+    free(nameRefs);
+    mappedFileClose(&file);
+
+    if (damagedBlocks > 0) {
+        printf("[WARN] %s: skipped %d damaged block(s) holding %d order(s).\n", path, damagedBlocks, damagedRows);
+    }
+    if (outOfMemory) {
+        printf("[ERROR] Out of memory after loading %d order(s).\n", loadedCount);
+    }
+
+    /* Index everything in one pass; duplicate IDs would be unreachable */
+    int duplicates = orderStoreReindex(&orderStore);
+    if (duplicates < 0) {
+        printf("[ERROR] Out of memory while indexing orders.\n");
+        orderStoreFree(&orderStore);
+        return -1;
+    }
+    if (duplicates > 0) {
+        printf("[WARN] Skipped %d order(s) with a duplicate Order ID.\n", duplicates);
+        loadedCount -= duplicates;
+    }
+    if (damagedBlocks > 0 || duplicates > 0) {
+        markDataFileDamaged(path);
+    }
+    METRICS_COUNT(recordsParsed, loadedCount);
+    METRICS_COUNT(recordsSkipped, damagedRows + duplicates);
+    return loadedCount;
+}
+
+/**
+ * Totals the orders of a columnar data file that pass a filter without
+ * loading the file. A block whose stats show it holds no match is not
+ * decoded at all, and the name columns of the rest are skipped over. A
+ * status filter is resolved against the file's status dictionary, so a
+ * custom label matches only its own orders.
+ *
+ * @param path   The file to scan
+ * @param filter Which orders to count
+ * @param scan   Receives the totals
+ * @return 1 on success, 0 if the file cannot be used
+ */
+int scanColumnarFile(const char *path, const ColumnarFilter *filter, ColumnarScan *scan) {
+    memset(scan, 0, sizeof(*scan));
+    MappedFile file;
+    if (!mappedFileOpen(path, &file, false)) {
+        printf("[ERROR] Unable to open %s.\n", path);
+        return 0;
+    }
+    const ColumnarHeader *header = columnarHeader(&file);
+    if (header == NULL) {
+        printf("[ERROR] %s is not a columnar data file this version can read.\n", path);
+        mappedFileClose(&file);
+        return 0;
+    }
+
+    /* Which labels in the file pass the status filter */
+    bool *wanted = malloc((size_t)header->statusCount + 1);
+    int category = filter->status != NULL ? mapStatusToIndex(filter->status) : -1;
+    bool anyWanted = filter->status == NULL;
+    ColumnarRows rows;
+    bool ok = wanted != NULL && columnarRowsAllocate(&rows, header->blockRows, false);
+    const SnapshotSection *section = &header->sections[COLUMNAR_STATUSES];
+    const uint8_t *p = (const uint8_t *)file.data + section->offset;
+    const uint8_t *end = p + section->length;
+    for (int i = 0; ok && i < header->statusCount; i++) {
+        const char *text;
+        size_t length;
+        char label[MAX_STATUS_LENGTH];
+        ok = (p = readDictionaryText(p, end, MAX_STATUS_LENGTH, &text, &length)) != NULL;
+        if (ok) {
+            memcpy(label, text, length);
+            label[length] = '\0';
+            wanted[i] = filter->status == NULL || equalsIgnoreCase(label, filter->status);
+            anyWanted = anyWanted || wanted[i];
+        }
+    }
+    if (ok && !anyWanted) {
+        printf("[WARN] No order in %s has the status \"%s\".\n", path, filter->status);
+    }
+
+    const ColumnarBlock *directory = columnarDirectory(&file, header);
+    for (int b = 0; ok && b < header->blockCount; b++) {
+        const ColumnarBlock *block = &directory[b];
+        if (block->maxOrderID < filter->minOrderID || block->minOrderID > filter->maxOrderID ||
+            block->maxValue < filter->minValue || block->minValue > filter->maxValue ||
+            !anyWanted || (category >= 0 && (block->categories & (1u << category)) == 0)) {
+            scan->blocksSkipped++;
+            continue;
+        }
+        rows.count = 0;
+        if (!decodeColumnarBlock(&file, header, block, &rows, false)) {
+            scan->damagedBlocks++;
+            continue;
+        }
+        scan->blocksRead++;
+        for (int r = 0; r < rows.count; r++) {
+            Money value = rows.prices[r] * rows.quantities[r];
+            if (rows.orderIDs[r] < filter->minOrderID || rows.orderIDs[r] > filter->maxOrderID ||
+                value < filter->minValue || value > filter->maxValue ||
+                !wanted[rows.statuses[r]]) {
+                continue;
+            }
+            scan->orders++;
+            scan->revenue += value;
+            if (scan->topOrderID == 0 || value > scan->topValue) {
+                scan->topOrderID = rows.orderIDs[r];
+                scan->topValue = value;
+            }
+        }
+    }
+    if (wanted != NULL && rows.orderIDs != NULL) {
+        columnarRowsFree(&rows);
+    }
+    free(wanted);
+    mappedFileClose(&file);
+    if (!ok) {
+        printf("[ERROR] Unable to scan %s.\n", path);
+    }
+    return ok;
+}
+
+/**
+ * Decodes every block of a columnar data file, checking its checksum and
+ * values.
+ *
+ * @param path The file to check
+ * @return 1 if the file is intact, 0 otherwise
+ */
+int verifyColumnarFile(const char *path) {
+    MappedFile file;
+    if (!mappedFileOpen(path, &file, false)) {
+        printf("[ERROR] Unable to open %s.\n", path);
+        return 0;
+    }
+    const ColumnarHeader *header = columnarHeader(&file);
+    if (header == NULL) {
+        printf("[ERROR] %s: bad header, dictionary or block directory.\n", path);
+        mappedFileClose(&file);
+        return 0;
+    }
+    ColumnarRows rows;
+    if (!columnarRowsAllocate(&rows, header->blockRows, true)) {
+        columnarRowsFree(&rows);
+        mappedFileClose(&file);
+        printf("[ERROR] Out of memory while checking %s.\n", path);
+        return 0;
+    }
+    const ColumnarBlock *directory = columnarDirectory(&file, header);
+    int damaged = 0;
+    for (int b = 0; b < header->blockCount; b++) {
+        rows.count = 0;
+        if (!decodeColumnarBlock(&file, header, &directory[b], &rows, true)) {
+            printf("[ERROR] %s: block %d (%d order(s)) is damaged.\n", path, b, directory[b].rows);
+            damaged++;
+        }
+    }
+    if (damaged == 0) {
+        printf("[INFO] %s: %d order(s) in %d block(s), all intact.\n", path, header->orderCount, header->blockCount);
+    }
+    columnarRowsFree(&rows);
+    mappedFileClose(&file);
+    return damaged == 0;
+}
+
+/* =============================================================================
+ * JOURNAL FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * FNV-1a hash of a journal line's text. It is stored at the start of the
+ * line so replay can tell a complete record from a torn or damaged one.
+ */
+static uint32_t journalChecksum(const char *text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Formats one journal line: checksum, record type, sequence number and
+ * payload, followed by a newline.
+ *
+ * @return Length of the line, or -1 if it does not fit
+ */
+static int journalFormatLine(char *line, size_t size, char type, uint64_t sequence, const char *payload) {
+    int length = snprintf(line, size, "%08x %c %llu %s\n", 0u, type, (unsigned long long)sequence, payload);
+    if (length < 0 || (size_t)length >= size) {
+        return -1;
+    }
+    char checksum[9];
+    snprintf(checksum, sizeof(checksum), "%08x", (unsigned)journalChecksum(line + 9, (size_t)length - 10));
+    memcpy(line, checksum, 8);
+    return length;
+}
+
+/**
+ * Checks a journal line against its checksum and splits it into fields.
+ *
+ * @param p        Start of the line
+ * @param lineEnd  The line's terminating '\n'
+ * @param type     Receives the record type
+ * @param sequence Receives the sequence number
+ * @param payload  Receives the start of the payload
+ * @return 1 if the line is intact, 0 otherwise
+ */
+static int journalParseLine(const char *p, const char *lineEnd, char *type, uint64_t *sequence,
+                            const char **payload) {
+    if (lineEnd - p < 14 || p[8] != ' ' || p[10] != ' ') {
+        return 0;
+    }
+    uint32_t stored = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = p[i];
+        int digit = IS_DIGIT(c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (digit < 0) {
+            return 0;
+        }
+        stored = stored << 4 | (uint32_t)digit;
+    }
+    if (stored != journalChecksum(p + 9, (size_t)(lineEnd - p - 9))) {
+        return 0;
+    }
+    const char *space = memchr(p + 11, ' ', (size_t)(lineEnd - p - 11));
+    if (space == NULL || !parseSequence(p + 11, (size_t)(space - p - 11), sequence)) {
+        return 0;
+    }
+    *type = p[9];
+    *payload = space + 1;
+    return 1;
+}
+
+/**
+ * Parses the payload of an add, update or delete record.
+ *
+ * @return 1 on success, 0 if the record is invalid
+ */
+static int journalParseEntry(char type, const char *payload, const char *lineEnd, JournalEntry *entry) {
+    Order order;
+    OrderNames names;
+    entry->type = type;
+    entry->payload = payload;
+    entry->length = (size_t)(lineEnd - payload);
+    if (type == JOURNAL_DELETE) {
+        return parseInteger(payload, entry->length, &order.orderID);
+    }
+    if (type != JOURNAL_ADD && type != JOURNAL_UPDATE) {
+        return 0;
+    }
+    return parseOrderText(payload, entry->length, &order, &names) == NULL;
+}
+
+/**
+ * Applies one replayed change to the store. Adds and updates both leave
+ * the order as recorded, whether or not it already exists.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int journalApply(const JournalEntry *entry) {
+    Order order;
+    OrderNames names;
+    if (entry->type == JOURNAL_DELETE) {
+        parseInteger(entry->payload, entry->length, &order.orderID);
+        int slot = orderStoreFind(&orderStore, order.orderID);
+        if (slot != -1) {
+            orderStoreDelete(&orderStore, slot);
+        }
+        return 1;
+    }
+    /* Already validated by journalParseEntry */
+    parseOrderText(entry->payload, entry->length, &order, &names);
+    int slot = orderStoreFind(&orderStore, order.orderID);
+    if (slot != -1) {
+        return orderStoreUpdate(&orderStore, slot, &order);
+    }
+    return orderStoreAdd(&orderStore, &order) != -1;
+}
+
+/**
+ * Queues a change for the journal. It becomes durable at the next save.
+ *
+ * @param type  JOURNAL_ADD, JOURNAL_UPDATE or JOURNAL_DELETE
+ * @param order The order as it now stands, or as it was before a delete
+ */
+void journalRecord(char type, const Order *order) {
+    /* The order's names are borrowed, so the record is formatted now */
+    size_t needed = journal.pendingBytes + RECORD_TEXT_LENGTH + 2;
+    if (needed > journal.pendingCapacity) {
+        size_t capacity = journal.pendingCapacity == 0 ? 4096 : journal.pendingCapacity;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char *pending = realloc(journal.pending, capacity);
+        if (pending == NULL) {
+            /* The change is lost to the journal; the next save checkpoints */
+            journal.needsCheckpoint = true;
+            return;
+        }
+        journal.pending = pending;
+        journal.pendingCapacity = capacity;
+    }
+
+    char *record = journal.pending + journal.pendingBytes;
+    int length;
+    record[0] = type;
+    if (type == JOURNAL_DELETE) {
+        length = snprintf(record + 1, RECORD_TEXT_LENGTH, "%d", order->orderID);
+    } else {
+        length = formatOrderRecord(order, record + 1, RECORD_TEXT_LENGTH);
+    }
+    if (length < 0 || length >= RECORD_TEXT_LENGTH) {
+        journal.needsCheckpoint = true;
+        return;
+    }
+    journal.pendingBytes += (size_t)length + 2;
+    journal.pendingCount++;
+}
+
+/**
+ * Appends the queued changes to the journal as one batch, ends it with a
+ * commit record and syncs the file. Replay applies a batch only if its
+ * commit record reached the disk.
+ *
+ * @return 1 on success, 0 on failure
+ */
+int journalCommit(void) {
+    if (journal.needsCheckpoint) {
+        return 0;
+    }
+    if (journal.pendingCount == 0) {
+        return 1;
+    }
+    if (journal.file == NULL && (journal.file = fopen(JOURNAL_FILE, "ab")) == NULL) {
+        return 0;
+    }
+
+    uint64_t sequence = journal.nextSequence;
+    uint64_t bytes = 0;
+    bool failed = false;
+    char line[JOURNAL_LINE_LENGTH];
+    const char *record = journal.pending;
+    for (int i = 0; i <= journal.pendingCount && !failed; i++) {
+        int length;
+        if (i == journal.pendingCount) {
+            char count[16];
+            snprintf(count, sizeof(count), "%d", journal.pendingCount);
+            length = journalFormatLine(line, sizeof(line), JOURNAL_COMMIT, sequence - 1, count);
+        } else {
+            length = journalFormatLine(line, sizeof(line), record[0], sequence++, record + 1);
+            record += strlen(record + 1) + 2;
+        }
+        failed = length < 0 || fwrite(line, 1, (size_t)length, journal.file) != (size_t)length;
+        bytes += (uint64_t)length;
+    }
+    if (failed || !syncFile(journal.file)) {
+        /* Whatever reached the file has no commit record and is ignored */
+        fclose(journal.file);
+        journal.file = NULL;
+        journal.needsCheckpoint = true;
+        return 0;
+    }
+
+    journal.nextSequence = sequence;
+    journal.bytes += bytes;
+    journal.pendingCount = 0;
+    journal.pendingBytes = 0;
+    METRICS_COUNT(bytesWritten, bytes);
+    return 1;
+}
+
+/**
+ * Reports whether the next save should write a checkpoint: either the
+ * journal can no longer be appended to, or replaying it would take a
+ * noticeable share of the time it takes to read the data file.
+ */
+bool journalNeedsCheckpoint(void) {
+    return journal.needsCheckpoint ||
+           (journal.bytes >= JOURNAL_CHECKPOINT_MIN_BYTES &&
+            journal.bytes * JOURNAL_CHECKPOINT_RATIO >= journal.checkpointBytes);
+}
+
+/**
+ * Writes every order to a new checkpoint and empties the journal. The data
+ * file and snapshot are each written to a temporary file and renamed into
+ * place, so a crash leaves either the old checkpoint or the new one; any
+ * journal records the new checkpoint already holds are skipped by
+ * sequence number on replay. A data file that lost orders when it was
+ * loaded (see markDataFileDamaged()) is first renamed with DAMAGED_SUFFIX,
+ * so it can still be recovered from.
+ *
+ * @return 1 on success, 0 on failure
+ */
+int journalCheckpoint(void) {
+    char damaged[FILENAME_MAX];
+    if (journal.dataFileDamaged) {
+        if (snprintf(damaged, sizeof(damaged), "%s%s", dataFile, DAMAGED_SUFFIX) >= (int)sizeof(damaged)) {
+            return 0;
+        }
+#ifndef ECOM_POSIX
+        remove(damaged);
+#endif
+        if (rename(dataFile, damaged) != 0) {
+            printf("[ERROR] Unable to keep damaged %s as %s; not overwriting it.\n", dataFile, damaged);
+            return 0;
+        }
+    }
+    uint64_t previous = journal.checkpointSequence;
+    journal.checkpointSequence = journal.nextSequence - 1;
+    int saved = strcmp(dataFile, DATA_FILE) == 0 ? saveOrdersToCsv(dataFile) : saveOrdersToColumnar(dataFile);
+    if (!saved) {
+        journal.checkpointSequence = previous;
+        if (journal.dataFileDamaged) {
+            rename(damaged, dataFile);
+        }
+        return 0;
+    }
+    if (journal.dataFileDamaged) {
+        printf("[WARN] Kept the damaged %s as %s.\n", dataFile, damaged);
+        journal.dataFileDamaged = false;
+    }
+#ifndef ECOM_NO_SNAPSHOT
+    if (!saveSnapshot(SNAPSHOT_FILE, dataFile)) {
+        printf("[WARN] Unable to write %s; the next start will parse %s instead.\n",
+               SNAPSHOT_FILE, dataFile);
+    }
+#endif
+    int64_t modified;
+    snapshotStampFile(dataFile, &journal.checkpointBytes, &modified);
+    journal.pendingCount = 0;
+    journal.pendingBytes = 0;
+    journal.needsCheckpoint = false;
+
+    if (journal.file != NULL) {
+        fclose(journal.file);
+        journal.file = NULL;
+    }
+    FILE *file = fopen(JOURNAL_FILE, "wb");
+    if (file == NULL || !syncFile(file)) {
+        printf("[WARN] Unable to empty %s; its changes are already in %s.\n", JOURNAL_FILE, dataFile);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    journal.bytes = 0;
+    return 1;
+}
+
+/**
+ * Replays the journal on top of the checkpoint just loaded. A batch is
+ * applied once its commit record has been read, skipping records the
+ * checkpoint already includes. The first torn or damaged line ends the
+ * replay, and the journal is cut back to the last complete batch so new
+ * changes are appended after it.
+ *
+ * @return Number of changes applied
+ */
+int journalReplay(void) {
+    MappedFile file;
+    journal.nextSequence = journal.checkpointSequence + 1;
+    journal.bytes = 0;
+    if (!mappedFileOpen(JOURNAL_FILE, &file, false)) {
+        return 0;
+    }
+
+    JournalEntry *batch = NULL;
+    int batchCount = 0;
+    int batchCapacity = 0;
+    uint64_t firstSequence = 0;
+    uint64_t lastSequence = journal.checkpointSequence;
+    size_t valid = 0;
+    long line = 0;
+    int applied = 0;
+    bool outOfMemory = false;
+    const char *p = file.data;
+    const char *end = file.data + file.size;
+
+    while (p < end && !outOfMemory) {
+        const char *lineEnd = memchr(p, '\n', (size_t)(end - p));
+        char type;
+        uint64_t sequence;
+        const char *payload;
+        line++;
+        if (lineEnd == NULL || !journalParseLine(p, lineEnd, &type, &sequence, &payload)) {
+            break;
+        }
+
+        if (type == JOURNAL_COMMIT) {
+            int count;
+            if (!parseInteger(payload, (size_t)(lineEnd - payload), &count) || count != batchCount ||
+                count == 0 || sequence != firstSequence + (uint64_t)count - 1) {
+                break;
+            }
+            for (int i = 0; i < batchCount; i++) {
+                if (firstSequence + (uint64_t)i <= journal.checkpointSequence) {
+                    continue;
+                }
+                if (!journalApply(&batch[i])) {
+                    outOfMemory = true;
+                    break;
+                }
+                applied++;
+            }
+            if (sequence > lastSequence) {
+                lastSequence = sequence;
+            }
+            batchCount = 0;
+            p = lineEnd + 1;
+            valid = (size_t)(p - file.data);
+            continue;
+        }
+
+        if (batchCount == 0) {
+            firstSequence = sequence;
+        } else if (sequence != firstSequence + (uint64_t)batchCount) {
+            break;
+        }
+        if (batchCount == batchCapacity) {
+            int capacity = batchCapacity == 0 ? 64 : batchCapacity * 2;
+            JournalEntry *grown = realloc(batch, (size_t)capacity * sizeof(*grown));
+            if (grown == NULL) {
+                outOfMemory = true;
+                break;
+            }
+            batch = grown;
+            batchCapacity = capacity;
+        }
+        if (!journalParseEntry(type, payload, lineEnd, &batch[batchCount])) {
+            break;
+        }
+        batchCount++;
+        p = lineEnd + 1;
+    }
+    free(batch);
+
+    if (outOfMemory) {
+        /* Leave the journal alone so the changes are there after a restart */
+        printf("[ERROR] Out of memory while replaying %s; some changes are missing.\n", JOURNAL_FILE);
+        journal.needsCheckpoint = true;
+        valid = file.size;
+    } else if (valid < file.size) {
+        printf("[WARN] %s:%ld: incomplete or damaged change; discarding the last %zu byte(s).\n",
+               JOURNAL_FILE, line, file.size - valid);
+#ifdef ECOM_POSIX
+        if (truncate(JOURNAL_FILE, (off_t)valid) != 0) {
+            journal.needsCheckpoint = true;
+        }
+#else
+        FILE *rewrite = fopen(JOURNAL_FILE, "wb");
+        if (rewrite == NULL || fwrite(file.data, 1, valid, rewrite) != valid || !syncFile(rewrite)) {
+            journal.needsCheckpoint = true;
+        }
+        if (rewrite != NULL) {
+            fclose(rewrite);
+        }
+#endif
+    }
+    mappedFileClose(&file);
+    METRICS_COUNT(recordsParsed, applied);
+
+    journal.nextSequence = lastSequence + 1;
+    journal.bytes = valid;
+    if (applied > 0) {
+        printf("[INFO] Replayed %d change(s) from %s.\n", applied, JOURNAL_FILE);
+    }
+    return applied;
+}
+
+/**
+ * Closes the journal and discards any changes that were never saved.
+ */
+void journalClose(void) {
+    if (journal.file != NULL) {
+        fclose(journal.file);
+        journal.file = NULL;
+    }
+    free(journal.pending);
+    journal.pending = NULL;
+    journal.pendingCount = 0;
+    journal.pendingBytes = 0;
+    journal.pendingCapacity = 0;
+}
+
+/* =============================================================================
+ * BULK IMPORT FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Mixes an Order ID into 64 well-distributed bits.
+ */
+static uint64_t idFilterHash(int orderID) {
+    uint64_t hash = (uint64_t)(uint32_t)orderID + 0x9E3779B97F4A7C15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * Sizes a filter for an expected number of IDs. If memory runs out the
+ * filter reports every ID as possibly present, which is slower but still
+ * correct.
+ */
+static void idFilterInit(IdFilter *filter, size_t expected) {
+    uint64_t words = 1;
+    while (words * 64 < (uint64_t)expected * IMPORT_FILTER_BITS && words < (1ULL << 28)) {
+        words <<= 1;
+    }
+    filter->words = calloc((size_t)words, sizeof(uint64_t));
+    filter->mask = words - 1;
+}
+
+/**
+ * Returns the IMPORT_FILTER_HASHES bits an ID sets within its word, taken
+ * from 6-bit fields of the upper half of its hash.
+ */
+static uint64_t idFilterBits(uint64_t hash) {
+    uint64_t bits = 0;
+    for (int i = 0; i < IMPORT_FILTER_HASHES; i++) {
+        bits |= 1ULL << ((hash >> (32 + 6 * i)) & 63);
+    }
+    return bits;
+}
+
+/**
+ * Adds an ID to a filter.
+ */
+static void idFilterAdd(IdFilter *filter, int orderID) {
+    if (filter->words != NULL) {
+        uint64_t hash = idFilterHash(orderID);
+        filter->words[hash & filter->mask] |= idFilterBits(hash);
+    }
+}
+
+/**
+ * Checks whether an ID may have been added to a filter.
+ *
+ * @return false if the ID was certainly never added
+ */
+static bool idFilterMayContain(const IdFilter *filter, int orderID) {
+    if (filter->words == NULL) {
+        return true;
+    }
+    uint64_t hash = idFilterHash(orderID);
+    uint64_t bits = idFilterBits(hash);
+    return (filter->words[hash & filter->mask] & bits) == bits;
+}
+
+/**
+ * Fills a block with the next run of whole lines from the import file.
+ * A partial line at the end of a read is carried over to the next block.
+ * A line that does not fit in a block is flagged on the block it starts
+ * in and skipped up to its end, which may lie several blocks on.
+ */
+static void importReadBlock(ImportJob *job, ImportBlock *block) {
+    memcpy(block->data, job->carry, job->carrySize);
+    size_t size = job->carrySize;
+    size += fread(block->data + size, 1, IMPORT_BLOCK_BYTES - size, job->file);
+    if (ferror(job->file)) {
+        job->readFailed = true;
+    }
+    block->last = size < IMPORT_BLOCK_BYTES;
+    block->overlong = false;
+
+    if (job->discarding) {
+        const char *lineEnd = memchr(block->data, '\n', size);
+        size_t skipped = lineEnd != NULL ? (size_t)(lineEnd - block->data) + 1 : size;
+        memmove(block->data, block->data + skipped, size - skipped);
+        size -= skipped;
+        job->discarding = lineEnd == NULL && !block->last;
+    }
+
+    size_t complete = size;
+    if (!block->last) {
+        while (complete > 0 && block->data[complete - 1] != '\n') {
+            complete--;
+        }
+        if (complete == 0 && size == IMPORT_BLOCK_BYTES) {
+            block->overlong = true;
+            job->discarding = true;
+            size = 0;
+        }
+    }
+    job->carrySize = size - complete;
+    memcpy(job->carry, block->data + complete, job->carrySize);
+    block->size = complete;
+}
+
+/**
+ * Parses every line of a block, recording all of the malformed ones.
+ */
+static void importParseBlock(ImportBlock *block) {
+    memset(&block->chunk, 0, sizeof(block->chunk));
+    block->chunk.begin = block->data;
+    block->chunk.end = block->data + block->size;
+    block->chunk.errorLimit = INT_MAX;
+    parseOrderChunk(&block->chunk);
+}
+
+/**
+ * Reports a rejected row: to the report file if there is one, otherwise
+ * to the console for the first LOAD_MAX_REPORTED_ERRORS rows.
+ */
+static void importReject(ImportJob *job, long line, const char *reason) {
+    job->rejected++;
+    if (job->report != NULL) {
+        fprintf(job->report, "%s:%ld: %s\n", job->path, line, reason);
+    } else if (job->rejected <= LOAD_MAX_REPORTED_ERRORS) {
+        printf("[WARN] %s:%ld: %s\n", job->path, line, reason);
+    }
+}
+
+/**
+ * Validates the rows of a parsed block and inserts the ones that pass,
+ * then commits them to the journal. Errors and rejected rows are reported
+ * in line order.
+ */
+static void importInsertBlock(ImportJob *job, ImportBlock *block) {
+    const LoadChunk *chunk = &block->chunk;
+    METRICS_COUNT(bytesRead, block->size);
+    if (block->overlong) {
+        /* The block holds nothing else: the line began at its start */
+        importReject(job, ++job->lineBase, "line is too long");
+    }
+    int recorded = loadChunkRecordedErrors(chunk);
+    int e = 0;
+    for (int r = 0; r <= chunk->rowCount; r++) {
+        long rowLine = r < chunk->rowCount ? chunk->rows[r].line : LONG_MAX;
+        for (; e < recorded && chunk->errors[e].line < rowLine; e++) {
+            importReject(job, job->lineBase + chunk->errors[e].line, chunk->errors[e].reason);
+        }
+        if (r == chunk->rowCount) {
+            break;
+        }
+
+        Order order;
+        OrderNames names;
+        const char *reason = NULL;
+        if (!parsedOrderToOrder(&chunk->rows[r], &order, &names)) {
+            reason = "too many distinct statuses";
+        } else if ((reason = validateOrder(&order)) == NULL &&
+                   idFilterMayContain(&job->filter, order.orderID)) {
+            int slot = findOrderByID(order.orderID);
+            if (slot != -1) {
+                reason = slot < job->firstSlot ? "Order ID already exists" : "Order ID repeats an earlier row";
+            }
+        }
+        if (reason == NULL && (job->outOfMemory || orderStoreAdd(&orderStore, &order) == -1)) {
+            job->outOfMemory = true;
+            reason = "out of memory";
+        }
+        if (reason != NULL) {
+            importReject(job, job->lineBase + rowLine, reason);
+            continue;
+        }
+        idFilterAdd(&job->filter, order.orderID);
+        if (!job->checkpointAtEnd) {
+            journalRecord(JOURNAL_ADD, &order);
+        }
+        changeGeneration++;
+        job->imported++;
+    }
+    job->rejected += chunk->errorCount - recorded;
+    job->outOfMemory = job->outOfMemory || chunk->outOfMemory;
+    job->lineBase += chunk->lineCount;
+
+    /* Make each block durable so an interrupted import can simply be rerun */
+    if (!job->checkpointAtEnd && journal.pendingCount > 0 && !job->saveFailed) {
+        if (journalCommit() || journalCheckpoint()) {
+            savedGeneration = changeGeneration;
+        } else {
+            job->saveFailed = true;
+        }
+    }
+}
+
+#ifdef ECOM_POSIX
+/**
+ * Waits until a block reaches the given pipeline stage.
+ */
+static void importWait(ImportJob *job, ImportBlock *block, int state) {
+    pthread_mutex_lock(&job->lock);
+    while (block->state != state) {
+        pthread_cond_wait(&job->changed, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * Hands a block on to the next pipeline stage.
+ */
+static void importAdvance(ImportJob *job, ImportBlock *block, int state) {
+    pthread_mutex_lock(&job->lock);
+    block->state = state;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/**
+ * Reader stage: fills empty blocks from the file in ring order.
+ */
+static void *importReaderThread(void *arg) {
+    ImportJob *job = arg;
+    for (int i = 0;; i = (i + 1) % IMPORT_PIPELINE_DEPTH) {
+        ImportBlock *block = &job->blocks[i];
+        importWait(job, block, IMPORT_EMPTY);
+        importReadBlock(job, block);
+        bool last = block->last;
+        importAdvance(job, block, IMPORT_READ);
+        if (last) {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Parser stage: parses blocks as the reader hands them over.
+ */
+static void *importParserThread(void *arg) {
+    ImportJob *job = arg;
+    for (int i = 0;; i = (i + 1) % IMPORT_PIPELINE_DEPTH) {
+        ImportBlock *block = &job->blocks[i];
+        importWait(job, block, IMPORT_READ);
+        importParseBlock(block);
+        bool last = block->last;
+        importAdvance(job, block, IMPORT_PARSED);
+        if (last) {
+            return NULL;
+        }
+    }
+}
+#endif
+
+/**
+ * Runs every block of the import through the read, parse and insert
+ * stages. The reader and parser get a thread each where threads are
+ * available; the calling thread inserts, since only it may touch the
+ * store.
+ */
+static void importRunPipeline(ImportJob *job) {
+#ifdef ECOM_POSIX
+    pthread_t reader;
+    pthread_t parser;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->changed, NULL);
+    if (pthread_create(&reader, NULL, importReaderThread, job) == 0) {
+        if (pthread_create(&parser, NULL, importParserThread, job) != 0) {
+            /* Parse on this thread instead, as the reader hands blocks over */
+            for (int i = 0;; i = (i + 1) % IMPORT_PIPELINE_DEPTH) {
+                ImportBlock *block = &job->blocks[i];
+                importWait(job, block, IMPORT_READ);
+                importParseBlock(block);
+                importInsertBlock(job, block);
+                free(block->chunk.rows);
+                free(block->chunk.errors);
+                bool last = block->last;
+                importAdvance(job, block, IMPORT_EMPTY);
+                if (last) {
+                    break;
+                }
+            }
+            pthread_join(reader, NULL);
+        } else {
+            for (int i = 0;; i = (i + 1) % IMPORT_PIPELINE_DEPTH) {
+                ImportBlock *block = &job->blocks[i];
+                importWait(job, block, IMPORT_PARSED);
+                importInsertBlock(job, block);
+                free(block->chunk.rows);
+                free(block->chunk.errors);
+                bool last = block->last;
+                importAdvance(job, block, IMPORT_EMPTY);
+                if (last) {
+                    break;
+                }
+            }
+            pthread_join(reader, NULL);
+            pthread_join(parser, NULL);
+        }
+        pthread_cond_destroy(&job->changed);
+        pthread_mutex_destroy(&job->lock);
+        return;
+    }
+    pthread_cond_destroy(&job->changed);
+    pthread_mutex_destroy(&job->lock);
+#endif
+    ImportBlock *block = &job->blocks[0];
+    do {
+        importReadBlock(job, block);
+        importParseBlock(block);
+        importInsertBlock(job, block);
+        free(block->chunk.rows);
+        free(block->chunk.errors);
+    } while (!block->last);
+}
+
+/**
+ * Imports orders from an external CSV file in the data-file format,
+ * streaming it in bounded memory. Each row is validated with the same
+ * rules as the Add Order prompts, and rows whose Order ID is already in
+ * the book or appeared earlier in the file are rejected. Accepted rows
+ * are journaled block by block, so an interrupted import can be rerun; a
+ * file large enough to trigger a checkpoint anyway is instead saved by a
+ * single checkpoint when the caller next saves.
+ *
+ * @param path       The file to import, or "-" for stdin
+ * @param reportPath File to list every rejected row in, or NULL to print
+ *                   the first few
+ * @return Number of orders imported, or -1 if the import could not run
+ */
+int importOrders(const char *path, const char *reportPath) {
+    bool fromStdin = strcmp(path, "-") == 0;
+    ImportJob job;
+    memset(&job, 0, sizeof(job));
+    job.path = fromStdin ? "stdin" : path;
+    job.file = fromStdin ? stdin : fopen(path, "rb");
+    if (job.file == NULL) {
+        printf("[ERROR] Unable to open %s.\n", path);
+        return -1;
+    }
+    if (reportPath != NULL && (job.report = fopen(reportPath, "w")) == NULL) {
+        printf("[ERROR] Unable to open %s for writing.\n", reportPath);
+        if (!fromStdin) {
+            fclose(job.file);
+        }
+        return -1;
+    }
+
+    bool allocated = (job.carry = malloc(IMPORT_BLOCK_BYTES)) != NULL;
+    for (int i = 0; i < IMPORT_PIPELINE_DEPTH; i++) {
+        allocated = allocated && (job.blocks[i].data = malloc(IMPORT_BLOCK_BYTES)) != NULL;
+    }
+
+    if (allocated) {
+        /* Size the prefilter for the book plus a typical row length's worth of the file */
+        uint64_t fileSize = 0;
+        int64_t modified;
+        if (fromStdin || !snapshotStampFile(path, &fileSize, &modified)) {
+            fileSize = 0;
+        }
+        idFilterInit(&job.filter, (size_t)orderStoreCount(&orderStore) + (size_t)(fileSize / SAVE_BYTES_PER_ORDER));
+        for (int slot = orderStoreNextLive(&orderStore, 0); slot != -1; slot = orderStoreNextLive(&orderStore, slot + 1)) {
+            idFilterAdd(&job.filter, orderStoreOrderID(&orderStore, slot));
+        }
+        job.firstSlot = orderStore.count;
+
+        /* A file that would outgrow the journal is saved as one checkpoint instead */
+        if (fileSize >= JOURNAL_CHECKPOINT_MIN_BYTES &&
+            fileSize * JOURNAL_CHECKPOINT_RATIO >= journal.checkpointBytes) {
+            job.checkpointAtEnd = true;
+        }
+        importRunPipeline(&job);
+        if (job.checkpointAtEnd && job.imported > 0) {
+            journal.needsCheckpoint = true;
+        }
+    }
+
+    free(job.filter.words);
+    free(job.carry);
+    for (int i = 0; i < IMPORT_PIPELINE_DEPTH; i++) {
+        free(job.blocks[i].data);
+    }
+    if (!fromStdin) {
+        fclose(job.file);
+    }
+    if (job.report != NULL && fclose(job.report) != 0) {
+        printf("[ERROR] Unable to write %s.\n", reportPath);
+    }
+
+    if (!allocated) {
+        printf("[ERROR] Out of memory before importing %s.\n", path);
+        return -1;
+    }
+    if (job.rejected > LOAD_MAX_REPORTED_ERRORS && job.report == NULL) {
+        printf("[WARN] ... and %d more rejected row(s).\n", job.rejected - LOAD_MAX_REPORTED_ERRORS);
+    }
+    if (job.readFailed) {
+        printf("[ERROR] Reading %s failed; the import stopped early.\n", job.path);
+    }
+    if (job.outOfMemory) {
+        printf("[ERROR] Out of memory while importing %s.\n", job.path);
+    }
+    if (job.saveFailed) {
+        printf("[ERROR] Unable to save imported orders as they arrived.\n");
+    }
+    printf("[INFO] Imported %d order(s) from %s; rejected %d row(s).\n", job.imported, job.path, job.rejected);
+    METRICS_COUNT(recordsParsed, job.imported);
+    METRICS_COUNT(recordsSkipped, job.rejected);
+    if (job.report != NULL && job.rejected > 0) {
+        printf("[INFO] Rejected rows are listed in %s.\n", reportPath);
+    }
+    return job.imported;
+}
+
+/* =============================================================================
+ * ORDER LISTING FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Orders two listing keys by their full text, breaking ties by slot so
+ * equal names keep their entry order.
+ */
+static int compareListingText(const void *a, const void *b) {
+    const ListingKey *x = a;
+    const ListingKey *y = b;
+    int result = strcmp(x->text, y->text);
+    if (result != 0) {
+        return result;
+    }
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+/**
+ * Orders two listing keys by their full text, largest first, breaking ties
+ * by slot so equal names keep their entry order.
+ */
+static int compareListingTextDescending(const void *a, const void *b) {
+    const ListingKey *x = a;
+    const ListingKey *y = b;
+    int result = strcmp(y->text, x->text);
+    if (result != 0) {
+        return result;
+    }
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+/**
+ * Packs the first eight bytes of a string into a number that orders the
+ * same way strcmp() does.
+ */
+static uint64_t textPrefixKey(const char *text) {
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key <<= 8;
+        if (*text != '\0') {
+            key |= (unsigned char)*text++;
+        }
+    }
+    return key;
+}
+
+/**
+ * Sorts listing keys by their 64-bit key with a stable LSD radix sort,
+ * LIST_RADIX_BITS per pass. Passes in which every key has the same digit
+ * are skipped, so small numbers such as quantities need only a couple.
+ *
+ * @param keys    The keys to sort
+ * @param scratch Room for count keys
+ * @param count   Number of keys
+ * @return Whichever of keys and scratch holds the sorted keys
+ */
+static ListingKey *radixSortListingKeys(ListingKey *keys, ListingKey *scratch, size_t count) {
+    uint32_t histogram[LIST_RADIX_PASSES][1 << LIST_RADIX_BITS];
+    memset(histogram, 0, sizeof(histogram));
+    for (size_t i = 0; i < count; i++) {
+        for (int pass = 0; pass < LIST_RADIX_PASSES; pass++) {
+            histogram[pass][(keys[i].key >> (pass * LIST_RADIX_BITS)) & LIST_RADIX_MASK]++;
+        }
+    }
+
+    for (int pass = 0; pass < LIST_RADIX_PASSES; pass++) {
+        int shift = pass * LIST_RADIX_BITS;
+        uint32_t *offsets = histogram[pass];
+        if (offsets[(keys[0].key >> shift) & LIST_RADIX_MASK] == count) {
+            continue;
+        }
+        uint32_t total = 0;
+        for (int digit = 0; digit <= LIST_RADIX_MASK; digit++) {
+            uint32_t bucket = offsets[digit];
+            offsets[digit] = total;
+            total += bucket;
+        }
+        for (size_t i = 0; i < count; i++) {
+            scratch[offsets[(keys[i].key >> shift) & LIST_RADIX_MASK]++] = keys[i];
+        }
+        ListingKey *swap = keys;
+        keys = scratch;
+        scratch = swap;
+    }
+    return keys;
+}
+
+/**
+ * Orders the runs of text keys that tie on eight bytes of text starting
+ * at depth. Long runs are radix sorted again on the next eight bytes;
+ * short ones are finished by comparing the whole strings.
+ *
+ * @param keys       Keys sorted on the bytes at depth
+ * @param scratch    Room for count keys
+ * @param count      Number of keys
+ * @param depth      Offset into the text the keys were made from
+ * @param descending Whether the keys are inverted
+ */
+static void refineListingText(ListingKey *keys, ListingKey *scratch, size_t count,
+                              size_t depth, bool descending) {
+    size_t end;
+    for (size_t begin = 0; begin < count; begin = end) {
+        end = begin + 1;
+        while (end < count && keys[end].key == keys[begin].key) {
+            end++;
+        }
+        /* A zero byte means every text in the run ended: they are equal */
+        uint64_t prefix = descending ? ~keys[begin].key : keys[begin].key;
+        size_t length = end - begin;
+        if (length < 2 || (prefix & 0xFF) == 0) {
+            continue;
+        }
+        if (length < LIST_RADIX_MIN_KEYS) {
+            qsort(keys + begin, length, sizeof(ListingKey),
+                  descending ? compareListingTextDescending : compareListingText);
+            continue;
+        }
+        for (size_t i = begin; i < end; i++) {
+            uint64_t key = textPrefixKey(keys[i].text + depth + 8);
+            keys[i].key = descending ? ~key : key;
+        }
+        ListingKey *sorted = radixSortListingKeys(keys + begin, scratch + begin, length);
+        if (sorted != keys + begin) {
+            memcpy(keys + begin, sorted, length * sizeof(ListingKey));
+        }
+        refineListingText(keys + begin, scratch + begin, length, depth + 8, descending);
+    }
+}
+
+/**
+ * Returns the LIST_SORT_* key with the given command-line name.
+ *
+ * @return The key, or -1 if there is none by that name
+ */
+int listingSortKey(const char *name) {
+    for (int i = 0; i < LIST_SORT_COUNT; i++) {
+        if (equalsIgnoreCase(name, LIST_SORT_NAMES[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Collects the live orders of a store in listing order. Statuses sort in
+ * dictionary order: the predefined ones in workflow order, then custom
+ * labels as they were first seen. Text sorts byte by byte. Orders with
+ * equal keys stay in entry order, whichever direction is chosen.
+ *
+ * @param listing    Receives the orders
+ * @param store      The store to list
+ * @param sortKey    One of the LIST_SORT_* keys
+ * @param descending Whether to list the largest keys first
+ * @return 1 on success, 0 if out of memory
+ */
+int orderListingInit(OrderListing *listing, const OrderStore *store, int sortKey, bool descending) {
+    memset(listing, 0, sizeof(*listing));
+    int count = orderStoreCount(store);
+    listing->slots = malloc(sizeof(int) * (size_t)(count > 0 ? count : 1));
+    if (listing->slots == NULL) {
+        return 0;
+    }
+
+    if (sortKey == LIST_SORT_ENTRY) {
+        for (int slot = orderStoreNextLive(store, 0); slot != -1; slot = orderStoreNextLive(store, slot + 1)) {
+            listing->slots[listing->count++] = slot;
+        }
+        if (descending) {
+            for (int i = 0, j = listing->count - 1; i < j; i++, j--) {
+                int swap = listing->slots[i];
+                listing->slots[i] = listing->slots[j];
+                listing->slots[j] = swap;
+            }
+        }
+        return 1;
+    }
+
+    ListingKey *keys = malloc(sizeof(ListingKey) * 2 * (size_t)(count > 0 ? count : 1));
+    if (keys == NULL) {
+        orderListingFree(listing);
+        return 0;
+    }
+    for (int slot = orderStoreNextLive(store, 0); slot != -1; slot = orderStoreNextLive(store, slot + 1)) {
+        const OrderSlab *slab = orderStoreSlab(store, slot);
+        int i = slot & ORDER_SLAB_MASK;
+        ListingKey *key = &keys[listing->count++];
+        int64_t number = 0;
+        key->text = NULL;
+        key->slot = slot;
+        switch (sortKey) {
+            case LIST_SORT_ID:       number = slab->orderIDs[i]; break;
+            case LIST_SORT_QUANTITY: number = slab->quantities[i]; break;
+            case LIST_SORT_PRICE:    number = slab->prices[i]; break;
+            case LIST_SORT_VALUE:    number = slab->prices[i] * slab->quantities[i]; break;
+            case LIST_SORT_STATUS:   number = slab->statusIds[i]; break;
+            case LIST_SORT_CUSTOMER:
+                key->text = stringHeapGet(&store->strings, slab->customerNames[i]);
+                break;
+            case LIST_SORT_PRODUCT:
+                key->text = stringHeapGet(&store->strings, slab->productNames[i]);
+                break;
+        }
+        /* Flip the sign bit so signed numbers order as unsigned ones */
+        key->key = key->text != NULL ? textPrefixKey(key->text) : (uint64_t)number ^ (1ULL << 63);
+        if (descending) {
+            key->key = ~key->key;
+        }
+    }
+
+    /* Keys are collected in slot order, so the stable sort keeps ties in entry order */
+    ListingKey *scratch = keys + count;
+    ListingKey *sorted = listing->count > 0 ? radixSortListingKeys(keys, scratch, (size_t)listing->count) : keys;
+    if (sortKey == LIST_SORT_CUSTOMER || sortKey == LIST_SORT_PRODUCT) {
+        refineListingText(sorted, sorted == keys ? scratch : keys, (size_t)listing->count, 0, descending);
+    }
+    for (int i = 0; i < listing->count; i++) {
+        listing->slots[i] = sorted[i].slot;
+    }
+    free(keys);
+    return 1;
+}
+
+/**
+ * Releases a listing's memory.
+ */
+void orderListingFree(OrderListing *listing) {
+    free(listing->slots);
+    free(listing->buffer);
+    memset(listing, 0, sizeof(*listing));
+}
+
+/**
+ * Writes spaces up to a column width.
+ *
+ * @return Pointer just past the padding
+ */
+static char *appendPadding(char *out, size_t used, size_t width) {
+    if (used < width) {
+        memset(out, ' ', width - used);
+        out += width - used;
+    }
+    return out;
+}
+
+/**
+ * Writes text left-aligned in a column, counting UTF-8 characters rather
+ * than bytes. Text too long for the column is cut short at a character
+ * boundary and ends in "...".
+ *
+ * @return Pointer just past the column
+ */
+static char *appendLeftColumn(char *out, const char *text, size_t width) {
+    size_t length = 0;
+    size_t characters = 0;
+    size_t cut = 0;         /* Bytes in the first width - 3 characters */
+    for (; text[length] != '\0'; length++) {
+        if (((unsigned char)text[length] & 0xC0) != 0x80) {
+            if (characters == width - 3) {
+                cut = length;
+            }
+            characters++;
+        }
+    }
+    if (characters > width) {
+        memcpy(out, text, cut);
+        memcpy(out + cut, "...", 3);
+        return out + cut + 3;
+    }
+    memcpy(out, text, length);
+    return appendPadding(out + length, characters, width);
+}
+
+/**
+ * Writes already formatted text right-aligned in a column. Text wider than
+ * the column is written in full.
+ *
+ * @return Pointer just past the column
+ */
+static char *appendRightColumn(char *out, const char *text, size_t length, size_t width) {
+    out = appendPadding(out, length, width);
+    memcpy(out, text, length);
+    return out + length;
+}
+
+/**
+ * Writes the column headings and rule of the order table.
+ *
+ * @return Pointer just past the rule's newline
+ */
+static char *appendListingHeader(char *out) {
+    static const char *const HEADINGS[] = {
+        "Order ID", "Customer", "Product", "Quantity", "Unit Price", "Total Amount", "Status"
+    };
+    static const size_t WIDTHS[] = {
+        LIST_ID_WIDTH, LIST_NAME_WIDTH, LIST_NAME_WIDTH, LIST_QUANTITY_WIDTH,
+        LIST_PRICE_WIDTH, LIST_TOTAL_WIDTH, MAX_STATUS_LENGTH - 1
+    };
+    static const bool LEFT[] = { false, true, true, false, false, false, true };
+    for (int row = 0; row < 2; row++) {
+        for (int i = 0; i < 7; i++) {
+            if (i > 0) {
+                out = appendText(out, "  ");
+            }
+            if (row == 1) {
+                memset(out, '-', WIDTHS[i]);
+                out += WIDTHS[i];
+            } else if (LEFT[i]) {
+                out = i < 6 ? appendLeftColumn(out, HEADINGS[i], WIDTHS[i]) : appendText(out, HEADINGS[i]);
+            } else {
+                out = appendRightColumn(out, HEADINGS[i], strlen(HEADINGS[i]), WIDTHS[i]);
+            }
+        }
+        *out++ = '\n';
+    }
+    return out;
+}
+
+/**
+ * Formats the order at a slot as one row of the order table, straight
+ * from the slab columns.
+ *
+ * @param store The store to read
+ * @param slot  Slot of a live order
+ * @param out   Buffer with room for LIST_ROW_LENGTH bytes
+ * @return Pointer just past the row's newline
+ */
+static char *appendListingRow(const OrderStore *store, int slot, char *out) {
+    const OrderSlab *slab = orderStoreSlab(store, slot);
+    int i = slot & ORDER_SLAB_MASK;
+    char number[MONEY_TEXT_LENGTH];
+    out = appendRightColumn(out, number, (size_t)(appendInteger(number, slab->orderIDs[i]) - number),
+                            LIST_ID_WIDTH);
+    out = appendText(out, "  ");
+    out = appendLeftColumn(out, stringHeapGet(&store->strings, slab->customerNames[i]), LIST_NAME_WIDTH);
+    out = appendText(out, "  ");
+    out = appendLeftColumn(out, stringHeapGet(&store->strings, slab->productNames[i]), LIST_NAME_WIDTH);
+    out = appendText(out, "  ");
+    out = appendRightColumn(out, number, (size_t)(appendInteger(number, slab->quantities[i]) - number),
+                            LIST_QUANTITY_WIDTH);
+    out = appendText(out, "  ");
+    out = appendRightColumn(out, number, (size_t)(appendMoney(number, slab->prices[i]) - number),
+                            LIST_PRICE_WIDTH);
+    out = appendText(out, "  ");
+    out = appendRightColumn(out, number,
+                            (size_t)(appendMoney(number, slab->prices[i] * slab->quantities[i]) - number),
+                            LIST_TOTAL_WIDTH);
+    out = appendText(out, "  ");
+    out = appendText(out, statusLabel(slab->statusIds[i]));
+    *out++ = '\n';
+    return out;
+}
+
+/**
+ * Renders a page of a listing as table rows into the listing's buffer and
+ * writes it with a single fwrite().
+ *
+ * @param listing The listing to render
+ * @param store   The store the listing was made from
+ * @param out     Where to write the page
+ * @param first   Position in the listing of the first row
+ * @param count   Most rows to write
+ * @param header  Whether to start with the column headings
+ * @return Number of rows written, or -1 if out of memory or the write failed
+ */
+int orderListingWrite(OrderListing *listing, const OrderStore *store, FILE *out,
+                      int first, int count, bool header) {
+    if (first < 0) {
+        first = 0;
+    }
+    if (count > listing->count - first) {
+        count = listing->count - first;
+    }
+    if (count < 0) {
+        count = 0;
+    }
+    size_t needed = ((size_t)count + 2) * LIST_ROW_LENGTH;
+    if (needed > listing->capacity) {
+        char *grown = realloc(listing->buffer, needed);
+        if (grown == NULL) {
+            return -1;
+        }
+        listing->buffer = grown;
+        listing->capacity = needed;
+    }
+
+    char *end = listing->buffer;
+    if (header) {
+        end = appendListingHeader(end);
+    }
+    for (int i = first; i < first + count; i++) {
+        end = appendListingRow(store, listing->slots[i], end);
+    }
+    size_t size = (size_t)(end - listing->buffer);
+    if (size > 0 && fwrite(listing->buffer, 1, size, out) != size) {
+        return -1;
+    }
+    return count;
+}
+
+/* =============================================================================
+ * GROUP-BY FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Looks up a GROUP_BY_* field or GROUP_RANK_* order by its command-line
+ * name, ignoring case.
+ *
+ * @return The index of the name, or -1 if it is unknown
+ */
+int groupNameIndex(const char *const *names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (equalsIgnoreCase(name, names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the interned name of a group.
+ */
+static inline const char *groupName(const GroupTable *table, const OrderGroup *group) {
+    return stringHeapGet(table->strings, group->name);
+}
+
+/**
+ * Returns the home bucket of a name reference: a golden-ratio
+ * multiplicative hash, with the upper half of the product masked to the
+ * capacity.
+ */
+static inline size_t groupHome(uint32_t name, size_t capacity) {
+    return (size_t)(((uint64_t)name * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+/**
+ * Allocates an empty table of GROUP_MIN_BUCKETS buckets.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int groupTableAllocate(GroupTable *table, const StringHeap *strings, int field) {
+    table->buckets = calloc(GROUP_MIN_BUCKETS, sizeof(*table->buckets));
+    table->capacity = GROUP_MIN_BUCKETS;
+    table->size = 0;
+    table->strings = strings;
+    table->field = field;
+    return table->buckets != NULL;
+}
+
+/**
+ * Doubles the number of buckets, moving every group to its new home.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int groupTableGrow(GroupTable *table) {
+    size_t capacity = table->capacity * 2;
+    OrderGroup *buckets = calloc(capacity, sizeof(*buckets));
+    if (buckets == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        const OrderGroup *group = &table->buckets[i];
+        if (group->orders != 0) {
+            size_t b = groupHome(group->name, capacity);
+            while (buckets[b].orders != 0) {
+                b = (b + 1) & (capacity - 1);
+            }
+            buckets[b] = *group;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->capacity = capacity;
+    return 1;
+}
+
+/**
+ * Finds the group of a name, adding an empty one if there is none.
+ * Growth happens before the probe, so the table is never more than half
+ * full.
+ *
+ * @return The group, or NULL if memory could not be allocated
+ */
+static OrderGroup *groupTableFind(GroupTable *table, uint32_t name) {
+    if ((table->size + 1) * 2 > table->capacity && !groupTableGrow(table)) {
+        return NULL;
+    }
+    size_t mask = table->capacity - 1;
+    size_t b = groupHome(name, table->capacity);
+    OrderGroup *group = &table->buckets[b];
+    while (group->orders != 0) {
+        if (group->name == name) {
+            return group;
+        }
+        b = (b + 1) & mask;
+        group = &table->buckets[b];
+    }
+    group->name = name;
+    group->revenue = 0;
+    table->size++;
+    return group;
+}
+
+/**
+ * A run of slabs grouped by one thread into a table of its own. The
+ * tables are merged once every thread is done.
+ */
+typedef struct {
+    const OrderStore *store;
+    GroupTable table;
+    int     firstSlab;
+    int     endSlab;        /* One past the last slab                 */
+    bool    failed;         /* Out of memory                          */
+} GroupChunk;
+
+/**
+ * Adds every live order of a run of slabs to its group.
+ */
+static void groupChunkBuild(GroupChunk *chunk) {
+    const OrderStore *store = chunk->store;
+    GroupTable *table = &chunk->table;
+    for (int s = chunk->firstSlab; s < chunk->endSlab; s++) {
+        const OrderSlab *slab = store->slabs[s];
+        const uint32_t *names = table->field == GROUP_BY_CUSTOMER ? slab->customerNames : slab->productNames;
+        int limit = store->count - (s << ORDER_SLAB_SHIFT);
+        limit = limit < ORDER_SLAB_SIZE ? limit : ORDER_SLAB_SIZE;
+
+        for (int w = 0; w * 64 < limit; w++) {
+            uint64_t live = slab->liveMask[w];
+            if (w * 64 + 64 > limit) {
+                live &= (1ULL << (limit - w * 64)) - 1;
+            }
+            /* Request a word's worth of buckets first, so the cache misses
+               overlap instead of being taken one by one */
+            for (uint64_t bits = live; bits != 0; bits &= bits - 1) {
+                PREFETCH(&table->buckets[groupHome(names[w * 64 + lowestSetBit(bits)], table->capacity)]);
+            }
+            for (; live != 0; live &= live - 1) {
+                int i = w * 64 + lowestSetBit(live);
+                OrderGroup *group = groupTableFind(table, names[i]);
+                if (group == NULL) {
+                    chunk->failed = true;
+                    return;
+                }
+                group->orders++;
+                group->revenue += slab->prices[i] * slab->quantities[i];
+            }
+        }
+    }
+}
+
+#ifdef ECOM_POSIX
+/**
+ * Thread entry point for groupChunkBuild().
+ */
+static void *groupChunkBuildThread(void *arg) {
+    groupChunkBuild(arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Folds the groups of one table into another.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+static int groupTableMerge(GroupTable *into, const GroupTable *from) {
+    for (size_t i = 0; i < from->capacity; i++) {
+        const OrderGroup *group = &from->buckets[i];
+        if (group->orders == 0) {
+            continue;
+        }
+        OrderGroup *target = groupTableFind(into, group->name);
+        if (target == NULL) {
+            return 0;
+        }
+        target->orders += group->orders;
+        target->revenue += group->revenue;
+    }
+    return 1;
+}
+
+/**
+ * Groups the live orders of a store by customer or product name, totalling
+ * the orders and revenue of each name. Names are compared exactly, so
+ * "Jane Doe" and "jane doe" are different customers.
+ *
+ * Names are interned in the store, so each order costs one probe keyed by
+ * its 32-bit name reference and never touches the text. Large stores are
+ * split into runs of slabs grouped by separate threads (see
+ * workerThreadCount()), whose tables are then merged.
+ *
+ * @param table Receives the groups; free with groupTableFree()
+ * @param store The store to read
+ * @param field GROUP_BY_CUSTOMER or GROUP_BY_PRODUCT
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+int groupTableBuild(GroupTable *table, const OrderStore *store, int field) {
+    GroupChunk chunks[WORKER_MAX_THREADS];
+    int threads = workerThreadCount((size_t)store->liveCount * GROUP_BYTES_PER_ORDER);
+    int slabsPerChunk = (store->slabCount + threads - 1) / threads;
+    int chunkCount = 0;
+    bool failed = false;
+    int s = 0;
+    do {
+        /* An empty store still gets one chunk, for the result's table */
+        GroupChunk *chunk = &chunks[chunkCount++];
+        chunk->store = store;
+        chunk->firstSlab = s;
+        chunk->endSlab = store->slabCount - s > slabsPerChunk ? s + slabsPerChunk : store->slabCount;
+        chunk->failed = !groupTableAllocate(&chunk->table, &store->strings, field);
+        s = chunk->endSlab;
+    } while (s < store->slabCount);
+
+#ifdef ECOM_POSIX
+    pthread_t workers[WORKER_MAX_THREADS];
+    bool started[WORKER_MAX_THREADS] = { false };
+    for (int i = 1; i < chunkCount; i++) {
+        if (!chunks[i].failed) {
+            started[i] = pthread_create(&workers[i], NULL, groupChunkBuildThread, &chunks[i]) == 0;
+        }
+    }
+#endif
+    for (int i = 0; i < chunkCount; i++) {
+#ifdef ECOM_POSIX
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+            continue;
+        }
+#endif
+        if (!chunks[i].failed) {
+            groupChunkBuild(&chunks[i]);
+        }
+    }
+
+    for (int i = 0; i < chunkCount; i++) {
+        failed = failed || chunks[i].failed;
+    }
+    for (int i = 1; i < chunkCount; i++) {
+        failed = failed || !groupTableMerge(&chunks[0].table, &chunks[i].table);
+        groupTableFree(&chunks[i].table);
+    }
+    *table = chunks[0].table;
+    if (failed) {
+        groupTableFree(table);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Releases the bucket array of a table. The names its groups point at
+ * belong to the shared interned heap, so they are left alone.
+ */
+void groupTableFree(GroupTable *table) {
+    free(table->buckets);
+    table->buckets = NULL;
+    table->capacity = 0;
+    table->size = 0;
+}
+
+/**
+ * Reports whether group a ranks above group b: by revenue or order count,
+ * then by the other of the two, then by name.
+ */
+static bool groupAbove(const OrderGroup *a, const OrderGroup *b, int rank, const GroupTable *table) {
+    MoneyTotal primaryA = rank == GROUP_RANK_ORDERS ? a->orders : a->revenue;
+    MoneyTotal primaryB = rank == GROUP_RANK_ORDERS ? b->orders : b->revenue;
+    if (primaryA != primaryB) {
+        return primaryA > primaryB;
+    }
+    MoneyTotal secondaryA = rank == GROUP_RANK_ORDERS ? a->revenue : a->orders;
+    MoneyTotal secondaryB = rank == GROUP_RANK_ORDERS ? b->revenue : b->orders;
+    if (secondaryA != secondaryB) {
+        return secondaryA > secondaryB;
+    }
+    return strcmp(groupName(table, a), groupName(table, b)) < 0;
+}
+
+/**
+ * Restores the min-heap order of a top-K heap from a position down. The
+ * lowest-ranked group sits at the root, ready to be displaced.
+ */
+static void groupHeapSiftDown(OrderGroup *heap, int size, int position, int rank, const GroupTable *table) {
+    OrderGroup entry = heap[position];
+    for (;;) {
+        int child = 2 * position + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && groupAbove(&heap[child], &heap[child + 1], rank, table)) {
+            child++;
+        }
+        if (!groupAbove(&entry, &heap[child], rank, table)) {
+            break;
+        }
+        heap[position] = heap[child];
+        position = child;
+    }
+    heap[position] = entry;
+}
+
+/**
+ * Selects the highest-ranked groups of a table with a bounded min-heap:
+ * O(n log k) time and O(k) space, with no sort of the whole table.
+ *
+ * @param table The groups
+ * @param rank  GROUP_RANK_REVENUE or GROUP_RANK_ORDERS
+ * @param top   Receives up to limit groups, best first
+ * @param limit Number of groups wanted
+ * @return Number of groups written to top
+ */
+int groupTableTop(const GroupTable *table, int rank, OrderGroup *top, int limit) {
+    int size = 0;
+    for (size_t i = 0; i < table->capacity && limit > 0; i++) {
+        const OrderGroup *group = &table->buckets[i];
+        if (group->orders == 0) {
+            continue;
+        }
+        if (size < limit) {
+            /* Sift the new group up from the bottom of the heap */
+            int position = size++;
+            while (position > 0 && groupAbove(&top[(position - 1) / 2], group, rank, table)) {
+                top[position] = top[(position - 1) / 2];
+                position = (position - 1) / 2;
+            }
+            top[position] = *group;
+        } else if (groupAbove(group, &top[0], rank, table)) {
+            top[0] = *group;
+            groupHeapSiftDown(top, size, 0, rank, table);
+        }
+    }
+    /* Pop the lowest-ranked group into the last free place until sorted */
+    for (int end = size - 1; end > 0; end--) {
+        OrderGroup lowest = top[0];
+        top[0] = top[end];
+        groupHeapSiftDown(top, end, 0, rank, table);
+        top[end] = lowest;
+    }
+    return size;
+}
+
+/**
+ * Prints ranked groups as a table with each group's share of the revenue.
+ *
+ * @param out   Where to print
+ * @param table The table the groups came from
+ * @param store The store the groups were built from
+ * @param top   The groups, best first
+ * @param count Number of groups
+ * @return 1 on success, 0 if the stream could not be written
+ */
+int printGroupRanking(FILE *out, const GroupTable *table, const OrderStore *store,
+                      const OrderGroup *top, int count) {
+    MoneyTotal revenue = orderStoreStats(store)->revenue;
+    char row[GROUP_ROW_LENGTH];
+    char *end = row;
+    end = appendLeftColumn(end, "Rank", GROUP_RANK_WIDTH);
+    *end++ = ' ';
+    end = appendLeftColumn(end, GROUP_FIELD_LABELS[table->field], LIST_NAME_WIDTH);
+    fprintf(out, "%.*s %*s %*s %*s\n", (int)(end - row), row, GROUP_ORDERS_WIDTH, "Orders",
+            LIST_TOTAL_WIDTH, "Revenue", GROUP_SHARE_WIDTH, "Share");
+    int rule = GROUP_RANK_WIDTH + LIST_NAME_WIDTH + GROUP_ORDERS_WIDTH + LIST_TOTAL_WIDTH + GROUP_SHARE_WIDTH + 4;
+    for (int i = 0; i < rule; i++) {
+        fputc('-', out);
+    }
+    fputc('\n', out);
+
+    for (int i = 0; i < count; i++) {
+        char rank[TEMP_BUFFER_LENGTH];
+        char money[MONEY_TEXT_LENGTH];
+        snprintf(rank, sizeof(rank), "%d", i + 1);
+        end = appendLeftColumn(row, rank, GROUP_RANK_WIDTH);
+        *end++ = ' ';
+        end = appendLeftColumn(end, groupName(table, &top[i]), LIST_NAME_WIDTH);
+        double share = revenue != 0 ? 100.0 * (double)top[i].revenue / (double)revenue : 0.0;
+        fprintf(out, "%.*s %*d %*s %*.2f%%\n", (int)(end - row), row, GROUP_ORDERS_WIDTH, top[i].orders,
+                LIST_TOTAL_WIDTH, formatMoney(top[i].revenue, money, sizeof(money)),
+                GROUP_SHARE_WIDTH - 1, share);
+    }
+    fprintf(out, "\n%zu distinct %s name(s) across %d order(s).\n", table->size,
+            GROUP_FIELD_NAMES[table->field], store->liveCount);
+    return !ferror(out);
+}
+
+/* =============================================================================
+ * ORDER GENERATOR FUNCTIONS
+ * ============================================================================= */
+
+static const char *const GENERATOR_FIRST_NAMES[] = {
+    "James", "Mary", "Robert", "Patricia", "John", "Jennifer", "Michael", "Linda",
+    "David", "Elizabeth", "William", "Barbara", "Richard", "Susan", "Joseph", "Jessica",
+    "Thomas", "Sarah", "Carlos", "Karen", "Daniel", "Maria", "Matthew", "Nancy",
+    "Anthony", "Lisa", "Mark", "Sofia", "Wei", "Priya", "Ahmed", "Yuki",
+    "Olga", "Kwame", "Lucia", "Hiroshi", "Fatima", "Ivan", "Chloe", "Mateo",
+    "Aisha", "Noah", "Emma", "Liam", "Olivia", "Ethan", "Ava", "Lucas"
+};
+
+static const char *const GENERATOR_LAST_NAMES[] = {
+    "Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller", "Davis",
+    "Rodriguez", "Martinez", "Hernandez", "Lopez", "Gonzalez", "Wilson", "Anderson", "Thomas",
+    "Taylor", "Moore", "Jackson", "Martin", "Lee", "Perez", "Thompson", "White",
+    "Harris", "Sanchez", "Clark", "Ramirez", "Lewis", "Robinson", "Walker", "Young",
+    "Nguyen", "Kim", "Patel", "Chen", "Singh", "Kowalski", "Ivanova", "Okafor",
+    "Tanaka", "Rossi", "Muller", "Silva", "O'Brien", "Dubois", "Novak", "Haddad"
+};
+
+static const char *const GENERATOR_PRODUCT_BRANDS[] = {
+    "Acme", "Nimbus", "Orbit", "Vertex", "Lumen", "Zephyr", "Polar", "Summit",
+    "Cobalt", "Evergreen", "Quantum", "Harbor", "Atlas", "Nova", "Pioneer", "Willow"
+};
+
+static const char *const GENERATOR_PRODUCT_ITEMS[] = {
+    "Wireless Mouse", "Mechanical Keyboard", "USB-C Hub", "Laptop Stand", "Noise Cancelling Headphones",
+    "Smart Watch", "Coffee Grinder", "Water Bottle", "Running Shoes", "Yoga Mat",
+    "Desk Lamp", "Backpack", "Bluetooth Speaker", "Phone Case", "Office Chair",
+    "Monitor 27in", "Webcam HD", "Electric Kettle", "Air Fryer", "Blender",
+    "Throw Blanket", "Cookware Set", "Board Game", "Action Camera"
+};
+
+/* Status mix of the generated orders, in parts per thousand */
+static const char *const GENERATOR_STATUSES[] = {
+    "Delivered", "Shipped", "Processing", "Pending", "Cancelled", "Returned", "On Hold"
+};
+static const int GENERATOR_STATUS_SHARES[] = { 520, 140, 100, 140, 70, 20, 10 };
+
+#define GENERATOR_COUNT(array) ((uint64_t)(sizeof(array) / sizeof((array)[0])))
+
+/**
+ * Returns the next number of a splitmix64 sequence. Integer-only, so a
+ * seed produces the same orders on every platform.
+ */
+static uint64_t generatorNext(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Returns a number in [0, bound).
+ */
+static uint64_t generatorBelow(uint64_t *state, uint64_t bound) {
+    return generatorNext(state) % bound;
+}
+
+/**
+ * Returns a number in [0, bound) skewed towards zero: the product of three
+ * uniform draws, so a small share of customers and products accounts for
+ * most orders, as in real sales data.
+ */
+static uint64_t generatorSkewed(uint64_t *state, uint64_t bound) {
+    uint64_t value = generatorBelow(state, bound);
+    value = value * generatorBelow(state, bound) / bound;
+    return value * generatorBelow(state, bound) / bound;
+}
+
+/**
+ * Writes the name of a generated customer: first name, middle initial and
+ * last name, picked by hashing the customer number.
+ *
+ * @return Pointer just past the name
+ */
+static char *appendGeneratedCustomer(char *out, uint64_t customer) {
+    uint64_t hash = generatorNext(&customer);
+    out = appendText(out, GENERATOR_FIRST_NAMES[hash % GENERATOR_COUNT(GENERATOR_FIRST_NAMES)]);
+    *out++ = ' ';
+    *out++ = (char)('A' + (hash >> 16) % 26);
+    *out++ = '.';
+    *out++ = ' ';
+    return appendText(out, GENERATOR_LAST_NAMES[(hash >> 32) % GENERATOR_COUNT(GENERATOR_LAST_NAMES)]);
+}
+
+/**
+ * Writes the name of a generated product, "<brand> <item> <model>", and
+ * returns its unit price. Both are derived from the product number, so a
+ * product has the same price in every order.
+ *
+ * @return Pointer just past the name
+ */
+static char *appendGeneratedProduct(char *out, uint64_t product, Money *price) {
+    uint64_t hash = generatorNext(&product);
+    out = appendText(out, GENERATOR_PRODUCT_BRANDS[hash % GENERATOR_COUNT(GENERATOR_PRODUCT_BRANDS)]);
+    *out++ = ' ';
+    out = appendText(out, GENERATOR_PRODUCT_ITEMS[(hash >> 8) % GENERATOR_COUNT(GENERATOR_PRODUCT_ITEMS)]);
+    *out++ = ' ';
+    *out++ = (char)('A' + (hash >> 16) % 26);
+    out = appendUnsigned(out, 100 + (hash >> 48) % 900);
+
+    /* Prices cluster in bands from a few dollars to a few thousand */
+    static const Money BAND_DOLLARS[] = { 5, 20, 60, 200, 900 };
+    Money band = BAND_DOLLARS[(hash >> 24) % 5];
+    *price = (band + (Money)((hash >> 32) % (uint64_t)(band * 2))) * 100 + 99;
+    return out;
+}
+
+/**
+ * Returns the quantity of a generated order: usually one, rarely dozens.
+ */
+static int generatedQuantity(uint64_t *state) {
+    uint64_t roll = generatorBelow(state, 100);
+    if (roll < 60) {
+        return 1;
+    }
+    if (roll < 80) {
+        return 2;
+    }
+    if (roll < 95) {
+        return 3 + (int)generatorBelow(state, 3);
+    }
+    return 6 + (int)generatorBelow(state, 45);
+}
+
+/**
+ * Returns the status label of a generated order, following the
+ * GENERATOR_STATUS_SHARES mix.
+ */
+static const char *generatedStatus(uint64_t *state) {
+    int roll = (int)generatorBelow(state, 1000);
+    size_t i = 0;
+    while (i + 1 < GENERATOR_COUNT(GENERATOR_STATUSES) && roll >= GENERATOR_STATUS_SHARES[i]) {
+        roll -= GENERATOR_STATUS_SHARES[i];
+        i++;
+    }
+    return GENERATOR_STATUSES[i];
+}
+
+/**
+ * Writes a data file of synthetic orders. The same count and seed always
+ * produce the same file. Order IDs increase with small gaps; customers
+ * and products are drawn from pools that grow with the count, with a
+ * few of each far more popular than the rest.
+ *
+ * @param path  File to create; an existing file is never overwritten
+ * @param count Number of orders, from 1 to GENERATE_MAX_ORDERS
+ * @param seed  Seed of the pseudo-random sequence
+ * @return 1 on success, 0 on failure
+ */
+int generateOrders(const char *path, int count, uint64_t seed) {
+    FILE *probe = fopen(path, "rb");
+    if (probe != NULL) {
+        fclose(probe);
+        printf("[ERROR] %s already exists. Generated orders are only written to a new file.\n", path);
+        return 0;
+    }
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("[ERROR] Unable to open %s for writing.\n", path);
+        return 0;
+    }
+    char *buffer = malloc(GENERATE_BLOCK_BYTES);
+    if (buffer == NULL) {
+        fclose(file);
+        remove(path);
+        printf("[ERROR] Out of memory.\n");
+        return 0;
+    }
+
+    uint64_t state = seed;
+    uint64_t customers = (uint64_t)count / 4 + 1;
+    uint64_t products = (uint64_t)count / 50 + 20;
+    int orderID = GENERATE_FIRST_ORDER_ID;
+    bool ok = true;
+    char *end = buffer + sprintf(buffer, "# E-Commerce Orders Database\n"
+                                 "# Format: OrderID,CustomerName,ProductName,Quantity,Price,Status\n"
+                                 "# Generated: %d order(s), seed %llu\n",
+                                 count, (unsigned long long)seed);
+    for (int i = 0; i < count && ok; i++) {
+        Money price;
+        end = appendInteger(end, orderID);
+        *end++ = ',';
+        end = appendGeneratedCustomer(end, generatorSkewed(&state, customers));
+        *end++ = ',';
+        end = appendGeneratedProduct(end, generatorSkewed(&state, products), &price);
+        *end++ = ',';
+        end = appendInteger(end, generatedQuantity(&state));
+        *end++ = ',';
+        end = appendMoney(end, price);
+        *end++ = ',';
+        end = appendText(end, generatedStatus(&state));
+        *end++ = '\n';
+        orderID += 1 + (int)generatorBelow(&state, 3);
+
+        if ((size_t)(end - buffer) > GENERATE_BLOCK_BYTES - RECORD_TEXT_LENGTH) {
+            ok = fwrite(buffer, 1, (size_t)(end - buffer), file) == (size_t)(end - buffer);
+            end = buffer;
+        }
+    }
+    ok = ok && fwrite(buffer, 1, (size_t)(end - buffer), file) == (size_t)(end - buffer);
+    free(buffer);
+    if (fclose(file) != 0 || !ok) {
+        remove(path);
+        printf("[ERROR] Unable to write %s.\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+#ifdef ECOM_BENCH
+/* =============================================================================
+ * BENCHMARK FUNCTIONS
+ * ============================================================================= */
+
+/* Consumes results that would otherwise be optimised away with their work */
+static volatile long benchSink;
+
+/**
+ * Returns a monotonic time in seconds.
+ */
+static double benchNow(void) {
+    return (double)monotonicNanoseconds() / 1e9;
+}
+
+/**
+ * Adds the time of one run to a benchmark's result.
+ *
+ * @param result     The result to update
+ * @param started    benchNow() when the run started
+ * @param operations Operations the run performed
+ */
+static void benchRecord(BenchResult *result, double started, long operations) {
+    double seconds = benchNow() - started;
+    if (result->runs == 0 || seconds < result->bestSeconds) {
+        result->bestSeconds = seconds;
+    }
+    result->totalSeconds += seconds;
+    result->operations = operations;
+    result->runs++;
+}
+
+/**
+ * Discards every order and all journal state, as if the program had just
+ * started.
+ *
+ * @return 1 on success, 0 if out of memory
+ */
+static int benchReset(void) {
+    journalClose();
+    orderStoreFree(&orderStore);
+    statusDictionaryFree();
+    journal = (Journal){ .nextSequence = 1 };
+    savedGeneration = changeGeneration;
+    return statusDictionaryInit();
+}
+
+/**
+ * Returns the IDs of every live order.
+ *
+ * @return A new array of orderStoreCount() IDs, or NULL if out of memory
+ */
+static int *benchOrderIDs(void) {
+    int count = orderStoreCount(&orderStore);
+    int *ids = malloc(sizeof(int) * (size_t)(count > 0 ? count : 1));
+    if (ids != NULL) {
+        int n = 0;
+        for (int slot = orderStoreNextLive(&orderStore, 0); slot != -1; slot = orderStoreNextLive(&orderStore, slot + 1)) {
+            ids[n++] = orderStoreOrderID(&orderStore, slot);
+        }
+    }
+    return ids;
+}
+
+/**
+ * Copies every live order into the old array-of-structs layout, names
+ * truncated to fit.
+ *
+ * @param count Set to the number of rows
+ * @return A new array of rows, or NULL if out of memory
+ */
+static BenchRowOrder *benchOrderRows(int *count) {
+    *count = orderStoreCount(&orderStore);
+    BenchRowOrder *rows = calloc((size_t)(*count > 0 ? *count : 1), sizeof(BenchRowOrder));
+    if (rows != NULL) {
+        int n = 0;
+        for (int slot = orderStoreNextLive(&orderStore, 0); slot != -1; slot = orderStoreNextLive(&orderStore, slot + 1)) {
+            Order order;
+            BenchRowOrder *row = &rows[n++];
+            orderStoreGet(&orderStore, slot, &order);
+            row->orderID = order.orderID;
+            snprintf(row->customerName, sizeof(row->customerName), "%s", order.customerName);
+            snprintf(row->productName, sizeof(row->productName), "%s", order.productName);
+            row->quantity = order.quantity;
+            row->price = order.price;
+            row->statusId = order.statusId;
+        }
+    }
+    return rows;
+}
+
+/**
+ * Recounts revenue, status counts and the top order over rows, one record
+ * at a time, the way the dashboard did before the column store.
+ */
+static void benchScanRows(const BenchRowOrder *rows, int count, ColumnScan *scan) {
+    memset(scan, 0, sizeof(*scan));
+    scan->topValue = INT64_MIN;
+    scan->topSlot = -1;
+    for (int i = 0; i < count; i++) {
+        Money value = rows[i].price * rows[i].quantity;
+        scan->revenue += value;
+        scan->statusCounts[statusCategory(rows[i].statusId)]++;
+        if (value > scan->topValue) {
+            scan->topValue = value;
+            scan->topSlot = i;
+        }
+    }
+}
+
+/**
+ * Writes the results as a JSON document.
+ */
+static void benchWriteJson(FILE *out, const BenchResult *results, int resultCount,
+                           int orders, uint64_t seed, int repeat) {
+    fprintf(out, "{\n  \"benchmark\": \"ecommerce\",\n  \"orders\": %d,\n  \"seed\": %llu,\n"
+            "  \"repeat\": %d,\n  \"caseKernel\": \"%s\",\n  \"results\": [\n",
+            orders, (unsigned long long)seed, repeat, caseKernelName());
+    for (int i = 0; i < resultCount; i++) {
+        const BenchResult *result = &results[i];
+        double perOperation = result->operations > 0 ? result->bestSeconds / (double)result->operations : 0.0;
+        fprintf(out, "    {\"name\": \"%s\", \"operations\": %ld, \"runs\": %d, \"bestSeconds\": %.6f, "
+                "\"meanSeconds\": %.6f, \"nanosecondsPerOperation\": %.1f}%s\n",
+                result->name, result->operations, result->runs, result->bestSeconds,
+                result->totalSeconds / result->runs, perOperation * 1e9, i + 1 < resultCount ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+/**
+ * Times the main operations on a generated book of orders. Works on the
+ * data files in the current directory, so it refuses to run where any
+ * already exist, and removes them when it is done.
+ *
+ * @param orders Size of the generated book
+ * @param seed   Seed for the generator and the random lookups
+ * @param repeat Runs of each repeatable benchmark; the best is reported
+ * @param output Results file, or NULL or "-" for stdout
+ * @return 1 on success, 0 on failure
+ */
+int runBenchmarks(int orders, uint64_t seed, int repeat, const char *output) {
+    const char *const files[] = { DATA_FILE, SNAPSHOT_FILE, JOURNAL_FILE, COLUMNAR_FILE };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        FILE *probe = fopen(files[i], "rb");
+        if (probe != NULL) {
+            fclose(probe);
+            printf("[ERROR] %s exists. Run the benchmarks in an empty directory.\n", files[i]);
+            return 0;
+        }
+    }
+
+    static const char *const NEEDLES[] = { "smith", "ann", "o'b", "maria g" };
+    size_t needleCount = sizeof(NEEDLES) / sizeof(NEEDLES[0]);
+    BenchResult results[BENCH_MAX_RESULTS];
+    memset(results, 0, sizeof(results));
+    const char *names[] = {
+        "generate", "loadCsv", "saveCheckpoint", "loadSnapshot", "findHit", "findMiss",
+        "searchScan", "searchIndex", "analytics", "analyticsScan", "analyticsRows", "groupBy", "valueRange", "delete",
+        "saveJournal", "compact", "saveColumnar", "loadColumnar"
+    };
+    int resultCount = (int)(sizeof(names) / sizeof(names[0]));
+    for (int i = 0; i < resultCount; i++) {
+        results[i].name = names[i];
+    }
+    BenchResult *next = results;
+    bool ok = true;
+    int *ids = NULL;
+    uint64_t state = seed;
+    double started;
+
+    fprintf(stderr, "[INFO] Generating %d order(s)...\n", orders);
+    started = benchNow();
+    ok = generateOrders(DATA_FILE, orders, seed);
+    benchRecord(next, started, orders);
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        ok = benchReset();
+        started = benchNow();
+        ok = ok && loadFromFile() == orders;
+        benchRecord(next, started, orders);
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        journal.needsCheckpoint = true;
+        started = benchNow();
+        ok = saveToFile();
+        benchRecord(next, started, orders);
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        ok = benchReset();
+        started = benchNow();
+        ok = ok && loadFromFile() == orders;
+        benchRecord(next, started, orders);
+    }
+    next += ok;
+
+    ids = ok ? benchOrderIDs() : NULL;
+    ok = ok && ids != NULL;
+    for (int miss = 0; ok && miss < 2; miss++, next += ok) {
+        for (int run = 0; ok && run < repeat; run++) {
+            long found = 0;
+            started = benchNow();
+            for (int i = 0; i < BENCH_LOOKUPS; i++) {
+                int id = ids[generatorBelow(&state, (uint64_t)orders)];
+                found += findOrderByID(miss ? -id : id) != -1;
+            }
+            benchRecord(next, started, BENCH_LOOKUPS);
+            ok = found == (miss ? 0 : BENCH_LOOKUPS);
+        }
+    }
+
+    for (int run = 0; ok && run < repeat; run++) {
+        long matched = 0;
+        started = benchNow();
+        for (size_t n = 0; n < needleCount; n++) {
+            for (int slot = orderStoreNextLive(&orderStore, 0); slot != -1; slot = orderStoreNextLive(&orderStore, slot + 1)) {
+                matched += containsIgnoreCase(orderStoreCustomerName(&orderStore, slot), NEEDLES[n]) ? 1 : 0;
+            }
+        }
+        benchRecord(next, started, (long)(needleCount * (size_t)orders));
+        benchSink += matched;
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        SlotList matches = { NULL, 0, 0 };
+        started = benchNow();
+        for (size_t n = 0; ok && n < needleCount; n++) {
+            matches.count = 0;
+            ok = orderStoreSearchName(&orderStore, NEEDLES[n], &matches);
+        }
+        benchRecord(next, started, (long)needleCount);
+        free(matches.slots);
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        AnalyticsSummary summary;
+        MoneyTotal checksum = 0;
+        started = benchNow();
+        for (int i = 0; i < BENCH_LOOKUPS; i++) {
+            summarizeAnalytics(&summary);
+            checksum += summary.averageOrderValue;
+        }
+        benchRecord(next, started, BENCH_LOOKUPS);
+        benchSink += (long)checksum;
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        ColumnScan scan;
+        started = benchNow();
+        orderStoreScanColumns(&orderStore, &scan, NULL, NULL);
+        benchRecord(next, started, orders);
+        ok = scan.revenue == orderStoreStats(&orderStore)->revenue;
+    }
+    next += ok;
+
+    /* The same recount over a copy of the book in the old row layout */
+    int rowCount = 0;
+    BenchRowOrder *rows = ok ? benchOrderRows(&rowCount) : NULL;
+    ok = ok && rows != NULL;
+    for (int run = 0; ok && run < repeat; run++) {
+        ColumnScan scan;
+        started = benchNow();
+        benchScanRows(rows, rowCount, &scan);
+        benchRecord(next, started, rowCount);
+        ok = scan.revenue == orderStoreStats(&orderStore)->revenue;
+        benchSink += scan.topSlot;
+    }
+    free(rows);
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        GroupTable table;
+        OrderGroup top[GROUP_DEFAULT_TOP];
+        started = benchNow();
+        ok = groupTableBuild(&table, &orderStore, GROUP_BY_CUSTOMER);
+        if (ok) {
+            benchSink += groupTableTop(&table, GROUP_RANK_REVENUE, top, GROUP_DEFAULT_TOP);
+            groupTableFree(&table);
+        }
+        benchRecord(next, started, orders);
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        /* The ten largest orders at or below a random total */
+        Order top;
+        orderStoreGet(&orderStore, orderStoreTopSlot(&orderStore), &top);
+        SlotList matches = { NULL, 0, 0 };
+        started = benchNow();
+        for (int i = 0; ok && i < BENCH_LOOKUPS; i++) {
+            Money maxValue = (Money)generatorBelow(&state, (uint64_t)orderValue(&top) + 1);
+            matches.count = 0;
+            ok = orderStoreValueRange(&orderStore, 0, maxValue, VALUE_DEFAULT_TOP, &matches);
+            benchSink += matches.count;
+        }
+        benchRecord(next, started, BENCH_LOOKUPS);
+        free(matches.slots);
+    }
+    next += ok;
+
+    /* The rest change the book, so each runs once. Deleting a quarter of
+       the orders leaves enough tombstones for a compaction. */
+    int deletes = (orders + COMPACT_DEAD_RATIO - 1) / COMPACT_DEAD_RATIO;
+    if (ok) {
+        for (int i = 0; i < deletes; i++) {
+            int j = i + (int)generatorBelow(&state, (uint64_t)(orders - i));
+            int swap = ids[i];
+            ids[i] = ids[j];
+            ids[j] = swap;
+        }
+        started = benchNow();
+        for (int i = 0; ok && i < deletes; i++) {
+            ok = deleteOrderRecord(ids[i]);
+        }
+        benchRecord(next, started, deletes);
+    }
+    next += ok;
+    if (ok) {
+        started = benchNow();
+        ok = saveToFile();
+        benchRecord(next, started, deletes);
+    }
+    next += ok;
+    if (ok) {
+        started = benchNow();
+        orderStoreCompactIfNeeded(&orderStore);
+        benchRecord(next, started, orders - deletes);
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        started = benchNow();
+        ok = saveOrdersToColumnar(COLUMNAR_FILE);
+        benchRecord(next, started, orders - deletes);
+    }
+    next += ok;
+
+    for (int run = 0; ok && run < repeat; run++) {
+        ok = benchReset();
+        started = benchNow();
+        ok = ok && loadOrdersFromColumnar(COLUMNAR_FILE) == orders - deletes;
+        benchRecord(next, started, orders - deletes);
+    }
+    next += ok;
+
+    free(ids);
+    benchReset();
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        remove(files[i]);
+    }
+    if (!ok) {
+        printf("[ERROR] Benchmark \"%s\" failed.\n", next->name);
+        return 0;
+    }
+
+    bool toStdout = output == NULL || strcmp(output, "-") == 0;
+    FILE *out = toStdout ? stdout : fopen(output, "w");
+    if (out == NULL) {
+        printf("[ERROR] Unable to open %s for writing.\n", output);
+        return 0;
+    }
+    benchWriteJson(out, results, resultCount, orders, seed, repeat);
+    if (!toStdout && fclose(out) != 0) {
+        printf("[ERROR] Unable to write %s.\n", output);
+        return 0;
+    }
+    return 1;
+}
+#endif
+
+#ifdef ECOM_SERVER
+/* =============================================================================
+ * SERVER FUNCTIONS
+ * ============================================================================= */
+
+static volatile sig_atomic_t serverStopRequested = 0;
+static pthread_rwlock_t      storeLock;     /* Readers share, writers exclude */
+static pthread_mutex_t       saveLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signal handler asking the event loop to stop.
+ */
+static void serverRequestStop(int signal) {
+    (void)signal;
+    serverStopRequested = 1;
+}
+
+/**
+ * Fills in the address of a Unix domain socket.
+ *
+ * @return 1 on success, 0 if the path is too long
+ */
+static int serverAddress(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        printf("[ERROR] Socket path %s is too long.\n", path);
+        return 0;
+    }
+    strcpy(address->sun_path, path);
+    return 1;
+}
+
+/**
+ * Opens a non-blocking listening socket at a path. A socket file left by a
+ * server that is no longer running is replaced.
+ *
+ * @return The socket, or -1 on failure
+ */
+static int serverListen(const char *path) {
+    struct sockaddr_un address;
+    if (!serverAddress(path, &address)) {
+        return -1;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe != -1 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        close(probe);
+        printf("[ERROR] Another server is already listening on %s.\n", path);
+        return -1;
+    }
+    if (probe != -1) {
+        close(probe);
+    }
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fd, SERVER_BACKLOG) != 0) {
+        printf("[ERROR] Unable to listen on %s: %s\n", path, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Sends a whole buffer, waiting for the client to make room as needed.
+ *
+ * @return 1 on success, 0 if the client has gone
+ */
+static int serverSend(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return 0;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return 1;
+}
+
+/**
+ * Saves any unsaved changes. Saving only reads the store, so it runs under
+ * the shared lock and queries carry on meanwhile; saveLock keeps it to one
+ * save at a time.
+ */
+static void serverSave(FILE *out, long line) {
+    pthread_rwlock_rdlock(&storeLock);
+    pthread_mutex_lock(&saveLock);
+    if (out != NULL) {
+        batchExecute(out, line, "save", "");
+    } else if (hasUnsavedChanges()) {
+        saveToFile();
+    }
+    pthread_mutex_unlock(&saveLock);
+    pthread_rwlock_unlock(&storeLock);
+}
+
+/**
+ * Reads what a client has sent and answers every complete line with one
+ * JSON line, as batch mode does. A partial line is kept for the next read.
+ * Queries hold storeLock shared; adds, updates and deletes hold it
+ * exclusively and also run any compaction that falls due.
+ *
+ * @return true to keep the connection, false to close it
+ */
+static bool serverAnswer(ServerConnection *connection) {
+    size_t room = sizeof(connection->input) - 1 - connection->used;
+    ssize_t received = recv(connection->fd, connection->input + connection->used, room, MSG_DONTWAIT);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if (received == 0) {
+        return false;
+    }
+    connection->used += (size_t)received;
+
+    char *response = NULL;
+    size_t responseSize = 0;
+    FILE *out = open_memstream(&response, &responseSize);
+    if (out == NULL) {
+        return false;
+    }
+    char *start = connection->input;
+    char *end = connection->input + connection->used;
+    char *newline;
+    while ((newline = memchr(start, '\n', (size_t)(end - start))) != NULL) {
+        *newline = '\0';
+        long line = ++connection->line;
+        char *arguments;
+        char *command = batchSplitLine(start, &arguments);
+        start = newline + 1;
+        if (command == NULL) {
+            continue;
+        }
+        if (strcmp(command, "save") == 0) {
+            serverSave(out, line);
+            continue;
+        }
+        bool writes = batchCommandWrites(command);
+        if (writes) {
+            pthread_rwlock_wrlock(&storeLock);
+        } else {
+            pthread_rwlock_rdlock(&storeLock);
+        }
+        batchExecute(out, line, command, arguments);
+        if (writes) {
+            orderStoreCompactIfNeeded(&orderStore);
+        }
+        pthread_rwlock_unlock(&storeLock);
+    }
+    connection->used = (size_t)(end - start);
+    memmove(connection->input, start, connection->used);
+
+    bool keep = true;
+    if (connection->used == sizeof(connection->input) - 1) {
+        fprintf(out, "{\"line\":%ld,\"ok\":false,\"error\":\"line too long\"}\n", ++connection->line);
+        keep = false;
+    }
+    bool sent = fclose(out) == 0 && serverSend(connection->fd, response, responseSize);
+    free(response);
+    return keep && sent;
+}
+
+/**
+ * Closes a connection and forgets it.
+ */
+static void serverDisconnect(ServerQueue *queue, ServerConnection *connection) {
+    epoll_ctl(queue->epoll, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    pthread_mutex_lock(&queue->lock);
+    if (connection->previous != NULL) {
+        connection->previous->next = connection->next;
+    } else {
+        queue->connections = connection->next;
+    }
+    if (connection->next != NULL) {
+        connection->next->previous = connection->previous;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    free(connection);
+}
+
+/**
+ * Worker thread: answers connections as the event loop hands them over,
+ * then re-arms each one for its next request.
+ */
+static void *serverWorker(void *arg) {
+    ServerQueue *queue = arg;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->head == NULL && !queue->stopping) {
+            pthread_cond_wait(&queue->ready, &queue->lock);
+        }
+        ServerConnection *connection = queue->head;
+        if (connection == NULL) {
+            pthread_mutex_unlock(&queue->lock);
+            return NULL;
+        }
+        queue->head = connection->nextReady;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (serverAnswer(connection)) {
+            struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = connection };
+            if (epoll_ctl(queue->epoll, EPOLL_CTL_MOD, connection->fd, &event) == 0) {
+                continue;
+            }
+        }
+        serverDisconnect(queue, connection);
+    }
+}
+
+/**
+ * Saver thread: saves pending changes every SERVER_SAVE_INTERVAL_MS, so
+ * each save covers every change made since the last one.
+ */
+static void *serverSaver(void *arg) {
+    ServerQueue *queue = arg;
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)SERVER_SAVE_INTERVAL_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        if (pthread_cond_timedwait(&queue->stopped, &queue->lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&queue->lock);
+            serverSave(NULL, 0);
+            pthread_mutex_lock(&queue->lock);
+        }
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+/**
+ * Accepts every pending connection and registers it with the event loop.
+ */
+static void serverAccept(ServerQueue *queue, int listener) {
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        ServerConnection *connection = calloc(1, sizeof(*connection));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        pthread_mutex_lock(&queue->lock);
+        connection->next = queue->connections;
+        if (queue->connections != NULL) {
+            queue->connections->previous = connection;
+        }
+        queue->connections = connection;
+        pthread_mutex_unlock(&queue->lock);
+
+        struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = connection };
+        if (epoll_ctl(queue->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            serverDisconnect(queue, connection);
+        }
+    }
+}
+
+/**
+ * Serves the saved orders over a Unix domain socket until interrupted. One
+ * thread waits on epoll for readable connections and queues them for a
+ * pool of workers; each connection is served by one worker at a time, so
+ * its answers come back in order. Queries run concurrently; changes take
+ * the store exclusively and are saved within SERVER_SAVE_INTERVAL_MS, and
+ * again on shutdown.
+ *
+ * @param path    Where to create the socket
+ * @param workers Number of worker threads
+ * @return 1 on a clean shutdown, 0 on failure
+ */
+int serveOrders(const char *path, int workers) {
+    loadFromFile();
+    int listener = serverListen(path);
+    if (listener == -1) {
+        return 0;
+    }
+    ServerQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    if (queue.epoll == -1 || epoll_ctl(queue.epoll, EPOLL_CTL_ADD, listener, &event) != 0) {
+        printf("[ERROR] Unable to start the event loop: %s\n", strerror(errno));
+        if (queue.epoll != -1) {
+            close(queue.epoll);
+        }
+        close(listener);
+        unlink(path);
+        return 0;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.ready, NULL);
+    pthread_cond_init(&queue.stopped, NULL);
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+#ifdef __GLIBC__
+    /* Without this a steady stream of queries would starve the writers */
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&storeLock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+
+    /* Only this thread takes SIGINT and SIGTERM, interrupting epoll_wait */
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serverRequestStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigset_t signals;
+    sigset_t previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    pthread_t threads[WORKER_MAX_THREADS + 1];
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        started += pthread_create(&threads[started], NULL, serverWorker, &queue) == 0;
+    }
+    bool saver = started > 0 && pthread_create(&threads[started], NULL, serverSaver, &queue) == 0;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    int ok = started > 0 && saver;
+    if (!ok) {
+        printf("[ERROR] Unable to start the worker threads.\n");
+        serverStopRequested = 1;
+    } else {
+        printf("[INFO] Serving %d order(s) on %s with %d worker(s). Press Ctrl+C to stop.\n",
+               orderStoreCount(&orderStore), path, started);
+        fflush(stdout);
+    }
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!serverStopRequested) {
+        int ready = epoll_wait(queue.epoll, events, SERVER_MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("[ERROR] Event loop failed: %s\n", strerror(errno));
+            ok = 0;
+            break;
+        }
+        pthread_mutex_lock(&queue.lock);
+        for (int i = 0; i < ready; i++) {
+            ServerConnection *connection = events[i].data.ptr;
+            if (connection == NULL) {
+                pthread_mutex_unlock(&queue.lock);
+                serverAccept(&queue, listener);
+                pthread_mutex_lock(&queue.lock);
+                continue;
+            }
+            connection->nextReady = NULL;
+            if (queue.tail != NULL) {
+                queue.tail->nextReady = connection;
+            } else {
+                queue.head = connection;
+            }
+            queue.tail = connection;
+            pthread_cond_signal(&queue.ready);
+        }
+        pthread_mutex_unlock(&queue.lock);
+    }
+
+    printf("\n[INFO] Stopping the server...\n");
+    pthread_mutex_lock(&queue.lock);
+    queue.stopping = true;
+    pthread_cond_broadcast(&queue.ready);
+    pthread_cond_broadcast(&queue.stopped);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < started + saver; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    while (queue.connections != NULL) {
+        serverDisconnect(&queue, queue.connections);
+    }
+    if (hasUnsavedChanges() && !saveToFile()) {
+        ok = 0;
+    }
+    close(queue.epoll);
+    close(listener);
+    unlink(path);
+    pthread_rwlock_destroy(&storeLock);
+    pthread_cond_destroy(&queue.stopped);
+    pthread_cond_destroy(&queue.ready);
+    pthread_mutex_destroy(&queue.lock);
+    return ok;
+}
+
+/**
+ * Opens a client connection to the order server.
+ *
+ * @return The connected socket, or -1 on failure
+ */
+static int loadClientConnect(const char *path) {
+    struct sockaddr_un address;
+    if (!serverAddress(path, &address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd != -1 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/**
+ * Sends one request line and reads the one-line answer.
+ *
+ * @return 1 on success, 0 if the connection failed
+ */
+static int loadClientExchange(int fd, FILE *in, const char *request, char *answer, int answerSize) {
+    if (!serverSend(fd, request, strlen(request))) {
+        return 0;
+    }
+    if (fgets(answer, answerSize, in) == NULL) {
+        return 0;
+    }
+    /* Skip the rest of a long answer such as a search result */
+    char rest[BATCH_LINE_LENGTH];
+    const char *tail = answer;
+    while (tail[0] != '\0' && tail[strlen(tail) - 1] != '\n') {
+        if (fgets(rest, (int)sizeof(rest), in) == NULL) {
+            return 0;
+        }
+        tail = rest;
+    }
+    return 1;
+}
+
+/**
+ * Writes the next request of a load client: a write with probability
+ * writePercent, which alternately adds an order with an ID of the
+ * client's own and deletes it again, otherwise mostly ID lookups with
+ * some customer searches, analytics and top-order queries.
+ */
+static void loadClientRequest(LoadClient *client, int request, char *text, size_t size) {
+    static const char *const NEEDLES[] = {
+        "Maria G. Ramirez", "Mark I. Miller", "James U. Anderson", "Elizabeth J. Davis"
+    };
+    if ((int)generatorBelow(&client->state, 100) < client->writePercent) {
+        if (client->pendingID != 0) {
+            snprintf(text, size, "delete %d\n", client->pendingID);
+            client->pendingID = 0;
+        } else {
+            client->pendingID = LOADGEN_FIRST_ORDER_ID + client->index * client->requests + request;
+            snprintf(text, size, "add %d,Load Client %d,Load Test Item,1,9.99,Pending\n",
+                     client->pendingID, client->index);
+        }
+        return;
+    }
+    int roll = (int)generatorBelow(&client->state, 100);
+    if (roll < 80) {
+        snprintf(text, size, "find %d\n", GENERATE_FIRST_ORDER_ID +
+                 (int)generatorBelow(&client->state, (uint64_t)client->idRange));
+    } else if (roll < 90) {
+        snprintf(text, size, "search %s\n",
+                 NEEDLES[generatorBelow(&client->state, sizeof(NEEDLES) / sizeof(NEEDLES[0]))]);
+    } else if (roll < 95) {
+        snprintf(text, size, "analytics\n");
+    } else {
+        snprintf(text, size, "largest %d\n", VALUE_DEFAULT_TOP);
+    }
+}
+
+/**
+ * Load client thread: sends its requests one at a time over its own
+ * connection and times each round trip.
+ */
+static void *loadClientRun(void *arg) {
+    LoadClient *client = arg;
+    int fd = loadClientConnect(client->path);
+    FILE *in = fd == -1 ? NULL : fdopen(fd, "r");
+    if (in == NULL) {
+        if (fd != -1) {
+            close(fd);
+        }
+        client->broken = true;
+        return NULL;
+    }
+    char request[BATCH_LINE_LENGTH];
+    char answer[BATCH_LINE_LENGTH];
+    for (int i = 0; i < client->requests; i++) {
+        loadClientRequest(client, i, request, sizeof(request));
+        uint64_t started = monotonicNanoseconds();
+        if (!loadClientExchange(fd, in, request, answer, (int)sizeof(answer))) {
+            client->broken = true;
+            break;
+        }
+        client->latencies[client->completed++] = monotonicNanoseconds() - started;
+        if (strstr(answer, "\"ok\":true") == NULL) {
+            client->failed++;
+        }
+    }
+    if (!client->broken && client->pendingID != 0) {
+        /* Leave the book as it was found */
+        snprintf(request, sizeof(request), "delete %d\n", client->pendingID);
+        loadClientExchange(fd, in, request, answer, (int)sizeof(answer));
+    }
+    fclose(in);
+    return NULL;
+}
+
+/**
+ * qsort() comparator for latencies.
+ */
+static int compareLatencies(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Drives a running server with several concurrent clients and reports the
+ * throughput and round-trip latency percentiles. Lookups pick IDs from
+ * the range generate assigns, so about half of them hit.
+ *
+ * @param path         The server's socket
+ * @param clients      Number of concurrent connections
+ * @param requests     Requests sent by each client
+ * @param writePercent Share of requests that add or delete an order
+ * @param seed         Seed for the request mix
+ * @return 1 if every client ran to completion, 0 otherwise
+ */
+int runLoadGenerator(const char *path, int clients, int requests, int writePercent, uint64_t seed) {
+    int fd = loadClientConnect(path);
+    FILE *in = fd == -1 ? NULL : fdopen(fd, "r");
+    char answer[BATCH_LINE_LENGTH];
+    if (in == NULL || !loadClientExchange(fd, in, "stats\n", answer, (int)sizeof(answer))) {
+        printf("[ERROR] Unable to reach a server on %s.\n", path);
+        if (in != NULL) {
+            fclose(in);
+        } else if (fd != -1) {
+            close(fd);
+        }
+        return 0;
+    }
+    fclose(in);
+    const char *count = strstr(answer, "\"orders\":");
+    int orders = count != NULL ? atoi(count + strlen("\"orders\":")) : 0;
+
+    LoadClient *pool = calloc((size_t)clients, sizeof(*pool));
+    uint64_t *latencies = malloc((size_t)clients * (size_t)requests * sizeof(*latencies));
+    pthread_t *threads = malloc((size_t)clients * sizeof(*threads));
+    bool *running = calloc((size_t)clients, sizeof(*running));
+    if (pool == NULL || latencies == NULL || threads == NULL || running == NULL) {
+        printf("[ERROR] Out of memory.\n");
+        free(pool);
+        free(latencies);
+        free(threads);
+        free(running);
+        return 0;
+    }
+    for (int i = 0; i < clients; i++) {
+        pool[i].path = path;
+        pool[i].index = i;
+        pool[i].requests = requests;
+        pool[i].writePercent = writePercent;
+        pool[i].idRange = 2 * orders + 1;
+        pool[i].state = seed + (uint64_t)i * 0x9E3779B97F4A7C15ULL;
+        pool[i].latencies = latencies + (size_t)i * (size_t)requests;
+    }
+
+    printf("[INFO] Sending %d request(s) from each of %d client(s) to %s...\n", requests, clients, path);
+    fflush(stdout);
+    uint64_t started = monotonicNanoseconds();
+    for (int i = 0; i < clients; i++) {
+        running[i] = pthread_create(&threads[i], NULL, loadClientRun, &pool[i]) == 0;
+        if (!running[i]) {
+            pool[i].broken = true;
+        }
+    }
+    int completed = 0;
+    int failed = 0;
+    int broken = 0;
+    for (int i = 0; i < clients; i++) {
+        if (running[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        /* Gather the latencies into one run at the front */
+        memmove(latencies + completed, pool[i].latencies, (size_t)pool[i].completed * sizeof(*latencies));
+        completed += pool[i].completed;
+        failed += pool[i].failed;
+        broken += pool[i].broken;
+    }
+    double seconds = (double)(monotonicNanoseconds() - started) / 1e9;
+
+    printf("[INFO] %d request(s) in %.3f s: %.0f requests/s\n", completed, seconds,
+           seconds > 0 ? completed / seconds : 0.0);
+    if (completed > 0) {
+        static const double FRACTIONS[] = { 0.50, 0.90, 0.99, 0.999 };
+        qsort(latencies, (size_t)completed, sizeof(*latencies), compareLatencies);
+        uint64_t total = 0;
+        for (int i = 0; i < completed; i++) {
+            total += latencies[i];
+        }
+        printf("[INFO] Round trip (microseconds): mean %.1f", (double)total / completed / 1000.0);
+        for (size_t f = 0; f < sizeof(FRACTIONS) / sizeof(FRACTIONS[0]); f++) {
+            size_t rank = (size_t)(FRACTIONS[f] * (completed - 1));
+            printf(", p%g %.1f", FRACTIONS[f] * 100, (double)latencies[rank] / 1000.0);
+        }
+        printf(", max %.1f\n", (double)latencies[completed - 1] / 1000.0);
+        printf("[INFO] %d answer(s) had \"ok\":false, mostly lookups of IDs not in the book.\n", failed);
+    }
+    if (broken > 0) {
+        printf("[ERROR] %d client(s) lost their connection.\n", broken);
+    }
+    free(pool);
+    free(latencies);
+    free(threads);
+    free(running);
+    return broken == 0;
+}
+#endif
+
+#ifndef ECOM_NO_METRICS
+/* =============================================================================
+ * METRICS FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Returns the histogram bucket of a latency. Values below
+ * METRICS_SUB_BUCKETS get a bucket each; above that, every power of two
+ * is split into METRICS_SUB_BUCKETS equal buckets.
+ */
+static int metricsBucket(uint64_t nanoseconds) {
+    if (nanoseconds < METRICS_SUB_BUCKETS) {
+        return (int)nanoseconds;
+    }
+    if (nanoseconds >> METRICS_MAX_BITS) {
+        nanoseconds = (1ULL << METRICS_MAX_BITS) - 1;
+    }
+    int shift = highestSetBit(nanoseconds) - METRICS_SUB_BUCKET_BITS;
+    return (shift + 1) * METRICS_SUB_BUCKETS + (int)((nanoseconds >> shift) - METRICS_SUB_BUCKETS);
+}
+
+/**
+ * Returns the largest latency that falls in a histogram bucket.
+ */
+static uint64_t metricsBucketLimit(int bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int shift = bucket / METRICS_SUB_BUCKETS - 1;
+    uint64_t mantissa = (uint64_t)(bucket % METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/**
+ * Takes metricsLock where there are threads to exclude. Only compilers
+ * without the GNU atomic builtins need it; the others update the metrics
+ * lock-free, so concurrent readers in the server never queue here.
+ */
+#if !defined(__GNUC__)
+static void metricsEnter(void) {
+#ifdef ECOM_POSIX
+    pthread_mutex_lock(&metricsLock);
+#endif
+}
+
+static void metricsLeave(void) {
+#ifdef ECOM_POSIX
+    pthread_mutex_unlock(&metricsLock);
+#endif
+}
+#endif
+
+/**
+ * Reads one metrics word while other threads may be updating it.
+ */
+static uint64_t metricsLoad(const uint64_t *value) {
+#if defined(__GNUC__)
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+#else
+    metricsEnter();
+    uint64_t current = *value;
+    metricsLeave();
+    return current;
+#endif
+}
+
+/**
+ * Raises a metrics word to a candidate if the candidate is larger.
+ */
+static void metricsRaise(uint64_t *value, uint64_t candidate) {
+#if defined(__GNUC__)
+    uint64_t current = __atomic_load_n(value, __ATOMIC_RELAXED);
+    while (candidate > current &&
+           !__atomic_compare_exchange_n(value, &current, candidate, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+#else
+    metricsEnter();
+    if (candidate > *value) {
+        *value = candidate;
+    }
+    metricsLeave();
+#endif
+}
+
+/**
+ * Lowers a metrics word to a candidate if the candidate is smaller, where
+ * a zero word means no value yet.
+ */
+static void metricsLower(uint64_t *value, uint64_t candidate) {
+#if defined(__GNUC__)
+    uint64_t current = __atomic_load_n(value, __ATOMIC_RELAXED);
+    while ((current == 0 || candidate < current) &&
+           !__atomic_compare_exchange_n(value, &current, candidate, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+#else
+    metricsEnter();
+    if (*value == 0 || candidate < *value) {
+        *value = candidate;
+    }
+    metricsLeave();
+#endif
+}
+
+/**
+ * Adds to one of the I/O counters. Relaxed ordering is enough: each
+ * counter is an independent tally that nothing synchronises through.
+ */
+void metricsAdd(uint64_t *counter, uint64_t amount) {
+#if defined(__GNUC__)
+    __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+#else
+    metricsEnter();
+    *counter += amount;
+    metricsLeave();
+#endif
+}
+
+/**
+ * Adds the latency of one completed operation to its histogram. Each field
+ * is updated on its own, so server workers never wait on one another.
+ *
+ * @param operation   One of the METRIC_* operations
+ * @param nanoseconds How long the operation took
+ */
+void metricsRecordLatency(int operation, uint64_t nanoseconds) {
+    LatencyHistogram *histogram = &metrics.latencies[operation];
+    /* A zero minimum means none yet; the clock cannot resolve 1 ns anyway */
+    metricsLower(&histogram->minimum, nanoseconds > 0 ? nanoseconds : 1);
+    metricsRaise(&histogram->maximum, nanoseconds);
+    metricsAdd(&histogram->total, nanoseconds);
+    metricsAdd(&histogram->buckets[metricsBucket(nanoseconds)], 1);
+    metricsAdd(&histogram->count, 1);
+}
+
+/**
+ * Copies a histogram that other threads may still be recording into. The
+ * count is taken from the copied buckets, so percentiles always agree with
+ * them even if a latency lands midway through the copy.
+ *
+ * @param operation One of the METRIC_* operations
+ * @param copy      Receives the histogram
+ */
+static void metricsSnapshot(int operation, LatencyHistogram *copy) {
+    const LatencyHistogram *histogram = &metrics.latencies[operation];
+    copy->count = 0;
+    for (int bucket = 0; bucket < METRICS_BUCKET_COUNT; bucket++) {
+        copy->buckets[bucket] = metricsLoad(&histogram->buckets[bucket]);
+        copy->count += copy->buckets[bucket];
+    }
+    copy->total = metricsLoad(&histogram->total);
+    copy->minimum = metricsLoad(&histogram->minimum);
+    copy->maximum = metricsLoad(&histogram->maximum);
+}
+
+/**
+ * Returns the latency below which a given share of the recorded operations
+ * fall, to the precision of the histogram buckets.
+ *
+ * @param histogram A histogram with at least one latency
+ * @param fraction  The share, from 0 to 1
+ * @return The percentile in nanoseconds
+ */
+static uint64_t metricsPercentile(const LatencyHistogram *histogram, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * (double)histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < METRICS_BUCKET_COUNT; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            uint64_t limit = metricsBucketLimit(bucket);
+            return limit < histogram->maximum ? limit : histogram->maximum;
+        }
+    }
+    return histogram->maximum;
+}
+
+/**
+ * Prints a latency table and the I/O counters for the session so far.
+ */
+void printMetrics(void) {
+    static const double FRACTIONS[] = { 0.50, 0.90, 0.99, 0.999 };
+    LatencyHistogram snapshot;
+    printf("\nLatency (microseconds):\n");
+    printf("  %-10s %9s %10s %10s %10s %10s %10s %10s\n",
+           "Operation", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+    for (int i = 0; i < METRIC_OPERATION_COUNT; i++) {
+        const LatencyHistogram *histogram = &snapshot;
+        metricsSnapshot(i, &snapshot);
+        printf("  %-10s %9llu", METRIC_NAMES[i], (unsigned long long)histogram->count);
+        if (histogram->count == 0) {
+            printf(" %10s %10s %10s %10s %10s %10s\n", "-", "-", "-", "-", "-", "-");
+            continue;
+        }
+        printf(" %10.1f", (double)histogram->total / (double)histogram->count / 1000.0);
+        for (size_t f = 0; f < sizeof(FRACTIONS) / sizeof(FRACTIONS[0]); f++) {
+            printf(" %10.1f", (double)metricsPercentile(histogram, FRACTIONS[f]) / 1000.0);
+        }
+        printf(" %10.1f\n", (double)histogram->maximum / 1000.0);
+    }
+    printf("\nI/O:\n");
+    printf("  Bytes Read      : %llu\n", (unsigned long long)metricsLoad(&metrics.bytesRead));
+    printf("  Bytes Written   : %llu\n", (unsigned long long)metricsLoad(&metrics.bytesWritten));
+    printf("  Records Parsed  : %llu\n", (unsigned long long)metricsLoad(&metrics.recordsParsed));
+    printf("  Records Skipped : %llu\n", (unsigned long long)metricsLoad(&metrics.recordsSkipped));
+}
+
+/**
+ * Writes the latency histograms and I/O counters as one JSON object.
+ * Latencies are in nanoseconds. Each histogram lists its non-empty buckets
+ * as [upper bound, count] pairs, so dumps from several sessions can be
+ * merged before taking percentiles.
+ *
+ * @param out Where to write the object; no newline follows it
+ */
+void writeMetricsJson(FILE *out) {
+    LatencyHistogram snapshot;
+    fprintf(out, "{\"latencies\":{");
+    for (int i = 0; i < METRIC_OPERATION_COUNT; i++) {
+        const LatencyHistogram *histogram = &snapshot;
+        metricsSnapshot(i, &snapshot);
+        fprintf(out, "%s\"%s\":{\"count\":%llu", i > 0 ? "," : "", METRIC_NAMES[i],
+                (unsigned long long)histogram->count);
+        if (histogram->count > 0) {
+            fprintf(out, ",\"mean\":%llu,\"min\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+                    "\"p999\":%llu,\"max\":%llu",
+                    (unsigned long long)(histogram->total / histogram->count),
+                    (unsigned long long)histogram->minimum,
+                    (unsigned long long)metricsPercentile(histogram, 0.50),
+                    (unsigned long long)metricsPercentile(histogram, 0.90),
+                    (unsigned long long)metricsPercentile(histogram, 0.99),
+                    (unsigned long long)metricsPercentile(histogram, 0.999),
+                    (unsigned long long)histogram->maximum);
+        }
+        fprintf(out, ",\"buckets\":[");
+        bool first = true;
+        for (int bucket = 0; bucket < METRICS_BUCKET_COUNT; bucket++) {
+            if (histogram->buckets[bucket] > 0) {
+                fprintf(out, "%s[%llu,%llu]", first ? "" : ",",
+                        (unsigned long long)metricsBucketLimit(bucket),
+                        (unsigned long long)histogram->buckets[bucket]);
+                first = false;
+            }
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "},\"bytesRead\":%llu,\"bytesWritten\":%llu,\"recordsParsed\":%llu,\"recordsSkipped\":%llu}",
+            (unsigned long long)metricsLoad(&metrics.bytesRead), (unsigned long long)metricsLoad(&metrics.bytesWritten),
+            (unsigned long long)metricsLoad(&metrics.recordsParsed), (unsigned long long)metricsLoad(&metrics.recordsSkipped));
+}
+#endif
+
+/* =============================================================================
+ * STATUS DICTIONARY FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Hashes a status label with 32-bit FNV-1a.
+ */
+static int statusHash(const char *label) {
+    uint32_t hash = 2166136261u;
+    for (; *label != '\0'; label++) {
+        hash = (hash ^ (unsigned char)*label) * 16777619u;
+    }
+    return (int)hash;
+}
+
+/**
+ * Seeds the dictionary with the predefined STATUS_OPTIONS so that their ids
+ * match their positions in that array.
+ *
+ * @return 1 on success, 0 if memory could not be allocated
+ */
+int statusDictionaryInit(void) {
+    memset(&statusDictionary, 0, sizeof(statusDictionary));
+    for (size_t i = 0; i < STATUS_OPTION_COUNT; i++) {
+        if (statusIntern(STATUS_OPTIONS[i]) != (int)i) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Releases the dictionary.
+ */
+void statusDictionaryFree(void) {
+    free(statusDictionary.labels);
+    free(statusDictionary.categories);
+    free(statusDictionary.lookup.entries);
+    memset(&statusDictionary, 0, sizeof(statusDictionary));
+}
+
+/**
+ * Returns the id of a status label, adding it to the dictionary if it has
+ * not been seen before. Labels are matched exactly, so the text written
+ * back to the data file is the text that was read or entered.
+ *
+ * @param label Status text, truncated to MAX_STATUS_LENGTH - 1 characters
+ * @return The status id, or -1 if the dictionary is full or out of memory
+ */
+int statusIntern(const char *label) {
+    char text[MAX_STATUS_LENGTH];
+    strncpy(text, label, sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    StatusDictionary *dict = &statusDictionary;
+    int hash = statusHash(text);
+    int id = intMapGet(&dict->lookup, hash);
+    if (id != -1 && strcmp(dict->labels[id], text) == 0) {
+        return id;
+    }
+    if (id != -1) {
+        /* Hash collision: fall back to a scan of the (small) dictionary */
+        for (int i = 0; i < dict->count; i++) {
+            if (strcmp(dict->labels[i], text) == 0) {
+                return i;
+            }
+        }
+    }
+
+    if (dict->count == MAX_STATUS_IDS) {
+        return -1;
+    }
+    if (dict->count == dict->capacity) {
+        int capacity = dict->capacity == 0 ? 16 : dict->capacity * 2;
+        char (*labels)[MAX_STATUS_LENGTH] = realloc(dict->labels, (size_t)capacity * sizeof(*labels));
+        if (labels == NULL) {
+            return -1;
+        }
+        dict->labels = labels;
+        uint8_t *categories = realloc(dict->categories, (size_t)capacity);
+        if (categories == NULL) {
+            return -1;
+        }
+        dict->categories = categories;
+        dict->capacity = capacity;
+    }
+    if (!intMapReserve(&dict->lookup, dict->lookup.size + 1)) {
+        return -1;
+    }
+
+    id = dict->count++;
+    memcpy(dict->labels[id], text, sizeof(text));
+    dict->categories[id] = (uint8_t)mapStatusToIndex(text);
+    if (intMapGet(&dict->lookup, hash) == -1) {
+        intMapPut(&dict->lookup, hash, id);
+    }
+    return id;
+}
+
+/**
+ * Returns the text of a status id.
+ */
+const char *statusLabel(int statusId) {
+    return statusDictionary.labels[statusId];
+}
+
+/**
+ * Returns the STATUS_OPTIONS index a status id counts towards in analytics,
+ * or STATUS_OPTION_COUNT for custom labels.
+ */
+int statusCategory(int statusId) {
+    return statusDictionary.categories[statusId];
+}
+
+/* =============================================================================
+ * CASE-FOLDING KERNELS
+ * ============================================================================= */
+
+/**
+ * Folds an ASCII upper-case letter to lower case. The program runs in the
+ * "C" locale, so this matches tolower() for every byte value.
+ */
+static inline unsigned char foldByte(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? (unsigned char)(c | 0x20) : c;
+}
+
+/**
+ * Compares folded text against an already folded pattern.
+ */
+static int foldMatches(const char *text, const char *folded, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (foldByte((unsigned char)text[i]) != (unsigned char)folded[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int foldEqualsScalar(const char *a, const char *b, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (foldByte((unsigned char)a[i]) != foldByte((unsigned char)b[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void foldCopyScalar(const char *src, char *dest, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        dest[i] = (char)foldByte((unsigned char)src[i]);
+    }
+}
+
+static const char *foldFindScalar(const char *haystack, size_t haystackLength,
+                                  const char *needle, size_t needleLength) {
+    if (needleLength > haystackLength) {
+        return NULL;
+    }
+    unsigned char first = (unsigned char)needle[0];
+    for (size_t i = 0; i + needleLength <= haystackLength; i++) {
+        if (foldByte((unsigned char)haystack[i]) == first &&
+            foldMatches(haystack + i + 1, needle + 1, needleLength - 1)) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+#ifdef ECOM_X86_SIMD
+
+/*
+ * The vector kernels only ever load whole blocks that lie inside the
+ * string; a partial final block is copied into a zero-padded local buffer
+ * first. Substring search tests the needle's first and last byte against a
+ * block of candidate positions at once and verifies only positions where
+ * both match. The AVX2 kernels hand their tails to the SSE2 ones and clear
+ * the upper register halves first to avoid AVX/SSE transition stalls.
+ */
+
+static inline __m128i foldSse2(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+static int foldEqualsSse2(const char *a, const char *b, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i x = foldSse2(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m128i y = foldSse2(_mm_loadu_si128((const __m128i *)(b + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+            return 0;
+        }
+    }
+    if (i == length) {
+        return 1;
+    }
+    char tailA[16] = { 0 };
+    char tailB[16] = { 0 };
+    memcpy(tailA, a + i, length - i);
+    memcpy(tailB, b + i, length - i);
+    __m128i x = foldSse2(_mm_loadu_si128((const __m128i *)tailA));
+    __m128i y = foldSse2(_mm_loadu_si128((const __m128i *)tailB));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+}
+
+static void foldCopySse2(const char *src, char *dest, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = foldSse2(_mm_loadu_si128((const __m128i *)(src + i)));
+        _mm_storeu_si128((__m128i *)(dest + i), v);
+    }
+    if (i < length) {
+        char tail[16] = { 0 };
+        memcpy(tail, src + i, length - i);
+        _mm_storeu_si128((__m128i *)tail, foldSse2(_mm_loadu_si128((const __m128i *)tail)));
+        memcpy(dest + i, tail, length - i);
+    }
+}
+
+static const char *foldFindSse2(const char *haystack, size_t haystackLength,
+                                const char *needle, size_t needleLength) {
+    if (needleLength > haystackLength) {
+        return NULL;
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+    size_t i = 0;
+    for (; i + needleLength - 1 + 16 <= haystackLength; i += 16) {
+        __m128i blockFirst = foldSse2(_mm_loadu_si128((const __m128i *)(haystack + i)));
+        __m128i blockLast = foldSse2(_mm_loadu_si128((const __m128i *)(haystack + i + needleLength - 1)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                                  _mm_cmpeq_epi8(blockLast, last)));
+        while (mask != 0) {
+            size_t pos = i + (size_t)lowestSetBit(mask);
+            if (foldMatches(haystack + pos + 1, needle + 1, needleLength - 1)) {
+                return haystack + pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return foldFindScalar(haystack + i, haystackLength - i, needle, needleLength);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i foldAvx2(__m256i v) {
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static int foldEqualsAvx2(const char *a, const char *b, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i x = foldAvx2(_mm256_loadu_si256((const __m256i *)(a + i)));
+        __m256i y = foldAvx2(_mm256_loadu_si256((const __m256i *)(b + i)));
+        if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFFu) {
+            return 0;
+        }
+    }
+    _mm256_zeroupper();
+    return foldEqualsSse2(a + i, b + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static void foldCopyAvx2(const char *src, char *dest, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = foldAvx2(_mm256_loadu_si256((const __m256i *)(src + i)));
+        _mm256_storeu_si256((__m256i *)(dest + i), v);
+    }
+    _mm256_zeroupper();
+    foldCopySse2(src + i, dest + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static const char *foldFindAvx2(const char *haystack, size_t haystackLength,
+                                const char *needle, size_t needleLength) {
+    /* Short haystacks never fill a 32-byte block; keep them on SSE2 */
+    if (needleLength - 1 + 32 > haystackLength) {
+        return foldFindSse2(haystack, haystackLength, needle, needleLength);
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+    size_t i = 0;
+    for (; i + needleLength - 1 + 32 <= haystackLength; i += 32) {
+        __m256i blockFirst = foldAvx2(_mm256_loadu_si256((const __m256i *)(haystack + i)));
+        __m256i blockLast = foldAvx2(_mm256_loadu_si256((const __m256i *)(haystack + i + needleLength - 1)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+                                                                        _mm256_cmpeq_epi8(blockLast, last)));
+        while (mask != 0) {
+            size_t pos = i + (size_t)lowestSetBit(mask);
+            if (foldMatches(haystack + pos + 1, needle + 1, needleLength - 1)) {
+                return haystack + pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    _mm256_zeroupper();
+    return foldFindSse2(haystack + i, haystackLength - i, needle, needleLength);
+}
+
+#endif /* ECOM_X86_SIMD */
+
+static CaseKernels caseKernels = {
+    "scalar", foldEqualsScalar, foldCopyScalar, foldFindScalar
+};
+
+/**
+ * Selects the fastest case-folding kernels supported by the running CPU.
+ * Until this is called the portable scalar kernels are used.
+ */
+void initCaseKernels(void) {
+#ifdef ECOM_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        caseKernels = (CaseKernels){ "avx2", foldEqualsAvx2, foldCopyAvx2, foldFindAvx2 };
+    } else {
+        caseKernels = (CaseKernels){ "sse2", foldEqualsSse2, foldCopySse2, foldFindSse2 };
+    }
+#endif
+}
+
+/**
+ * Returns the name of the active case-folding kernel set.
+ */
+const char *caseKernelName(void) {
+    return caseKernels.name;
+}
+
+/* =============================================================================
+ * UTILITY FUNCTIONS
+ * ============================================================================= */
+
+/**
+ * Clears the input buffer to prevent input issues.
+ */
+void clearInputBuffer(void) {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}
+
+/**
+ * Reads an integer from user input with validation.
+ * 
+ * @param prompt The prompt to display
+ * @param value  Pointer to store the result
+ * @return 1 on success, 0 on failure
+ */
+int readInteger(const char *prompt, int *value) {
+    printf("%s", prompt);
+    
+    if (scanf("%d", value) != 1) {
+        clearInputBuffer();
+        return 0;
+    }
+    
+    clearInputBuffer();
+    return 1;
+}
+
+/**
+ * Reads a money amount from user input with validation.
+ * 
+ * @param prompt The prompt to display
+ * @param value  Pointer to store the result in cents
+ * @return 1 on success, 0 on failure
+ */
+int readMoney(const char *prompt, Money *value) {
+    char buffer[MONEY_TEXT_LENGTH];
+    printf("%s", prompt);
+    
+    if (scanf("%47s", buffer) != 1) {
+        clearInputBuffer();
+        return 0;
+    }
+    
+    clearInputBuffer();
+    return parseMoney(buffer, strlen(buffer), value);
+}
+
+/**
+ * Parses a decimal integer such as "42" or "-7" from a span of text that
+ * need not be NUL-terminated.
+ * 
+ * @param text   The text to parse; surrounding whitespace is ignored
+ * @param length Number of characters in text
+ * @param value  Pointer to store the result
+ * @return 1 on success, 0 on failure or overflow
+ */
+int parseInteger(const char *text, size_t length, int *value) {
+    const char *end = text + length;
+    long long result = 0;
+    bool negative = false;
+
+    while (text < end && IS_SPACE(*text)) {
+        text++;
+    }
+    if (text < end && (*text == '-' || *text == '+')) {
+        negative = (*text == '-');
+        text++;
+    }
+    const char *digits = text;
+    for (; text < end && IS_DIGIT(*text); text++) {
+        result = result * 10 + (*text - '0');
+        if (result > (long long)INT_MAX + 1) {
+            return 0;
+        }
+    }
+    while (text < end && IS_SPACE(*text)) {
+        text++;
+    }
+    if (text == digits || text != end || (!negative && result > INT_MAX)) {
+        return 0;
+    }
+
+    *value = (int)(negative ? -result : result);
+    return 1;
+}
+
+/**
+ * Parses a decimal amount such as "19.99", "-1" or "0.5" into cents
+ * without going through floating point. Digits past the second decimal
+ * place must be zero, so no amount is silently rounded.
+ * 
+ * @param text   The text to parse; surrounding whitespace is ignored
+ * @param length Number of characters in text
+ * @param value  Pointer to store the result in cents
+ * @return 1 on success, 0 on failure
+ */
+int parseMoney(const char *text, size_t length, Money *value) {
+    const char *end = text + length;
+    const Money limit = (INT64_MAX - 99) / 100;
+    Money whole = 0;
+    int cents = 0;
+    int digits = 0;
+    bool negative = false;
+
+    while (text < end && IS_SPACE(*text)) {
+        text++;
+    }
+    if (text < end && (*text == '-' || *text == '+')) {
+        negative = (*text == '-');
+        text++;
+    }
+    for (; text < end && IS_DIGIT(*text); text++, digits++) {
+        /* Fifteen digits cannot overflow; only check beyond that */
+        if (digits >= 15 && whole > (limit - (*text - '0')) / 10) {
+            return 0;
+        }
+        whole = whole * 10 + (*text - '0');
+    }
+    if (text < end && *text == '.') {
+        text++;
+        for (int place = 0; text < end && IS_DIGIT(*text); text++, place++, digits++) {
+            if (place < 2) {
+                cents += (*text - '0') * (place == 0 ? 10 : 1);
+            } else if (*text != '0') {
+                return 0;
+            }
+        }
+    }
+    while (text < end && IS_SPACE(*text)) {
+        text++;
+    }
+    if (digits == 0 || text != end) {
+        return 0;
+    }
+
+    Money amount = whole * 100 + cents;
+    *value = negative ? -amount : amount;
+    return 1;
+}
+
+/**
+ * Parses an unsigned 64-bit sequence number from a span of text that need
+ * not be NUL-terminated.
+ * 
+ * @param text   The digits to parse, with no sign or whitespace
+ * @param length Number of characters in text
+ * @param value  Pointer to store the result
+ * @return 1 on success, 0 on failure or overflow
+ */
+int parseSequence(const char *text, size_t length, uint64_t *value) {
+    uint64_t result = 0;
+    if (length == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        unsigned digit = (unsigned)(text[i] - '0');
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10) {
+            return 0;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return 1;
+}
+
+/**
+ * Formats an amount in cents as a plain decimal with two places,
+ * e.g. "1234.50" or "-0.05".
+ * 
+ * @param cents  The amount to format
+ * @param buffer Buffer to store the result
+ * @param size   Size of the buffer
+ * @return buffer, for use directly in printf arguments
+ */
+const char *formatMoney(MoneyTotal cents, char *buffer, size_t size) {
+    char digits[MONEY_TEXT_LENGTH];
+    int length = 0;
+    bool negative = cents < 0;
+
+    /* Peel digits off a non-positive value so the most negative total works */
+    MoneyTotal rest = negative ? cents : -cents;
+    do {
+        digits[length++] = (char)('0' - (int)(rest % 10));
+        rest /= 10;
+    } while (rest != 0 || length < 3);
+
+    size_t pos = 0;
+    if (negative && pos + 1 < size) {
+        buffer[pos++] = '-';
+    }
+    while (length > 0 && pos + 1 < size) {
+        if (length == 2 && pos + 1 < size) {
+            buffer[pos++] = '.';
+            if (pos + 1 >= size) {
+                break;
+            }
+        }
+        buffer[pos++] = digits[--length];
+    }
+    if (size > 0) {
+        buffer[pos] = '\0';
+    }
+    return buffer;
+}
+
 /**
  * Reads a string from user input safely.
  * 
@@ -770,12 +11300,7 @@ void readString(const char *prompt, char *buffer, int maxLength) {
  * @return Index of the order, or -1 if not found
  */
 int findOrderByID(int orderID) {
-    for (int i = 0; i < orderCount; i++) {
-        if (orders[i].orderID == orderID) {
-            return i;
-        }
-    }
-    return -1;
+    return orderStoreFind(&orderStore, orderID);
 }
 
 /**
@@ -807,14 +11332,11 @@ int equalsIgnoreCase(const char *a, const char *b) {
     if (a == NULL || b == NULL) {
         return 0;
     }
-    while (*a != '\0' && *b != '\0') {
-        if (tolower((unsigned char)*a) != tolower((unsigned char)*b)) {
-            return 0;
-        }
-        a++;
-        b++;
+    size_t length = strlen(a);
+    if (strlen(b) != length) {
+        return 0;
     }
-    return (*a == '\0' && *b == '\0');
+    return caseKernels.equals(a, b, length);
 }
 
 /**
@@ -824,31 +11346,40 @@ void toLowerCopy(const char *src, char *dest, size_t destSize) {
     if (src == NULL || dest == NULL || destSize == 0) {
         return;
     }
-    size_t i = 0;
-    for (; i < destSize - 1 && src[i] != '\0'; i++) {
-        dest[i] = (char)tolower((unsigned char)src[i]);
+    size_t length = strlen(src);
+    if (length > destSize - 1) {
+        length = destSize - 1;
     }
-    dest[i] = '\0';
+    caseKernels.copy(src, dest, length);
+    dest[length] = '\0';
 }
 
 /**
- * Checks if haystack contains needle, case-insensitive.
+ * Checks if haystack contains needle, case-insensitive. The haystack is
+ * folded on the fly; only the needle is copied, on the stack unless it is
+ * longer than any name.
  */
 int containsIgnoreCase(const char *haystack, const char *needle) {
     if (haystack == NULL || needle == NULL) {
         return 0;
     }
-
-    char haystackLower[TEMP_BUFFER_LENGTH];
-    char needleLower[TEMP_BUFFER_LENGTH];
-    toLowerCopy(haystack, haystackLower, sizeof(haystackLower));
-    toLowerCopy(needle, needleLower, sizeof(needleLower));
-
-    if (strlen(needleLower) == 0) {
+    size_t needleLength = strlen(needle);
+    size_t haystackLength = strlen(haystack);
+    if (needleLength == 0 || needleLength > haystackLength) {
         return 0;
     }
 
-    return strstr(haystackLower, needleLower) != NULL;
+    char buffer[MAX_NAME_LENGTH];
+    char *needleLower = needleLength < sizeof(buffer) ? buffer : malloc(needleLength);
+    if (needleLower == NULL) {
+        return 0;
+    }
+    caseKernels.copy(needle, needleLower, needleLength);
+    int found = caseKernels.find(haystack, haystackLength, needleLower, needleLength) != NULL;
+    if (needleLower != buffer) {
+        free(needleLower);
+    }
+    return found;
 }
 
 /**
@@ -866,6 +11397,20 @@ int mapStatusToIndex(const char *status) {
     return (int)STATUS_OPTION_COUNT;
 }
 
+/**
+ * Returns a monotonic time in nanoseconds, for measuring intervals. Where
+ * no monotonic clock is available, processor time is used instead.
+ */
+uint64_t monotonicNanoseconds(void) {
+#ifdef ECOM_POSIX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#else
+    return (uint64_t)((double)clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
 /**
  * Prompts the user for a yes/no response.
  */
@@ -879,3 +11424,967 @@ int promptYesNo(const char *message) {
     }
     return 0;
 }
+
+#ifdef ECOM_TEST
+/* =============================================================================
+ * SELF-TEST FUNCTIONS
+ * ============================================================================= */
+
+#define TEST_CHECK(condition) testCheck((condition) ? 1 : 0, #condition, __LINE__)
+
+static int testFailures;            /* Failed checks of the current test */
+static bool testTimed;              /* Whether tests also print timings  */
+static volatile long testSink;      /* Keeps timed work from being dropped */
+
+/**
+ * Records the outcome of one check, reporting it if it failed.
+ */
+static void testCheck(int passed, const char *expression, int line) {
+    if (!passed) {
+        if (testFailures < 10) {
+            printf("  [FAIL] line %d: %s\n", line, expression);
+        }
+        testFailures++;
+    }
+}
+
+/**
+ * Fills a buffer with bytes drawn mostly from around the letters, where
+ * case folding has its edges, with some digits, spaces and bytes above
+ * 0x7F mixed in.
+ */
+static void testRandomText(uint64_t *state, char *text, size_t length) {
+    static const char EDGES[] = "@AZ[`az{ 09";
+    for (size_t i = 0; i < length; i++) {
+        uint64_t pick = generatorBelow(state, 8);
+        if (pick < 4) {
+            text[i] = (char)('A' + generatorBelow(state, 26) + (pick & 1) * 32);
+        } else if (pick < 6) {
+            text[i] = EDGES[generatorBelow(state, sizeof(EDGES) - 1)];
+        } else {
+            text[i] = (char)(1 + generatorBelow(state, 255));
+        }
+    }
+}
+
+/**
+ * Folds text the way the program did before the kernels: with tolower(),
+ * which the kernels must match byte for byte in the "C" locale.
+ */
+static void testReferenceFold(const char *src, char *dest, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        dest[i] = (char)tolower((unsigned char)src[i]);
+    }
+}
+
+/**
+ * Returns the first position of a folded needle in a haystack ignoring
+ * case, or -1, by brute force.
+ */
+static long testReferenceFind(const char *haystack, size_t haystackLength, const char *needle, size_t needleLength) {
+    for (size_t i = 0; i + needleLength <= haystackLength; i++) {
+        size_t j = 0;
+        while (j < needleLength && tolower((unsigned char)haystack[i + j]) == (unsigned char)needle[j]) {
+            j++;
+        }
+        if (j == needleLength) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the case-folding kernel sets the running CPU supports, scalar
+ * first.
+ */
+static int testCaseKernelSets(CaseKernels *sets) {
+    int count = 0;
+    sets[count++] = (CaseKernels){ "scalar", foldEqualsScalar, foldCopyScalar, foldFindScalar };
+#ifdef ECOM_X86_SIMD
+    __builtin_cpu_init();
+    sets[count++] = (CaseKernels){ "sse2", foldEqualsSse2, foldCopySse2, foldFindSse2 };
+    if (__builtin_cpu_supports("avx2")) {
+        sets[count++] = (CaseKernels){ "avx2", foldEqualsAvx2, foldCopyAvx2, foldFindAvx2 };
+    }
+#endif
+    return count;
+}
+
+/**
+ * Times every kernel set on names of typical length.
+ */
+static void testTimeCaseKernels(const CaseKernels *sets, int setCount) {
+    enum { NAMES = 1024, NAME_LENGTH = 100, CALLS = 2000000 };
+    char *names = malloc((size_t)NAMES * NAME_LENGTH);
+    char *folded = malloc((size_t)NAMES * NAME_LENGTH);
+    if (names == NULL || folded == NULL) {
+        free(names);
+        free(folded);
+        return;
+    }
+    uint64_t state = 7;
+    testRandomText(&state, names, (size_t)NAMES * NAME_LENGTH);
+    testReferenceFold(names, folded, (size_t)NAMES * NAME_LENGTH);
+    const char needle[] = "zq~";
+
+    printf("  %-8s %14s %14s %14s\n", "kernel", "equals ns/op", "copy ns/op", "find ns/op");
+    for (int k = 0; k < setCount; k++) {
+        char copy[NAME_LENGTH];
+        long sink = 0;
+        double timings[3];
+        for (int op = 0; op < 3; op++) {
+            uint64_t started = monotonicNanoseconds();
+            for (int i = 0; i < CALLS; i++) {
+                const char *name = names + (size_t)(i % NAMES) * NAME_LENGTH;
+                if (op == 0) {
+                    sink += sets[k].equals(name, folded + (size_t)(i % NAMES) * NAME_LENGTH, NAME_LENGTH);
+                } else if (op == 1) {
+                    sets[k].copy(name, copy, NAME_LENGTH);
+                    sink += copy[i % NAME_LENGTH];
+                } else {
+                    sink += sets[k].find(name, NAME_LENGTH, needle, sizeof(needle) - 1) != NULL;
+                }
+            }
+            timings[op] = (double)(monotonicNanoseconds() - started) / CALLS;
+        }
+        testSink += sink;
+        printf("  %-8s %14.1f %14.1f %14.1f\n", sets[k].name, timings[0], timings[1], timings[2]);
+    }
+    free(names);
+    free(folded);
+}
+
+/**
+ * Checks every case-folding kernel set against tolower() on random text,
+ * including bytes above 0x7F and every length around the 16- and 32-byte
+ * block sizes. Inputs are allocated at their exact size so a sanitizer
+ * build catches any read past the end.
+ */
+static void testCaseKernels(void) {
+    CaseKernels sets[3];
+    int setCount = testCaseKernelSets(sets);
+    uint64_t state = 42;
+    for (int round = 0; round < 20000; round++) {
+        size_t length = round < 200 ? (size_t)round : (size_t)generatorBelow(&state, 300);
+        char *text = malloc(length + 1);
+        char *other = malloc(length + 1);
+        char *expected = malloc(length + 1);
+        char *actual = malloc(length + 1);
+        if (text == NULL || other == NULL || expected == NULL || actual == NULL) {
+            TEST_CHECK(!"out of memory");
+            free(text);
+            free(other);
+            free(expected);
+            free(actual);
+            return;
+        }
+        testRandomText(&state, text, length);
+        testReferenceFold(text, expected, length);
+
+        /* Swap the case of some letters, and sometimes change one byte */
+        memcpy(other, text, length);
+        for (size_t i = 0; i < length; i++) {
+            if (isalpha((unsigned char)other[i]) && generatorBelow(&state, 2)) {
+                other[i] ^= 0x20;
+            }
+        }
+        if (length > 0 && generatorBelow(&state, 2)) {
+            other[generatorBelow(&state, length)] = (char)generatorBelow(&state, 256);
+        }
+        char *otherFolded = malloc(length + 1);
+        if (otherFolded != NULL) {
+            testReferenceFold(other, otherFolded, length);
+        }
+        int same = otherFolded != NULL && memcmp(expected, otherFolded, length) == 0;
+        free(otherFolded);
+
+        /* A needle cut from the text, or random; always folded */
+        size_t needleLength = 1 + (size_t)generatorBelow(&state, 40);
+        char *needle = malloc(needleLength);
+        if (needle != NULL) {
+            if (length >= needleLength && generatorBelow(&state, 4) != 0) {
+                testReferenceFold(text + generatorBelow(&state, length - needleLength + 1), needle, needleLength);
+            } else {
+                testRandomText(&state, needle, needleLength);
+                testReferenceFold(needle, needle, needleLength);
+            }
+        }
+        long position = needle != NULL ? testReferenceFind(text, length, needle, needleLength) : -1;
+
+        for (int k = 0; k < setCount; k++) {
+            memset(actual, 0, length + 1);
+            sets[k].copy(text, actual, length);
+            TEST_CHECK(memcmp(actual, expected, length) == 0);
+            TEST_CHECK(sets[k].equals(text, other, length) == same);
+            TEST_CHECK(sets[k].equals(text, text, length) == 1);
+            if (needle != NULL) {
+                const char *found = sets[k].find(text, length, needle, needleLength);
+                TEST_CHECK((found == NULL ? -1 : (long)(found - text)) == position);
+            }
+        }
+        free(needle);
+        free(text);
+        free(other);
+        free(expected);
+        free(actual);
+    }
+    if (testTimed) {
+        testTimeCaseKernels(sets, setCount);
+    }
+}
+
+/**
+ * Checks that names longer than the old 127-character search window are
+ * found wherever the needle falls in them, by both the trigram index and
+ * the scan used for short needles.
+ */
+static void testLongNameSearch(void) {
+    char zebra[160];
+    char quokka[MAX_NAME_LENGTH];
+    char tooLong[MAX_NAME_LENGTH * 2 + 1];
+    memset(zebra, 'A', 150);
+    strcpy(zebra + 150, "Zebra");
+    memset(quokka, 'b', sizeof(quokka) - 7);
+    strcpy(quokka + sizeof(quokka) - 7, "Quokka");
+    memset(tooLong, 'b', sizeof(tooLong) - 1);
+    tooLong[sizeof(tooLong) - 1] = '\0';
+
+    TEST_CHECK(containsIgnoreCase(zebra, "zebra"));
+    TEST_CHECK(containsIgnoreCase(zebra, "aZEB"));
+    TEST_CHECK(!containsIgnoreCase(zebra, "zebras"));
+    TEST_CHECK(containsIgnoreCase(quokka, quokka));
+    TEST_CHECK(!containsIgnoreCase(quokka, tooLong));
+
+    OrderStore store;
+    orderStoreInit(&store);
+    Order order = { .orderID = 1, .customerName = zebra, .productName = "Thing", .quantity = 1, .price = 100 };
+    TEST_CHECK(orderStoreAdd(&store, &order) != -1);
+    order.orderID = 2;
+    order.customerName = quokka;
+    TEST_CHECK(orderStoreAdd(&store, &order) != -1);
+
+    static const struct {
+        const char *needle;
+        int orderID;        /* The one match expected, or 0 for none */
+    } CASES[] = {
+        { "zebra", 1 }, { "ZE", 1 }, { "aaz", 1 }, { "quokka", 2 }, { "bQ", 2 }, { "zebras", 0 },
+    };
+    SlotList matches = { NULL, 0, 0 };
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+        TEST_CHECK(orderStoreSearchName(&store, CASES[i].needle, &matches));
+        TEST_CHECK(matches.count == (CASES[i].orderID != 0));
+        TEST_CHECK(matches.count == 0 || orderStoreOrderID(&store, matches.slots[0]) == CASES[i].orderID);
+    }
+    TEST_CHECK(orderStoreSearchName(&store, quokka, &matches) && matches.count == 1);
+    TEST_CHECK(orderStoreSearchName(&store, tooLong, &matches) && matches.count == 0);
+    free(matches.slots);
+    orderStoreFree(&store);
+}
+
+/**
+ * Discards every order and all journal state in memory, as if the program
+ * had just started.
+ */
+static void testDiscardBook(void) {
+    journalClose();
+    orderStoreFree(&orderStore);
+    statusDictionaryFree();
+    journal = (Journal){ .nextSequence = 1 };
+    savedGeneration = changeGeneration;
+    dataFile = DATA_FILE;
+    TEST_CHECK(statusDictionaryInit());
+}
+
+/**
+ * Discards every order, all journal state and the order files, so each
+ * test that uses the global book starts from an empty one.
+ */
+static void testReset(void) {
+    testDiscardBook();
+    remove(DATA_FILE);
+    remove(SNAPSHOT_FILE);
+    remove(JOURNAL_FILE);
+    remove(COLUMNAR_FILE);
+}
+
+/**
+ * Writes text to a file, optionally followed by a run of one byte.
+ */
+static void testWriteFile(const char *path, const char *text, char fill, size_t fillCount, const char *tail) {
+    FILE *file = fopen(path, "wb");
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+    fputs(text, file);
+    for (size_t i = 0; i < fillCount; i++) {
+        fputc(fill, file);
+    }
+    fputs(tail, file);
+    TEST_CHECK(fclose(file) == 0);
+}
+
+/**
+ * Reads a whole small file into a buffer, NUL-terminated.
+ */
+static void testReadFile(const char *path, char *buffer, size_t size) {
+    FILE *file = fopen(path, "rb");
+    size_t length = file != NULL ? fread(buffer, 1, size - 1, file) : 0;
+    buffer[length] = '\0';
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+/**
+ * Checks that an import line longer than a whole import block counts as
+ * one rejected row at its own line number, and that the line numbers of
+ * the rows after it stay right.
+ */
+static void testImportOverlongLine(void) {
+    static const struct {
+        const char *head;
+        size_t      fillCount;  /* Bytes of the overlong line 2 */
+        const char *tail;
+        int         imported;
+        const char *report;
+    } CASES[] = {
+        { "1,Ann,Lamp,1,2.00,Pending\n", IMPORT_BLOCK_BYTES + IMPORT_BLOCK_BYTES / 4,
+          "\n3,Bob,Desk,1,5.00,Shipped\n4,Cy,Desk,x,5.00,Shipped\n5,Di,Mug,2,1.50,Delivered\n", 3,
+          "t.csv:2: line is too long\nt.csv:4: invalid quantity\n" },
+        { "1,Ann,Lamp,1,2.00,Pending\n", IMPORT_BLOCK_BYTES * 2, "", 1,
+          "t.csv:2: line is too long\n" },
+        { "", IMPORT_BLOCK_BYTES, "\n3,Bob,Desk,1,5.00,Shipped\n", 1,
+          "t.csv:1: line is too long\n" },
+        /* One byte shorter, the line and its newline just fit in a block */
+        { "", IMPORT_BLOCK_BYTES - 1, "\n3,Bob,Desk,1,5.00,Shipped\n", 1,
+          "t.csv:1: expected 6 comma-separated fields\n" },
+    };
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+        testReset();
+        testWriteFile("t.csv", CASES[i].head, 'z', CASES[i].fillCount, CASES[i].tail);
+        TEST_CHECK(importOrders("t.csv", "t.report") == CASES[i].imported);
+        char report[256];
+        testReadFile("t.report", report, sizeof(report));
+        TEST_CHECK(strcmp(report, CASES[i].report) == 0);
+        if (strcmp(report, CASES[i].report) != 0) {
+            printf("  case %d report:\n%s", (int)i, report);
+        }
+    }
+    remove("t.csv");
+    remove("t.report");
+    testReset();
+}
+
+/**
+ * Returns whether two files hold the same bytes.
+ */
+static bool testFilesEqual(const char *pathA, const char *pathB) {
+    FILE *a = fopen(pathA, "rb");
+    FILE *b = fopen(pathB, "rb");
+    bool equal = a != NULL && b != NULL;
+    char bufferA[BUFSIZ];
+    char bufferB[BUFSIZ];
+    while (equal) {
+        size_t lengthA = fread(bufferA, 1, sizeof(bufferA), a);
+        size_t lengthB = fread(bufferB, 1, sizeof(bufferB), b);
+        equal = lengthA == lengthB && memcmp(bufferA, bufferB, lengthA) == 0;
+        if (lengthA == 0) {
+            break;
+        }
+    }
+    if (a != NULL) {
+        fclose(a);
+    }
+    if (b != NULL) {
+        fclose(b);
+    }
+    return equal;
+}
+
+/**
+ * Writes the live orders the way saveOrdersToCsv() did before it was
+ * rewritten as a buffered parallel serializer: one fprintf() per order.
+ */
+static void testWriteReferenceCsv(const char *path) {
+    FILE *file = fopen(path, "w");
+    TEST_CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+    fprintf(file, "# E-Commerce Orders Database\n");
+    fprintf(file, "# Format: OrderID,CustomerName,ProductName,Quantity,Price,Status\n");
+    fprintf(file, "# Total Orders: %d\n", orderStoreCount(&orderStore));
+    fprintf(file, CSV_SEQUENCE_HEADER "%llu\n", (unsigned long long)journal.checkpointSequence);
+    for (int i = orderStoreNextLive(&orderStore, 0); i != -1; i = orderStoreNextLive(&orderStore, i + 1)) {
+        Order order;
+        char money[MONEY_TEXT_LENGTH];
+        orderStoreGet(&orderStore, i, &order);
+        fprintf(file, "%d,%s,%s,%d,%s,%s\n", order.orderID, order.customerName, order.productName,
+                order.quantity, formatMoney(order.price, money, sizeof(money)), statusLabel(order.statusId));
+    }
+    TEST_CHECK(fclose(file) == 0);
+}
+
+/**
+ * Checks that the checkpoint serializer writes exactly what the original
+ * per-order writer did: for edge values, for a book large enough to be
+ * split across threads, with tombstones, on one thread and on several,
+ * and after a round trip through the snapshot, the columnar file and the
+ * CSV loader.
+ */
+static void testSerializerGolden(void) {
+    testReset();
+    static const Order EDGES[] = {
+        { INT_MAX, "Max", "Item", MAX_QUANTITY, MAX_PRICE_CENTS, 0 },
+        { INT_MIN, "Min", "Item", -MAX_QUANTITY, -MAX_PRICE_CENTS, 0 },
+        { 0, "Zero", "Item", 0, 0, 0 },
+        { 7, "Cents", "Item", 1, 5, 0 },
+        { -7, "Refund", "Item", -1, -5, 0 },
+        { 8, "Dollar", "Item", 1, -100, 0 },
+        { 9, "Ümlaut Ölsen", "Café Crème", 3, 123456, 0 },
+    };
+    uint16_t custom = (uint16_t)statusIntern("Back-ordered");
+    for (size_t i = 0; i < sizeof(EDGES) / sizeof(EDGES[0]); i++) {
+        Order order = EDGES[i];
+        order.statusId = i % 2 ? custom : (uint16_t)statusIntern(STATUS_OPTIONS[i % STATUS_OPTION_COUNT]);
+        TEST_CHECK(orderStoreAdd(&orderStore, &order) != -1);
+    }
+    char longName[MAX_NAME_LENGTH];
+    memset(longName, 'L', sizeof(longName) - 1);
+    longName[sizeof(longName) - 1] = '\0';
+    Order order = { 10, longName, longName, 2, 999, custom };
+    TEST_CHECK(orderStoreAdd(&orderStore, &order) != -1);
+
+    /* Enough orders that four threads each get several chunks */
+    static const char *const NAMES[] = { "Ann Lee", "Bo", "Carla Diaz-Ortega", "D", "Eve O'Neil" };
+    uint64_t state = 5;
+    char customer[64];
+    for (int id = 100; id < 200000; id++) {
+        snprintf(customer, sizeof(customer), "%s %d", NAMES[id % 5], (int)generatorBelow(&state, 5000));
+        order = (Order){ id, customer, NAMES[(id / 5) % 5], 1 + (int)generatorBelow(&state, 20),
+                         (Money)generatorBelow(&state, 2000000) - 1000, (uint16_t)statusIntern(
+                         STATUS_OPTIONS[generatorBelow(&state, STATUS_OPTION_COUNT)]) };
+        TEST_CHECK(orderStoreAdd(&orderStore, &order) != -1);
+    }
+    for (int id = 100; id < 200000; id += 7) {
+        TEST_CHECK(orderStoreDelete(&orderStore, orderStoreFind(&orderStore, id)));
+    }
+    journal.checkpointSequence = 12345;
+    testWriteReferenceCsv("golden.txt");
+
+#ifdef ECOM_POSIX
+    static const char *const THREADS[] = { "1", "4" };
+    for (size_t i = 0; i < sizeof(THREADS) / sizeof(THREADS[0]); i++) {
+        setenv(WORKER_THREADS_ENV, THREADS[i], 1);
+        TEST_CHECK(saveOrdersToCsv("t.txt"));
+        TEST_CHECK(testFilesEqual("t.txt", "golden.txt"));
+    }
+    unsetenv(WORKER_THREADS_ENV);
+#else
+    TEST_CHECK(saveOrdersToCsv("t.txt"));
+    TEST_CHECK(testFilesEqual("t.txt", "golden.txt"));
+#endif
+
+    TEST_CHECK(saveSnapshot("t.snap", NULL));
+    TEST_CHECK(saveOrdersToColumnar("t.col"));
+    int count = orderStoreCount(&orderStore);
+
+    testReset();
+    TEST_CHECK(loadSnapshot("t.snap", NULL) == count);
+    TEST_CHECK(saveOrdersToCsv("t.txt") && testFilesEqual("t.txt", "golden.txt"));
+    testReset();
+    TEST_CHECK(loadOrdersFromColumnar("t.col") == count);
+    TEST_CHECK(saveOrdersToCsv("t.txt") && testFilesEqual("t.txt", "golden.txt"));
+    testReset();
+    TEST_CHECK(loadOrdersFromCsv("golden.txt") == count);
+    TEST_CHECK(saveOrdersToCsv("t.txt") && testFilesEqual("t.txt", "golden.txt"));
+
+    remove("golden.txt");
+    remove("t.txt");
+    remove("t.snap");
+    remove("t.col");
+    testReset();
+}
+
+/**
+ * Checks that a columnar data file with a damaged block still loads the
+ * other blocks, and that the next checkpoint keeps the damaged file
+ * rather than overwrite the orders it lost.
+ */
+static void testDamagedColumnar(void) {
+    testReset();
+    char customer[64];
+    for (int id = 1; id <= COLUMNAR_BLOCK_ROWS * 3; id++) {
+        snprintf(customer, sizeof(customer), "Customer %d", id % 997);
+        Order order = { id, customer, "Item", 1 + id % 5, 100 + id % 1000, (uint16_t)statusIntern(
+                        STATUS_OPTIONS[id % STATUS_OPTION_COUNT]) };
+        TEST_CHECK(orderStoreAdd(&orderStore, &order) != -1);
+    }
+    TEST_CHECK(saveOrdersToColumnar("t.col"));
+    int count = orderStoreCount(&orderStore);
+    testReset();
+
+    /* Flip a byte in the middle of the second block */
+    MappedFile file;
+    long offset = -1;
+    int lost = 0;
+    if (mappedFileOpen("t.col", &file, false)) {
+        const ColumnarHeader *header = columnarHeader(&file);
+        if (header != NULL && header->blockCount > 1) {
+            const ColumnarBlock *block = &columnarDirectory(&file, header)[1];
+            offset = (long)(block->data.offset + block->data.length / 2);
+            lost = block->rows;
+        }
+        mappedFileClose(&file);
+    }
+    FILE *damaged = offset >= 0 ? fopen("t.col", "r+b") : NULL;
+    TEST_CHECK(damaged != NULL);
+    if (damaged == NULL) {
+        return;
+    }
+    fseek(damaged, offset, SEEK_SET);
+    int byte = fgetc(damaged);
+    fseek(damaged, offset, SEEK_SET);
+    fputc(byte ^ 0xFF, damaged);
+    fclose(damaged);
+    TEST_CHECK(rename("t.col", COLUMNAR_FILE) == 0);
+
+    TEST_CHECK(loadFromFile() == count - lost);
+    TEST_CHECK(strcmp(dataFile, COLUMNAR_FILE) == 0);
+    TEST_CHECK(saveToFile());
+    TEST_CHECK(isColumnarFile(COLUMNAR_FILE DAMAGED_SUFFIX) && !verifyColumnarFile(COLUMNAR_FILE DAMAGED_SUFFIX));
+    TEST_CHECK(verifyColumnarFile(COLUMNAR_FILE));
+
+    /* Later checkpoints leave the kept file alone */
+    journal.needsCheckpoint = true;
+    TEST_CHECK(saveToFile());
+    TEST_CHECK(isColumnarFile(COLUMNAR_FILE DAMAGED_SUFFIX) && !verifyColumnarFile(COLUMNAR_FILE DAMAGED_SUFFIX));
+    remove(COLUMNAR_FILE DAMAGED_SUFFIX);
+    testReset();
+}
+
+/**
+ * Checks that the next checkpoint keeps a CSV data file whose malformed
+ * lines were skipped at load, rather than rewrite it without them.
+ */
+static void testDamagedCsv(void) {
+    testReset();
+    static const char CSV[] =
+        "1,Ann,Lamp,1,2.00,Pending\n"
+        "2,Bob,Desk,2000000,5.00,Shipped\n"
+        "3,Cy,Mug,2,1.50,Delivered\n";
+    testWriteFile(DATA_FILE, CSV, 0, 0, "");
+    TEST_CHECK(loadFromFile() == 2);
+    TEST_CHECK(saveToFile());
+    char kept[sizeof(CSV) + 1];
+    testReadFile(DATA_FILE DAMAGED_SUFFIX, kept, sizeof(kept));
+    TEST_CHECK(strcmp(kept, CSV) == 0);
+    TEST_CHECK(rename(DATA_FILE, "t.txt") == 0);
+    testReset();
+    TEST_CHECK(loadOrdersFromCsv("t.txt") == 2 && !journal.dataFileDamaged);
+    remove("t.txt");
+    remove(DATA_FILE DAMAGED_SUFFIX);
+    testReset();
+}
+
+/**
+ * Checks that a status filter on a columnar scan matches only orders with
+ * that label, custom labels included, and that an unknown label matches
+ * nothing rather than every custom status.
+ */
+static void testColumnarStatusScan(void) {
+    testReset();
+    static const struct {
+        const char *status;
+        int         orders;
+    } CASES[] = {
+        { NULL, 6 }, { "Shipped", 2 }, { "shipped", 2 }, { "Returned", 1 },
+        { "On Hold", 3 }, { "Bogus", 0 }, { "Pending", 0 },
+    };
+    static const char *const LABELS[] = { "Shipped", "On Hold", "Returned", "On Hold", "Shipped", "On Hold" };
+    for (int id = 1; id <= 6; id++) {
+        Order order = { id, "Ann", "Lamp", 1, 100 * id, (uint16_t)statusIntern(LABELS[id - 1]) };
+        TEST_CHECK(orderStoreAdd(&orderStore, &order) != -1);
+    }
+    TEST_CHECK(saveOrdersToColumnar("t.col"));
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+        ColumnarFilter filter = { INT_MIN, INT_MAX, -INT64_MAX, INT64_MAX, CASES[i].status };
+        ColumnarScan scan;
+        TEST_CHECK(scanColumnarFile("t.col", &filter, &scan));
+        TEST_CHECK(scan.orders == CASES[i].orders);
+    }
+    remove("t.col");
+    testReset();
+}
+
+/**
+ * Discards the book in memory and loads it again from orders.txt, the
+ * snapshot and the journal, as a restart would.
+ *
+ * @return Number of journaled changes replayed
+ */
+static int testRestart(void) {
+    testDiscardBook();
+    if (loadSnapshot(SNAPSHOT_FILE, DATA_FILE) < 0) {
+        loadOrdersFromCsv(DATA_FILE);
+    }
+    return journalReplay();
+}
+
+/**
+ * Returns the quantity of an order, or -1 if it does not exist.
+ */
+static int testQuantity(int orderID) {
+    int slot = orderStoreFind(&orderStore, orderID);
+    Order order;
+    if (slot == -1) {
+        return -1;
+    }
+    orderStoreGet(&orderStore, slot, &order);
+    return order.quantity;
+}
+
+/**
+ * Checks journal replay after the crashes it is meant to survive: a batch
+ * whose commit record is torn, a checkpoint written but the journal not yet
+ * emptied, and a checkpoint whose temporary files were never renamed into
+ * place.
+ */
+static void testJournalReplay(void) {
+    testReset();
+    Order order = { 1, "Ann", "Lamp", 1, 200, (uint16_t)statusIntern("Pending") };
+    TEST_CHECK(addOrderRecord(&order) == 1);
+    journal.needsCheckpoint = true;
+    TEST_CHECK(saveToFile());
+    order.orderID = 2;
+    TEST_CHECK(addOrderRecord(&order) == 1);
+    TEST_CHECK(saveToFile());
+    order.orderID = 3;
+    TEST_CHECK(addOrderRecord(&order) == 1);
+    order.orderID = 1;
+    order.quantity = 7;
+    TEST_CHECK(updateOrderRecord(&order) == 1);
+    TEST_CHECK(saveToFile());
+    uint64_t complete = journal.bytes;
+    TEST_CHECK(deleteOrderRecord(2) == 1);
+    order.orderID = 4;
+    TEST_CHECK(addOrderRecord(&order) == 1);
+    TEST_CHECK(saveToFile());
+
+    /* The last batch's commit record is torn: only the batches before it count */
+    char text[4096];
+    testReadFile(JOURNAL_FILE, text, sizeof(text));
+    TEST_CHECK(strlen(text) == journal.bytes && journal.bytes > complete);
+    text[journal.bytes - 5] = '\0';
+    testWriteFile(JOURNAL_FILE, text, 0, 0, "");
+    TEST_CHECK(testRestart() == 3);
+    TEST_CHECK(orderStoreCount(&orderStore) == 3 && testQuantity(1) == 7);
+    TEST_CHECK(testQuantity(2) == 1 && testQuantity(4) == -1);
+    testReadFile(JOURNAL_FILE, text, sizeof(text));
+    TEST_CHECK(journal.bytes == complete && strlen(text) == complete);
+    /* New batches are appended after the last complete one */
+    order.orderID = 5;
+    TEST_CHECK(addOrderRecord(&order) == 1 && saveToFile());
+    TEST_CHECK(testRestart() == 4 && testQuantity(5) == 7);
+
+    /* A checkpoint was written but the journal it covers was not emptied */
+    testReadFile(JOURNAL_FILE, text, sizeof(text));
+    journal.needsCheckpoint = true;
+    TEST_CHECK(saveToFile());
+    testWriteFile(JOURNAL_FILE, text, 0, 0, "");
+    TEST_CHECK(testRestart() == 0 && orderStoreCount(&orderStore) == 4);
+    TEST_CHECK(deleteOrderRecord(3) == 1 && saveToFile());
+    TEST_CHECK(testRestart() == 1 && testQuantity(3) == -1 && orderStoreCount(&orderStore) == 3);
+
+    /* A checkpoint stopped before renaming its temporary files: the old
+       checkpoint and the whole journal still stand */
+    order.orderID = 6;
+    TEST_CHECK(addOrderRecord(&order) == 1 && saveToFile());
+    testWriteFile(DATA_FILE ".tmp", "# E-Commerce Orders Database\n6,Ann,La", 0, 0, "");
+    testWriteFile(SNAPSHOT_FILE ".tmp", SNAPSHOT_MAGIC, 0, 0, "");
+    TEST_CHECK(testRestart() == 2 && testQuantity(6) == 7 && orderStoreCount(&orderStore) == 4);
+    journal.needsCheckpoint = true;
+    TEST_CHECK(saveToFile());
+    FILE *stray = fopen(DATA_FILE ".tmp", "rb");
+    TEST_CHECK(stray == NULL);
+    if (stray != NULL) {
+        fclose(stray);
+    }
+    TEST_CHECK(testRestart() == 0 && orderStoreCount(&orderStore) == 4 && testQuantity(1) == 7);
+    remove(SNAPSHOT_FILE ".tmp");
+    testReset();
+}
+
+/**
+ * qsort() comparison putting value entries in value index order: highest
+ * value first, ties to the lower slot.
+ */
+static int testCompareValueEntries(const void *a, const void *b) {
+    const ValueEntry *x = a;
+    const ValueEntry *y = b;
+    if (x->value != y->value) {
+        return x->value > y->value ? -1 : 1;
+    }
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+/**
+ * Checks a store's value index against its live slots: the leaf chain holds
+ * each live order once, in index order, with consistent back links, and
+ * value range queries return what a sorted scan of the slots does.
+ */
+static void testCheckValueIndex(const OrderStore *store, uint64_t *state, ValueEntry *expected) {
+    const ValueTree *tree = &store->stats.top;
+    int live = 0;
+    for (int slot = orderStoreNextLive(store, 0); slot != -1; slot = orderStoreNextLive(store, slot + 1)) {
+        Order order;
+        orderStoreGet(store, slot, &order);
+        expected[live++] = (ValueEntry){ orderValue(&order), slot };
+    }
+    qsort(expected, (size_t)live, sizeof(*expected), testCompareValueEntries);
+    TEST_CHECK(tree->size == live && (tree->root == -1) == (live == 0));
+
+    int keys = 0;
+    bool ordered = true;
+    for (int leaf = tree->root == -1 ? -1 : valueTreeFirstLeaf(tree, tree->root), prev = -1; leaf != -1;
+         prev = leaf, leaf = tree->nodes[leaf].next) {
+        const ValueNode *node = &tree->nodes[leaf];
+        ordered = ordered && node->leaf && node->prev == prev && node->count > 0;
+        for (int k = 0; ordered && k < node->count; k++, keys++) {
+            ordered = keys < live && node->values[k] == expected[keys].value && node->slots[k] == expected[keys].slot;
+        }
+    }
+    TEST_CHECK(ordered && keys == live);
+
+    SlotList matches = { NULL, 0, 0 };
+    for (int query = 0; query < 50 && live > 0; query++) {
+        Money a = expected[generatorBelow(state, (uint64_t)live)].value + (Money)generatorBelow(state, 3) - 1;
+        Money b = expected[generatorBelow(state, (uint64_t)live)].value;
+        Money minValue = a < b ? a : b;
+        Money maxValue = a < b ? b : a;
+        int limit = query % 2 ? (int)generatorBelow(state, VALUE_MAX_TOP) + 1 : INT_MAX;
+        matches.count = 0;
+        TEST_CHECK(orderStoreValueRange(store, minValue, maxValue, limit, &matches));
+        int found = 0;
+        bool same = true;
+        for (int i = 0; i < live && found < limit; i++) {
+            if (expected[i].value >= minValue && expected[i].value <= maxValue) {
+                same = same && found < matches.count && matches.slots[found] == expected[i].slot;
+                found++;
+            }
+        }
+        TEST_CHECK(same && found == matches.count);
+    }
+    free(matches.slots);
+}
+
+/**
+ * Applies random adds, updates and deletes to a store whose order values
+ * repeat a lot, deleting whole bands of values so that emptied leaves are
+ * unlinked, and compares the value index with a brute-force scan after
+ * each round. One round follows a compaction, which rebuilds the index.
+ */
+static void testValueIndex(void) {
+    enum { ORDERS = 20000, ROUNDS = 6, CHANGES = 4000, PRICES = 600 };
+    OrderStore store;
+    orderStoreInit(&store);
+    ValueEntry *expected = malloc(sizeof(*expected) * ORDERS * 2);
+    TEST_CHECK(expected != NULL);
+    if (expected == NULL) {
+        return;
+    }
+    uint64_t state = 21;
+    int nextID = 1;
+    for (; nextID <= ORDERS; nextID++) {
+        Order order = { nextID, "Ann", "Lamp", 1, (Money)generatorBelow(&state, PRICES), 0 };
+        TEST_CHECK(orderStoreAdd(&store, &order) != -1);
+    }
+    testCheckValueIndex(&store, &state, expected);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int change = 0; change < CHANGES; change++) {
+            int id = 1 + (int)generatorBelow(&state, (uint64_t)(nextID - 1));
+            int slot = orderStoreFind(&store, id);
+            Order order = { id, "Ann", "Lamp", 1 + (int)generatorBelow(&state, 3),
+                            (Money)generatorBelow(&state, PRICES), 0 };
+            switch (generatorBelow(&state, 3)) {
+            case 0:
+                order.orderID = nextID++;
+                TEST_CHECK(orderStoreAdd(&store, &order) != -1);
+                break;
+            case 1:
+                TEST_CHECK(slot == -1 || orderStoreUpdate(&store, slot, &order));
+                break;
+            default:
+                TEST_CHECK(slot == -1 || orderStoreDelete(&store, slot));
+                break;
+            }
+        }
+        /* Every order in a band of values, so whole leaves empty out */
+        Money low = (Money)generatorBelow(&state, PRICES);
+        for (int slot = orderStoreNextLive(&store, 0); slot != -1; slot = orderStoreNextLive(&store, slot + 1)) {
+            Order order;
+            orderStoreGet(&store, slot, &order);
+            Money value = orderValue(&order);
+            if (value >= low && value < low + PRICES / 4) {
+                TEST_CHECK(orderStoreDelete(&store, slot));
+            }
+        }
+        if (round == ROUNDS / 2) {
+            TEST_CHECK(orderStoreReindex(&store) == 0);
+        }
+        testCheckValueIndex(&store, &state, expected);
+    }
+
+    for (int slot = orderStoreNextLive(&store, 0); slot != -1; slot = orderStoreNextLive(&store, slot + 1)) {
+        TEST_CHECK(orderStoreDelete(&store, slot));
+    }
+    testCheckValueIndex(&store, &state, expected);
+    free(expected);
+    orderStoreFree(&store);
+}
+
+/**
+ * Checks that a snapshot whose unchecksummed sections hold an index or
+ * reference out of range, or that is cut short, is turned away rather than
+ * read out of bounds, and that the intact snapshot still loads.
+ */
+static void testDamagedSnapshot(void) {
+    testReset();
+    char customer[32];
+    for (int id = 1; id <= 3000; id++) {
+        snprintf(customer, sizeof(customer), "Customer %d", id % 101);
+        Order order = { id, customer, "Item", 1, 100 + id, (uint16_t)statusIntern(
+                        STATUS_OPTIONS[id % STATUS_OPTION_COUNT]) };
+        TEST_CHECK(orderStoreAdd(&orderStore, &order) != -1);
+    }
+    TEST_CHECK(saveSnapshot("t.snap", NULL));
+    int count = orderStoreCount(&orderStore);
+
+    FILE *file = fopen("t.snap", "rb");
+    long size = -1;
+    if (file != NULL && fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+        rewind(file);
+    }
+    char *original = size > 0 ? malloc((size_t)size) : NULL;
+    char *damaged = size > 0 ? malloc((size_t)size) : NULL;
+    bool read = original != NULL && damaged != NULL && fread(original, 1, (size_t)size, file) == (size_t)size;
+    if (file != NULL) {
+        fclose(file);
+    }
+    TEST_CHECK(read);
+    if (!read) {
+        free(original);
+        free(damaged);
+        return;
+    }
+    const SnapshotHeader *header = (const SnapshotHeader *)original;
+    const SnapshotSection *sections = header->sections;
+    const StringEntry *table = (const StringEntry *)(original + sections[SNAPSHOT_STRING_TABLE].offset);
+    size_t usedBucket = 0;
+    while (usedBucket + 1 < header->stringTableCapacity && table[usedBucket].ref == STRING_REF_NONE) {
+        usedBucket++;
+    }
+    const ValueNode *root = (const ValueNode *)(original + sections[SNAPSHOT_VALUE_NODES].offset) + header->valueRoot;
+    TEST_CHECK(header->valueHeight > 1 && root->leaf == 0);
+
+    const uint16_t badStatus = (uint16_t)header->statusCount;
+    const uint32_t badRef = (uint32_t)header->stringChunkCount << STRING_CHUNK_SHIFT | 64;
+    const int32_t badSlot = header->count;
+    const int32_t badNode = header->valueNodeCount;
+    const struct {
+        uint64_t    offset;
+        const void *bytes;
+        size_t      length;
+    } CASES[] = {
+        { sections[SNAPSHOT_SLABS].offset + offsetof(OrderSlab, statusIds) + 2 * sizeof(uint16_t), &badStatus, sizeof(badStatus) },
+        { sections[SNAPSHOT_SLABS].offset + offsetof(OrderSlab, customerNames) + 5 * sizeof(uint32_t), &badRef, sizeof(badRef) },
+        { sections[SNAPSHOT_SLABS].offset + offsetof(OrderSlab, productNames), &badRef, sizeof(badRef) },
+        { sections[SNAPSHOT_STRING_TABLE].offset + usedBucket * sizeof(StringEntry) + offsetof(StringEntry, ref), &badRef, sizeof(badRef) },
+        { sections[SNAPSHOT_ORDER_INDEX].offset + offsetof(IntMapEntry, value), &badSlot, sizeof(badSlot) },
+        { sections[SNAPSHOT_TRIGRAM_SLOTS].offset, &badSlot, sizeof(badSlot) },
+        { sections[SNAPSHOT_VALUE_NODES].offset + (uint64_t)header->valueRoot * sizeof(ValueNode) +
+          offsetof(ValueNode, children) + sizeof(int32_t), &badNode, sizeof(badNode) },
+        { sections[SNAPSHOT_VALUE_NODES].offset + (uint64_t)header->valueRoot * sizeof(ValueNode) +
+          offsetof(ValueNode, children), &header->valueRoot, sizeof(header->valueRoot) },
+    };
+    for (size_t i = 0; i <= sizeof(CASES) / sizeof(CASES[0]); i++) {
+        memcpy(damaged, original, (size_t)size);
+        size_t length = (size_t)size;
+        if (i < sizeof(CASES) / sizeof(CASES[0])) {
+            memcpy(damaged + CASES[i].offset, CASES[i].bytes, CASES[i].length);
+        } else {
+            /* Cut short in the middle of the slabs */
+            length = (size_t)(sections[SNAPSHOT_SLABS].offset + sections[SNAPSHOT_SLABS].length / 2);
+        }
+        file = fopen("t2.snap", "wb");
+        TEST_CHECK(file != NULL && fwrite(damaged, 1, length, file) == length);
+        if (file != NULL) {
+            fclose(file);
+        }
+        testDiscardBook();
+        TEST_CHECK(loadSnapshot("t2.snap", NULL) == -1 && orderStoreCount(&orderStore) == 0);
+        if (orderStoreCount(&orderStore) != 0) {
+            printf("  case %d loaded\n", (int)i);
+        }
+    }
+    testDiscardBook();
+    TEST_CHECK(loadSnapshot("t.snap", NULL) == count);
+    free(original);
+    free(damaged);
+    remove("t.snap");
+    remove("t2.snap");
+    testReset();
+}
+
+/**
+ * Runs every self-test, printing one line per test.
+ *
+ * @param timed Whether tests with a microbenchmark should also run it
+ * @return 1 if every test passed, 0 otherwise
+ */
+int runSelfTests(bool timed) {
+    static const struct {
+        const char *name;
+        void (*run)(void);
+    } TESTS[] = {
+        { "caseKernels", testCaseKernels },
+        { "longNameSearch", testLongNameSearch },
+        { "importOverlongLine", testImportOverlongLine },
+        { "serializerGolden", testSerializerGolden },
+        { "damagedColumnar", testDamagedColumnar },
+        { "damagedCsv", testDamagedCsv },
+        { "columnarStatusScan", testColumnarStatusScan },
+        { "journalReplay", testJournalReplay },
+        { "valueIndex", testValueIndex },
+        { "damagedSnapshot", testDamagedSnapshot },
+    };
+    const char *const files[] = { DATA_FILE, SNAPSHOT_FILE, JOURNAL_FILE, COLUMNAR_FILE };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        FILE *probe = fopen(files[i], "rb");
+        if (probe != NULL) {
+            fclose(probe);
+            printf("[ERROR] %s exists. Run the self-tests in an empty directory.\n", files[i]);
+            return 0;
+        }
+    }
+    int failed = 0;
+    testTimed = timed;
+    for (size_t i = 0; i < sizeof(TESTS) / sizeof(TESTS[0]); i++) {
+        testFailures = 0;
+        TESTS[i].run();
+        printf("[%s] %s", testFailures == 0 ? "PASS" : "FAIL", TESTS[i].name);
+        if (testFailures > 0) {
+            printf(": %d failed check(s)", testFailures);
+            failed++;
+        }
+        printf("\n");
+    }
+    printf("[INFO] %d of %d test(s) passed.\n", (int)(sizeof(TESTS) / sizeof(TESTS[0])) - failed,
+           (int)(sizeof(TESTS) / sizeof(TESTS[0])));
+    return failed == 0;
+}
+#endif